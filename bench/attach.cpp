@@ -0,0 +1,345 @@
+/*
+ *  -----------------------------------
+ * |         JNIHook - by rdbo         |
+ * |      Java VM Hooking Library      |
+ *  -----------------------------------
+ */
+
+/*
+ * Copyright (C) 2026    Rdbo
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License version 3
+ * as published by the Free Software Foundation.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+// Measures the latency of JNIHook's own operations (attach, detach, batch
+// attach and shutdown) on synthetic classes, varying one axis at a time
+// from a baseline shape: method count, constant pool size, code size,
+// inner classes, live threads (which are suspended while hooking) and
+// the init mode (cached class files or JNIHOOK_INIT_RETRANSFORM).
+// Results are written as JSON, to track regressions across versions.
+
+#include <jnihook.h>
+#include <algorithm>
+#include <condition_variable>
+#include <cstdio>
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "bench.hpp"
+#include "classgen.hpp"
+
+typedef struct config_t {
+        std::string axis;
+        class_shape_t shape;
+        size_t threads;
+        jint init_flags;
+} config_t;
+
+// Java threads that stay idle while the operations are measured,
+// since every other thread is suspended while a hook is placed
+class IdleThreads {
+private:
+        std::vector<std::thread> threads;
+        std::mutex mutex;
+        std::condition_variable cond;
+        size_t attached = 0;
+        bool stopping = false;
+public:
+        void
+        start(JavaVM *jvm, size_t count)
+        {
+                for (size_t i = 0; i < count; ++i) {
+                        threads.emplace_back([this, jvm]() {
+                                JNIEnv *env;
+                                bool ok = jvm->AttachCurrentThreadAsDaemon(reinterpret_cast<void **>(&env), NULL) == JNI_OK;
+
+                                std::unique_lock<std::mutex> lock(mutex);
+                                ++attached;
+                                cond.notify_all();
+                                cond.wait(lock, [this]() { return stopping; });
+                                lock.unlock();
+
+                                if (ok)
+                                        jvm->DetachCurrentThread();
+                        });
+                }
+
+                std::unique_lock<std::mutex> lock(mutex);
+                cond.wait(lock, [this]() { return attached == threads.size(); });
+        }
+
+        void
+        stop()
+        {
+                {
+                        std::lock_guard<std::mutex> lock(mutex);
+                        stopping = true;
+                }
+                cond.notify_all();
+
+                for (auto &thread : threads)
+                        thread.join();
+
+                threads.clear();
+                attached = 0;
+                stopping = false;
+        }
+};
+
+static void JNICALL
+hook(JNIEnv *env, jclass clazz)
+{
+}
+
+static std::vector<config_t>
+Configurations(bool quick)
+{
+        std::vector<config_t> configs;
+        class_shape_t baseline;
+
+        configs.push_back({ "baseline", baseline, 0, 0 });
+
+        for (size_t methods : quick ? std::vector<size_t> { 256 } : std::vector<size_t> { 256, 1024 }) {
+                auto shape = baseline;
+                shape.methods = methods;
+                configs.push_back({ "methods", shape, 0, 0 });
+        }
+
+        for (size_t constants : quick ? std::vector<size_t> { 4096 } : std::vector<size_t> { 4096, 32768 }) {
+                auto shape = baseline;
+                shape.constants = constants;
+                configs.push_back({ "constants", shape, 0, 0 });
+        }
+
+        for (size_t code_size : quick ? std::vector<size_t> { 1024 } : std::vector<size_t> { 1024, 16384 }) {
+                auto shape = baseline;
+                shape.code_size = code_size;
+                configs.push_back({ "code_size", shape, 0, 0 });
+        }
+
+        for (size_t inner_classes : quick ? std::vector<size_t> { 8 } : std::vector<size_t> { 8, 64 }) {
+                auto shape = baseline;
+                shape.inner_classes = inner_classes;
+                configs.push_back({ "inner_classes", shape, 0, 0 });
+        }
+
+        for (size_t threads : quick ? std::vector<size_t> { 16 } : std::vector<size_t> { 16, 128 })
+                configs.push_back({ "threads", baseline, threads, 0 });
+
+        // Without the cache, every operation gets the class file from a retransformation
+        configs.push_back({ "init_mode", baseline, 0, JNIHOOK_INIT_RETRANSFORM });
+        {
+                auto shape = baseline;
+                shape.methods = quick ? 256 : 1024;
+                configs.push_back({ "init_mode", shape, 0, JNIHOOK_INIT_RETRANSFORM });
+        }
+
+        return configs;
+}
+
+static JsonObject
+Result(const config_t &config, size_t class_bytes, const char *operation, const std::vector<uint64_t> &samples, size_t errors)
+{
+        JsonObject result;
+
+        result.set("axis", config.axis)
+                .set("methods", config.shape.methods)
+                .set("constants", config.shape.constants)
+                .set("code_size", config.shape.code_size)
+                .set("inner_classes", config.shape.inner_classes)
+                .set("threads", config.threads)
+                .set("init_mode", (config.init_flags & JNIHOOK_INIT_RETRANSFORM) ? "retransform" : "cached")
+                .set("class_bytes", class_bytes)
+                .set("operation", operation)
+                .set(Summarize(samples))
+                .set("errors", errors);
+
+        return result;
+}
+
+static bool
+RunConfiguration(JavaVM *jvm, JNIEnv *env, jobject loader, size_t index, const config_t &config,
+                 size_t iterations, std::vector<JsonObject> &results)
+{
+        auto name = "jnihook/bench/Attach" + std::to_string(index);
+        auto generated = GenerateClasses(name, config.shape);
+        std::vector<jclass> classes;
+
+        for (auto &generated_class : generated) {
+                jclass clazz = env->DefineClass(generated_class.name.c_str(), loader,
+                                                reinterpret_cast<const jbyte *>(generated_class.bytes.data()),
+                                                static_cast<jsize>(generated_class.bytes.size()));
+                if (!clazz) {
+                        env->ExceptionDescribe();
+                        env->ExceptionClear();
+                        fprintf(stderr, "[!] Failed to define class %s\n", generated_class.name.c_str());
+                        return false;
+                }
+                classes.push_back(clazz);
+        }
+
+        // Outer class methods, followed by the method of every inner class
+        std::vector<jmethodID> methods;
+        for (size_t i = 0; i < config.shape.methods; ++i)
+                methods.push_back(env->GetStaticMethodID(classes[0], ("m" + std::to_string(i)).c_str(), "()V"));
+        std::vector<jmethodID> inner_methods;
+        for (size_t i = 1; i < classes.size(); ++i)
+                inner_methods.push_back(env->GetStaticMethodID(classes[i], "m0", "()V"));
+
+        IdleThreads idle;
+        idle.start(jvm, config.threads);
+
+        // Single attach/detach, the first attach also caches the class
+        std::vector<uint64_t> cold_attach, attach, detach;
+        size_t attach_errors = 0, detach_errors = 0;
+
+        JNIHook_InitEx(jvm, config.init_flags);
+        for (size_t i = 0; i <= iterations; ++i) {
+                jmethodID method = methods[i % methods.size()];
+                jmethodID original = NULL;
+
+                uint64_t start = BenchNow();
+                jnihook_result_t result = JNIHook_Attach(method, reinterpret_cast<void *>(hook), &original);
+                uint64_t attached = BenchNow();
+                jnihook_result_t detach_result = JNIHook_Detach(method);
+                uint64_t detached = BenchNow();
+
+                attach_errors += result != JNIHOOK_OK;
+                detach_errors += detach_result != JNIHOOK_OK;
+                (i == 0 ? cold_attach : attach).push_back(attached - start);
+                detach.push_back(detached - attached);
+        }
+        JNIHook_Shutdown();
+
+        // Batch attach of every method (up to 64) and inner class, then shutdown.
+        // JNIHook is initialized again every time, so the classes are cached by the batch
+        // (unless they are retransformed instead).
+        std::vector<uint64_t> batch, shutdown;
+        size_t batch_errors = 0, shutdown_errors = 0;
+        size_t batch_iterations = std::max<size_t>(5, iterations / 5);
+        jnihook_schedule_t schedule = { UINT64_MAX, 0, NULL, NULL }; // Single batch
+
+        for (size_t i = 0; i < batch_iterations; ++i) {
+                std::vector<jnihook_hook_t> hooks;
+                for (size_t j = 0; j < methods.size() && j < 64; ++j)
+                        hooks.push_back({ methods[j], reinterpret_cast<void *>(hook), 0, NULL, JNIHOOK_OK });
+                for (auto method : inner_methods)
+                        hooks.push_back({ method, reinterpret_cast<void *>(hook), 0, NULL, JNIHOOK_OK });
+
+                JNIHook_InitEx(jvm, config.init_flags);
+
+                uint64_t start = BenchNow();
+                jnihook_result_t result = JNIHook_AttachBatch(hooks.data(), static_cast<jint>(hooks.size()), &schedule, NULL);
+                uint64_t attached = BenchNow();
+                jnihook_result_t shutdown_result = JNIHook_Shutdown();
+                uint64_t stopped = BenchNow();
+
+                batch_errors += result != JNIHOOK_OK;
+                shutdown_errors += shutdown_result != JNIHOOK_OK;
+                batch.push_back(attached - start);
+                shutdown.push_back(stopped - attached);
+        }
+
+        idle.stop();
+
+        size_t class_bytes = generated[0].bytes.size();
+        results.push_back(Result(config, class_bytes, "attach_cold", cold_attach, 0));
+        results.push_back(Result(config, class_bytes, "attach", attach, attach_errors));
+        results.push_back(Result(config, class_bytes, "detach", detach, detach_errors));
+        results.push_back(Result(config, class_bytes, "batch_attach", batch, batch_errors));
+        results.push_back(Result(config, class_bytes, "shutdown", shutdown, shutdown_errors));
+
+        fprintf(stderr, "[*] %s: methods=%zu constants=%zu code_size=%zu inner_classes=%zu threads=%zu init=%s -> "
+                "attach p50=%llu ns, detach p50=%llu ns, batch p50=%llu ns, shutdown p50=%llu ns\n",
+                config.axis.c_str(), config.shape.methods, config.shape.constants, config.shape.code_size,
+                config.shape.inner_classes, config.threads,
+                (config.init_flags & JNIHOOK_INIT_RETRANSFORM) ? "retransform" : "cached",
+                static_cast<unsigned long long>(Summarize(attach).p50_ns),
+                static_cast<unsigned long long>(Summarize(detach).p50_ns),
+                static_cast<unsigned long long>(Summarize(batch).p50_ns),
+                static_cast<unsigned long long>(Summarize(shutdown).p50_ns));
+
+        for (auto clazz : classes)
+                env->DeleteLocalRef(clazz);
+
+        return true;
+}
+
+static void
+usage(const char *program)
+{
+        fprintf(stderr,
+                "usage: %s [-o <output.json>] [-n <iterations>] [--quick] [-J<jvm option>]...\n"
+                "  -o <file>      Where to write the JSON results (default: stdout)\n"
+                "  -n <count>     Attach/detach iterations per configuration (default: 50)\n"
+                "  --quick        Measure fewer configurations\n"
+                "  -J<option>     Extra option for the JVM, e.g. -J-Xint\n",
+                program);
+}
+
+int
+main(int argc, char **argv)
+{
+        std::string output;
+        std::vector<std::string> jvm_options;
+        size_t iterations = 50;
+        bool quick = false;
+
+        for (int i = 1; i < argc; ++i) {
+                std::string arg = argv[i];
+
+                if (arg == "-o" && i + 1 < argc) {
+                        output = argv[++i];
+                } else if (arg == "-n" && i + 1 < argc) {
+                        iterations = std::max<size_t>(1, strtoul(argv[++i], NULL, 10));
+                } else if (arg == "--quick") {
+                        quick = true;
+                } else if (arg.compare(0, 2, "-J") == 0) {
+                        jvm_options.push_back(arg.substr(2));
+                } else {
+                        usage(argv[0]);
+                        return 1;
+                }
+        }
+
+        JavaVM *jvm;
+        JNIEnv *env;
+        if (!CreateJavaVM(jvm_options, &jvm, &env)) {
+                fprintf(stderr, "[!] Failed to create JVM\n");
+                return 1;
+        }
+
+        jobject loader = SystemClassLoader(env);
+        auto configs = Configurations(quick);
+        std::vector<JsonObject> results;
+
+        for (size_t i = 0; i < configs.size(); ++i) {
+                if (!RunConfiguration(jvm, env, loader, i, configs[i], iterations, results))
+                        return 1;
+        }
+
+        JsonObject root;
+        root.set("benchmark", "attach")
+                .set("java_version", JavaVersion(env))
+                .set("iterations", iterations)
+                .set("results", results);
+
+        if (!WriteJson(output, root)) {
+                fprintf(stderr, "[!] Failed to write results\n");
+                return 1;
+        }
+
+        // NOTE: The JVM is not destroyed, DestroyJavaVM waits for every non-daemon thread
+        return 0;
+}
@@ -0,0 +1,218 @@
+/*
+ *  -----------------------------------
+ * |         JNIHook - by rdbo         |
+ * |      Java VM Hooking Library      |
+ *  -----------------------------------
+ */
+
+/*
+ * Copyright (C) 2026    Rdbo
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License version 3
+ * as published by the Free Software Foundation.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "bench.hpp"
+#include <algorithm>
+#include <numeric>
+
+latency_t
+Summarize(std::vector<uint64_t> samples)
+{
+        latency_t latency = {};
+
+        if (samples.empty())
+                return latency;
+
+        std::sort(samples.begin(), samples.end());
+
+        auto rank = [&](double percentile) {
+                size_t index = static_cast<size_t>(percentile * samples.size() + 0.999999);
+                return samples[std::clamp<size_t>(index, 1, samples.size()) - 1];
+        };
+
+        latency.samples = samples.size();
+        latency.min_ns = samples.front();
+        latency.p50_ns = rank(0.50);
+        latency.p99_ns = rank(0.99);
+        latency.max_ns = samples.back();
+        latency.mean_ns = std::accumulate(samples.begin(), samples.end(), uint64_t(0)) / samples.size();
+
+        return latency;
+}
+
+static std::string
+json_string(const std::string &value)
+{
+        std::string out = "\"";
+
+        for (unsigned char c : value) {
+                if (c == '"' || c == '\\') {
+                        out += '\\';
+                        out += c;
+                } else if (c < 0x20) {
+                        char buf[8];
+                        snprintf(buf, sizeof(buf), "\\u%04x", c);
+                        out += buf;
+                } else {
+                        out += c;
+                }
+        }
+
+        return out + "\"";
+}
+
+JsonObject &
+JsonObject::set_scalar(const std::string &key, std::string value)
+{
+        fields.push_back({ key, std::move(value), {}, field_t::SCALAR });
+        return *this;
+}
+
+JsonObject &
+JsonObject::set(const std::string &key, const std::string &value)
+{
+        return set_scalar(key, json_string(value));
+}
+
+JsonObject &
+JsonObject::set(const std::string &key, const char *value)
+{
+        return set(key, std::string(value ? value : ""));
+}
+
+JsonObject &
+JsonObject::set(const std::string &key, const JsonObject &value)
+{
+        fields.push_back({ key, "", { value }, field_t::OBJECT });
+        return *this;
+}
+
+JsonObject &
+JsonObject::set(const std::string &key, const std::vector<JsonObject> &values)
+{
+        fields.push_back({ key, "", values, field_t::ARRAY });
+        return *this;
+}
+
+JsonObject &
+JsonObject::set(const latency_t &latency)
+{
+        return set("samples", latency.samples)
+                .set("min_ns", latency.min_ns)
+                .set("p50_ns", latency.p50_ns)
+                .set("p99_ns", latency.p99_ns)
+                .set("max_ns", latency.max_ns)
+                .set("mean_ns", latency.mean_ns);
+}
+
+std::string
+JsonObject::str(int indent) const
+{
+        std::string pad(indent * 2, ' ');
+        std::string out = "{";
+
+        for (size_t i = 0; i < fields.size(); ++i) {
+                auto &field = fields[i];
+
+                out += i ? ",\n" : "\n";
+                out += pad + "  " + json_string(field.key) + ": ";
+                switch (field.kind) {
+                case field_t::SCALAR:
+                        out += field.value;
+                        break;
+                case field_t::OBJECT:
+                        out += field.objects[0].str(indent + 1);
+                        break;
+                case field_t::ARRAY:
+                        out += "[";
+                        for (size_t j = 0; j < field.objects.size(); ++j) {
+                                out += j ? ",\n" : "\n";
+                                out += pad + "    " + field.objects[j].str(indent + 2);
+                        }
+                        out += field.objects.empty() ? "]" : "\n" + pad + "  ]";
+                        break;
+                }
+        }
+
+        return out + (fields.empty() ? "}" : "\n" + pad + "}");
+}
+
+bool
+WriteJson(const std::string &path, const JsonObject &object)
+{
+        std::string json = object.str() + "\n";
+
+        if (path.empty() || path == "-")
+                return fwrite(json.data(), 1, json.size(), stdout) == json.size();
+
+        FILE *file = fopen(path.c_str(), "w");
+        if (!file)
+                return false;
+
+        bool ok = fwrite(json.data(), 1, json.size(), file) == json.size();
+        return fclose(file) == 0 && ok;
+}
+
+bool
+CreateJavaVM(const std::vector<std::string> &options, JavaVM **jvm, JNIEnv **env)
+{
+        // Fixed heap and collector, so that GC threads and heap resizing don't vary across runs
+        std::vector<std::string> all_options = { "-Xms256m", "-Xmx256m", "-XX:+UseSerialGC", "-Xshare:auto" };
+        all_options.insert(all_options.end(), options.begin(), options.end());
+
+        std::vector<JavaVMOption> vm_options(all_options.size());
+        for (size_t i = 0; i < all_options.size(); ++i) {
+                vm_options[i].optionString = const_cast<char *>(all_options[i].c_str());
+                vm_options[i].extraInfo = NULL;
+        }
+
+        JavaVMInitArgs args;
+        args.version = JNI_VERSION_1_8;
+        args.nOptions = static_cast<jint>(vm_options.size());
+        args.options = vm_options.data();
+        args.ignoreUnrecognized = JNI_FALSE;
+
+        return JNI_CreateJavaVM(jvm, reinterpret_cast<void **>(env), &args) == JNI_OK;
+}
+
+std::string
+JavaVersion(JNIEnv *env)
+{
+        jclass system = env->FindClass("java/lang/System");
+        jmethodID get_property = env->GetStaticMethodID(system, "getProperty", "(Ljava/lang/String;)Ljava/lang/String;");
+        jstring key = env->NewStringUTF("java.version");
+        auto value = reinterpret_cast<jstring>(env->CallStaticObjectMethod(system, get_property, key));
+        std::string version;
+
+        if (value) {
+                const char *chars = env->GetStringUTFChars(value, NULL);
+                version = chars;
+                env->ReleaseStringUTFChars(value, chars);
+        }
+
+        env->DeleteLocalRef(key);
+        env->DeleteLocalRef(system);
+
+        return version;
+}
+
+jobject
+SystemClassLoader(JNIEnv *env)
+{
+        jclass class_loader = env->FindClass("java/lang/ClassLoader");
+        jmethodID get_system = env->GetStaticMethodID(class_loader, "getSystemClassLoader", "()Ljava/lang/ClassLoader;");
+        jobject loader = env->CallStaticObjectMethod(class_loader, get_system);
+
+        env->DeleteLocalRef(class_loader);
+
+        return loader;
+}
@@ -0,0 +1,125 @@
+/*
+ *  -----------------------------------
+ * |         JNIHook - by rdbo         |
+ * |      Java VM Hooking Library      |
+ *  -----------------------------------
+ */
+
+/*
+ * Copyright (C) 2026    Rdbo
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License version 3
+ * as published by the Free Software Foundation.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef _BENCH_HPP_
+#define _BENCH_HPP_
+
+#include <jni.h>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+// Shared helpers of the benchmarks: in-process JVM, latency summaries and JSON output
+
+typedef struct latency_t {
+        size_t samples;
+        uint64_t min_ns;
+        uint64_t p50_ns;
+        uint64_t p99_ns;
+        uint64_t max_ns;
+        uint64_t mean_ns;
+} latency_t;
+
+inline uint64_t
+BenchNow()
+{
+        auto since_epoch = std::chrono::steady_clock::now().time_since_epoch();
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(since_epoch).count();
+}
+
+// Nearest-rank percentiles of the samples
+latency_t
+Summarize(std::vector<uint64_t> samples);
+
+// Flat or nested JSON object, written in insertion order
+class JsonObject {
+private:
+        typedef struct field_t {
+                std::string key;
+                std::string value; // Encoded scalar
+                std::vector<JsonObject> objects;
+                enum { SCALAR, OBJECT, ARRAY } kind;
+        } field_t;
+
+        std::vector<field_t> fields;
+
+        JsonObject &
+        set_scalar(const std::string &key, std::string value);
+public:
+        template <typename T>
+        requires std::is_arithmetic_v<T>
+        JsonObject &
+        set(const std::string &key, T value)
+        {
+                if constexpr (std::is_same_v<T, bool>) {
+                        return set_scalar(key, value ? "true" : "false");
+                } else if constexpr (std::is_floating_point_v<T>) {
+                        char buf[64];
+                        snprintf(buf, sizeof(buf), "%.3f", static_cast<double>(value));
+                        return set_scalar(key, buf);
+                } else {
+                        return set_scalar(key, std::to_string(value));
+                }
+        }
+
+        JsonObject &
+        set(const std::string &key, const std::string &value);
+
+        JsonObject &
+        set(const std::string &key, const char *value);
+
+        JsonObject &
+        set(const std::string &key, const JsonObject &value);
+
+        JsonObject &
+        set(const std::string &key, const std::vector<JsonObject> &values);
+
+        // Adds the fields of a latency summary ("samples", "min_ns", "p50_ns", ...)
+        JsonObject &
+        set(const latency_t &latency);
+
+        std::string
+        str(int indent = 0) const;
+};
+
+// Writes the JSON to `path`, or to stdout if it is empty or "-"
+bool
+WriteJson(const std::string &path, const JsonObject &object);
+
+// Creates a JVM in this process with fixed flags, so that runs are comparable.
+// `options` are appended to them (e.g. "-Djava.class.path=...").
+bool
+CreateJavaVM(const std::vector<std::string> &options, JavaVM **jvm, JNIEnv **env);
+
+// Value of the "java.version" system property
+std::string
+JavaVersion(JNIEnv *env);
+
+// Class loader to define the generated classes in
+jobject
+SystemClassLoader(JNIEnv *env);
+
+#endif
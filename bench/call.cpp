@@ -0,0 +1,400 @@
+/*
+ *  -----------------------------------
+ * |         JNIHook - by rdbo         |
+ * |      Java VM Hooking Library      |
+ *  -----------------------------------
+ */
+
+/*
+ * Copyright (C) 2026    Rdbo
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License version 3
+ * as published by the Free Software Foundation.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+// Measures what a call through a hooked method costs, compared with the
+// unhooked method, for a primitive-heavy and an object-heavy signature:
+//     unhooked         Java calls the method, no hook
+//     replace          Java calls the method, the hook returns without calling the original
+//     passthrough      Java calls the method, the hook calls the original with CallStatic*Method
+//     instrumented     Same as passthrough, through the timing thunk (JNIHOOK_ATTACH_INSTRUMENTED)
+//     native_unhooked  Native code calls the unhooked method with CallStatic*Method
+//     native_original  Native code calls the copy of the original method with CallStatic*Method
+// Every mode is measured right after the hook changes ("cold", the callers were
+// deoptimized by the redefinition) and after the JIT has warmed up again ("warm"),
+// with 1..N caller threads, so that the cost of the JNI transitions and of the
+// lost inlining can be told apart.
+
+#include <jnihook.h>
+#include <algorithm>
+#include <condition_variable>
+#include <cstdio>
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "bench.hpp"
+
+#ifndef JNIHOOK_BENCH_CLASSPATH
+#define JNIHOOK_BENCH_CLASSPATH "bench-classes"
+#endif
+
+#define PRIMITIVE 0 // CallBench.PRIMITIVE
+#define OBJECT 1    // CallBench.OBJECT
+
+typedef enum {
+        CALLER_JAVA,
+        CALLER_NATIVE
+} caller_t;
+
+typedef enum {
+        HOOK_NONE,
+        HOOK_REPLACE,
+        HOOK_PASSTHROUGH
+} hook_style_t;
+
+typedef struct call_mode_t {
+        const char *name;
+        caller_t caller;
+        hook_style_t hook;
+        jint flags;
+        bool call_original; // Native callers call the copy of the original method
+} call_mode_t;
+
+static const call_mode_t g_modes[] = {
+        { "unhooked", CALLER_JAVA, HOOK_NONE, 0, false },
+        { "replace", CALLER_JAVA, HOOK_REPLACE, 0, false },
+        { "passthrough", CALLER_JAVA, HOOK_PASSTHROUGH, 0, false },
+        { "instrumented", CALLER_JAVA, HOOK_PASSTHROUGH, JNIHOOK_ATTACH_INSTRUMENTED, false },
+        { "native_unhooked", CALLER_NATIVE, HOOK_NONE, 0, false },
+        { "native_original", CALLER_NATIVE, HOOK_PASSTHROUGH, 0, true },
+};
+
+typedef struct run_config_t {
+        size_t chunks;      // Chunks per thread
+        size_t calls;       // Calls per chunk
+        size_t cold_chunks;
+        size_t warmup_chunks;
+        std::vector<size_t> threads;
+} run_config_t;
+
+static jclass g_bench_class;
+static jmethodID g_targets[2];   // CallBench.primitive, CallBench.object
+static jmethodID g_originals[2]; // Their original copies, while hooked
+
+static jint JNICALL
+hk_primitive_replace(JNIEnv *env, jclass clazz, jint a, jlong b, jdouble c)
+{
+        return a ^ static_cast<jint>(b) ^ static_cast<jint>(c);
+}
+
+static jint JNICALL
+hk_primitive_passthrough(JNIEnv *env, jclass clazz, jint a, jlong b, jdouble c)
+{
+        return env->CallStaticIntMethod(clazz, g_originals[PRIMITIVE], a, b, c);
+}
+
+static jobject JNICALL
+hk_object_replace(JNIEnv *env, jclass clazz, jobject a, jstring b, jobjectArray c)
+{
+        return env->GetArrayLength(c) == 0 ? b : a;
+}
+
+static jobject JNICALL
+hk_object_passthrough(JNIEnv *env, jclass clazz, jobject a, jstring b, jobjectArray c)
+{
+        return env->CallStaticObjectMethod(clazz, g_originals[OBJECT], a, b, c);
+}
+
+static void *
+hook_for(int kind, hook_style_t style)
+{
+        if (kind == PRIMITIVE)
+                return style == HOOK_REPLACE ? reinterpret_cast<void *>(hk_primitive_replace) : reinterpret_cast<void *>(hk_primitive_passthrough);
+
+        return style == HOOK_REPLACE ? reinterpret_cast<void *>(hk_object_replace) : reinterpret_cast<void *>(hk_object_passthrough);
+}
+
+// Same as CallBench.chunk, calling through JNI
+static uint64_t
+native_chunk(JNIEnv *env, int kind, jmethodID method, size_t calls, jobjectArray array, jstring string)
+{
+        uint64_t start = BenchNow();
+        jlong acc = 0;
+
+        env->PushLocalFrame(static_cast<jint>(calls) + 16);
+        if (kind == PRIMITIVE) {
+                for (size_t i = 0; i < calls; ++i)
+                        acc += env->CallStaticIntMethod(g_bench_class, method, static_cast<jint>(i), static_cast<jlong>(i), 1.0);
+        } else {
+                for (size_t i = 0; i < calls; ++i)
+                        acc += env->CallStaticObjectMethod(g_bench_class, method, array, string, array) != NULL;
+        }
+        env->PopLocalFrame(NULL);
+
+        static volatile jlong sink;
+        sink = acc;
+
+        return BenchNow() - start;
+}
+
+// Same layout as CallBench.run: the time of every chunk, followed by the wall time
+static std::vector<uint64_t>
+native_run(JavaVM *jvm, int kind, jmethodID method, size_t threads, size_t chunks, size_t calls)
+{
+        std::vector<uint64_t> samples(threads * chunks + 1);
+        std::vector<std::thread> workers;
+        std::mutex mutex;
+        std::condition_variable cond;
+        size_t ready = 0;
+        bool started = false;
+        uint64_t begin = 0;
+
+        for (size_t t = 0; t < threads; ++t) {
+                workers.emplace_back([&, t]() {
+                        JNIEnv *env;
+                        jobjectArray array = NULL;
+                        jstring string = NULL;
+                        bool attached = jvm->AttachCurrentThreadAsDaemon(reinterpret_cast<void **>(&env), NULL) == JNI_OK;
+
+                        if (attached) {
+                                jclass object_class = env->FindClass("java/lang/Object");
+                                array = env->NewObjectArray(1, object_class, NULL);
+                                string = env->NewStringUTF("string");
+                        }
+
+                        {
+                                std::unique_lock<std::mutex> lock(mutex);
+                                ++ready;
+                                cond.notify_all();
+                                cond.wait(lock, [&]() { return started; });
+                        }
+
+                        if (!attached)
+                                return;
+
+                        for (size_t c = 0; c < chunks; ++c)
+                                samples[t * chunks + c] = native_chunk(env, kind, method, calls, array, string);
+
+                        jvm->DetachCurrentThread();
+                });
+        }
+
+        {
+                std::unique_lock<std::mutex> lock(mutex);
+                cond.wait(lock, [&]() { return ready == threads; });
+                started = true;
+                begin = BenchNow();
+        }
+        cond.notify_all();
+
+        for (auto &worker : workers)
+                worker.join();
+        samples[threads * chunks] = BenchNow() - begin;
+
+        return samples;
+}
+
+static std::vector<uint64_t>
+java_run(JNIEnv *env, int kind, size_t threads, size_t chunks, size_t calls)
+{
+        static jmethodID run_method = env->GetStaticMethodID(g_bench_class, "run", "(IIII)[J");
+        std::vector<uint64_t> samples;
+
+        auto result = reinterpret_cast<jlongArray>(env->CallStaticObjectMethod(g_bench_class, run_method, kind,
+                                                                              static_cast<jint>(threads),
+                                                                              static_cast<jint>(chunks),
+                                                                              static_cast<jint>(calls)));
+        if (!result || env->ExceptionCheck()) {
+                env->ExceptionDescribe();
+                env->ExceptionClear();
+                return samples;
+        }
+
+        std::vector<jlong> values(env->GetArrayLength(result));
+        env->GetLongArrayRegion(result, 0, static_cast<jsize>(values.size()), values.data());
+        env->DeleteLocalRef(result);
+
+        samples.assign(values.begin(), values.end());
+        return samples;
+}
+
+static std::vector<uint64_t>
+run(JavaVM *jvm, JNIEnv *env, const call_mode_t &mode, int kind, size_t threads, size_t chunks, size_t calls)
+{
+        if (mode.caller == CALLER_JAVA)
+                return java_run(env, kind, threads, chunks, calls);
+
+        return native_run(jvm, kind, mode.call_original ? g_originals[kind] : g_targets[kind], threads, chunks, calls);
+}
+
+static JsonObject
+Result(const call_mode_t &mode, int kind, const char *phase, size_t threads, size_t calls, const std::vector<uint64_t> &samples)
+{
+        JsonObject result;
+        std::vector<uint64_t> chunks(samples.begin(), samples.end() - 1);
+        latency_t latency = Summarize(chunks);
+        double wall_s = static_cast<double>(samples.back()) / 1e9;
+
+        result.set("signature", kind == PRIMITIVE ? "primitive" : "object")
+                .set("mode", mode.name)
+                .set("phase", phase)
+                .set("threads", threads)
+                .set("chunks", chunks.size())
+                .set("calls_per_chunk", calls)
+                .set("ns_per_call_min", static_cast<double>(latency.min_ns) / calls)
+                .set("ns_per_call_p50", static_cast<double>(latency.p50_ns) / calls)
+                .set("ns_per_call_p99", static_cast<double>(latency.p99_ns) / calls)
+                .set("ns_per_call_max", static_cast<double>(latency.max_ns) / calls)
+                .set("ns_per_call_mean", static_cast<double>(latency.mean_ns) / calls)
+                .set("calls_per_sec", wall_s > 0 ? static_cast<double>(chunks.size() * calls) / wall_s : 0.0);
+
+        return result;
+}
+
+static bool
+RunMode(JavaVM *jvm, JNIEnv *env, const call_mode_t &mode, int kind, const run_config_t &config, std::vector<JsonObject> &results)
+{
+        const char *signature = kind == PRIMITIVE ? "primitive" : "object";
+
+        g_originals[kind] = NULL;
+        if (mode.hook != HOOK_NONE) {
+                auto result = JNIHook_AttachEx(g_targets[kind], hook_for(kind, mode.hook), &g_originals[kind], mode.flags);
+                if (result != JNIHOOK_OK) {
+                        fprintf(stderr, "[!] Failed to hook %s for mode %s: %d\n", signature, mode.name, result);
+                        return false;
+                }
+        }
+
+        // Right after the hook changed, then after the JIT warmed up
+        auto cold = run(jvm, env, mode, kind, 1, config.cold_chunks, config.calls);
+        run(jvm, env, mode, kind, 1, config.warmup_chunks, config.calls);
+        if (cold.size() < 2)
+                return false;
+        results.push_back(Result(mode, kind, "cold", 1, config.calls, cold));
+
+        uint64_t warm_p50 = 0;
+        for (auto threads : config.threads) {
+                auto warm = run(jvm, env, mode, kind, threads, config.chunks, config.calls);
+                if (warm.size() < 2)
+                        return false;
+                if (threads == 1)
+                        warm_p50 = Summarize(std::vector<uint64_t>(warm.begin(), warm.end() - 1)).p50_ns;
+                results.push_back(Result(mode, kind, "warm", threads, config.calls, warm));
+        }
+
+        fprintf(stderr, "[*] %s/%s: cold p50 %.2f ns/call, warm p50 %.2f ns/call (1 thread)\n",
+                signature, mode.name,
+                static_cast<double>(Summarize(std::vector<uint64_t>(cold.begin(), cold.end() - 1)).p50_ns) / config.calls,
+                static_cast<double>(warm_p50) / config.calls);
+
+        if (mode.hook != HOOK_NONE && JNIHook_Detach(g_targets[kind]) != JNIHOOK_OK) {
+                fprintf(stderr, "[!] Failed to unhook %s for mode %s\n", signature, mode.name);
+                return false;
+        }
+
+        return true;
+}
+
+static void
+usage(const char *program)
+{
+        fprintf(stderr,
+                "usage: %s [options] [-J<jvm option>]...\n"
+                "  -o <file>        Where to write the JSON results (default: stdout)\n"
+                "  --threads <n>    Measure with 1, 2, 4, ... up to n caller threads (default: hardware threads)\n"
+                "  --chunks <n>     Timed chunks per thread (default: 200)\n"
+                "  --calls <n>      Calls per chunk (default: 1000)\n"
+                "  --warmup <n>     Chunks run to warm up the JIT before the warm measurements (default: 2000)\n"
+                "  -J<option>       Extra option for the JVM, e.g. -J-XX:-Inline\n",
+                program);
+}
+
+int
+main(int argc, char **argv)
+{
+        std::string output;
+        std::vector<std::string> jvm_options = { "-Djava.class.path=" JNIHOOK_BENCH_CLASSPATH };
+        size_t max_threads = std::max(1u, std::thread::hardware_concurrency());
+        run_config_t config = { 200, 1000, 20, 2000, {} };
+
+        for (int i = 1; i < argc; ++i) {
+                std::string arg = argv[i];
+                bool has_value = i + 1 < argc;
+
+                if (arg == "-o" && has_value) {
+                        output = argv[++i];
+                } else if (arg == "--threads" && has_value) {
+                        max_threads = std::max<size_t>(1, strtoul(argv[++i], NULL, 10));
+                } else if (arg == "--chunks" && has_value) {
+                        config.chunks = std::max<size_t>(1, strtoul(argv[++i], NULL, 10));
+                } else if (arg == "--calls" && has_value) {
+                        config.calls = std::max<size_t>(1, strtoul(argv[++i], NULL, 10));
+                } else if (arg == "--warmup" && has_value) {
+                        config.warmup_chunks = strtoul(argv[++i], NULL, 10);
+                } else if (arg.compare(0, 2, "-J") == 0) {
+                        jvm_options.push_back(arg.substr(2));
+                } else {
+                        usage(argv[0]);
+                        return 1;
+                }
+        }
+
+        for (size_t threads = 1; threads < max_threads; threads *= 2)
+                config.threads.push_back(threads);
+        config.threads.push_back(max_threads);
+
+        JavaVM *jvm;
+        JNIEnv *env;
+        if (!CreateJavaVM(jvm_options, &jvm, &env)) {
+                fprintf(stderr, "[!] Failed to create JVM\n");
+                return 1;
+        }
+
+        g_bench_class = env->FindClass("jnihook/bench/CallBench");
+        if (!g_bench_class) {
+                env->ExceptionDescribe();
+                fprintf(stderr, "[!] Class jnihook.bench.CallBench not found in the class path\n");
+                return 1;
+        }
+        g_bench_class = reinterpret_cast<jclass>(env->NewGlobalRef(g_bench_class));
+        g_targets[PRIMITIVE] = env->GetStaticMethodID(g_bench_class, "primitive", "(IJD)I");
+        g_targets[OBJECT] = env->GetStaticMethodID(g_bench_class, "object",
+                                                   "(Ljava/lang/Object;Ljava/lang/String;[Ljava/lang/Object;)Ljava/lang/Object;");
+
+        if (JNIHook_Init(jvm) != JNIHOOK_OK) {
+                fprintf(stderr, "[!] Failed to initialize JNIHook\n");
+                return 1;
+        }
+
+        std::vector<JsonObject> results;
+        for (int kind : { PRIMITIVE, OBJECT }) {
+                for (auto &mode : g_modes) {
+                        if (!RunMode(jvm, env, mode, kind, config, results))
+                                return 1;
+                }
+        }
+
+        JNIHook_Shutdown();
+
+        JsonObject root;
+        root.set("benchmark", "call")
+                .set("java_version", JavaVersion(env))
+                .set("results", results);
+
+        if (!WriteJson(output, root)) {
+                fprintf(stderr, "[!] Failed to write results\n");
+                return 1;
+        }
+
+        return 0;
+}
@@ -0,0 +1,224 @@
+/*
+ *  -----------------------------------
+ * |         JNIHook - by rdbo         |
+ * |      Java VM Hooking Library      |
+ *  -----------------------------------
+ */
+
+/*
+ * Copyright (C) 2026    Rdbo
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License version 3
+ * as published by the Free Software Foundation.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "classgen.hpp"
+#include <stdexcept>
+#include <unordered_map>
+
+#define ACC_PUBLIC 0x0001
+#define ACC_STATIC 0x0008
+#define ACC_SUPER 0x0020
+#define CONSTANT_UTF8 1
+#define CONSTANT_CLASS 7
+#define OP_ICONST_0 0x03
+#define OP_POP 0x57
+#define OP_RETURN 0xb1
+
+class ClassWriter {
+private:
+        std::vector<uint8_t> pool;
+        uint16_t pool_count = 1;
+        std::unordered_map<std::string, uint16_t> utf8s;
+        std::unordered_map<std::string, uint16_t> classes;
+
+        uint16_t
+        add_entry()
+        {
+                if (pool_count == 0xffff)
+                        throw std::length_error("constant pool is full");
+
+                return pool_count++;
+        }
+public:
+        std::vector<uint8_t> body; // Everything after the constant pool
+
+        static void
+        put16(std::vector<uint8_t> &out, size_t value)
+        {
+                out.push_back((value >> 8) & 0xff);
+                out.push_back(value & 0xff);
+        }
+
+        static void
+        put32(std::vector<uint8_t> &out, size_t value)
+        {
+                put16(out, (value >> 16) & 0xffff);
+                put16(out, value & 0xffff);
+        }
+
+        uint16_t
+        utf8(const std::string &value)
+        {
+                if (auto it = utf8s.find(value); it != utf8s.end())
+                        return it->second;
+
+                uint16_t index = add_entry();
+                pool.push_back(CONSTANT_UTF8);
+                put16(pool, value.size());
+                pool.insert(pool.end(), value.begin(), value.end());
+
+                return utf8s[value] = index;
+        }
+
+        uint16_t
+        klass(const std::string &name)
+        {
+                if (auto it = classes.find(name); it != classes.end())
+                        return it->second;
+
+                uint16_t name_index = utf8(name);
+                uint16_t index = add_entry();
+                pool.push_back(CONSTANT_CLASS);
+                put16(pool, name_index);
+
+                return classes[name] = index;
+        }
+
+        std::vector<uint8_t>
+        bytes() const
+        {
+                std::vector<uint8_t> out;
+
+                put32(out, 0xcafebabe);
+                put16(out, 0);  // Minor version
+                put16(out, 52); // Major version
+                put16(out, pool_count);
+                out.insert(out.end(), pool.begin(), pool.end());
+                out.insert(out.end(), body.begin(), body.end());
+
+                return out;
+        }
+};
+
+// InnerClasses attribute, describing the given member classes of `outer`
+static void
+put_inner_classes(ClassWriter &writer, std::vector<uint8_t> &out, const std::string &outer, const std::vector<std::string> &inners)
+{
+        std::vector<uint16_t> entries;
+
+        // All the constants must be added before the attribute is written
+        uint16_t attr_name = writer.utf8("InnerClasses");
+        uint16_t outer_index = writer.klass(outer);
+        for (auto &inner : inners) {
+                entries.push_back(writer.klass(outer + "$" + inner));
+                entries.push_back(writer.utf8(inner));
+        }
+
+        ClassWriter::put16(out, attr_name);
+        ClassWriter::put32(out, 2 + inners.size() * 8);
+        ClassWriter::put16(out, inners.size());
+        for (size_t i = 0; i < inners.size(); ++i) {
+                ClassWriter::put16(out, entries[i * 2]);
+                ClassWriter::put16(out, outer_index);
+                ClassWriter::put16(out, entries[i * 2 + 1]);
+                ClassWriter::put16(out, ACC_PUBLIC | ACC_STATIC);
+        }
+}
+
+static generated_class_t
+generate_class(const std::string &name, const std::string &outer, const class_shape_t &shape)
+{
+        ClassWriter writer;
+        auto &body = writer.body;
+        bool is_inner = !outer.empty();
+
+        if (shape.methods > 0xffff || shape.code_size == 0 || shape.code_size > 0xffff)
+                throw std::length_error("invalid class shape");
+
+        uint16_t this_class = writer.klass(name);
+        uint16_t super_class = writer.klass("java/lang/Object");
+        uint16_t code_name = writer.utf8("Code");
+        uint16_t descriptor = writer.utf8("()V");
+        std::vector<uint16_t> method_names;
+        for (size_t i = 0; i < shape.methods; ++i)
+                method_names.push_back(writer.utf8("m" + std::to_string(i)));
+
+        if (!is_inner) {
+                for (size_t i = 0; i < shape.constants; ++i)
+                        writer.utf8("constant" + std::to_string(i));
+        }
+
+        // An inner class only describes itself
+        std::vector<std::string> inners;
+        if (is_inner) {
+                inners.push_back(name.substr(outer.size() + 1));
+        } else {
+                for (size_t i = 0; i < shape.inner_classes; ++i)
+                        inners.push_back("Inner" + std::to_string(i));
+        }
+
+        std::vector<uint8_t> attributes;
+        if (!inners.empty())
+                put_inner_classes(writer, attributes, is_inner ? outer : name, inners);
+
+        ClassWriter::put16(body, ACC_PUBLIC | ACC_SUPER);
+        ClassWriter::put16(body, this_class);
+        ClassWriter::put16(body, super_class);
+        ClassWriter::put16(body, 0); // Interfaces
+        ClassWriter::put16(body, 0); // Fields
+
+        // Rounded down to an odd size, the `return` takes the last byte
+        std::vector<uint8_t> code;
+        while (code.size() + 2 < shape.code_size) {
+                code.push_back(OP_ICONST_0);
+                code.push_back(OP_POP);
+        }
+        code.push_back(OP_RETURN);
+
+        ClassWriter::put16(body, shape.methods);
+        for (size_t i = 0; i < shape.methods; ++i) {
+                ClassWriter::put16(body, ACC_PUBLIC | ACC_STATIC);
+                ClassWriter::put16(body, method_names[i]);
+                ClassWriter::put16(body, descriptor);
+                ClassWriter::put16(body, 1); // Attributes
+
+                ClassWriter::put16(body, code_name);
+                ClassWriter::put32(body, 12 + code.size());
+                ClassWriter::put16(body, 1); // Max stack
+                ClassWriter::put16(body, 0); // Max locals
+                ClassWriter::put32(body, code.size());
+                body.insert(body.end(), code.begin(), code.end());
+                ClassWriter::put16(body, 0); // Exception table
+                ClassWriter::put16(body, 0); // Attributes
+        }
+
+        ClassWriter::put16(body, inners.empty() ? 0 : 1);
+        body.insert(body.end(), attributes.begin(), attributes.end());
+
+        return { name, writer.bytes() };
+}
+
+std::vector<generated_class_t>
+GenerateClasses(const std::string &name, const class_shape_t &shape)
+{
+        std::vector<generated_class_t> classes;
+
+        classes.push_back(generate_class(name, "", shape));
+
+        // The inner classes have a single method, so that they cost little to load
+        class_shape_t inner_shape;
+        inner_shape.methods = 1;
+        for (size_t i = 0; i < shape.inner_classes; ++i)
+                classes.push_back(generate_class(name + "$Inner" + std::to_string(i), name, inner_shape));
+
+        return classes;
+}
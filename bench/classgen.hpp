@@ -0,0 +1,53 @@
+/*
+ *  -----------------------------------
+ * |         JNIHook - by rdbo         |
+ * |      Java VM Hooking Library      |
+ *  -----------------------------------
+ */
+
+/*
+ * Copyright (C) 2026    Rdbo
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License version 3
+ * as published by the Free Software Foundation.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef _CLASSGEN_HPP_
+#define _CLASSGEN_HPP_
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Generates class files of a given shape, to measure how the costs of
+// JNIHook scale with the size and structure of the hooked classes.
+// The classes only have static methods "m<i>()V", whose bodies are
+// `iconst_0; pop` pairs followed by `return`, so they need no stack map
+// and are valid in any JVM (class file version 52, Java 8).
+
+typedef struct class_shape_t {
+        size_t methods = 16;
+        size_t constants = 0;     // Unused constant pool entries added to the outer class
+        size_t code_size = 16;    // Bytecode bytes of every method
+        size_t inner_classes = 0; // Static member classes "<name>$Inner<i>"
+} class_shape_t;
+
+typedef struct generated_class_t {
+        std::string name; // Internal name
+        std::vector<uint8_t> bytes;
+} generated_class_t;
+
+// Returns the outer class first, followed by its inner classes
+// NOTE: Throws std::length_error if the shape exceeds the class file limits
+std::vector<generated_class_t>
+GenerateClasses(const std::string &name, const class_shape_t &shape);
+
+#endif
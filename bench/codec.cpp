@@ -0,0 +1,469 @@
+/*
+ *  -----------------------------------
+ * |         JNIHook - by rdbo         |
+ * |      Java VM Hooking Library      |
+ *  -----------------------------------
+ */
+
+/*
+ * Copyright (C) 2026    Rdbo
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License version 3
+ * as published by the Free Software Foundation.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+// Measures the throughput of the class file codecs on the classes of a JDK:
+//     jnif     (used by JNIHook): parse, clone, patch one method, serialize
+//     in-tree  (src/classfile.cpp): load, serialize
+// along with the allocations made by every phase, checking on the way that
+// serializing an unmodified class gives back the exact input bytes.
+// The classes are read from $JAVA_HOME/jmods/*.jmod (or jre/lib/rt.jar on
+// Java 8), or from the jars, jmods and class directories given as arguments.
+
+#include <jnif.hpp>
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <new>
+#include <string>
+#include <vector>
+#include "bench.hpp"
+#include "classfile.hpp"
+#include "patcher.hpp"
+#include "zip.hpp"
+
+#ifndef JNIHOOK_BENCH_JAVA_HOME
+#define JNIHOOK_BENCH_JAVA_HOME ""
+#endif
+
+namespace fs = std::filesystem;
+
+// Allocation counters, updated by the replaced global operator new
+static std::atomic<uint64_t> g_allocations = 0;
+static std::atomic<uint64_t> g_allocated_bytes = 0;
+
+void *
+operator new(size_t size)
+{
+        g_allocations.fetch_add(1, std::memory_order_relaxed);
+        g_allocated_bytes.fetch_add(size, std::memory_order_relaxed);
+
+        if (void *ptr = malloc(size ? size : 1))
+                return ptr;
+
+        throw std::bad_alloc();
+}
+
+void *
+operator new[](size_t size)
+{
+        return operator new(size);
+}
+
+void
+operator delete(void *ptr) noexcept
+{
+        free(ptr);
+}
+
+void
+operator delete[](void *ptr) noexcept
+{
+        free(ptr);
+}
+
+void
+operator delete(void *ptr, size_t) noexcept
+{
+        free(ptr);
+}
+
+void
+operator delete[](void *ptr, size_t) noexcept
+{
+        free(ptr);
+}
+
+typedef struct corpus_class_t {
+        std::string name;
+        std::vector<uint8_t> bytes;
+} corpus_class_t;
+
+typedef struct phase_t {
+        const char *codec;
+        const char *name;
+        uint64_t time_ns = 0;
+        uint64_t classes = 0;
+        uint64_t bytes = 0; // Input bytes of the classes processed
+        uint64_t allocations = 0;
+        uint64_t allocated_bytes = 0;
+} phase_t;
+
+// Times a phase and counts its allocations
+class PhaseTimer {
+private:
+        phase_t &phase;
+        uint64_t start;
+        uint64_t allocations;
+        uint64_t allocated_bytes;
+public:
+        PhaseTimer(phase_t &phase, size_t input_size) : phase(phase)
+        {
+                phase.classes += 1;
+                phase.bytes += input_size;
+                allocations = g_allocations.load(std::memory_order_relaxed);
+                allocated_bytes = g_allocated_bytes.load(std::memory_order_relaxed);
+                start = BenchNow();
+        }
+
+        ~PhaseTimer()
+        {
+                phase.time_ns += BenchNow() - start;
+                phase.allocations += g_allocations.load(std::memory_order_relaxed) - allocations;
+                phase.allocated_bytes += g_allocated_bytes.load(std::memory_order_relaxed) - allocated_bytes;
+        }
+};
+
+enum {
+        JNIF_PARSE,
+        JNIF_CLONE,
+        JNIF_PATCH,
+        JNIF_SERIALIZE,
+        JNIF_SERIALIZE_PATCHED,
+        INTREE_LOAD,
+        INTREE_SERIALIZE,
+        PHASE_COUNT
+};
+
+typedef struct pass_t {
+        std::vector<phase_t> phases;
+        uint64_t jnif_failures = 0;
+        uint64_t jnif_mismatches = 0;      // Unmodified classes not serialized to their input bytes
+        uint64_t patched_failures = 0;     // Patched classes that could not be parsed again
+        uint64_t intree_unsupported = 0;   // Classes the in-tree codec cannot load
+        uint64_t intree_mismatches = 0;
+} pass_t;
+
+static bool
+is_class_entry(const std::string &name)
+{
+        return name.size() > 6 && name.compare(name.size() - 6, 6, ".class") == 0;
+}
+
+static bool
+LoadArchive(const fs::path &path, std::vector<corpus_class_t> &corpus)
+{
+#ifdef JNIHOOK_PATCH_ZIP
+        ZipReader reader;
+        std::vector<uint8_t> raw;
+
+        if (!reader.open(path.string()))
+                return false;
+
+        for (auto &entry : reader.list()) {
+                corpus_class_t cls;
+
+                if (!is_class_entry(entry.name))
+                        continue;
+
+                if (!reader.read_raw(entry, raw) || !ZipReader::inflate(entry, raw, cls.bytes))
+                        return false;
+
+                cls.name = entry.name;
+                corpus.push_back(std::move(cls));
+        }
+
+        return true;
+#else
+        fprintf(stderr, "[!] Built without zlib, only class directories are supported: %s\n", path.string().c_str());
+        return false;
+#endif
+}
+
+static bool
+LoadDirectory(const fs::path &path, std::vector<corpus_class_t> &corpus)
+{
+        std::error_code ec;
+
+        for (auto it = fs::recursive_directory_iterator(path, ec); !ec && it != fs::recursive_directory_iterator(); it.increment(ec)) {
+                if (!it->is_regular_file(ec) || !is_class_entry(it->path().filename().string()))
+                        continue;
+
+                std::ifstream file(it->path(), std::ios::binary);
+                corpus_class_t cls;
+                cls.name = fs::relative(it->path(), path).generic_string();
+                cls.bytes.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+                corpus.push_back(std::move(cls));
+        }
+
+        return !ec;
+}
+
+// The jmods of the JDK, or rt.jar on Java 8
+static std::vector<fs::path>
+DefaultSources()
+{
+        std::vector<fs::path> sources;
+        const char *env_java_home = getenv("JAVA_HOME");
+        fs::path java_home = env_java_home ? env_java_home : JNIHOOK_BENCH_JAVA_HOME;
+        std::error_code ec;
+
+        if (java_home.empty())
+                return sources;
+
+        for (auto it = fs::directory_iterator(java_home / "jmods", ec); !ec && it != fs::directory_iterator(); it.increment(ec)) {
+                if (it->path().extension() == ".jmod")
+                        sources.push_back(it->path());
+        }
+        std::sort(sources.begin(), sources.end());
+
+        if (sources.empty() && fs::exists(java_home / "jre" / "lib" / "rt.jar"))
+                sources.push_back(java_home / "jre" / "lib" / "rt.jar");
+
+        return sources;
+}
+
+// First method with code, which is what a hook would be placed on
+static bool
+find_patch_target(jnif::ClassFile *cf, method_info_t &target)
+{
+        for (auto &method : cf->methods) {
+                std::string name = method.getName();
+
+                if (name[0] == '<' || (method.accessFlags & (jnif::Method::NATIVE | jnif::Method::ABSTRACT)))
+                        continue;
+
+                target = { name, method.getDesc(), static_cast<jint>(method.accessFlags) };
+                return true;
+        }
+
+        return false;
+}
+
+static void
+RunJnif(const corpus_class_t &cls, pass_t &pass)
+{
+        auto &phases = pass.phases;
+        std::unique_ptr<jnif::ClassFile> cf;
+        std::unique_ptr<jnif::ClassFile> copy;
+        std::vector<uint8_t> bytes;
+        method_info_t target;
+        size_t size = cls.bytes.size();
+
+        try {
+                {
+                        PhaseTimer timer(phases[JNIF_PARSE], size);
+                        cf = jnif::ClassFile::parse(cls.bytes.data(), static_cast<int>(size));
+                }
+
+                {
+                        PhaseTimer timer(phases[JNIF_SERIALIZE], size);
+                        bytes = cf->toBytes();
+                }
+                pass.jnif_mismatches += bytes != cls.bytes;
+
+                if (!find_patch_target(cf.get(), target))
+                        return;
+
+                {
+                        PhaseTimer timer(phases[JNIF_CLONE], size);
+                        copy = cf->clone();
+                }
+
+                {
+                        PhaseTimer timer(phases[JNIF_PATCH], size);
+                        PatchClassFile(copy.get(), { target }, "_____jnihook_bench");
+                }
+
+                {
+                        PhaseTimer timer(phases[JNIF_SERIALIZE_PATCHED], size);
+                        bytes = copy->toBytes();
+                }
+        } catch (...) {
+                ++pass.jnif_failures;
+                return;
+        }
+
+        try {
+                jnif::ClassFile::parse(bytes.data(), static_cast<int>(bytes.size()));
+        } catch (...) {
+                ++pass.patched_failures;
+        }
+}
+
+static void
+RunInTree(const corpus_class_t &cls, pass_t &pass)
+{
+        auto &phases = pass.phases;
+        std::unique_ptr<ClassFile> cf;
+        std::vector<uint8_t> bytes;
+        size_t size = cls.bytes.size();
+
+        {
+                PhaseTimer timer(phases[INTREE_LOAD], size);
+                cf = ClassFile::load(cls.bytes.data());
+        }
+
+        if (!cf) {
+                ++pass.intree_unsupported;
+                return;
+        }
+
+        {
+                PhaseTimer timer(phases[INTREE_SERIALIZE], size);
+                bytes = cf->bytes();
+        }
+        pass.intree_mismatches += bytes != cls.bytes;
+}
+
+static pass_t
+RunPass(const std::vector<corpus_class_t> &corpus)
+{
+        pass_t pass;
+
+        pass.phases = {
+                { "jnif", "parse" },
+                { "jnif", "clone" },
+                { "jnif", "patch" },
+                { "jnif", "serialize" },
+                { "jnif", "serialize_patched" },
+                { "in-tree", "load" },
+                { "in-tree", "serialize" },
+        };
+
+        for (auto &cls : corpus) {
+                RunJnif(cls, pass);
+                RunInTree(cls, pass);
+        }
+
+        return pass;
+}
+
+static void
+usage(const char *program)
+{
+        fprintf(stderr,
+                "usage: %s [-o <output.json>] [-n <passes>] [<jar, jmod or class directory>...]\n"
+                "  -o <file>    Where to write the JSON results (default: stdout)\n"
+                "  -n <count>   Passes over the corpus, the fastest one is reported (default: 3)\n"
+                "Without sources, the classes of $JAVA_HOME are used.\n",
+                program);
+}
+
+int
+main(int argc, char **argv)
+{
+        std::string output;
+        std::vector<fs::path> sources;
+        size_t passes = 3;
+
+        for (int i = 1; i < argc; ++i) {
+                std::string arg = argv[i];
+
+                if (arg == "-o" && i + 1 < argc) {
+                        output = argv[++i];
+                } else if (arg == "-n" && i + 1 < argc) {
+                        passes = std::max<size_t>(1, strtoul(argv[++i], NULL, 10));
+                } else if (arg[0] == '-') {
+                        usage(argv[0]);
+                        return 1;
+                } else {
+                        sources.push_back(arg);
+                }
+        }
+
+        if (sources.empty())
+                sources = DefaultSources();
+        if (sources.empty()) {
+                fprintf(stderr, "[!] No JDK classes found, set JAVA_HOME or pass the sources\n");
+                return 1;
+        }
+
+        std::vector<corpus_class_t> corpus;
+        uint64_t corpus_bytes = 0;
+        for (auto &source : sources) {
+                bool ok = fs::is_directory(source) ? LoadDirectory(source, corpus) : LoadArchive(source, corpus);
+                if (!ok) {
+                        fprintf(stderr, "[!] Failed to read %s\n", source.string().c_str());
+                        return 1;
+                }
+        }
+        for (auto &cls : corpus)
+                corpus_bytes += cls.bytes.size();
+
+        fprintf(stderr, "[*] Corpus: %zu classes, %llu bytes, from %zu sources\n",
+                corpus.size(), static_cast<unsigned long long>(corpus_bytes), sources.size());
+
+        // Keep the fastest time of every phase across the passes
+        pass_t best;
+        for (size_t i = 0; i < passes; ++i) {
+                auto pass = RunPass(corpus);
+
+                if (i == 0) {
+                        best = pass;
+                        continue;
+                }
+
+                for (size_t j = 0; j < PHASE_COUNT; ++j) {
+                        if (pass.phases[j].time_ns < best.phases[j].time_ns)
+                                best.phases[j] = pass.phases[j];
+                }
+        }
+
+        std::vector<JsonObject> results;
+        for (auto &phase : best.phases) {
+                double seconds = static_cast<double>(phase.time_ns) / 1e9;
+                JsonObject result;
+
+                result.set("codec", phase.codec)
+                        .set("phase", phase.name)
+                        .set("classes", phase.classes)
+                        .set("bytes", phase.bytes)
+                        .set("time_ns", phase.time_ns)
+                        .set("mb_per_sec", seconds > 0 ? static_cast<double>(phase.bytes) / 1e6 / seconds : 0.0)
+                        .set("classes_per_sec", seconds > 0 ? static_cast<double>(phase.classes) / seconds : 0.0)
+                        .set("allocations", phase.allocations)
+                        .set("allocated_bytes", phase.allocated_bytes)
+                        .set("allocations_per_class", phase.classes ? static_cast<double>(phase.allocations) / phase.classes : 0.0);
+                results.push_back(result);
+
+                fprintf(stderr, "[*] %s/%s: %.1f MB/s, %.0f classes/s, %.1f allocations/class\n", phase.codec, phase.name,
+                        seconds > 0 ? static_cast<double>(phase.bytes) / 1e6 / seconds : 0.0,
+                        seconds > 0 ? static_cast<double>(phase.classes) / seconds : 0.0,
+                        phase.classes ? static_cast<double>(phase.allocations) / phase.classes : 0.0);
+        }
+
+        JsonObject checks;
+        checks.set("jnif_failures", best.jnif_failures)
+                .set("jnif_roundtrip_mismatches", best.jnif_mismatches)
+                .set("patched_reparse_failures", best.patched_failures)
+                .set("intree_unsupported", best.intree_unsupported)
+                .set("intree_roundtrip_mismatches", best.intree_mismatches);
+
+        JsonObject root;
+        root.set("benchmark", "codec")
+                .set("corpus_classes", corpus.size())
+                .set("corpus_bytes", corpus_bytes)
+                .set("passes", passes)
+                .set("results", results)
+                .set("checks", checks);
+
+        if (!WriteJson(output, root)) {
+                fprintf(stderr, "[!] Failed to write results\n");
+                return 1;
+        }
+
+        // Every unmodified class must serialize to its input bytes
+        return best.jnif_failures || best.jnif_mismatches || best.patched_failures ? 2 : 0;
+}
@@ -0,0 +1,72 @@
+package jnihook.bench;
+
+import java.util.concurrent.CountDownLatch;
+
+// Driver of jnihook-bench-call: the target methods are hooked from native code,
+// and the loops below call them from Java, in chunks of calls timed with nanoTime
+public class CallBench {
+    public static final int PRIMITIVE = 0;
+    public static final int OBJECT = 1;
+
+    // Keeps the JIT from removing the calls
+    public static volatile long sink;
+
+    public static int primitive(int a, long b, double c) {
+        return a ^ (int) b ^ (int) c;
+    }
+
+    public static Object object(Object a, String b, Object[] c) {
+        return c.length == 0 ? b : a;
+    }
+
+    static long chunk(int kind, int calls) {
+        long start = System.nanoTime();
+        long acc = 0;
+
+        if (kind == PRIMITIVE) {
+            for (int i = 0; i < calls; ++i)
+                acc += primitive(i, i, 1.0);
+        } else {
+            Object[] array = new Object[1];
+            String string = "string";
+            for (int i = 0; i < calls; ++i)
+                acc += object(array, string, array) == array ? 1 : 0;
+        }
+
+        sink = acc;
+        return System.nanoTime() - start;
+    }
+
+    // Runs `chunks` chunks of `calls` calls on each of `threads` threads at the same time.
+    // Returns the time of every chunk, followed by the wall time of the whole run.
+    public static long[] run(final int kind, int threads, final int chunks, final int calls) throws InterruptedException {
+        final long[] samples = new long[threads * chunks + 1];
+        final CountDownLatch start = new CountDownLatch(1);
+        Thread[] workers = new Thread[threads];
+
+        for (int t = 0; t < threads; ++t) {
+            final int offset = t * chunks;
+            workers[t] = new Thread(new Runnable() {
+                public void run() {
+                    try {
+                        start.await();
+                    } catch (InterruptedException e) {
+                        return;
+                    }
+
+                    for (int c = 0; c < chunks; ++c)
+                        samples[offset + c] = chunk(kind, calls);
+                }
+            });
+            workers[t].start();
+        }
+
+        long begin = System.nanoTime();
+        start.countDown();
+        for (Thread worker : workers)
+            worker.join();
+        samples[threads * chunks] = System.nanoTime() - begin;
+
+        return samples;
+    }
+}
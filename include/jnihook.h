@@ -25,10 +25,14 @@
 
 #include <jni.h>
 #include <jvmti.h>
+#include <stdint.h>
 
 #define JNIHOOK_API
 #define JNIHOOK_CALL
 
+#define JNIHOOK_HISTOGRAM_SUB_BUCKETS 4
+#define JNIHOOK_HISTOGRAM_BUCKETS 140 /* Covers durations up to 2^36ns (~68s) */
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -46,12 +50,169 @@ typedef enum {
 	JNIHOOK_ERR_CLASS_FILE_CACHE,
 	JNIHOOK_ERR_JAVA_EXCEPTION,
 	JNIHOOK_ERR_CLASS_FILE_FORMAT,
+	JNIHOOK_ERR_INVALID_ARGUMENT,
+	JNIHOOK_ERR_UNSUPPORTED,
 
 	JNIHOOK_ERR_UNKNOWN
 } jnihook_result_t;
 
+typedef enum {
+	JNIHOOK_PHASE_CACHE = 0,   /* RetransformClasses used to capture the original class file */
+	JNIHOOK_PHASE_PARSE,       /* Parsing the captured class file */
+	JNIHOOK_PHASE_CLONE,       /* Cloning the cached class file before patching */
+	JNIHOOK_PHASE_PATCH,       /* Applying the hooks to the cloned class file */
+	JNIHOOK_PHASE_SERIALIZE,   /* Converting the patched class file to bytes */
+	JNIHOOK_PHASE_SUSPEND,     /* Suspending the other threads */
+	JNIHOOK_PHASE_REDEFINE,    /* RedefineClasses */
+	JNIHOOK_PHASE_RESUME,      /* Resuming the other threads */
+
+	JNIHOOK_PHASE_COUNT
+} jnihook_phase_t;
+
+typedef struct {
+	uint64_t count;    /* Amount of times the phase ran */
+	uint64_t total_ns; /* Accumulated time spent in the phase */
+	uint64_t max_ns;   /* Slowest single run of the phase */
+} jnihook_phase_stats_t;
+
+typedef struct {
+	jnihook_phase_stats_t phases[JNIHOOK_PHASE_COUNT];
+
+	uint64_t attaches;          /* Successful calls to JNIHook_Attach */
+	uint64_t detaches;          /* Successful calls to JNIHook_Detach */
+	uint64_t failures;          /* Attach/detach calls that returned an error */
+	uint64_t classes_cached;    /* Class files parsed and stored in the class file cache */
+	uint64_t classes_redefined; /* Classes passed to RedefineClasses */
+	uint64_t bytes_serialized;  /* Class file bytes generated for redefinition */
+	uint64_t threads_suspended; /* Threads suspended while placing hooks */
+	uint64_t max_pause_ns;      /* Longest time other threads were kept suspended */
+	uint64_t classes_transformed; /* Classes patched inside the ClassFileLoadHook (see jnihook_init_flags_t) */
+	uint64_t classes_unloaded;  /* Hooked or cached classes whose state was released after they were unloaded */
+	uint64_t bytes_reclaimed;   /* Memory released from the unloaded classes */
+	uint64_t content_hash_hits; /* Classes left out of a redefinition because their bytes were already installed */
+	uint64_t redefinitions_skipped; /* RedefineClasses calls avoided because every class was already installed */
+	uint64_t archive_hits;      /* Patched class files loaded from the class archive (see JNIHook_SetClassArchive) */
+	uint64_t archive_misses;
+	uint64_t archive_stores;    /* Patched class files written to the class archive */
+	uint64_t archive_corrupt;   /* Damaged class archive records that were dropped */
+	uint64_t prepatched_attaches; /* Hooks placed on methods patched ahead of time (see JNIHook_LoadManifest) */
+} jnihook_stats_t;
+
+typedef enum {
+	JNIHOOK_INIT_RETRANSFORM = 1 << 0, /* Patch the classes while they are retransformed, without caching them */
+	JNIHOOK_INIT_PERSISTENT  = 1 << 1  /* Keep the hooks applied when other agents redefine the hooked classes */
+} jnihook_init_flags_t;
+
+typedef enum {
+	JNIHOOK_ATTACH_INSTRUMENTED = 1 << 0 /* Record calls and durations of the native hook */
+} jnihook_attach_flags_t;
+
+typedef struct {
+	jmethodID method;           /* The Java method being hooked */
+	void *native_hook_method;   /* The native method that will be called by the JVM instead of `method` */
+	jint flags;                 /* Bitwise OR of jnihook_attach_flags_t values */
+	jmethodID original_method;  /* Output: copy of the original (unhooked) method */
+	jnihook_result_t result;    /* Output: JNIHOOK_OK if this hook was attached */
+} jnihook_hook_t;
+
+typedef struct {
+	jint index;                  /* Position of the batch in the schedule */
+	jint class_count;            /* Classes redefined in the batch */
+	uint64_t class_bytes;        /* Size of the class files redefined in the batch */
+	uint64_t predicted_pause_ns; /* Pause predicted when the batch was scheduled */
+	uint64_t actual_pause_ns;    /* Time the other threads were actually suspended */
+	jnihook_result_t result;     /* Result of the redefinition */
+} jnihook_batch_report_t;
+
+typedef struct {
+	uint64_t pause_budget_ns; /* Batches are sized so that their predicted pause fits in this budget */
+	uint64_t min_gap_ns;      /* Time between batches (0: as long as the previous pause) */
+	void (*on_batch)(const jnihook_batch_report_t *report, void *arg); /* (optional) Called after each batch (it must not place or remove hooks on the classes of the call) */
+	void *arg;                /* Passed to `on_batch` */
+} jnihook_schedule_t;
+
+typedef struct {
+	jint batches;                    /* Amount of redefinitions performed */
+	jint over_budget;                /* Batches whose actual pause exceeded the budget */
+	uint64_t predicted_pause_ns;     /* Sum of the predicted pauses */
+	uint64_t actual_pause_ns;        /* Sum of the actual pauses */
+	uint64_t max_predicted_pause_ns;
+	uint64_t max_actual_pause_ns;
+} jnihook_schedule_report_t;
+
+typedef struct {
+	jint class_count;     /* Hooked classes that were still loaded */
+	jint restored;        /* Classes restored to their original bytes */
+	jint redefinitions;   /* RedefineClasses calls (1, unless some class had to be restored alone) */
+	uint64_t lookup_ns;   /* Resolving the hooked classes */
+	uint64_t prepare_ns;  /* Rebuilding the original class files */
+	uint64_t redefine_ns; /* Redefining the classes */
+	uint64_t cleanup_ns;  /* Releasing the class references, tags and caches */
+	uint64_t total_ns;
+} jnihook_shutdown_report_t;
+
+typedef struct {
+	uint64_t budget_bytes;       /* Memory budget of the class file cache (0: unlimited) */
+	uint64_t used_bytes;         /* Estimated memory used by the cached class files */
+	uint64_t parsed_entries;     /* Class files kept parsed, ready to be patched */
+	uint64_t raw_entries;        /* Class files demoted to their raw bytes */
+	uint64_t compressed_entries; /* Class files demoted to compressed bytes */
+	uint64_t parsed_bytes;       /* Estimated memory used by the parsed class files */
+	uint64_t raw_bytes;
+	uint64_t compressed_bytes;
+	uint64_t demotions;          /* Times a class file was moved to a more compact form */
+	uint64_t inflations;         /* Times a demoted class file was parsed again */
+	uint64_t inflation_failures; /* Demoted class files that could not be parsed again */
+	uint64_t classes;            /* Cached classes (the *_entries count unique class files) */
+	uint64_t dedup_hits;         /* Classes that reused the class file of another class with identical bytes */
+	uint64_t patch_reuses;       /* Times a patched class file was reused instead of being generated again */
+} jnihook_cache_stats_t;
+
+/* Called on the JNIHook worker thread when an async operation completes */
+typedef void (*jnihook_callback_t)(jmethodID method, jnihook_result_t result, jmethodID original_method, void *arg);
+
+/*
+ * Call to an intercepted method (see JNIHook_Intercept)
+ * The type of each argument is the first character of its descriptor, e.g. 'I' for
+ * an int (read from `args[i].i`), 'L' for an object and '[' for an array (`args[i].l`).
+ */
+typedef struct {
+	JNIEnv *env;
+	jobject self;              /* `this`, or the class of static methods */
+	jclass clazz;              /* Declaring class of the method */
+	jmethodID method;          /* The intercepted method */
+	jmethodID original_method; /* Copy of the original method */
+	jboolean is_static;
+	const char *signature;     /* Descriptor of the method, e.g. "(ILjava/lang/String;)V" */
+	const char *arg_types;     /* Type of each argument */
+	jint arg_count;
+	jvalue *args;              /* Arguments of the call (they can be modified before calling the original) */
+	char return_type;          /* Type of the returned value ('V' if none) */
+	jvalue result;             /* Value returned to the caller (zero unless set) */
+	void *arg;                 /* Passed to JNIHook_Intercept */
+} jnihook_call_t;
+
+typedef void (*jnihook_interceptor_t)(jnihook_call_t *call);
+
+/*
+ * Histogram bucket `i` holds the calls that took [lower, upper) nanoseconds, where:
+ *     i <  JNIHOOK_HISTOGRAM_SUB_BUCKETS: lower = i, upper = i + 1
+ *     i >= JNIHOOK_HISTOGRAM_SUB_BUCKETS: every power of two is split into
+ *                                         JNIHOOK_HISTOGRAM_SUB_BUCKETS linear buckets
+ * Use JNIHook_GetHistogramBucketBound to get the bounds of a bucket.
+ */
+typedef struct {
+	uint64_t calls;    /* Calls to the hook (includes calls that have not returned yet) */
+	uint64_t total_ns; /* Accumulated time spent inside the hook */
+	uint64_t buckets[JNIHOOK_HISTOGRAM_BUCKETS];
+} jnihook_hook_metrics_t;
+
 /**
  * Initializes the JNIHook library
+ * NOTE: Once initialized, JNIHook can be used from any thread attached to the JVM,
+ *       concurrently. Hooks on different classes are prepared in parallel; only
+ *       the suspension of the other threads and the redefinition are serialized.
+ *       Initialization and shutdown wait for the calls in progress.
  *
  * @param jvm The Java Virtual Machine that will be instrumented by JNIHook
  * @return JNIHOOK_OK on success, JNIHOOK_ERR_* on failure.
@@ -59,6 +220,27 @@ typedef enum {
 JNIHOOK_API jnihook_result_t JNIHOOK_CALL
 JNIHook_Init(JavaVM *jvm);
 
+/**
+ * Initializes the JNIHook library, with extra options
+ * NOTE: With JNIHOOK_INIT_RETRANSFORM, JNIHook keeps no copy of the hooked classes.
+ *       The ClassFileLoadHook stays enabled and every hook change retransforms
+ *       the class, which is patched from the original bytes kept by the JVM.
+ *       This saves the memory of the class file cache, but the class is parsed,
+ *       patched and serialized again on every change, while the other threads are
+ *       suspended (see the `parse`, `patch` and `serialize` phases in JNIHook_GetStats).
+ * NOTE: With JNIHOOK_INIT_PERSISTENT, the ClassFileLoadHook also stays enabled, and the
+ *       hooks are applied again whenever another agent (e.g. a profiler) redefines or
+ *       retransforms a hooked class. The classes that are not hooked are rejected by
+ *       name, with a Bloom filter. The hooks remain registered, since HotSpot keeps the
+ *       native bindings of the methods across redefinitions.
+ *
+ * @param jvm The Java Virtual Machine that will be instrumented by JNIHook
+ * @param flags Bitwise OR of jnihook_init_flags_t values
+ * @return JNIHOOK_OK on success, JNIHOOK_ERR_* on failure.
+ */
+JNIHOOK_API jnihook_result_t JNIHOOK_CALL
+JNIHook_InitEx(JavaVM *jvm, jint flags);
+
 /**
  * Attaches a hook to a Java method
  * NOTE: Native method signatures are as follows:
@@ -66,12 +248,76 @@ JNIHook_Init(JavaVM *jvm);
  *
  * @param method The Java method being hooked
  * @param native_hook_method The native method that will be called by the JVM instead of `method`
- * @param original_method (optional) Output variable that will receive a copy of the original (unhooked) method
+ * @param original_method (optional) Output variable that will receive a copy of the original (unhooked) method.
+ *                        It is set before the hook can be called, and reset to NULL on failure.
  * @return JNIHOOK_OK on success, JNIHOOK_ERR_* on failure.
  */
 JNIHOOK_API jnihook_result_t JNIHOOK_CALL
 JNIHook_Attach(jmethodID method, void *native_hook_method, jmethodID *original_method);
 
+/**
+ * Attaches a hook to a Java method, with extra options
+ * NOTE: JNIHOOK_ATTACH_INSTRUMENTED is only available on x86_64 and AArch64.
+ *       It registers a generated thunk that forwards the calls to `native_hook_method`,
+ *       so the hook itself does not need to be changed.
+ *
+ * @param method The Java method being hooked
+ * @param native_hook_method The native method that will be called by the JVM instead of `method`
+ * @param original_method (optional) Output variable that will receive a copy of the original (unhooked) method
+ * @param flags Bitwise OR of jnihook_attach_flags_t values
+ * @return JNIHOOK_OK on success, JNIHOOK_ERR_* on failure.
+ */
+JNIHOOK_API jnihook_result_t JNIHOOK_CALL
+JNIHook_AttachEx(jmethodID method, void *native_hook_method, jmethodID *original_method, jint flags);
+
+/**
+ * Attaches a single function that intercepts a Java method of any signature.
+ * A small stub is generated for the method, which passes the arguments of every
+ * call to `interceptor` as a jnihook_call_t, without boxing them into Java objects.
+ * The hook is removed with JNIHook_Detach.
+ * NOTE: Only available with the System V x86_64 and AArch64 (Linux) calling conventions.
+ *       The stub of a method is generated once, and it is reused (with the new
+ *       `interceptor` and `arg`) when the method is intercepted again, since it may
+ *       still be running after the hook is detached. It is released with its class.
+ *
+ * @param method The Java method being intercepted
+ * @param interceptor The function called instead of `method`
+ * @param arg Passed to `interceptor` in `call->arg`
+ * @param original_method (optional) Output variable that will receive a copy of the original (unhooked) method
+ * @param flags Bitwise OR of jnihook_attach_flags_t values
+ * @return JNIHOOK_OK on success, JNIHOOK_ERR_* on failure.
+ */
+JNIHOOK_API jnihook_result_t JNIHOOK_CALL
+JNIHook_Intercept(jmethodID method, jnihook_interceptor_t interceptor, void *arg, jmethodID *original_method, jint flags);
+
+/**
+ * Calls the original method of an intercepted call with `call->args`,
+ * and stores the returned value in `call->result`
+ * NOTE: If the original method throws, the exception is left pending,
+ *       so that it is thrown to the caller once the interceptor returns.
+ *
+ * @param call The call received by the interceptor
+ * @return JNIHOOK_OK on success, JNIHOOK_ERR_JAVA_EXCEPTION if the method threw, JNIHOOK_ERR_* on failure.
+ */
+JNIHOOK_API jnihook_result_t JNIHOOK_CALL
+JNIHook_CallOriginal(jnihook_call_t *call);
+
+/**
+ * Attaches many hooks, spreading the class redefinitions over several pauses.
+ * The classes are packed in batches predicted to keep the other threads suspended
+ * for at most `schedule->pause_budget_ns`, and the batches are spaced out so that
+ * the application can make progress between them. The predictions come from the
+ * pauses observed on previous batches.
+ *
+ * @param hooks The hooks to attach. Their `original_method` and `result` fields are filled in.
+ * @param count Amount of hooks
+ * @param schedule How the redefinitions are spread
+ * @param report (optional) Output variable that will receive the predicted and actual pauses
+ * @return JNIHOOK_OK if every hook was attached, otherwise the first error found.
+ */
+JNIHOOK_API jnihook_result_t JNIHOOK_CALL
+JNIHook_AttachBatch(jnihook_hook_t *hooks, jint count, const jnihook_schedule_t *schedule, jnihook_schedule_report_t *report);
+
 /**
  * Detaches a hook from a Java method
  *
@@ -81,12 +327,205 @@ JNIHook_Attach(jmethodID method, void *native_hook_method, jmethodID *original_m
 JNIHOOK_API jnihook_result_t JNIHOOK_CALL
 JNIHook_Detach(jmethodID method);
 
+/**
+ * Retrieves the copy of the original method of a hooked method
+ * NOTE: Wait-free: it takes no locks and allocates nothing, so it can be called
+ *       from any thread, including from inside a hook on every call.
+ *       A hook is visible here before it can first run (so a hook can always look
+ *       up its own original method), and it is gone once the call that removed it
+ *       has returned.
+ *
+ * @param method The hooked method
+ * @param original_method Output variable that will receive the original method
+ * @return JNIHOOK_OK on success, JNIHOOK_ERR_INVALID_ARGUMENT if the method is not hooked.
+ */
+JNIHOOK_API jnihook_result_t JNIHOOK_CALL
+JNIHook_GetOriginal(jmethodID method, jmethodID *original_method);
+
+/**
+ * Checks whether a method is hooked (wait-free, see JNIHook_GetOriginal)
+ *
+ * @param method The method to check
+ * @return JNI_TRUE if the method is hooked, JNI_FALSE otherwise.
+ */
+JNIHOOK_API jboolean JNIHOOK_CALL
+JNIHook_IsHooked(jmethodID method);
+
+/**
+ * Queues a hook to be attached by the JNIHook worker thread and returns immediately.
+ * The worker is a daemon thread attached to the JVM, started on the first async call.
+ * Every operation queued on the same class while the worker is busy is applied
+ * with a single class redefinition, in the order they were queued.
+ * NOTE: A queued attach replaces a previous hook on the same method. If it is
+ *       followed by a queued detach of that method, it completes with JNIHOOK_OK
+ *       and a NULL original method.
+ *
+ * @param method The Java method being hooked
+ * @param native_hook_method The native method that will be called by the JVM instead of `method`
+ * @param flags Bitwise OR of jnihook_attach_flags_t values
+ * @param callback (optional) Called with the result and the original method once the hook is placed
+ * @param arg Passed to `callback`
+ * @return JNIHOOK_OK if the operation was queued, JNIHOOK_ERR_* on failure.
+ */
+JNIHOOK_API jnihook_result_t JNIHOOK_CALL
+JNIHook_AttachAsync(jmethodID method, void *native_hook_method, jint flags, jnihook_callback_t callback, void *arg);
+
+/**
+ * Queues a hook to be detached by the JNIHook worker thread and returns immediately
+ *
+ * @param method The method being unhooked
+ * @param callback (optional) Called with the result once the hook is removed
+ * @param arg Passed to `callback`
+ * @return JNIHOOK_OK if the operation was queued, JNIHOOK_ERR_* on failure.
+ */
+JNIHOOK_API jnihook_result_t JNIHOOK_CALL
+JNIHook_DetachAsync(jmethodID method, jnihook_callback_t callback, void *arg);
+
 /**
  * Detaches every hook and shuts down JNIHook
+ * NOTE: Pending async operations are completed first
  */
 JNIHOOK_API jnihook_result_t JNIHOOK_CALL
 JNIHook_Shutdown();
 
+/**
+ * Same as JNIHook_Shutdown, but also reports where the teardown time went
+ * NOTE: Every hooked class is restored with a single redefinition
+ *
+ * @param report (optional) Output variable that will receive the timings
+ * @return JNIHOOK_OK on success, JNIHOOK_ERR_* on failure.
+ */
+JNIHOOK_API jnihook_result_t JNIHOOK_CALL
+JNIHook_ShutdownEx(jnihook_shutdown_report_t *report);
+
+/**
+ * Retrieves the timers and counters of every hook operation since
+ * the last call to JNIHook_ResetStats (or since the library was loaded)
+ * NOTE: The statistics are kept even if JNIHook is not initialized
+ *
+ * @param stats Output variable that will receive the statistics
+ * @return JNIHOOK_OK on success, JNIHOOK_ERR_* on failure.
+ */
+JNIHOOK_API jnihook_result_t JNIHOOK_CALL
+JNIHook_GetStats(jnihook_stats_t *stats);
+
+/**
+ * Resets every timer and counter to zero
+ */
+JNIHOOK_API void JNIHOOK_CALL
+JNIHook_ResetStats();
+
+/**
+ * Retrieves the call counter and latency histogram of an instrumented hook
+ * NOTE: The metrics are kept after the hook is detached
+ *
+ * @param method A method that was hooked with JNIHOOK_ATTACH_INSTRUMENTED
+ * @param metrics Output variable that will receive the metrics
+ * @return JNIHOOK_OK on success, JNIHOOK_ERR_* on failure.
+ */
+JNIHOOK_API jnihook_result_t JNIHOOK_CALL
+JNIHook_GetHookMetrics(jmethodID method, jnihook_hook_metrics_t *metrics);
+
+/**
+ * Retrieves the bounds of a latency histogram bucket
+ *
+ * @param bucket Index of the bucket
+ * @param lower_ns (optional) Output variable that will receive the inclusive lower bound
+ * @param upper_ns (optional) Output variable that will receive the exclusive upper bound
+ * @return JNIHOOK_OK on success, JNIHOOK_ERR_* on failure.
+ */
+JNIHOOK_API jnihook_result_t JNIHOOK_CALL
+JNIHook_GetHistogramBucketBound(jint bucket, uint64_t *lower_ns, uint64_t *upper_ns);
+
+/**
+ * Writes the metrics of every instrumented hook to a file,
+ * using the Prometheus text exposition format
+ *
+ * @param path The file that will be (over)written
+ * @return JNIHOOK_OK on success, JNIHOOK_ERR_* on failure.
+ */
+JNIHOOK_API jnihook_result_t JNIHOOK_CALL
+JNIHook_ExportMetrics(const char *path);
+
+/**
+ * Sets the memory budget of the class file cache.
+ * The cache keeps a copy of the original class file of every hooked class.
+ * When it goes over the budget, the least recently used class files are
+ * demoted from their parsed form to raw bytes (compressed if `compress` is set),
+ * and parsed again the next time their class is hooked or unhooked.
+ * NOTE: Class files are never dropped from the cache, since they are needed to
+ *       restore the original classes. The budget may be exceeded if even the
+ *       most compact form of the class files does not fit in it.
+ *
+ * @param budget_bytes Memory budget of the cache in bytes (0: unlimited, the default)
+ * @param compress Compress the demoted class files
+ */
+JNIHOOK_API void JNIHOOK_CALL
+JNIHook_SetCacheBudget(uint64_t budget_bytes, jboolean compress);
+
+/**
+ * Retrieves the memory usage of the class file cache
+ *
+ * @param stats Output variable that will receive the usage
+ * @return JNIHOOK_OK on success, JNIHOOK_ERR_* on failure.
+ */
+JNIHOOK_API jnihook_result_t JNIHOOK_CALL
+JNIHook_GetCacheStats(jnihook_cache_stats_t *stats);
+
+/**
+ * Stores the original class files of many classes in the class file cache ahead of time,
+ * so that hooking them later does not need a retransformation per class.
+ * Every class is captured by a single RetransformClasses call, and the
+ * captured class files are parsed in parallel.
+ * NOTE: Does nothing with JNIHOOK_INIT_RETRANSFORM, since there is no cache.
+ *
+ * @param classes The classes to cache
+ * @param count Amount of classes
+ * @return JNIHOOK_OK if every class was cached, otherwise the last error found.
+ */
+JNIHOOK_API jnihook_result_t JNIHOOK_CALL
+JNIHook_PrewarmCache(jclass *classes, jint count);
+
+/**
+ * Same as JNIHook_PrewarmCache, for every loaded class whose name starts with `prefix`
+ *
+ * @param prefix Prefix of the internal class names, e.g. "com/acme/"
+ * @return JNIHOOK_OK if every matching class was cached, otherwise the last error found.
+ */
+JNIHOOK_API jnihook_result_t JNIHOOK_CALL
+JNIHook_PrewarmCacheByPrefix(const char *prefix);
+
+/**
+ * Keeps the patched class files in an archive inside `directory`, which is
+ * reused across restarts. When a class is hooked with the same hooks as in a
+ * previous run, its patched class file is loaded from the archive instead of
+ * being parsed, patched and serialized again.
+ * Stale and damaged archive entries are detected and written again.
+ * NOTE: Call it before placing any hook, so that the archived class files can be
+ *       used (otherwise the archive is rebuilt). The archive is closed on shutdown.
+ *       A directory must not be used by processes running at the same time.
+ *
+ * @param directory Directory of the archive (created if needed), or NULL to close the archive
+ * @return JNIHOOK_OK on success, JNIHOOK_ERR_* on failure.
+ */
+JNIHOOK_API jnihook_result_t JNIHOOK_CALL
+JNIHook_SetClassArchive(const char *directory);
+
+/**
+ * Loads the manifest written by the jnihook-patch tool, which lists the methods
+ * that were patched ahead of time in the application's jars or class directories.
+ * Attaching a hook to one of these methods only registers the native hook,
+ * without redefining its class or suspending any thread.
+ * NOTE: The patched jars must be the ones loaded by the JVM. Hooks on prepatched
+ *       methods cannot be detached (JNIHOOK_ERR_UNSUPPORTED), since the original
+ *       code is never restored.
+ *
+ * @param path Path of the manifest, e.g. "<output directory>/jnihook.manifest"
+ * @return JNIHOOK_OK on success, JNIHOOK_ERR_INVALID_ARGUMENT if `path` is NULL, JNIHOOK_ERR_* on failure.
+ */
+JNIHOOK_API jnihook_result_t JNIHOOK_CALL
+JNIHook_LoadManifest(const char *path);
+
 #ifdef __cplusplus
 }
 #endif
@@ -1,24 +1,30 @@
 #include "jnihook.h"
+#include <array>
+#include <atomic>
 #include <functional>
 #include <expected>
+#include <future>
+#include <span>
+#include <string_view>
+#include <type_traits>
 
 namespace jnihook {
         typedef jnihook_result_t result_t;
 
         inline result_t
-        init(JavaVM *jvm)
+        init(JavaVM *jvm, jint flags = 0)
         {
-                return JNIHook_Init(jvm);
+                return JNIHook_InitEx(jvm, flags);
         }
 
         template <typename T>
         inline std::expected<jmethodID, result_t>
-        attach(jmethodID method, T *native_hook_method)
+        attach(jmethodID method, T *native_hook_method, jint flags = 0)
         {
                 jmethodID orig_method;
-                result_t result = JNIHook_Attach(method,
-                                                 reinterpret_cast<void *>(native_hook_method),
-                                                 &orig_method);
+                result_t result = JNIHook_AttachEx(method,
+                                                   reinterpret_cast<void *>(native_hook_method),
+                                                   &orig_method, flags);
 
                 if (result != JNIHOOK_OK)
                         return std::unexpected(result);
@@ -26,15 +32,503 @@ namespace jnihook {
                 return orig_method;
         }
 
+        inline std::expected<jnihook_schedule_report_t, result_t>
+        attach_batch(std::span<jnihook_hook_t> hooks, const jnihook_schedule_t &schedule)
+        {
+                jnihook_schedule_report_t report;
+                result_t result = JNIHook_AttachBatch(hooks.data(), static_cast<jint>(hooks.size()),
+                                                      &schedule, &report);
+
+                if (result != JNIHOOK_OK)
+                        return std::unexpected(result);
+
+                return report;
+        }
+
         inline result_t
         detach(jmethodID method)
         {
                 return JNIHook_Detach(method);
         }
 
+        inline std::expected<jmethodID, result_t>
+        get_original(jmethodID method)
+        {
+                jmethodID orig_method;
+                result_t result = JNIHook_GetOriginal(method, &orig_method);
+
+                if (result != JNIHOOK_OK)
+                        return std::unexpected(result);
+
+                return orig_method;
+        }
+
+        inline bool
+        is_hooked(jmethodID method)
+        {
+                return JNIHook_IsHooked(method) == JNI_TRUE;
+        }
+
+        inline std::expected<jmethodID, result_t>
+        intercept(jmethodID method, jnihook_interceptor_t interceptor, void *arg = nullptr, jint flags = 0)
+        {
+                jmethodID orig_method;
+                result_t result = JNIHook_Intercept(method, interceptor, arg, &orig_method, flags);
+
+                if (result != JNIHOOK_OK)
+                        return std::unexpected(result);
+
+                return orig_method;
+        }
+
+        inline result_t
+        call_original(jnihook_call_t *call)
+        {
+                return JNIHook_CallOriginal(call);
+        }
+
+        // The future is fulfilled on the JNIHook worker thread
+        template <typename T>
+        inline std::future<std::expected<jmethodID, result_t>>
+        attach_async(jmethodID method, T *native_hook_method, jint flags = 0)
+        {
+                typedef std::promise<std::expected<jmethodID, result_t>> promise_t;
+                auto promise = new promise_t();
+                auto future = promise->get_future();
+
+                auto callback = [](jmethodID, jnihook_result_t result, jmethodID original_method, void *arg) {
+                        auto promise = static_cast<promise_t *>(arg);
+
+                        if (result == JNIHOOK_OK)
+                                promise->set_value(original_method);
+                        else
+                                promise->set_value(std::unexpected(result));
+
+                        delete promise;
+                };
+
+                result_t result = JNIHook_AttachAsync(method, reinterpret_cast<void *>(native_hook_method),
+                                                      flags, callback, promise);
+                if (result != JNIHOOK_OK) {
+                        promise->set_value(std::unexpected(result));
+                        delete promise;
+                }
+
+                return future;
+        }
+
+        inline std::future<result_t>
+        detach_async(jmethodID method)
+        {
+                typedef std::promise<result_t> promise_t;
+                auto promise = new promise_t();
+                auto future = promise->get_future();
+
+                auto callback = [](jmethodID, jnihook_result_t result, jmethodID, void *arg) {
+                        auto promise = static_cast<promise_t *>(arg);
+
+                        promise->set_value(result);
+                        delete promise;
+                };
+
+                result_t result = JNIHook_DetachAsync(method, callback, promise);
+                if (result != JNIHOOK_OK) {
+                        promise->set_value(result);
+                        delete promise;
+                }
+
+                return future;
+        }
+
         inline result_t
         shutdown()
         {
                 return JNIHook_Shutdown();
         }
+
+        inline std::expected<jnihook_shutdown_report_t, result_t>
+        shutdown_with_report()
+        {
+                jnihook_shutdown_report_t report;
+                result_t result = JNIHook_ShutdownEx(&report);
+
+                if (result != JNIHOOK_OK)
+                        return std::unexpected(result);
+
+                return report;
+        }
+
+        inline std::expected<jnihook_stats_t, result_t>
+        get_stats()
+        {
+                jnihook_stats_t stats;
+                result_t result = JNIHook_GetStats(&stats);
+
+                if (result != JNIHOOK_OK)
+                        return std::unexpected(result);
+
+                return stats;
+        }
+
+        inline void
+        reset_stats()
+        {
+                JNIHook_ResetStats();
+        }
+
+        inline std::expected<jnihook_hook_metrics_t, result_t>
+        get_hook_metrics(jmethodID method)
+        {
+                jnihook_hook_metrics_t metrics;
+                result_t result = JNIHook_GetHookMetrics(method, &metrics);
+
+                if (result != JNIHOOK_OK)
+                        return std::unexpected(result);
+
+                return metrics;
+        }
+
+        inline result_t
+        export_metrics(const char *path)
+        {
+                return JNIHook_ExportMetrics(path);
+        }
+
+        inline void
+        set_cache_budget(uint64_t budget_bytes, bool compress = false)
+        {
+                JNIHook_SetCacheBudget(budget_bytes, compress ? JNI_TRUE : JNI_FALSE);
+        }
+
+        inline result_t
+        prewarm_cache(std::span<jclass> classes)
+        {
+                return JNIHook_PrewarmCache(classes.data(), static_cast<jint>(classes.size()));
+        }
+
+        inline result_t
+        prewarm_cache(const char *prefix)
+        {
+                return JNIHook_PrewarmCacheByPrefix(prefix);
+        }
+
+        inline result_t
+        set_class_archive(const char *directory)
+        {
+                return JNIHook_SetClassArchive(directory);
+        }
+
+        inline result_t
+        load_manifest(const char *path)
+        {
+                return JNIHook_LoadManifest(path);
+        }
+
+        inline std::expected<jnihook_cache_stats_t, result_t>
+        get_cache_stats()
+        {
+                jnihook_cache_stats_t stats;
+                result_t result = JNIHook_GetCacheStats(&stats);
+
+                if (result != JNIHOOK_OK)
+                        return std::unexpected(result);
+
+                return stats;
+        }
+
+        // Compile-time string, used to name the classes and methods of typed hooks
+        template <size_t N>
+        struct fixed_string {
+                char value[N] = {};
+
+                constexpr fixed_string(const char (&str)[N])
+                {
+                        for (size_t i = 0; i < N; ++i)
+                                value[i] = str[i];
+                }
+
+                constexpr std::string_view
+                view() const
+                {
+                        return std::string_view(value, N - 1);
+                }
+        };
+
+        namespace detail {
+                template <typename T>
+                inline constexpr bool dependent_false = false;
+
+                // Concatenates strings with static storage into a null-terminated constant
+                template <const std::string_view &...Parts>
+                struct join {
+                        static constexpr auto storage = []() {
+                                std::array<char, (Parts.size() + ... + 0) + 1> buffer = {};
+                                size_t i = 0;
+
+                                ((void)[&]() {
+                                        for (char c : Parts)
+                                                buffer[i++] = c;
+                                }(), ...);
+
+                                return buffer;
+                        }();
+
+                        static constexpr std::string_view value = std::string_view(storage.data(), storage.size() - 1);
+                };
+
+                inline constexpr std::string_view object_prefix = "L";
+                inline constexpr std::string_view object_suffix = ";";
+                inline constexpr std::string_view params_begin = "(";
+                inline constexpr std::string_view params_end = ")";
+        }
+
+        // Reference to an instance of a class that has no JNI type, e.g. object<"com/acme/Bar">.
+        // Array types are named by their descriptor, e.g. object<"[Lcom/acme/Bar;">.
+        template <fixed_string Class>
+        struct object {
+                static constexpr std::string_view name = Class.view();
+                static constexpr std::string_view descriptor =
+                        name.starts_with("[") ? name : detail::join<detail::object_prefix, name, detail::object_suffix>::value;
+
+                jobject value;
+
+                object(jobject value = NULL) : value(value) {}
+
+                operator jobject() const
+                {
+                        return value;
+                }
+        };
+
+        namespace detail {
+                template <typename T>
+                inline constexpr bool is_object = false;
+
+                template <fixed_string Class>
+                inline constexpr bool is_object<object<Class>> = true;
+
+                // Type of the value as the JVM passes it to a native method
+                template <typename T>
+                using jni_t = std::conditional_t<is_object<T>, jobject, T>;
+
+                template <typename T>
+                constexpr std::string_view
+                descriptor_of()
+                {
+                        if constexpr (std::is_void_v<T>) return "V";
+                        else if constexpr (std::is_same_v<T, jboolean>) return "Z";
+                        else if constexpr (std::is_same_v<T, jbyte>) return "B";
+                        else if constexpr (std::is_same_v<T, jchar>) return "C";
+                        else if constexpr (std::is_same_v<T, jshort>) return "S";
+                        else if constexpr (std::is_same_v<T, jint>) return "I";
+                        else if constexpr (std::is_same_v<T, jlong>) return "J";
+                        else if constexpr (std::is_same_v<T, jfloat>) return "F";
+                        else if constexpr (std::is_same_v<T, jdouble>) return "D";
+                        else if constexpr (std::is_same_v<T, jobject>) return "Ljava/lang/Object;";
+                        else if constexpr (std::is_same_v<T, jclass>) return "Ljava/lang/Class;";
+                        else if constexpr (std::is_same_v<T, jstring>) return "Ljava/lang/String;";
+                        else if constexpr (std::is_same_v<T, jthrowable>) return "Ljava/lang/Throwable;";
+                        else if constexpr (std::is_same_v<T, jbooleanArray>) return "[Z";
+                        else if constexpr (std::is_same_v<T, jbyteArray>) return "[B";
+                        else if constexpr (std::is_same_v<T, jcharArray>) return "[C";
+                        else if constexpr (std::is_same_v<T, jshortArray>) return "[S";
+                        else if constexpr (std::is_same_v<T, jintArray>) return "[I";
+                        else if constexpr (std::is_same_v<T, jlongArray>) return "[J";
+                        else if constexpr (std::is_same_v<T, jfloatArray>) return "[F";
+                        else if constexpr (std::is_same_v<T, jdoubleArray>) return "[D";
+                        else if constexpr (std::is_same_v<T, jobjectArray>) return "[Ljava/lang/Object;";
+                        else if constexpr (is_object<T>) return T::descriptor;
+                        else static_assert(dependent_false<T>, "Type has no JVM descriptor (use the JNI types or jnihook::object)");
+                }
+
+                template <typename T>
+                struct descriptor {
+                        static constexpr std::string_view value = descriptor_of<T>();
+                };
+
+                template <typename R, typename... Args>
+                using method_descriptor = join<params_begin, descriptor<Args>::value..., params_end, descriptor<R>::value>;
+
+                template <typename T>
+                inline jni_t<T>
+                to_jni(T value)
+                {
+                        return value;
+                }
+
+                template <typename T>
+                inline T
+                from_jni(jni_t<T> value)
+                {
+                        return T(value);
+                }
+
+                // JNIEnv function that calls a method returning T (the reference types return jobject)
+                template <typename T, bool Static>
+                constexpr auto
+                caller()
+                {
+                        if constexpr (Static) {
+                                if constexpr (std::is_void_v<T>) return &JNIEnv::CallStaticVoidMethod;
+                                else if constexpr (std::is_same_v<T, jboolean>) return &JNIEnv::CallStaticBooleanMethod;
+                                else if constexpr (std::is_same_v<T, jbyte>) return &JNIEnv::CallStaticByteMethod;
+                                else if constexpr (std::is_same_v<T, jchar>) return &JNIEnv::CallStaticCharMethod;
+                                else if constexpr (std::is_same_v<T, jshort>) return &JNIEnv::CallStaticShortMethod;
+                                else if constexpr (std::is_same_v<T, jint>) return &JNIEnv::CallStaticIntMethod;
+                                else if constexpr (std::is_same_v<T, jlong>) return &JNIEnv::CallStaticLongMethod;
+                                else if constexpr (std::is_same_v<T, jfloat>) return &JNIEnv::CallStaticFloatMethod;
+                                else if constexpr (std::is_same_v<T, jdouble>) return &JNIEnv::CallStaticDoubleMethod;
+                                else return &JNIEnv::CallStaticObjectMethod;
+                        } else {
+                                if constexpr (std::is_void_v<T>) return &JNIEnv::CallNonvirtualVoidMethod;
+                                else if constexpr (std::is_same_v<T, jboolean>) return &JNIEnv::CallNonvirtualBooleanMethod;
+                                else if constexpr (std::is_same_v<T, jbyte>) return &JNIEnv::CallNonvirtualByteMethod;
+                                else if constexpr (std::is_same_v<T, jchar>) return &JNIEnv::CallNonvirtualCharMethod;
+                                else if constexpr (std::is_same_v<T, jshort>) return &JNIEnv::CallNonvirtualShortMethod;
+                                else if constexpr (std::is_same_v<T, jint>) return &JNIEnv::CallNonvirtualIntMethod;
+                                else if constexpr (std::is_same_v<T, jlong>) return &JNIEnv::CallNonvirtualLongMethod;
+                                else if constexpr (std::is_same_v<T, jfloat>) return &JNIEnv::CallNonvirtualFloatMethod;
+                                else if constexpr (std::is_same_v<T, jdouble>) return &JNIEnv::CallNonvirtualDoubleMethod;
+                                else return &JNIEnv::CallNonvirtualObjectMethod;
+                        }
+                }
+        }
+
+        // Hook on the method `Name` of `Class` (an internal class name, e.g. "com/acme/Foo"),
+        // typed after its C++ signature, e.g. jint(jlong, jstring) for `int bar(long, String)`.
+        // The JVM descriptor is derived from the signature at compile time, and the JNI
+        // trampoline that forwards the calls to the hook is generated for each hook function.
+        // The target and original methods are kept in static storage, so `call_original`
+        // does no lookups. Use `hook` for instance methods and `static_hook` for static methods.
+        // NOTE: Attaching and detaching the same method from several threads at once is not supported.
+        template <fixed_string Class, fixed_string Name, typename Signature, bool Static>
+        class basic_hook;
+
+        template <fixed_string Class, fixed_string Name, typename R, typename... Args, bool Static>
+        class basic_hook<Class, Name, R(Args...), Static> {
+        public:
+                // `this` of instance methods, the class of static methods
+                typedef std::conditional_t<Static, jclass, jobject> self_t;
+
+                static constexpr std::string_view class_name = Class.view();
+                static constexpr std::string_view method_name = Name.view();
+                static constexpr std::string_view descriptor = detail::method_descriptor<R, Args...>::value;
+        private:
+                static inline jweak clazz = NULL; // Weak, so that the class loader can still be unloaded
+                static inline jmethodID method = NULL;
+                static inline jmethodID original = NULL; // Set by JNIHook_AttachEx before the hook can run
+
+                template <auto Hook>
+                static detail::jni_t<R> JNICALL
+                trampoline(JNIEnv *env, self_t self, detail::jni_t<Args>... args)
+                {
+                        if constexpr (std::is_void_v<R>)
+                                Hook(env, self, detail::from_jni<Args>(args)...);
+                        else
+                                return detail::to_jni<R>(Hook(env, self, detail::from_jni<Args>(args)...));
+                }
+        public:
+                // Attaches `Hook`, a function (or captureless lambda) called as R(JNIEnv *, self_t, Args...),
+                // to the method of the class with the same name that is visible to `FindClass`
+                template <auto Hook>
+                static std::expected<jmethodID, result_t>
+                attach(JNIEnv *env, jint flags = 0)
+                {
+                        jclass target_class = env->FindClass(class_name.data());
+
+                        if (!target_class) {
+                                env->ExceptionClear();
+                                return std::unexpected(JNIHOOK_ERR_JAVA_EXCEPTION);
+                        }
+
+                        auto result = attach<Hook>(env, target_class, flags);
+                        env->DeleteLocalRef(target_class);
+
+                        return result;
+                }
+
+                // Same as above, for a class that was found in some other way (e.g. from another class loader)
+                template <auto Hook>
+                static std::expected<jmethodID, result_t>
+                attach(JNIEnv *env, jclass target_class, jint flags = 0)
+                {
+                        static_assert(std::is_invocable_r_v<R, decltype(Hook), JNIEnv *, self_t, Args...>,
+                                      "The hook must be callable as R(JNIEnv *, self_t, Args...)");
+
+                        jmethodID target_method;
+                        if constexpr (Static)
+                                target_method = env->GetStaticMethodID(target_class, method_name.data(), descriptor.data());
+                        else
+                                target_method = env->GetMethodID(target_class, method_name.data(), descriptor.data());
+
+                        if (!target_method) {
+                                env->ExceptionClear();
+                                return std::unexpected(JNIHOOK_ERR_JAVA_EXCEPTION);
+                        }
+
+                        if (!clazz || !env->IsSameObject(clazz, target_class)) {
+                                if (clazz)
+                                        env->DeleteWeakGlobalRef(clazz);
+
+                                clazz = env->NewWeakGlobalRef(target_class);
+                        }
+                        method = target_method;
+
+                        result_t result = JNIHook_AttachEx(method, reinterpret_cast<void *>(&trampoline<Hook>),
+                                                           &original, flags);
+
+                        if (result != JNIHOOK_OK)
+                                return std::unexpected(result);
+
+                        return original;
+                }
+
+                static result_t
+                detach()
+                {
+                        if (!method)
+                                return JNIHOOK_ERR_INVALID_ARGUMENT;
+
+                        result_t result = JNIHook_Detach(method);
+                        if (result == JNIHOOK_OK)
+                                std::atomic_ref(original).store(NULL, std::memory_order_release);
+
+                        return result;
+                }
+
+                // Calls the original (unhooked) method, bypassing virtual dispatch like the hooked call did
+                static R
+                call_original(JNIEnv *env, self_t self, Args... args)
+                {
+                        auto call = detail::caller<detail::jni_t<R>, Static>();
+                        auto orig_method = std::atomic_ref(original).load(std::memory_order_acquire);
+                        // NOTE: The class is still loaded, since the caller has `self` or is running one of its methods
+                        auto target_class = static_cast<jclass>(basic_hook::clazz);
+
+                        if constexpr (std::is_void_v<R>) {
+                                if constexpr (Static)
+                                        (env->*call)(target_class, orig_method, detail::to_jni<Args>(args)...);
+                                else
+                                        (env->*call)(self, target_class, orig_method, detail::to_jni<Args>(args)...);
+                        } else if constexpr (Static) {
+                                auto value = (env->*call)(target_class, orig_method, detail::to_jni<Args>(args)...);
+                                return detail::from_jni<R>(static_cast<detail::jni_t<R>>(value));
+                        } else {
+                                auto value = (env->*call)(self, target_class, orig_method, detail::to_jni<Args>(args)...);
+                                return detail::from_jni<R>(static_cast<detail::jni_t<R>>(value));
+                        }
+                }
+
+                static jmethodID
+                target()
+                {
+                        return method;
+                }
+        };
+
+        template <fixed_string Class, fixed_string Name, typename Signature>
+        using hook = basic_hook<Class, Name, Signature, false>;
+
+        template <fixed_string Class, fixed_string Name, typename Signature>
+        using static_hook = basic_hook<Class, Name, Signature, true>;
 }
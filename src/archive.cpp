@@ -0,0 +1,341 @@
+/*
+ *  -----------------------------------
+ * |         JNIHook - by rdbo         |
+ * |      Java VM Hooking Library      |
+ *  -----------------------------------
+ */
+
+/*
+ * Copyright (C) 2026    Rdbo
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License version 3
+ * as published by the Free Software Foundation.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "archive.hpp"
+#include "hash.hpp"
+#include "stats.hpp"
+#include <cstring>
+#include <filesystem>
+#ifdef _WIN32
+#include <windows.h>
+#include <io.h>
+#else
+#include <sys/mman.h>
+#endif
+
+#define CLASS_ARCHIVE_FILE "classes.jnihook"
+#define CLASS_ARCHIVE_MAGIC "JNIHKARC"
+#define CLASS_ARCHIVE_FORMAT 1
+#define CLASS_ARCHIVE_RECORD_MAGIC 0x4345524a // "JREC"
+#define CLASS_ARCHIVE_SUFFIX_SIZE 64
+#define CLASS_ARCHIVE_ALIGNMENT 8
+
+typedef struct archive_header_t {
+        char magic[8];
+        uint32_t format;
+        uint32_t version;
+        char copy_suffix[CLASS_ARCHIVE_SUFFIX_SIZE];
+        uint64_t checksum; // ContentHash of the fields above
+} archive_header_t;
+
+typedef struct archive_record_t {
+        uint32_t magic;
+        uint32_t version;
+        uint32_t size;
+        uint32_t reserved;
+        uint64_t content_hash;
+        uint64_t hookset_hash;
+        uint64_t data_hash;
+        uint64_t checksum; // ContentHash of the fields above
+} archive_record_t;
+
+static inline uint64_t
+align(uint64_t size)
+{
+        return (size + CLASS_ARCHIVE_ALIGNMENT - 1) & ~static_cast<uint64_t>(CLASS_ARCHIVE_ALIGNMENT - 1);
+}
+
+ClassArchive::~ClassArchive()
+{
+        close();
+}
+
+bool
+ClassArchive::map()
+{
+        unmap();
+
+        if (file_size == 0)
+                return false;
+
+        fflush(file);
+
+#ifdef _WIN32
+        auto file_handle = reinterpret_cast<HANDLE>(_get_osfhandle(_fileno(file)));
+        mapping_handle = CreateFileMappingA(file_handle, NULL, PAGE_READONLY, 0, 0, NULL);
+        if (!mapping_handle)
+                return false;
+
+        auto view = MapViewOfFile(mapping_handle, FILE_MAP_READ, 0, 0, 0);
+        if (!view) {
+                CloseHandle(mapping_handle);
+                mapping_handle = nullptr;
+                return false;
+        }
+#else
+        auto view = mmap(NULL, file_size, PROT_READ, MAP_SHARED, fileno(file), 0);
+        if (view == MAP_FAILED)
+                return false;
+#endif
+
+        mapping = reinterpret_cast<const uint8_t *>(view);
+        mapping_size = file_size;
+
+        return true;
+}
+
+void
+ClassArchive::unmap()
+{
+        if (!mapping)
+                return;
+
+#ifdef _WIN32
+        UnmapViewOfFile(mapping);
+        CloseHandle(mapping_handle);
+        mapping_handle = nullptr;
+#else
+        munmap(const_cast<uint8_t *>(mapping), mapping_size);
+#endif
+
+        mapping = nullptr;
+        mapping_size = 0;
+}
+
+// Starts an empty archive, replacing the existing file (if any)
+bool
+ClassArchive::create(const std::string &copy_suffix)
+{
+        archive_header_t header = {};
+
+        if (copy_suffix.size() >= sizeof(header.copy_suffix))
+                return false;
+
+        file = fopen(path.c_str(), "w+b");
+        if (!file)
+                return false;
+
+        memcpy(header.magic, CLASS_ARCHIVE_MAGIC, sizeof(header.magic));
+        header.format = CLASS_ARCHIVE_FORMAT;
+        header.version = CLASS_ARCHIVE_VERSION;
+        memcpy(header.copy_suffix, copy_suffix.data(), copy_suffix.size());
+        header.checksum = ContentHash(&header, offsetof(archive_header_t, checksum));
+
+        if (fwrite(&header, sizeof(header), 1, file) != 1 || fflush(file) != 0) {
+                fclose(file);
+                file = nullptr;
+                return false;
+        }
+
+        file_size = sizeof(header);
+        index.clear();
+        map();
+
+        return true;
+}
+
+// Builds the index from the record headers. The archive is cut at the first damaged record.
+void
+ClassArchive::load()
+{
+        uint64_t offset = sizeof(archive_header_t);
+
+        index.clear();
+
+        while (offset + sizeof(archive_record_t) <= mapping_size) {
+                archive_record_t record;
+
+                memcpy(&record, &mapping[offset], sizeof(record));
+                if (record.magic != CLASS_ARCHIVE_RECORD_MAGIC ||
+                    record.checksum != ContentHash(&record, offsetof(archive_record_t, checksum)) ||
+                    offset + sizeof(record) + record.size > mapping_size)
+                        break;
+
+                // Newer records of the same key replace the older ones
+                if (record.version == CLASS_ARCHIVE_VERSION) {
+                        archive_key_t key = { record.content_hash, record.hookset_hash };
+                        index[key] = record_t { offset + sizeof(record), record.size, record.data_hash };
+                }
+
+                offset += sizeof(record) + align(record.size);
+        }
+
+        // Drop the damaged (or partially written) tail, so that it gets written again
+        if (offset < file_size) {
+                std::error_code ec;
+
+                StatsAdd(g_stats.archive_corrupt, 1);
+                unmap();
+                std::filesystem::resize_file(path, offset, ec);
+                file_size = offset;
+                map();
+        }
+}
+
+bool
+ClassArchive::open(const std::string &directory, std::string &copy_suffix, bool adopt_suffix)
+{
+        std::lock_guard<std::mutex> lock(mutex);
+        std::error_code ec;
+        archive_header_t header;
+
+        close_locked();
+
+        std::filesystem::create_directories(directory, ec);
+        path = (std::filesystem::path(directory) / CLASS_ARCHIVE_FILE).string();
+
+        file = fopen(path.c_str(), "r+b");
+        if (!file)
+                return create(copy_suffix);
+
+        // Stale archives are rebuilt
+        if (fread(&header, sizeof(header), 1, file) != 1 ||
+            memcmp(header.magic, CLASS_ARCHIVE_MAGIC, sizeof(header.magic)) != 0 ||
+            header.format != CLASS_ARCHIVE_FORMAT ||
+            header.version != CLASS_ARCHIVE_VERSION ||
+            header.checksum != ContentHash(&header, offsetof(archive_header_t, checksum))) {
+                fclose(file);
+                return create(copy_suffix);
+        }
+
+        // The patched class files refer to the copies of the hooked methods by name
+        std::string archived_suffix(header.copy_suffix, strnlen(header.copy_suffix, sizeof(header.copy_suffix)));
+        if (archived_suffix != copy_suffix) {
+                if (!adopt_suffix) {
+                        fclose(file);
+                        return create(copy_suffix);
+                }
+
+                copy_suffix = archived_suffix;
+        }
+
+        fseek(file, 0, SEEK_END);
+        file_size = static_cast<uint64_t>(ftell(file));
+        if (!map()) {
+                fclose(file);
+                file = nullptr;
+                return false;
+        }
+
+        load();
+
+        return true;
+}
+
+void
+ClassArchive::close_locked()
+{
+        unmap();
+
+        if (file) {
+                fclose(file);
+                file = nullptr;
+        }
+
+        file_size = 0;
+        index.clear();
+}
+
+void
+ClassArchive::close()
+{
+        std::lock_guard<std::mutex> lock(mutex);
+
+        close_locked();
+}
+
+bool
+ClassArchive::is_open() const
+{
+        std::lock_guard<std::mutex> lock(mutex);
+
+        return file != nullptr;
+}
+
+bool
+ClassArchive::find(uint64_t content_hash, uint64_t hookset_hash, std::vector<uint8_t> &bytes)
+{
+        std::lock_guard<std::mutex> lock(mutex);
+
+        auto it = index.find({ content_hash, hookset_hash });
+        if (it == index.end()) {
+                StatsAdd(g_stats.archive_misses, 1);
+                return false;
+        }
+
+        auto &record = it->second;
+
+        // Records stored since the archive was mapped are not mapped yet
+        if (record.offset + record.size > mapping_size && !map()) {
+                StatsAdd(g_stats.archive_misses, 1);
+                return false;
+        }
+
+        auto data = &mapping[record.offset];
+        if (record.offset + record.size > mapping_size || ContentHash(data, record.size) != record.data_hash) {
+                StatsAdd(g_stats.archive_corrupt, 1);
+                StatsAdd(g_stats.archive_misses, 1);
+                index.erase(it);
+                return false;
+        }
+
+        bytes.assign(data, data + record.size);
+        StatsAdd(g_stats.archive_hits, 1);
+
+        return true;
+}
+
+void
+ClassArchive::store(uint64_t content_hash, uint64_t hookset_hash, const uint8_t *data, size_t size)
+{
+        std::lock_guard<std::mutex> lock(mutex);
+        archive_record_t record = {};
+        static const uint8_t padding[CLASS_ARCHIVE_ALIGNMENT] = {};
+
+        if (!file || size > UINT32_MAX)
+                return;
+
+        auto data_hash = ContentHash(data, size);
+        if (auto it = index.find({ content_hash, hookset_hash }); it != index.end() && it->second.data_hash == data_hash)
+                return;
+
+        record.magic = CLASS_ARCHIVE_RECORD_MAGIC;
+        record.version = CLASS_ARCHIVE_VERSION;
+        record.size = static_cast<uint32_t>(size);
+        record.content_hash = content_hash;
+        record.hookset_hash = hookset_hash;
+        record.data_hash = data_hash;
+        record.checksum = ContentHash(&record, offsetof(archive_record_t, checksum));
+
+        // NOTE: A failed write leaves a damaged tail, which is cut when the archive is opened again
+        size_t padding_size = align(size) - size;
+        if (fseek(file, static_cast<long>(file_size), SEEK_SET) != 0 ||
+            fwrite(&record, sizeof(record), 1, file) != 1 ||
+            fwrite(data, 1, size, file) != size ||
+            fwrite(padding, 1, padding_size, file) != padding_size ||
+            fflush(file) != 0)
+                return;
+
+        index[{ content_hash, hookset_hash }] = record_t { file_size + sizeof(record), record.size, data_hash };
+        file_size += sizeof(record) + size + padding_size;
+        StatsAdd(g_stats.archive_stores, 1);
+}
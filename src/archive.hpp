@@ -0,0 +1,128 @@
+/*
+ *  -----------------------------------
+ * |         JNIHook - by rdbo         |
+ * |      Java VM Hooking Library      |
+ *  -----------------------------------
+ */
+
+/*
+ * Copyright (C) 2026    Rdbo
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License version 3
+ * as published by the Free Software Foundation.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef _ARCHIVE_HPP_
+#define _ARCHIVE_HPP_
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Version of the patched class files. It must be bumped whenever
+// `PatchClassFile` changes its output, so that old archives are rebuilt.
+#define CLASS_ARCHIVE_VERSION 1
+
+// On-disk archive of patched class files, keyed by the content hash of the
+// original class file and the hash of the hook set (see `HookSetHash`).
+// It is reused across restarts, so that a hit skips parsing, patching and
+// serializing the class file.
+//
+// File format (integers in native byte order, which is caught by the format check):
+//     header:  magic, format, patch version, copy suffix, checksum
+//     records: magic, version, size, content hash, hook set hash, data hash, checksum, data
+//              (padded to 8 bytes)
+// The index is built from the record headers when the archive is opened
+// (the file is mapped into memory). A record that fails its checksum ends
+// the archive, and the file is truncated there, so the records after it are
+// written again. A record whose data does not match its hash is ignored and
+// replaced on the next store. An archive with another format, version or copy
+// suffix is stale, and it is rebuilt from scratch.
+// NOTE: A directory must not be used by processes running at the same time
+class ClassArchive {
+private:
+        typedef struct record_t {
+                uint64_t offset; // Offset of the data in the file
+                uint32_t size;
+                uint64_t data_hash;
+        } record_t;
+
+        typedef struct archive_key_t {
+                uint64_t content_hash;
+                uint64_t hookset_hash;
+
+                bool operator==(const archive_key_t &other) const
+                {
+                        return content_hash == other.content_hash && hookset_hash == other.hookset_hash;
+                }
+        } archive_key_t;
+
+        typedef struct key_hash_t {
+                size_t operator()(const archive_key_t &key) const
+                {
+                        return static_cast<size_t>(key.content_hash ^ (key.hookset_hash * 0x9e3779b97f4a7c15ULL));
+                }
+        } key_hash_t;
+
+        mutable std::mutex mutex;
+        std::string path;
+        FILE *file = nullptr;
+        uint64_t file_size = 0;
+        std::unordered_map<archive_key_t, record_t, key_hash_t> index;
+
+        const uint8_t *mapping = nullptr;
+        uint64_t mapping_size = 0;
+#ifdef _WIN32
+        void *mapping_handle = nullptr;
+#endif
+
+        bool
+        map();
+
+        void
+        unmap();
+
+        bool
+        create(const std::string &copy_suffix);
+
+        void
+        load();
+
+        void
+        close_locked();
+public:
+        ~ClassArchive();
+
+        // Opens (or creates) the archive in a directory. If the archive was built
+        // with another copy suffix, it is adopted if `adopt_suffix` is set (and
+        // stored in `copy_suffix`), otherwise the archive is rebuilt.
+        bool
+        open(const std::string &directory, std::string &copy_suffix, bool adopt_suffix);
+
+        void
+        close();
+
+        bool
+        is_open() const;
+
+        // Copies the archived bytes of a patched class file, if there are valid ones
+        bool
+        find(uint64_t content_hash, uint64_t hookset_hash, std::vector<uint8_t> &bytes);
+
+        void
+        store(uint64_t content_hash, uint64_t hookset_hash, const uint8_t *data, size_t size);
+};
+
+#endif
@@ -0,0 +1,105 @@
+/*
+ *  -----------------------------------
+ * |         JNIHook - by rdbo         |
+ * |      Java VM Hooking Library      |
+ *  -----------------------------------
+ */
+
+/*
+ * Copyright (C) 2026    Rdbo
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License version 3
+ * as published by the Free Software Foundation.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef _BLOOM_HPP_
+#define _BLOOM_HPP_
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string_view>
+
+// Bloom filter that can be queried from any thread without locking.
+// Keys can't be removed, so a stale key only costs a false positive;
+// callers must confirm a positive with an exact lookup.
+template <size_t Bits = 4096, size_t Hashes = 4>
+class BloomFilter {
+private:
+        static_assert(Bits % 64 == 0, "Bits must be a multiple of 64");
+
+        std::atomic<uint64_t> words[Bits / 64] = {};
+
+        // Hashes 8 bytes at a time, split in two halves for double hashing
+        static inline uint64_t
+        hash(std::string_view key)
+        {
+                const uint64_t k = 0xff51afd7ed558ccdULL;
+                uint64_t h = 0x9e3779b97f4a7c15ULL ^ key.size();
+                size_t i = 0;
+                uint64_t word;
+
+                for (; i + sizeof(word) <= key.size(); i += sizeof(word)) {
+                        memcpy(&word, &key[i], sizeof(word));
+                        h = (h ^ word) * k;
+                        h ^= h >> 32;
+                }
+
+                word = 0;
+                for (size_t shift = 0; i < key.size(); ++i, shift += 8)
+                        word |= static_cast<uint64_t>(static_cast<unsigned char>(key[i])) << shift;
+                h = (h ^ word) * k;
+                h ^= h >> 29;
+                h *= 0xc4ceb9fe1a85ec53ULL;
+                h ^= h >> 32;
+
+                return h;
+        }
+public:
+        inline void
+        insert(std::string_view key)
+        {
+                uint64_t h = hash(key);
+                uint64_t h1 = h & 0xffffffff;
+                uint64_t h2 = (h >> 32) | 1;
+
+                for (size_t i = 0; i < Hashes; ++i) {
+                        size_t bit = (h1 + i * h2) % Bits;
+                        words[bit / 64].fetch_or(1ULL << (bit % 64), std::memory_order_relaxed);
+                }
+        }
+
+        inline bool
+        may_contain(std::string_view key) const
+        {
+                uint64_t h = hash(key);
+                uint64_t h1 = h & 0xffffffff;
+                uint64_t h2 = (h >> 32) | 1;
+
+                for (size_t i = 0; i < Hashes; ++i) {
+                        size_t bit = (h1 + i * h2) % Bits;
+                        if (!(words[bit / 64].load(std::memory_order_relaxed) & (1ULL << (bit % 64))))
+                                return false;
+                }
+
+                return true;
+        }
+
+        inline void
+        clear()
+        {
+                for (auto &word : words)
+                        word.store(0, std::memory_order_relaxed);
+        }
+};
+
+#endif
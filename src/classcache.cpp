@@ -0,0 +1,473 @@
+/*
+ *  -----------------------------------
+ * |         JNIHook - by rdbo         |
+ * |      Java VM Hooking Library      |
+ *  -----------------------------------
+ */
+
+/*
+ * Copyright (C) 2026    Rdbo
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License version 3
+ * as published by the Free Software Foundation.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "classcache.hpp"
+#include "lz.hpp"
+#include "stats.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <exception>
+
+using namespace jnif;
+
+void
+ClassCache::account(content_t &content, bool add)
+{
+        size_t size = content.bytes.capacity() + content.patched_bytes.capacity();
+
+        if (content.form == CLASS_CACHE_PARSED)
+                size += content.class_size * CLASS_CACHE_PARSED_FACTOR;
+
+        if (add) {
+                content.charge = size;
+                used += size;
+                form_entries[content.form] += 1;
+                form_bytes[content.form] += size;
+        } else {
+                used -= content.charge;
+                form_entries[content.form] -= 1;
+                form_bytes[content.form] -= content.charge;
+                content.charge = 0;
+        }
+}
+
+void
+ClassCache::touch(content_t &content)
+{
+        lru.splice(lru.begin(), lru, content.lru);
+}
+
+bool
+ClassCache::can_demote(const content_t &content) const
+{
+        if (content.form == CLASS_CACHE_COMPRESSED)
+                return false;
+
+        return content.form == CLASS_CACHE_PARSED || (compress && !content.incompressible);
+}
+
+// Marks a content that is being worked on without the lock,
+// and keeps it alive until the work is done (see `release`)
+void
+ClassCache::set_busy(content_t &content, bool is_busy)
+{
+        content.busy = is_busy;
+
+        if (is_busy) {
+                ++content.refs;
+                ++busy_contents;
+        } else {
+                --busy_contents;
+                idle.notify_all();
+        }
+}
+
+// Moves a content to its most compact form.
+// The lock is released while the bytes are being compressed.
+void
+ClassCache::demote(std::unique_lock<std::mutex> &lock, content_t &content)
+{
+        // The patched result can be generated again from the parsed class file
+        account(content, false);
+        std::vector<uint8_t>().swap(content.patched_bytes);
+        content.class_file = nullptr;
+        content.form = CLASS_CACHE_RAW;
+        content.bytes.shrink_to_fit();
+        account(content, true);
+        ++demotions;
+
+        if (!compress || content.incompressible)
+                return;
+
+        set_busy(content, true);
+        lock.unlock();
+        auto compressed = LzCompress(content.bytes.data(), content.bytes.size());
+        lock.lock();
+        set_busy(content, false);
+
+        if (compressed.size() < content.bytes.size()) {
+                account(content, false);
+                content.form = CLASS_CACHE_COMPRESSED;
+                content.bytes = std::move(compressed);
+                content.bytes.shrink_to_fit();
+                account(content, true);
+        } else {
+                content.incompressible = true;
+        }
+
+        release(&content);
+}
+
+// Parses a demoted content again. The lock is released while the bytes are being
+// decompressed and parsed. Returns false on failure, or if the content was freed.
+bool
+ClassCache::inflate(std::unique_lock<std::mutex> &lock, content_t &content)
+{
+        if (content.form == CLASS_CACHE_PARSED)
+                return true;
+
+        bool compressed = content.form == CLASS_CACHE_COMPRESSED;
+        std::vector<uint8_t> decompressed;
+        std::unique_ptr<ClassFile> class_file;
+        std::exception_ptr error;
+
+        set_busy(content, true);
+        lock.unlock();
+        try {
+                auto result = compressed ? LzDecompress(content.bytes.data(), content.bytes.size(), content.class_size)
+                                         : std::nullopt;
+                if (result)
+                        decompressed = std::move(*result);
+
+                // The bytes are parsed where they are, so that the content
+                // is left untouched if the parser fails (or throws)
+                if (!compressed || result) {
+                        auto &bytes = compressed ? decompressed : content.bytes;
+                        StatsTimer timer(JNIHOOK_PHASE_PARSE);
+                        class_file = ClassFile::parse(bytes.data(), bytes.size());
+                }
+        } catch (...) {
+                error = std::current_exception();
+        }
+        lock.lock();
+        set_busy(content, false);
+
+        if (class_file) {
+                account(content, false);
+                content.class_file = std::move(class_file);
+                if (compressed)
+                        content.bytes = std::move(decompressed);
+                content.form = CLASS_CACHE_PARSED;
+                account(content, true);
+                ++inflations;
+        } else {
+                ++inflation_failures;
+        }
+
+        bool parsed = content.form == CLASS_CACHE_PARSED;
+        bool alive = content.refs > 1;
+        release(&content);
+        if (error)
+                std::rethrow_exception(error);
+
+        return alive && parsed;
+}
+
+// Demotes the least recently used contents (except `keep`, pinned and busy ones) until the cache fits the budget
+void
+ClassCache::enforce_budget(std::unique_lock<std::mutex> &lock, const content_t *keep)
+{
+        if (budget == 0)
+                return;
+
+        // The list is searched again after every demotion, since the lock may have been released
+        while (used > budget) {
+                auto it = std::find_if(lru.rbegin(), lru.rend(), [this, keep](content_t *content) {
+                        return content != keep && content->pins == 0 && !content->busy && can_demote(*content);
+                });
+                if (it == lru.rend())
+                        break;
+
+                demote(lock, **it);
+        }
+}
+
+// Finds the content with the given bytes
+// NOTE: The bytes are compared, so that a hash collision can't mix up two classes
+ClassCache::content_t *
+ClassCache::find_content(uint64_t hash, const uint8_t *data, size_t size)
+{
+        auto [begin, end] = contents.equal_range(hash);
+
+        for (auto it = begin; it != end; ++it) {
+                auto &content = it->second;
+
+                if (content.class_size != size)
+                        continue;
+
+                if (content.form == CLASS_CACHE_COMPRESSED) {
+                        auto decompressed = LzDecompress(content.bytes.data(), content.bytes.size(), content.class_size);
+                        if (decompressed && memcmp(decompressed->data(), data, size) == 0)
+                                return &content;
+                } else if (memcmp(content.bytes.data(), data, size) == 0) {
+                        return &content;
+                }
+        }
+
+        return nullptr;
+}
+
+ClassCache::content_t *
+ClassCache::find_class(class_id_t id) const
+{
+        auto it = classes.find(id);
+        if (it == classes.end())
+                return nullptr;
+
+        return it->second;
+}
+
+bool
+ClassCache::contains(class_id_t id) const
+{
+        std::lock_guard<std::mutex> lock(mutex);
+
+        return classes.find(id) != classes.end();
+}
+
+bool
+ClassCache::share(class_id_t id, uint64_t hash, const uint8_t *data, size_t size)
+{
+        std::lock_guard<std::mutex> lock(mutex);
+        auto content = find_content(hash, data, size);
+        if (!content)
+                return false;
+
+        // Take the reference first, in case the class pointed to the same content
+        ++content->refs;
+        erase_class(id);
+        classes[id] = content;
+        touch(*content);
+        ++dedup_hits;
+
+        return true;
+}
+
+void
+ClassCache::insert(class_id_t id, uint64_t hash, std::unique_ptr<ClassFile> class_file, std::vector<uint8_t> bytes)
+{
+        std::unique_lock<std::mutex> lock(mutex);
+
+        erase_class(id);
+
+        auto &content = contents.emplace(hash, content_t {})->second;
+        content.hash = hash;
+        content.form = class_file ? CLASS_CACHE_PARSED : CLASS_CACHE_RAW;
+        content.class_file = std::move(class_file);
+        content.class_size = bytes.size();
+        content.bytes = std::move(bytes);
+        content.charge = 0;
+        content.incompressible = false;
+        content.busy = false;
+        content.pins = 0;
+        content.refs = 1;
+        content.patched_hookset = 0;
+        content.lru = lru.insert(lru.begin(), &content);
+        account(content, true);
+        classes[id] = &content;
+
+        enforce_budget(lock, &content);
+}
+
+ClassFile *
+ClassCache::acquire(class_id_t id)
+{
+        std::unique_lock<std::mutex> lock(mutex);
+        content_t *content;
+
+        // Another thread may be parsing or compressing the same content
+        while ((content = find_class(id)) && content->busy)
+                idle.wait(lock);
+
+        if (!content || !inflate(lock, *content))
+                return nullptr;
+
+        ++content->pins;
+        touch(*content);
+        enforce_budget(lock, content);
+
+        return content->class_file.get();
+}
+
+uint64_t
+ClassCache::content_hash(class_id_t id) const
+{
+        std::lock_guard<std::mutex> lock(mutex);
+        auto content = find_class(id);
+
+        return content ? content->hash : 0;
+}
+
+bool
+ClassCache::get_patched(class_id_t id, uint64_t hookset, std::vector<uint8_t> &bytes)
+{
+        std::lock_guard<std::mutex> lock(mutex);
+        auto content = find_class(id);
+        if (!content || content->patched_bytes.empty() || content->patched_hookset != hookset)
+                return false;
+
+        bytes = content->patched_bytes;
+        touch(*content);
+        ++patch_reuses;
+
+        return true;
+}
+
+void
+ClassCache::set_patched(class_id_t id, uint64_t hookset, const std::vector<uint8_t> &bytes)
+{
+        std::unique_lock<std::mutex> lock(mutex);
+        auto content = find_class(id);
+        if (!content || content->form != CLASS_CACHE_PARSED)
+                return;
+
+        account(*content, false);
+        content->patched_hookset = hookset;
+        content->patched_bytes = bytes;
+        account(*content, true);
+
+        enforce_budget(lock, content);
+}
+
+void
+ClassCache::clear_patched()
+{
+        std::lock_guard<std::mutex> lock(mutex);
+
+        for (auto &[_hash, content] : contents) {
+                if (content.patched_bytes.empty())
+                        continue;
+
+                account(content, false);
+                std::vector<uint8_t>().swap(content.patched_bytes);
+                account(content, true);
+        }
+}
+
+void
+ClassCache::unpin(class_id_t id)
+{
+        std::unique_lock<std::mutex> lock(mutex);
+        auto content = find_class(id);
+        if (!content || content->pins == 0)
+                return;
+
+        if (--content->pins == 0)
+                enforce_budget(lock, nullptr);
+}
+
+size_t
+ClassCache::erase(class_id_t id)
+{
+        std::lock_guard<std::mutex> lock(mutex);
+
+        return erase_class(id);
+}
+
+size_t
+ClassCache::erase_class(class_id_t id)
+{
+        auto it = classes.find(id);
+        if (it == classes.end())
+                return 0;
+
+        auto content = it->second;
+        classes.erase(it);
+
+        return release(content);
+}
+
+// Drops a reference to a content, and frees it with the last one.
+// Returns the bytes that were released (0 if the content is still referenced).
+size_t
+ClassCache::release(content_t *content)
+{
+        if (--content->refs > 0)
+                return 0;
+
+        size_t charge = content->charge;
+        account(*content, false);
+        lru.erase(content->lru);
+
+        auto [begin, end] = contents.equal_range(content->hash);
+        for (auto it = begin; it != end; ++it) {
+                if (&it->second == content) {
+                        contents.erase(it);
+                        break;
+                }
+        }
+
+        return charge;
+}
+
+void
+ClassCache::clear()
+{
+        std::unique_lock<std::mutex> lock(mutex);
+
+        idle.wait(lock, [this]() { return busy_contents == 0; });
+
+        classes.clear();
+        contents.clear();
+        lru.clear();
+        used = 0;
+        for (auto form : { CLASS_CACHE_PARSED, CLASS_CACHE_RAW, CLASS_CACHE_COMPRESSED }) {
+                form_entries[form] = 0;
+                form_bytes[form] = 0;
+        }
+}
+
+std::vector<class_id_t>
+ClassCache::ids() const
+{
+        std::lock_guard<std::mutex> lock(mutex);
+        std::vector<class_id_t> result;
+
+        result.reserve(classes.size());
+        for (auto &[id, _content] : classes)
+                result.push_back(id);
+
+        return result;
+}
+
+void
+ClassCache::set_budget(size_t budget_bytes, bool compress_entries)
+{
+        std::unique_lock<std::mutex> lock(mutex);
+
+        budget = budget_bytes;
+        compress = compress_entries;
+
+        enforce_budget(lock, nullptr);
+}
+
+void
+ClassCache::snapshot(jnihook_cache_stats_t *stats) const
+{
+        std::lock_guard<std::mutex> lock(mutex);
+
+        stats->budget_bytes = budget;
+        stats->used_bytes = used;
+        stats->parsed_entries = form_entries[CLASS_CACHE_PARSED];
+        stats->raw_entries = form_entries[CLASS_CACHE_RAW];
+        stats->compressed_entries = form_entries[CLASS_CACHE_COMPRESSED];
+        stats->parsed_bytes = form_bytes[CLASS_CACHE_PARSED];
+        stats->raw_bytes = form_bytes[CLASS_CACHE_RAW];
+        stats->compressed_bytes = form_bytes[CLASS_CACHE_COMPRESSED];
+        stats->demotions = demotions;
+        stats->inflations = inflations;
+        stats->inflation_failures = inflation_failures;
+        stats->classes = classes.size();
+        stats->dedup_hits = dedup_hits;
+        stats->patch_reuses = patch_reuses;
+}
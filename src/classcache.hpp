@@ -0,0 +1,193 @@
+/*
+ *  -----------------------------------
+ * |         JNIHook - by rdbo         |
+ * |      Java VM Hooking Library      |
+ *  -----------------------------------
+ */
+
+/*
+ * Copyright (C) 2026    Rdbo
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License version 3
+ * as published by the Free Software Foundation.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef _CLASSCACHE_HPP_
+#define _CLASSCACHE_HPP_
+
+#include <jnihook.h>
+#include <jnif.hpp>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+// Identity of a class, stored as a JVMTI tag on its class object.
+// Unlike the class name, it is unique across class loaders,
+// and it does not keep the class (or its class loader) alive.
+typedef jlong class_id_t;
+
+// Rough memory usage of a parsed class file, relative to its size in bytes.
+// jnif keeps a node for every constant pool entry and bytecode instruction.
+#define CLASS_CACHE_PARSED_FACTOR 8
+
+typedef enum {
+        CLASS_CACHE_PARSED = 0, // Parsed jnif::ClassFile, ready to be patched
+        CLASS_CACHE_RAW,        // Original class file bytes
+        CLASS_CACHE_COMPRESSED  // Original class file bytes, compressed with LzCompress
+} class_cache_form_t;
+
+// Cache of the original class files, keyed by class identity.
+// Classes with identical bytes (e.g. the same library loaded by many class
+// loaders) share a single content entry, found by its content hash and
+// confirmed by comparing the bytes. The content also remembers its last
+// patched result, so that it is patched once per set of hooks.
+// When a budget is set, the least recently used contents are demoted from
+// their parsed form to raw (and optionally compressed) bytes until the
+// estimated memory usage fits the budget. Demoted contents are parsed again
+// the next time they are needed. Entries are never dropped, since they are
+// needed to restore the original classes.
+// Every method takes the cache's own lock, so it can be used from any thread.
+// Parsing and compression run with the lock released, on a content that is
+// marked busy meanwhile (it is neither demoted nor parsed by another thread).
+class ClassCache {
+private:
+        typedef struct content_t {
+                uint64_t hash;
+                class_cache_form_t form;
+                std::unique_ptr<jnif::ClassFile> class_file;
+                // Original class file bytes (compressed if CLASS_CACHE_COMPRESSED)
+                // NOTE: Also kept while parsed, since jnif may point into them
+                std::vector<uint8_t> bytes;
+                size_t class_size;   // Size of the uncompressed class file
+                size_t charge;       // Bytes accounted against the budget
+                bool incompressible; // Compression was tried and did not shrink the bytes
+                bool busy;           // Being parsed or compressed without the lock
+                unsigned pins;       // Pinned contents are not demoted
+                size_t refs;         // Classes sharing this content (and busy operations)
+                uint64_t patched_hookset; // Hook set that `patched_bytes` was generated for
+                std::vector<uint8_t> patched_bytes;
+                std::list<content_t *>::iterator lru;
+        } content_t;
+
+        // NOTE: Pointers to the contents stay valid when the map is rehashed
+        std::unordered_multimap<uint64_t, content_t> contents; // Keyed by content hash
+        std::unordered_map<class_id_t, content_t *> classes;
+        std::list<content_t *> lru; // Most recently used first
+        mutable std::mutex mutex;
+        std::condition_variable idle; // Notified when a content is no longer busy
+        size_t busy_contents = 0;
+
+        size_t budget = 0; // 0 means unlimited
+        bool compress = false;
+
+        size_t used = 0;
+        size_t form_entries[3] = {};
+        size_t form_bytes[3] = {};
+        uint64_t demotions = 0;
+        uint64_t inflations = 0;
+        uint64_t inflation_failures = 0;
+        uint64_t dedup_hits = 0;
+        uint64_t patch_reuses = 0;
+
+        void
+        account(content_t &content, bool add);
+
+        void
+        touch(content_t &content);
+
+        bool
+        can_demote(const content_t &content) const;
+
+        void
+        demote(std::unique_lock<std::mutex> &lock, content_t &content);
+
+        bool
+        inflate(std::unique_lock<std::mutex> &lock, content_t &content);
+
+        void
+        enforce_budget(std::unique_lock<std::mutex> &lock, const content_t *keep);
+
+        void
+        set_busy(content_t &content, bool is_busy);
+
+        content_t *
+        find_content(uint64_t hash, const uint8_t *data, size_t size);
+
+        content_t *
+        find_class(class_id_t id) const;
+
+        size_t
+        erase_class(class_id_t id);
+
+        size_t
+        release(content_t *content);
+public:
+        bool
+        contains(class_id_t id) const;
+
+        // Points a class at the cached content with the same bytes, if there is one.
+        // Returns false if the bytes have to be parsed and inserted.
+        bool
+        share(class_id_t id, uint64_t hash, const uint8_t *data, size_t size);
+
+        // NOTE: `bytes` are the original bytes that `class_file` was parsed from.
+        //       Without a `class_file`, the bytes are parsed the first time they are needed.
+        void
+        insert(class_id_t id, uint64_t hash, std::unique_ptr<jnif::ClassFile> class_file, std::vector<uint8_t> bytes);
+
+        // Returns the parsed class file (parsing it again if it was demoted) and pins it,
+        // so that it stays valid until `unpin`. It must only be read, since it may be
+        // shared with other classes (and read by other threads) at the same time.
+        jnif::ClassFile *
+        acquire(class_id_t id);
+
+        // Content hash of the original bytes of a class (0 if it is not cached)
+        uint64_t
+        content_hash(class_id_t id) const;
+
+        // Retrieves the bytes last generated from the class content with the given hook set
+        bool
+        get_patched(class_id_t id, uint64_t hookset, std::vector<uint8_t> &bytes);
+
+        void
+        set_patched(class_id_t id, uint64_t hookset, const std::vector<uint8_t> &bytes);
+
+        // Forgets every patched result (e.g. when the way of patching changes)
+        void
+        clear_patched();
+
+        // Releases a class file pinned by `acquire`
+        void
+        unpin(class_id_t id);
+
+        // Returns the bytes that were released (0 if the content is still shared)
+        size_t
+        erase(class_id_t id);
+
+        void
+        clear();
+
+        std::vector<class_id_t>
+        ids() const;
+
+        void
+        set_budget(size_t budget_bytes, bool compress_entries);
+
+        void
+        snapshot(jnihook_cache_stats_t *stats) const;
+};
+
+#endif
@@ -0,0 +1,165 @@
+/*
+ *  -----------------------------------
+ * |         JNIHook - by rdbo         |
+ * |      Java VM Hooking Library      |
+ *  -----------------------------------
+ */
+
+/*
+ * Copyright (C) 2026    Rdbo
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License version 3
+ * as published by the Free Software Foundation.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "codearena.hpp"
+#include <cstring>
+#include <mutex>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <cerrno>
+#include <cstdio>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+#define CODE_ARENA_CHUNK_SIZE (64 * 1024)
+#define CODE_ARENA_ALIGNMENT 16
+
+// Every chunk is mapped twice: the code is written through the read-write
+// view and runs from the read-execute view, so no page is ever both
+struct code_chunk_t {
+        uint8_t *writable;
+        uint8_t *executable;
+};
+
+static std::mutex g_code_arena_mutex;
+static code_chunk_t g_code_arena_chunk = { nullptr, nullptr };
+static size_t g_code_arena_used = 0;
+
+static size_t
+get_chunk_size()
+{
+#ifdef _WIN32
+        SYSTEM_INFO info;
+        GetSystemInfo(&info);
+        size_t granularity = info.dwAllocationGranularity;
+#else
+        size_t granularity = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+#endif
+        return granularity > CODE_ARENA_CHUNK_SIZE ? granularity : CODE_ARENA_CHUNK_SIZE;
+}
+
+#ifndef _WIN32
+// Anonymous shared memory object backing both views of a chunk
+static int
+open_shared_memory()
+{
+#ifdef __linux__
+#ifdef MFD_EXEC
+        int fd = memfd_create("jnihook-code", MFD_CLOEXEC | MFD_EXEC);
+        if (fd != -1 || errno != EINVAL)
+                return fd;
+#endif
+        return memfd_create("jnihook-code", MFD_CLOEXEC);
+#else
+        char name[64];
+        snprintf(name, sizeof(name), "/jnihook-code-%ld-%p", static_cast<long>(getpid()), static_cast<void *>(&name));
+        int fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0600);
+        if (fd != -1)
+                shm_unlink(name);
+        return fd;
+#endif
+}
+#endif
+
+static bool
+alloc_chunk(code_chunk_t *chunk, size_t size)
+{
+#ifdef _WIN32
+        HANDLE mapping = CreateFileMappingW(INVALID_HANDLE_VALUE, NULL, PAGE_EXECUTE_READWRITE, 0,
+                                            static_cast<DWORD>(size), NULL);
+        if (!mapping)
+                return false;
+
+        auto writable = MapViewOfFile(mapping, FILE_MAP_WRITE, 0, 0, size);
+        auto executable = MapViewOfFile(mapping, FILE_MAP_READ | FILE_MAP_EXECUTE, 0, 0, size);
+        CloseHandle(mapping); // The views keep the section alive
+        if (!writable || !executable) {
+                if (writable)
+                        UnmapViewOfFile(writable);
+                if (executable)
+                        UnmapViewOfFile(executable);
+                return false;
+        }
+#else
+        int fd = open_shared_memory();
+        if (fd == -1)
+                return false;
+
+        void *writable = MAP_FAILED;
+        void *executable = MAP_FAILED;
+        if (ftruncate(fd, static_cast<off_t>(size)) == 0) {
+                writable = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+                executable = mmap(NULL, size, PROT_READ | PROT_EXEC, MAP_SHARED, fd, 0);
+        }
+        close(fd); // The mappings keep the memory alive
+        if (writable == MAP_FAILED || executable == MAP_FAILED) {
+                if (writable != MAP_FAILED)
+                        munmap(writable, size);
+                if (executable != MAP_FAILED)
+                        munmap(executable, size);
+                return false;
+        }
+#endif
+
+        chunk->writable = reinterpret_cast<uint8_t *>(writable);
+        chunk->executable = reinterpret_cast<uint8_t *>(executable);
+        return true;
+}
+
+void *
+CodeArenaWrite(const void *code, size_t size)
+{
+        std::lock_guard<std::mutex> lock(g_code_arena_mutex);
+
+        static const size_t chunk_size = get_chunk_size();
+        size_t aligned_size = (size + CODE_ARENA_ALIGNMENT - 1) & ~static_cast<size_t>(CODE_ARENA_ALIGNMENT - 1);
+        if (aligned_size > chunk_size)
+                return nullptr;
+
+        if (!g_code_arena_chunk.writable || g_code_arena_used + aligned_size > chunk_size) {
+                // The remaining space of the previous chunk is simply abandoned
+                code_chunk_t chunk;
+                if (!alloc_chunk(&chunk, chunk_size))
+                        return nullptr;
+
+                g_code_arena_chunk = chunk;
+                g_code_arena_used = 0;
+        }
+
+        // Code that is already running from the chunk is never touched, the
+        // new code only lands in bytes that nothing has executed yet
+        memcpy(&g_code_arena_chunk.writable[g_code_arena_used], code, size);
+        auto dest = &g_code_arena_chunk.executable[g_code_arena_used];
+        g_code_arena_used += aligned_size;
+
+        // The instruction cache is not always kept coherent with the written data
+#ifdef _WIN32
+        FlushInstructionCache(GetCurrentProcess(), dest, size);
+#elif defined(__aarch64__)
+        __builtin___clear_cache(reinterpret_cast<char *>(dest), reinterpret_cast<char *>(dest + size));
+#endif
+
+        return dest;
+}
@@ -0,0 +1,66 @@
+/*
+ *  -----------------------------------
+ * |         JNIHook - by rdbo         |
+ * |      Java VM Hooking Library      |
+ *  -----------------------------------
+ */
+
+/*
+ * Copyright (C) 2026    Rdbo
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License version 3
+ * as published by the Free Software Foundation.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef _CODEARENA_HPP_
+#define _CODEARENA_HPP_
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Growable buffer used for emitting machine code
+class CodeBuffer {
+private:
+        std::vector<uint8_t> code;
+public:
+        inline void emit(std::initializer_list<uint8_t> bytes)
+        {
+                code.insert(code.end(), bytes);
+        }
+
+        template <typename T>
+        inline void emit_imm(T value)
+        {
+                auto bytes = reinterpret_cast<const uint8_t *>(&value);
+                code.insert(code.end(), bytes, &bytes[sizeof(value)]);
+        }
+
+        inline size_t size()
+        {
+                return code.size();
+        }
+
+        inline const uint8_t *data()
+        {
+                return code.data();
+        }
+};
+
+// Allocates executable memory for generated code. The arena's chunks are
+// mapped twice, a read-write view for writing the code and a read-execute
+// view for running it, so no page is ever writable and executable at once.
+// NOTE: Code written to the arena is never freed, because a JVM
+//       thread could still be running it after a hook is removed.
+void *
+CodeArenaWrite(const void *code, size_t size);
+
+#endif
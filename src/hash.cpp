@@ -0,0 +1,116 @@
+/*
+ *  -----------------------------------
+ * |         JNIHook - by rdbo         |
+ * |      Java VM Hooking Library      |
+ *  -----------------------------------
+ */
+
+/*
+ * Copyright (C) 2026    Rdbo
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License version 3
+ * as published by the Free Software Foundation.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "hash.hpp"
+#include <cstring>
+
+#define HASH_PRIME1 0x9e3779b185ebca87ULL
+#define HASH_PRIME2 0xc2b2ae3d27d4eb4fULL
+#define HASH_PRIME3 0x165667b19e3779f9ULL
+#define HASH_PRIME4 0x85ebca77c2b2ae63ULL
+#define HASH_PRIME5 0x27d4eb2f165667c5ULL
+
+static inline uint64_t
+read64(const uint8_t *p)
+{
+        uint64_t value;
+        memcpy(&value, p, sizeof(value));
+        return value;
+}
+
+static inline uint64_t
+rotl(uint64_t value, int shift)
+{
+        return (value << shift) | (value >> (64 - shift));
+}
+
+static inline uint64_t
+hash_round(uint64_t acc, uint64_t input)
+{
+        acc += input * HASH_PRIME2;
+        acc = rotl(acc, 31);
+        return acc * HASH_PRIME1;
+}
+
+static inline uint64_t
+merge(uint64_t acc, uint64_t lane)
+{
+        acc ^= hash_round(0, lane);
+        return acc * HASH_PRIME1 + HASH_PRIME4;
+}
+
+// Same construction as XXH64, so its distribution properties carry over
+uint64_t
+ContentHash(const void *data, size_t size, uint64_t seed)
+{
+        auto p = static_cast<const uint8_t *>(data);
+        auto end = p + size;
+        uint64_t h;
+
+        if (size >= 32) {
+                uint64_t lanes[4] = {
+                        seed + HASH_PRIME1 + HASH_PRIME2,
+                        seed + HASH_PRIME2,
+                        seed,
+                        seed - HASH_PRIME1
+                };
+
+                for (; p + 32 <= end; p += 32) {
+                        for (int i = 0; i < 4; ++i)
+                                lanes[i] = hash_round(lanes[i], read64(p + i * 8));
+                }
+
+                h = rotl(lanes[0], 1) + rotl(lanes[1], 7) + rotl(lanes[2], 12) + rotl(lanes[3], 18);
+                for (int i = 0; i < 4; ++i)
+                        h = merge(h, lanes[i]);
+        } else {
+                h = seed + HASH_PRIME5;
+        }
+
+        h += size;
+
+        for (; p + 8 <= end; p += 8) {
+                h ^= hash_round(0, read64(p));
+                h = rotl(h, 27) * HASH_PRIME1 + HASH_PRIME4;
+        }
+
+        if (p + 4 <= end) {
+                uint32_t word;
+                memcpy(&word, p, sizeof(word));
+                h ^= static_cast<uint64_t>(word) * HASH_PRIME1;
+                h = rotl(h, 23) * HASH_PRIME2 + HASH_PRIME3;
+                p += 4;
+        }
+
+        for (; p < end; ++p) {
+                h ^= static_cast<uint64_t>(*p) * HASH_PRIME5;
+                h = rotl(h, 11) * HASH_PRIME1;
+        }
+
+        h ^= h >> 33;
+        h *= HASH_PRIME2;
+        h ^= h >> 29;
+        h *= HASH_PRIME3;
+        h ^= h >> 32;
+
+        return h;
+}
@@ -0,0 +1,37 @@
+/*
+ *  -----------------------------------
+ * |         JNIHook - by rdbo         |
+ * |      Java VM Hooking Library      |
+ *  -----------------------------------
+ */
+
+/*
+ * Copyright (C) 2026    Rdbo
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License version 3
+ * as published by the Free Software Foundation.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef _HASH_HPP_
+#define _HASH_HPP_
+
+#include <cstddef>
+#include <cstdint>
+
+// Fast 64-bit hash of a block of bytes (e.g. a class file), used to tell
+// whether two class files are identical without comparing them.
+// It is not cryptographic, so a match must not be trusted across a trust boundary.
+// It consumes 32 bytes per round in 4 independent lanes, which the compiler can keep
+// in separate registers (or vectorize), so it runs at several bytes per cycle.
+uint64_t
+ContentHash(const void *data, size_t size, uint64_t seed = 0);
+
+#endif
@@ -0,0 +1,194 @@
+/*
+ *  -----------------------------------
+ * |         JNIHook - by rdbo         |
+ * |      Java VM Hooking Library      |
+ *  -----------------------------------
+ */
+
+/*
+ * Copyright (C) 2026    Rdbo
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License version 3
+ * as published by the Free Software Foundation.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "hooktable.hpp"
+
+#include <thread>
+
+static inline size_t
+hash_method(jmethodID method)
+{
+        uint64_t h = reinterpret_cast<uintptr_t>(method);
+
+        // jmethodIDs are aligned pointers, so the low bits are mixed in from the high ones
+        h ^= h >> 33;
+        h *= 0xff51afd7ed558ccdULL;
+        h ^= h >> 33;
+
+        return static_cast<size_t>(h);
+}
+
+HookTable::~HookTable()
+{
+        for (auto previous : retired)
+                delete previous;
+
+        delete snapshot.load();
+}
+
+// Builds a snapshot of the entries and swaps it in, then frees the previous one
+// once no reader can be using it anymore (unless the reclamation is deferred)
+void
+HookTable::publish_locked(bool defer_reclaim)
+{
+        snapshot_t *next = nullptr;
+
+        if (!entries.empty()) {
+                size_t capacity = 16;
+
+                // At most half full, so that a lookup always finds an empty slot
+                while (capacity < entries.size() * 2)
+                        capacity *= 2;
+
+                next = new snapshot_t { capacity - 1, std::vector<hook_entry_t>(capacity) };
+
+                for (auto &[method, entry] : entries) {
+                        size_t i = hash_method(method) & next->mask;
+
+                        while (next->slots[i].method)
+                                i = (i + 1) & next->mask;
+
+                        next->slots[i] = entry;
+                }
+        }
+
+        auto previous = snapshot.exchange(next);
+        if (previous)
+                retired.push_back(previous);
+
+        if (!defer_reclaim)
+                reclaim_locked();
+}
+
+void
+HookTable::reclaim_locked()
+{
+        if (retired.empty())
+                return;
+
+        synchronize();
+
+        for (auto previous : retired)
+                delete previous;
+        retired.clear();
+}
+
+// Waits until every reader that could have seen the previous snapshot is done.
+// The epoch is flipped twice, so that both counters are waited for: a reader that picked
+// the parity right before a flip may only increment its counter after the writer has
+// checked it, but then it can only load the snapshot that was just published.
+void
+HookTable::synchronize()
+{
+        for (int i = 0; i < 2; ++i) {
+                auto parity = epoch.fetch_add(1) & 1;
+
+                while (readers[parity].count.load() != 0)
+                        std::this_thread::yield();
+        }
+}
+
+void
+HookTable::publish(const std::vector<hook_entry_t> &new_entries, bool defer_reclaim)
+{
+        if (new_entries.empty())
+                return;
+
+        std::lock_guard<std::mutex> lock(mutex);
+
+        for (auto &entry : new_entries)
+                entries[entry.method] = entry;
+
+        publish_locked(defer_reclaim);
+}
+
+void
+HookTable::retract(const std::vector<jmethodID> &methods, bool defer_reclaim)
+{
+        std::lock_guard<std::mutex> lock(mutex);
+        size_t erased = 0;
+
+        for (auto method : methods)
+                erased += entries.erase(method);
+
+        if (erased > 0)
+                publish_locked(defer_reclaim);
+}
+
+void
+HookTable::reclaim()
+{
+        std::lock_guard<std::mutex> lock(mutex);
+
+        reclaim_locked();
+}
+
+void
+HookTable::retract_class(jlong clazz_id)
+{
+        std::lock_guard<std::mutex> lock(mutex);
+
+        auto erased = std::erase_if(entries, [clazz_id](auto &item) {
+                return item.second.clazz_id == clazz_id;
+        });
+
+        if (erased > 0)
+                publish_locked(false);
+}
+
+void
+HookTable::clear()
+{
+        std::lock_guard<std::mutex> lock(mutex);
+
+        if (entries.empty())
+                return;
+
+        entries.clear();
+        publish_locked(false);
+}
+
+bool
+HookTable::find(jmethodID method, hook_entry_t *entry) const
+{
+        bool found = false;
+        auto parity = epoch.load() & 1;
+
+        readers[parity].count.fetch_add(1);
+
+        auto current = snapshot.load();
+        if (current && method) {
+                // Bounded by the table size, since there is always an empty slot
+                for (size_t i = hash_method(method) & current->mask; current->slots[i].method; i = (i + 1) & current->mask) {
+                        if (current->slots[i].method == method) {
+                                if (entry)
+                                        *entry = current->slots[i];
+                                found = true;
+                                break;
+                        }
+                }
+        }
+
+        readers[parity].count.fetch_sub(1);
+
+        return found;
+}
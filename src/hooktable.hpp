@@ -0,0 +1,91 @@
+/*
+ *  -----------------------------------
+ * |         JNIHook - by rdbo         |
+ * |      Java VM Hooking Library      |
+ *  -----------------------------------
+ */
+
+/*
+ * Copyright (C) 2026    Rdbo
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License version 3
+ * as published by the Free Software Foundation.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef _HOOKTABLE_HPP_
+#define _HOOKTABLE_HPP_
+
+#include <jnihook.h>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+typedef struct hook_entry_t {
+        jmethodID method;          // Hooked method (NULL in the empty slots of a snapshot)
+        jmethodID original_method; // Copy of the original method
+        void *native_hook_method;
+        jlong clazz_id;            // class_id_t of the declaring class
+} hook_entry_t;
+
+// Hooked methods by jmethodID, readable from any thread (including from inside a hook)
+// without locking or allocating.
+// Readers look the methods up in an immutable snapshot, an open addressing table that
+// is rebuilt and published atomically after every change. A replaced snapshot is only
+// freed after a grace period: the readers count themselves in one of two counters,
+// picked by the parity of an epoch that the writer flips, and the writer waits for
+// both counters to drain before freeing it.
+// NOTE: Writers are serialized, and they wait for the readers, so they must not be
+//       called while a lookup is in progress on the same thread. While other threads
+//       are suspended, writers must defer the reclamation (a suspended reader could
+//       never finish) and call `reclaim` once the threads are resumed.
+class HookTable {
+private:
+        typedef struct snapshot_t {
+                size_t mask;
+                std::vector<hook_entry_t> slots;
+        } snapshot_t;
+
+        typedef struct alignas(64) readers_t {
+                std::atomic<uint64_t> count;
+        } readers_t;
+
+        std::atomic<snapshot_t *> snapshot = nullptr;
+        std::atomic<uint64_t> epoch = 0;
+        mutable readers_t readers[2] = {};
+
+        std::mutex mutex; // Serializes the writers
+        std::unordered_map<jmethodID, hook_entry_t> entries;
+        std::vector<snapshot_t *> retired; // Replaced snapshots that may still be read
+
+        void publish_locked(bool defer_reclaim);
+        void reclaim_locked();
+        void synchronize();
+public:
+        ~HookTable();
+
+        // Adds the entries (replacing the ones of the same methods)
+        void publish(const std::vector<hook_entry_t> &new_entries, bool defer_reclaim = false);
+        // Removes the entries of the methods
+        void retract(const std::vector<jmethodID> &methods, bool defer_reclaim = false);
+        // Frees the snapshots replaced by writers that deferred the reclamation
+        void reclaim();
+        // Removes the entries of every method of a class
+        void retract_class(jlong clazz_id);
+        void clear();
+
+        // Wait-free lookup, returns false if the method is not hooked
+        bool find(jmethodID method, hook_entry_t *entry) const;
+};
+
+#endif
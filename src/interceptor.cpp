@@ -0,0 +1,387 @@
+/*
+ *  -----------------------------------
+ * |         JNIHook - by rdbo         |
+ * |      Java VM Hooking Library      |
+ *  -----------------------------------
+ */
+
+/*
+ * Copyright (C) 2026    Rdbo
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License version 3
+ * as published by the Free Software Foundation.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "interceptor.hpp"
+#include "codearena.hpp"
+#include <cstring>
+#include <mutex>
+
+// The JVM limits a method to 255 argument slots
+#define INTERCEPT_MAX_ARGS 255
+#define INTERCEPT_FPRS 8
+
+#if defined(__x86_64__) && !defined(_WIN32)
+        #define INTERCEPT_GPRS 6 // rdi, rsi, rdx, rcx, r8, r9
+#elif defined(__aarch64__) && !defined(__APPLE__)
+        #define INTERCEPT_GPRS 8 // x0-x7
+#endif
+
+#ifdef INTERCEPT_GPRS
+static void *g_intercept_stub = nullptr;
+
+// Reads the callback of `interceptor` and its argument as a pair (see `SetInterceptorCallback`)
+static void
+load_callback(interceptor_t *interceptor, jnihook_interceptor_t &callback, void *&arg)
+{
+        unsigned sequence;
+
+        do {
+                sequence = interceptor->sequence.load(std::memory_order_acquire);
+                callback = interceptor->interceptor.load(std::memory_order_relaxed);
+                arg = interceptor->arg.load(std::memory_order_relaxed);
+                std::atomic_thread_fence(std::memory_order_acquire);
+        } while ((sequence & 1) || sequence != interceptor->sequence.load(std::memory_order_relaxed));
+}
+
+// Called by the common stub with the saved argument registers (the general purpose
+// ones, followed by the floating point ones) and the arguments passed on the stack.
+// Returns the bits of the result, which the stub places in both return registers.
+static uint64_t
+InterceptorDispatch(interceptor_t *interceptor, const uint64_t *regs, const uint64_t *stack)
+{
+        jvalue args[INTERCEPT_MAX_ARGS];
+        jnihook_call_t call = {};
+        jnihook_interceptor_t callback;
+        uint64_t result = 0;
+
+        for (size_t i = 0; i < interceptor->locations.size(); ++i) {
+                auto &location = interceptor->locations[i];
+                uint64_t value;
+
+                switch (location.kind) {
+                case arg_location_t::GPR:
+                        value = regs[location.index];
+                        break;
+                case arg_location_t::FPR:
+                        value = regs[INTERCEPT_GPRS + location.index];
+                        break;
+                default:
+                        value = stack[location.index];
+                        break;
+                }
+
+                // Only the low bits of the register or stack slot belong to the argument
+                switch (interceptor->arg_types[i]) {
+                case 'Z': args[i].z = static_cast<jboolean>(value); break;
+                case 'B': args[i].b = static_cast<jbyte>(value); break;
+                case 'C': args[i].c = static_cast<jchar>(value); break;
+                case 'S': args[i].s = static_cast<jshort>(value); break;
+                case 'I': args[i].i = static_cast<jint>(value); break;
+                case 'F': memcpy(&args[i].f, &value, sizeof(args[i].f)); break;
+                case 'J': args[i].j = static_cast<jlong>(value); break;
+                case 'D': memcpy(&args[i].d, &value, sizeof(args[i].d)); break;
+                default:  args[i].l = reinterpret_cast<jobject>(value); break;
+                }
+        }
+
+        call.env = reinterpret_cast<JNIEnv *>(regs[0]);
+        call.self = reinterpret_cast<jobject>(regs[1]);
+        // NOTE: The class can't be unloaded while one of its methods is running,
+        //       and the local reference is freed when the stub returns to Java
+        call.clazz = static_cast<jclass>(call.env->NewLocalRef(interceptor->clazz));
+        call.method = interceptor->method;
+        call.original_method = interceptor->original_method;
+        call.is_static = interceptor->is_static ? JNI_TRUE : JNI_FALSE;
+        call.signature = interceptor->signature.c_str();
+        call.arg_types = interceptor->arg_types.c_str();
+        call.arg_count = static_cast<jint>(interceptor->arg_types.size());
+        call.args = args;
+        call.return_type = interceptor->return_type;
+        load_callback(interceptor, callback, call.arg);
+
+        callback(&call);
+
+        // The caller may read the whole return register, so narrow values are extended
+        switch (call.return_type) {
+        case 'Z': result = call.result.z; break;
+        case 'B': result = static_cast<uint64_t>(static_cast<int64_t>(call.result.b)); break;
+        case 'C': result = call.result.c; break;
+        case 'S': result = static_cast<uint64_t>(static_cast<int64_t>(call.result.s)); break;
+        case 'I': result = static_cast<uint64_t>(static_cast<int64_t>(call.result.i)); break;
+        case 'F': memcpy(&result, &call.result.f, sizeof(call.result.f)); break;
+        case 'J': result = static_cast<uint64_t>(call.result.j); break;
+        case 'D': memcpy(&result, &call.result.d, sizeof(call.result.d)); break;
+        case 'V': break;
+        default:  result = reinterpret_cast<uint64_t>(call.result.l); break;
+        }
+
+        return result;
+}
+#endif
+
+#if defined(__x86_64__) && !defined(_WIN32)
+// Stack layout of the common stub (offsets from rsp after the prologue):
+//     [0, 48)    rdi, rsi, rdx, rcx, r8, r9
+//     [48, 112)  low halves of xmm0-xmm7
+//     [112, 120) rbp of the caller
+//     [120, 128) return address
+//     [128, ...) arguments passed on the stack
+#define INTERCEPT_FRAME_SIZE 112
+
+static void *
+generate_intercept_stub()
+{
+        CodeBuffer code;
+
+        code.emit({ 0x55 });                                     // push rbp
+        code.emit({ 0x48, 0x89, 0xE5 });                         // mov rbp, rsp
+        code.emit({ 0x48, 0x81, 0xEC });                         // sub rsp, INTERCEPT_FRAME_SIZE
+        code.emit_imm<int32_t>(INTERCEPT_FRAME_SIZE);
+        code.emit({ 0x48, 0x89, 0x7C, 0x24, 0x00 });             // mov [rsp], rdi
+        code.emit({ 0x48, 0x89, 0x74, 0x24, 0x08 });             // mov [rsp + 8], rsi
+        code.emit({ 0x48, 0x89, 0x54, 0x24, 0x10 });             // mov [rsp + 16], rdx
+        code.emit({ 0x48, 0x89, 0x4C, 0x24, 0x18 });             // mov [rsp + 24], rcx
+        code.emit({ 0x4C, 0x89, 0x44, 0x24, 0x20 });             // mov [rsp + 32], r8
+        code.emit({ 0x4C, 0x89, 0x4C, 0x24, 0x28 });             // mov [rsp + 40], r9
+        for (uint8_t i = 0; i < INTERCEPT_FPRS; ++i) {
+                // movq [rsp + disp8], xmm<i>
+                code.emit({ 0x66, 0x0F, 0xD6, static_cast<uint8_t>(0x44 | (i << 3)), 0x24 });
+                code.emit_imm<uint8_t>(48 + 8 * i);
+        }
+
+        code.emit({ 0x4C, 0x89, 0xD7 });                         // mov rdi, r10
+        code.emit({ 0x48, 0x89, 0xE6 });                         // mov rsi, rsp
+        code.emit({ 0x48, 0x8D, 0x55, 0x10 });                   // lea rdx, [rbp + 16]
+        code.emit({ 0x48, 0xB8 });                               // mov rax, InterceptorDispatch
+        code.emit_imm(reinterpret_cast<uint64_t>(&InterceptorDispatch));
+        code.emit({ 0xFF, 0xD0 });                               // call rax
+
+        code.emit({ 0x66, 0x48, 0x0F, 0x6E, 0xC0 });             // movq xmm0, rax
+        code.emit({ 0xC9 });                                     // leave
+        code.emit({ 0xC3 });                                     // ret
+
+        return CodeArenaWrite(code.data(), code.size());
+}
+
+static void *
+generate_stub(interceptor_t *interceptor)
+{
+        CodeBuffer code;
+
+        code.emit({ 0x49, 0xBA });                               // mov r10, interceptor
+        code.emit_imm(reinterpret_cast<uint64_t>(interceptor));
+        code.emit({ 0x49, 0xBB });                               // mov r11, common stub
+        code.emit_imm(reinterpret_cast<uint64_t>(g_intercept_stub));
+        code.emit({ 0x41, 0xFF, 0xE3 });                         // jmp r11
+
+        return CodeArenaWrite(code.data(), code.size());
+}
+#elif defined(__aarch64__) && !defined(__APPLE__)
+// Stack layout of the common stub (offsets from sp after the prologue):
+//     [0, 64)    x0-x7
+//     [64, 128)  d0-d7
+//     [128, 144) x29, x30 of the caller
+//     [144, ...) arguments passed on the stack
+#define INTERCEPT_FRAME_SIZE 128
+
+// stp <rt>, <rt2>, [sp, #offset] (d registers if `fp` is set)
+static uint32_t
+encode_stp(uint32_t rt, uint32_t rt2, uint32_t offset, bool fp)
+{
+        return (fp ? 0x6D000000 : 0xA9000000) | ((offset / 8) << 15) | (rt2 << 10) | (31 << 5) | rt;
+}
+
+static void *
+generate_intercept_stub()
+{
+        CodeBuffer code;
+
+        code.emit_imm<uint32_t>(0xA9BF7BFD);                     // stp x29, x30, [sp, #-16]!
+        code.emit_imm<uint32_t>(0x910003FD);                     // mov x29, sp
+        code.emit_imm<uint32_t>(0xD10003FF | (INTERCEPT_FRAME_SIZE << 10)); // sub sp, sp, #INTERCEPT_FRAME_SIZE
+        for (uint32_t i = 0; i < INTERCEPT_GPRS; i += 2)
+                code.emit_imm<uint32_t>(encode_stp(i, i + 1, 8 * i, false));      // stp x<i>, x<i+1>, [sp, #8*i]
+        for (uint32_t i = 0; i < INTERCEPT_FPRS; i += 2)
+                code.emit_imm<uint32_t>(encode_stp(i, i + 1, 64 + 8 * i, true));  // stp d<i>, d<i+1>, [sp, #64+8*i]
+
+        code.emit_imm<uint32_t>(0xAA1003E0);                     // mov x0, x16
+        code.emit_imm<uint32_t>(0x910003E1);                     // mov x1, sp
+        code.emit_imm<uint32_t>(0x910043A2);                     // add x2, x29, #16
+        code.emit_imm<uint32_t>(0x58000000 | (6 << 5) | 17);     // ldr x17, dispatch (24 bytes ahead)
+        code.emit_imm<uint32_t>(0xD63F0220);                     // blr x17
+
+        code.emit_imm<uint32_t>(0x9E670000);                     // fmov d0, x0
+        code.emit_imm<uint32_t>(0x910003BF);                     // mov sp, x29
+        code.emit_imm<uint32_t>(0xA8C17BFD);                     // ldp x29, x30, [sp], #16
+        code.emit_imm<uint32_t>(0xD65F03C0);                     // ret
+        code.emit_imm(reinterpret_cast<uint64_t>(&InterceptorDispatch));
+
+        return CodeArenaWrite(code.data(), code.size());
+}
+
+static void *
+generate_stub(interceptor_t *interceptor)
+{
+        CodeBuffer code;
+
+        code.emit_imm<uint32_t>(0x58000000 | (4 << 5) | 16);     // ldr x16, interceptor
+        code.emit_imm<uint32_t>(0x58000000 | (5 << 5) | 17);     // ldr x17, common stub
+        code.emit_imm<uint32_t>(0xD61F0220);                     // br x17
+        code.emit_imm<uint32_t>(0xD503201F);                     // nop (aligns the literals)
+        code.emit_imm(reinterpret_cast<uint64_t>(interceptor));
+        code.emit_imm(reinterpret_cast<uint64_t>(g_intercept_stub));
+
+        return CodeArenaWrite(code.data(), code.size());
+}
+#endif
+
+// Splits a method descriptor into the first character of each argument type and the return type
+static bool
+parse_signature(const std::string &signature, std::string &arg_types, char &return_type)
+{
+        size_t i = 1;
+
+        if (signature.empty() || signature[0] != '(')
+                return false;
+
+        while (i < signature.size() && signature[i] != ')') {
+                size_t start = i;
+
+                while (i < signature.size() && signature[i] == '[')
+                        ++i;
+
+                if (i >= signature.size())
+                        return false;
+
+                if (signature[i] == 'L') {
+                        i = signature.find(';', i);
+                        if (i == std::string::npos)
+                                return false;
+                } else if (!strchr("ZBCSIJFD", signature[i])) {
+                        return false;
+                }
+
+                arg_types.push_back(signature[start]);
+                ++i;
+        }
+
+        if (i + 1 >= signature.size())
+                return false;
+
+        return_type = signature[i + 1];
+
+        return arg_types.size() <= INTERCEPT_MAX_ARGS;
+}
+
+void *
+GenerateInterceptorStub(interceptor_t *interceptor)
+{
+#ifdef INTERCEPT_GPRS
+        static std::once_flag stub_flag;
+        uint16_t gprs = 2; // JNIEnv and `this` (or the class)
+        uint16_t fprs = 0;
+        uint16_t slots = 0;
+
+        std::call_once(stub_flag, []() {
+                g_intercept_stub = generate_intercept_stub();
+        });
+
+        if (!g_intercept_stub)
+                return nullptr;
+
+        interceptor->arg_types.clear();
+        if (!parse_signature(interceptor->signature, interceptor->arg_types, interceptor->return_type))
+                return nullptr;
+
+        // Both conventions pass the arguments in registers of their class while there
+        // are any left, then in 8-byte stack slots, in the order they are declared
+        interceptor->locations.clear();
+        for (char type : interceptor->arg_types) {
+                bool fp = type == 'F' || type == 'D';
+
+                if (fp && fprs < INTERCEPT_FPRS)
+                        interceptor->locations.push_back({ arg_location_t::FPR, fprs++ });
+                else if (!fp && gprs < INTERCEPT_GPRS)
+                        interceptor->locations.push_back({ arg_location_t::GPR, gprs++ });
+                else
+                        interceptor->locations.push_back({ arg_location_t::STACK, slots++ });
+        }
+
+        return generate_stub(interceptor);
+#else
+        // NOTE: Only the System V x86_64 and AArch64 calling conventions are supported.
+        //       The Microsoft x64 one (and any other target) gets no stub, so that
+        //       JNIHook_Intercept fails with JNIHOOK_ERR_UNSUPPORTED.
+        (void)interceptor;
+        return nullptr;
+#endif
+}
+
+void
+SetInterceptorCallback(interceptor_t *interceptor, jnihook_interceptor_t callback, void *arg)
+{
+        auto sequence = interceptor->sequence.load(std::memory_order_relaxed);
+
+        interceptor->sequence.store(sequence + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        interceptor->interceptor.store(callback, std::memory_order_relaxed);
+        interceptor->arg.store(arg, std::memory_order_relaxed);
+        interceptor->sequence.store(sequence + 2, std::memory_order_release);
+}
+
+jnihook_result_t
+InterceptorCallOriginal(jnihook_call_t *call)
+{
+        auto env = call->env;
+        auto clazz = call->clazz;
+        auto self = call->self;
+        auto method = call->original_method;
+        auto args = call->args;
+        auto &result = call->result;
+
+        if (!method)
+                return JNIHOOK_ERR_INVALID_ARGUMENT;
+
+        if (call->is_static) {
+                switch (call->return_type) {
+                case 'Z': result.z = env->CallStaticBooleanMethodA(clazz, method, args); break;
+                case 'B': result.b = env->CallStaticByteMethodA(clazz, method, args); break;
+                case 'C': result.c = env->CallStaticCharMethodA(clazz, method, args); break;
+                case 'S': result.s = env->CallStaticShortMethodA(clazz, method, args); break;
+                case 'I': result.i = env->CallStaticIntMethodA(clazz, method, args); break;
+                case 'F': result.f = env->CallStaticFloatMethodA(clazz, method, args); break;
+                case 'J': result.j = env->CallStaticLongMethodA(clazz, method, args); break;
+                case 'D': result.d = env->CallStaticDoubleMethodA(clazz, method, args); break;
+                case 'V': env->CallStaticVoidMethodA(clazz, method, args); break;
+                default:  result.l = env->CallStaticObjectMethodA(clazz, method, args); break;
+                }
+        } else {
+                switch (call->return_type) {
+                case 'Z': result.z = env->CallNonvirtualBooleanMethodA(self, clazz, method, args); break;
+                case 'B': result.b = env->CallNonvirtualByteMethodA(self, clazz, method, args); break;
+                case 'C': result.c = env->CallNonvirtualCharMethodA(self, clazz, method, args); break;
+                case 'S': result.s = env->CallNonvirtualShortMethodA(self, clazz, method, args); break;
+                case 'I': result.i = env->CallNonvirtualIntMethodA(self, clazz, method, args); break;
+                case 'F': result.f = env->CallNonvirtualFloatMethodA(self, clazz, method, args); break;
+                case 'J': result.j = env->CallNonvirtualLongMethodA(self, clazz, method, args); break;
+                case 'D': result.d = env->CallNonvirtualDoubleMethodA(self, clazz, method, args); break;
+                case 'V': env->CallNonvirtualVoidMethodA(self, clazz, method, args); break;
+                default:  result.l = env->CallNonvirtualObjectMethodA(self, clazz, method, args); break;
+                }
+        }
+
+        // The exception is left pending, so that it is thrown to the caller of the method
+        if (env->ExceptionCheck())
+                return JNIHOOK_ERR_JAVA_EXCEPTION;
+
+        return JNIHOOK_OK;
+}
@@ -0,0 +1,78 @@
+/*
+ *  -----------------------------------
+ * |         JNIHook - by rdbo         |
+ * |      Java VM Hooking Library      |
+ *  -----------------------------------
+ */
+
+/*
+ * Copyright (C) 2026    Rdbo
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License version 3
+ * as published by the Free Software Foundation.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef _INTERCEPTOR_HPP_
+#define _INTERCEPTOR_HPP_
+
+#include <jnihook.h>
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Where the calling convention puts an argument of the intercepted method
+typedef struct arg_location_t {
+        enum { GPR, FPR, STACK } kind;
+        uint16_t index; // Register number, or 8-byte stack slot
+} arg_location_t;
+
+typedef struct interceptor_t {
+        // Replaced with `SetInterceptorCallback` when the method is intercepted again
+        std::atomic<jnihook_interceptor_t> interceptor;
+        std::atomic<void *> arg;
+        std::atomic<unsigned> sequence;         // Odd while they are being replaced
+        void *stub;                             // Generated once for the method
+        jmethodID method;
+        jmethodID original_method;              // Set before the stub is registered
+        jweak clazz;                            // Weak global reference, so that the
+                                                // class loader can still be unloaded
+        bool is_static;
+        std::string signature;
+        std::string arg_types;
+        char return_type;
+        std::vector<arg_location_t> locations;
+} interceptor_t;
+
+// Generates a native method for `interceptor`, which stores the arguments
+// of every call in a jnihook_call_t (without boxing them) and passes it to
+// `interceptor->interceptor`. The arguments are located by parsing the
+// signature of the method once, here.
+// Returns NULL if the signature is malformed or if the current architecture
+// or calling convention is not supported (only System V x86_64 and AArch64).
+// NOTE: The interceptor must not be freed while its class is loaded, since the
+//       generated code may still be running on another thread after the hook
+//       is detached. The code itself is never freed (see `CodeArenaWrite`).
+void *
+GenerateInterceptorStub(interceptor_t *interceptor);
+
+// Replaces the function called by the stub of `interceptor` and its argument,
+// so that a call running meanwhile sees either the old pair or the new one.
+// NOTE: Calls to this for the same interceptor must not run concurrently
+void
+SetInterceptorCallback(interceptor_t *interceptor, jnihook_interceptor_t callback, void *arg);
+
+// Calls the original method of an intercepted call with `call->args`
+// and stores the returned value in `call->result`
+jnihook_result_t
+InterceptorCallOriginal(jnihook_call_t *call);
+
+#endif
@@ -24,14 +24,32 @@
 #include <atomic>
 #include <jnihook.h>
 #include <map>
+#include <mutex>
+#include <shared_mutex>
 #include <sstream>
 #include <unordered_map>
+#include <unordered_set>
 #include <string>
+#include <thread>
 #include <vector>
 #include <cstring>
 #include <jnif.hpp>
+#include "archive.hpp"
+#include "bloom.hpp"
+#include "classcache.hpp"
+#include "hash.hpp"
+#include "hooktable.hpp"
+#include "interceptor.hpp"
 #include "jvm.hpp"
+#include "manifest.hpp"
+#include "metrics.hpp"
+#include "patcher.hpp"
+#include "scheduler.hpp"
+#include "stats.hpp"
+#include "threadpool.hpp"
+#include "thunk.hpp"
 #include "uuid.hpp"
+#include "worker.hpp"
 #ifdef JNIHOOK_DEBUG
         #define LOG(...) {printf("[JNIHOOK] " __VA_ARGS__);fflush(stdout);}
 #else
@@ -48,22 +66,97 @@ typedef struct jnihook_t {
         jvmtiEnv *jvmti;
 } jnihook_t;
 
-typedef struct method_info_t {
-        std::string name;
-        std::string signature;
-        jint access_flags;
-} method_info_t;
-
 typedef struct hook_info_t {
         method_info_t method_info;
         void *native_hook_method;
 } hook_info_t;
 
+// Locking (in the order the locks are taken):
+//   - `g_init_mutex` is held exclusively while JNIHook is set up or torn down
+//     (or while the way classes are patched changes), and shared by every other call.
+//   - The shard of a class (see `ClassShard`) is held for the whole operation on it,
+//     so that operations on classes of different shards prepare them concurrently.
+//     Operations on many classes lock their shards in ascending order.
+//   - `g_redefine_mutex` is held while the other threads are suspended and
+//     classes are redefined, so that only that step is serialized.
+//   - The remaining mutexes only guard a few containers, and are never held while
+//     calling into the JVM: a thread that is suspended blocks on its next JNI or
+//     JVMTI call, and it must not be holding a lock that the suspending thread needs.
+//     `g_tag_mutex` and `g_load_hook_mutex` are the exceptions, so they are never
+//     taken while threads are suspended.
+static std::shared_mutex g_init_mutex;
+// NOTE: Recursive, since a failed attach restores its class from within the pause
+static std::recursive_mutex g_redefine_mutex;
 static std::unique_ptr<jnihook_t> g_jnihook = nullptr;
-static std::unordered_map<std::string, std::vector<hook_info_t>> g_hooks;
-static std::unordered_map<std::string, std::unique_ptr<ClassFile>> g_class_file_cache;
+
+// Amount of lock shards for the per-class state
+#define CLASS_SHARDS 64
+
+typedef struct class_shard_t {
+        std::mutex mutex;
+        std::unordered_map<class_id_t, std::vector<hook_info_t>> hooks;
+} class_shard_t;
+
+static class_shard_t g_class_shards[CLASS_SHARDS];
+static ClassCache g_class_file_cache;
+
+// Guards the names and references of the tagged classes, their installed hashes and the prepatched methods
+static std::mutex g_registry_mutex;
+// Names of the tagged classes (see `GetClassId`)
+static std::unordered_map<class_id_t, std::string> g_class_names;
+// Weak references to the tagged classes, to find them again at shutdown
+// without walking the heap or going through a class loader
+static std::unordered_map<class_id_t, jweak> g_class_refs;
+// Content hash of the class file bytes currently installed for each cached class,
+// used to skip redefinitions that would not change anything
+// NOTE: Not kept in retransform and persistent modes, where the installed bytes
+//       are generated inside the ClassFileLoadHook (possibly from other agents' bytes)
+static std::unordered_map<class_id_t, uint64_t> g_installed_hashes;
+// Serializes the tagging of classes, so that a class can't get two identities
+static std::mutex g_tag_mutex;
+static class_id_t g_next_class_id = 1;
 // static std::unordered_map<std::string, jclass> g_original_classes;
-static std::atomic<bool> g_force_class_caching = false;
+static jint g_init_flags = 0;
+// Callers that need the ClassFileLoadHook enabled to cache classes (see `AcquireClassFileLoadHook`)
+static std::mutex g_load_hook_mutex;
+static size_t g_load_hook_users = 0;
+// Hooked methods of every class, as seen by the ClassFileLoadHook
+// NOTE: The ClassFileLoadHook must not take the shard locks: it may run on another
+//       agent's thread while the JVM has the class locked for that agent's
+//       redefinition, and the thread holding the shard may be waiting on it.
+static std::mutex g_class_patches_mutex;
+static std::unordered_map<class_id_t, std::vector<method_info_t>> g_class_patches;
+static BloomFilter<> g_class_patches_filter;
+// Set while the current thread caches a class or redefines classes with patched bytes
+static thread_local bool t_caching = false;
+static thread_local bool t_redefining = false;
+// Receives the bytes of the classes being cached in a batch (see `JNIHook_PrewarmCache`)
+static thread_local std::unordered_map<class_id_t, std::vector<u1>> *t_captured_classes = nullptr;
+static ThreadPool g_thread_pool;
+// Suffix of the copies of the hooked methods. It is unique to the process,
+// unless it is adopted from the class archive, whose patched class files
+// refer to the copies by name (see `JNIHook_SetClassArchive`)
+static std::string g_copy_suffix = "_____jnihook_" + GenerateUuid();
+static ClassArchive g_class_archive;
+// Copy suffix of the methods patched ahead of time by jnihook-patch,
+// by "<class name>.<method name><signature>" (see `JNIHook_LoadManifest`)
+static std::unordered_map<std::string, std::string> g_prepatched_methods;
+// Hooked methods that were patched ahead of time, which cannot be detached
+static std::unordered_set<jmethodID> g_prepatched_hooks;
+// NOTE: Metrics are never freed, since a generated thunk may still be using them.
+//       They are guarded by a mutex because they can be read from any thread.
+static std::mutex g_hook_metrics_mutex;
+static std::unordered_map<jmethodID, std::unique_ptr<hook_metrics_t>> g_hook_metrics;
+static std::mutex g_pause_model_mutex;
+static PauseModel g_pause_model;
+// Contexts of the intercepted methods, reused with their stub when a method is intercepted again.
+// NOTE: They are only freed once their class is unloaded (see `ReleaseUnloadedInterceptors`),
+//       since a stub may still be running after its hook is detached or fails to attach.
+static std::mutex g_interceptors_mutex;
+static std::unordered_map<jmethodID, std::unique_ptr<interceptor_t>> g_interceptors;
+// Hooked methods and their originals, for JNIHook_GetOriginal and JNIHook_IsHooked.
+// A hook is published before it is registered, so it is found as soon as it can run.
+static HookTable g_hook_table;
 
 static std::string
 get_class_signature(jvmtiEnv *jvmti, jclass clazz)
@@ -113,6 +206,101 @@ get_class_name(JNIEnv *env, jclass clazz)
         return name;
 }
 
+// Retrieves the identity of a class, tagging the class if it has none yet
+// NOTE: Returns 0 on failure
+static class_id_t
+GetClassId(JNIEnv *env, jclass clazz)
+{
+        jlong tag;
+
+        if (g_jnihook->jvmti->GetTag(clazz, &tag) != JVMTI_ERROR_NONE)
+                return 0;
+
+        if (tag != 0)
+                return tag;
+
+        std::lock_guard<std::mutex> lock(g_tag_mutex);
+
+        // Another thread may have tagged the class in the meantime
+        if (g_jnihook->jvmti->GetTag(clazz, &tag) != JVMTI_ERROR_NONE)
+                return 0;
+
+        if (tag != 0)
+                return tag;
+
+        auto clazz_name = get_class_name(env, clazz);
+        if (clazz_name.length() == 0)
+                return 0;
+
+        auto clazz_ref = env->NewWeakGlobalRef(clazz);
+        if (!clazz_ref)
+                return 0;
+
+        tag = g_next_class_id;
+        if (g_jnihook->jvmti->SetTag(clazz, tag) != JVMTI_ERROR_NONE) {
+                env->DeleteWeakGlobalRef(clazz_ref);
+                return 0;
+        }
+
+        ++g_next_class_id;
+
+        std::lock_guard<std::mutex> registry_lock(g_registry_mutex);
+        g_class_names[tag] = clazz_name;
+        g_class_refs[tag] = clazz_ref;
+
+        return tag;
+}
+
+static std::string
+GetClassName(class_id_t clazz_id)
+{
+        std::lock_guard<std::mutex> lock(g_registry_mutex);
+
+        auto it = g_class_names.find(clazz_id);
+        return it != g_class_names.end() ? it->second : "";
+}
+
+static class_shard_t &
+ClassShard(class_id_t clazz_id)
+{
+        return g_class_shards[static_cast<uint64_t>(clazz_id) % CLASS_SHARDS];
+}
+
+static void
+SetInstalledHash(class_id_t clazz_id, uint64_t hash)
+{
+        std::lock_guard<std::mutex> lock(g_registry_mutex);
+
+        g_installed_hashes[clazz_id] = hash;
+}
+
+// Hooks placed on a class
+// NOTE: The shard of the class must be locked
+static std::vector<hook_info_t> &
+ClassHooks(class_id_t clazz_id)
+{
+        return ClassShard(clazz_id).hooks[clazz_id];
+}
+
+// Locks the shards of many classes, in ascending order so that callers can't deadlock
+static std::vector<std::unique_lock<std::mutex>>
+LockClassShards(const std::vector<class_id_t> &class_ids)
+{
+        std::vector<size_t> shards;
+        std::vector<std::unique_lock<std::mutex>> locks;
+
+        for (auto clazz_id : class_ids)
+                shards.push_back(static_cast<uint64_t>(clazz_id) % CLASS_SHARDS);
+
+        std::sort(shards.begin(), shards.end());
+        shards.erase(std::unique(shards.begin(), shards.end()), shards.end());
+
+        for (auto shard : shards)
+                locks.emplace_back(g_class_shards[shard].mutex);
+
+        return locks;
+}
+
 static std::unique_ptr<method_info_t>
 get_method_info(jvmtiEnv *jvmti, jmethodID method)
 {
@@ -135,12 +323,158 @@ get_method_info(jvmtiEnv *jvmti, jmethodID method)
         return std::make_unique<method_info_t>(method_info_t { name_str, signature_str, access_flags });
 }
 
-static std::string
-get_copy_method_name(const std::string &method_name)
+// Methods currently hooked in a class
+// NOTE: The shard of the class must be locked
+static std::vector<method_info_t>
+GetClassHooks(class_id_t clazz_id)
+{
+        std::vector<method_info_t> methods;
+
+        for (auto &hk_info : ClassHooks(clazz_id))
+                methods.push_back(hk_info.method_info);
+
+        return methods;
+}
+
+// Publishes the hooked methods of a class for the ClassFileLoadHook
+// and returns the ones that were published before
+static std::vector<method_info_t>
+SetClassPatches(class_id_t clazz_id, std::vector<method_info_t> methods)
+{
+        std::string clazz_name = methods.empty() ? "" : GetClassName(clazz_id);
+        std::lock_guard<std::mutex> lock(g_class_patches_mutex);
+        std::vector<method_info_t> previous;
+
+        if (auto it = g_class_patches.find(clazz_id); it != g_class_patches.end()) {
+                previous = std::move(it->second);
+                g_class_patches.erase(it);
+        }
+
+        if (!methods.empty()) {
+                g_class_patches_filter.insert(clazz_name);
+                g_class_patches[clazz_id] = std::move(methods);
+        }
+
+        return previous;
+}
+
+// Retrieves the published hooked methods of a class.
+// Classes that were never hooked are rejected by their internal name with
+// the Bloom filter, without locking. The others are looked up by their tag.
+static bool
+GetClassPatches(jvmtiEnv *jvmti_env, const char *name, jclass clazz, std::vector<method_info_t> &methods)
+{
+        jlong clazz_id;
+
+        if (!name || !g_class_patches_filter.may_contain(name))
+                return false;
+
+        if (jvmti_env->GetTag(clazz, &clazz_id) != JVMTI_ERROR_NONE || clazz_id == 0)
+                return false;
+
+        std::lock_guard<std::mutex> lock(g_class_patches_mutex);
+
+        auto it = g_class_patches.find(clazz_id);
+        if (it == g_class_patches.end())
+                return false;
+
+        methods = it->second;
+        return true;
+}
+
+// Identifies a set of hooked methods. The patched class file only depends
+// on which methods are hooked, so the order of the hooks does not matter.
+static uint64_t
+HookSetHash(const std::vector<method_info_t> &hooked_methods)
+{
+        std::vector<std::string> keys;
+        std::string joined;
+
+        for (auto &minfo : hooked_methods)
+                keys.push_back(minfo.name + minfo.signature);
+
+        std::sort(keys.begin(), keys.end());
+        keys.erase(std::unique(keys.begin(), keys.end()), keys.end());
+
+        for (auto &key : keys) {
+                joined += key;
+                joined.push_back('\0');
+        }
+
+        return ContentHash(joined.data(), joined.size());
+}
+
+// Patches up a class from the bytes given to the ClassFileLoadHook, using
+// the published hooks (JNIHOOK_INIT_RETRANSFORM and JNIHOOK_INIT_PERSISTENT)
+void
+TransformClass(jvmtiEnv *jvmti_env,
+               const char *name,
+               jclass clazz,
+               jint class_data_len,
+               const unsigned char *class_data,
+               jint *new_class_data_len,
+               unsigned char **new_class_data)
 {
-        static std::string uuid = GenerateUuid();
+        std::vector<method_info_t> hooked_methods;
+
+        // Unhooked classes are left as they are, which restores them
+        if (!GetClassPatches(jvmti_env, name, clazz, hooked_methods))
+                return;
+
+        // NOTE: Exceptions can't be thrown through the JVM, so a class that fails
+        //       to be patched is left unchanged (registering its hooks will fail)
+        try {
+                std::vector<u1> class_bytes;
+                uint64_t content_hash = 0;
+                uint64_t hookset_hash = 0;
+                bool archived = false;
+
+                if (g_class_archive.is_open()) {
+                        content_hash = ContentHash(class_data, class_data_len);
+                        hookset_hash = HookSetHash(hooked_methods);
+                        archived = g_class_archive.find(content_hash, hookset_hash, class_bytes);
+                }
+
+                if (!archived) {
+                        std::unique_ptr<ClassFile> cf;
+                        {
+                                StatsTimer timer(JNIHOOK_PHASE_PARSE);
+                                cf = ClassFile::parse((u1 *)class_data, class_data_len);
+                        }
+                        if (!cf)
+                                return;
+
+                        // The bytes may already be patched (e.g. when another agent
+                        // retransforms a class that JNIHook has redefined)
+                        if (PatchClassFile(cf.get(), hooked_methods, g_copy_suffix) == 0)
+                                return;
+
+                        {
+                                StatsTimer timer(JNIHOOK_PHASE_SERIALIZE);
+                                class_bytes = cf->toBytes();
+                        }
+
+                        if (g_class_archive.is_open())
+                                g_class_archive.store(content_hash, hookset_hash, class_bytes.data(), class_bytes.size());
+                }
+
+                unsigned char *bytes;
+                if (jvmti_env->Allocate(class_bytes.size(), &bytes) != JVMTI_ERROR_NONE) {
+                        LOG("ERR: Failed to allocate transformed class\n");
+                        return;
+                }
 
-        return method_name + "_____jnihook_" + uuid;
+                memcpy(bytes, class_bytes.data(), class_bytes.size());
+                *new_class_data = bytes;
+                *new_class_data_len = static_cast<jint>(class_bytes.size());
+
+                StatsAdd(g_stats.bytes_serialized, class_bytes.size());
+                StatsAdd(g_stats.classes_transformed, 1);
+        } catch (jnif::Exception ex) {
+                LOG("ERR: JNIF exception thrown while transforming class -> %s\n", ex.message.c_str());
+        } catch (...) {
+                LOG("ERR: Unhandled exception thrown while transforming class\n");
+        }
 }
 
 void JNICALL JNIHook_ClassFileLoadHook(jvmtiEnv *jvmti_env,
@@ -154,16 +488,63 @@ void JNICALL JNIHook_ClassFileLoadHook(jvmtiEnv *jvmti_env,
                                        jint* new_class_data_len,
                                        unsigned char** new_class_data)
 {
-        auto class_name = get_class_name(jni_env, class_being_redefined);
+        // Classes being loaded for the first time can't be hooked yet
+        // NOTE: This also keeps `get_class_name` from throwing on a NULL class
+        if (!class_being_redefined)
+                return;
+
+        // While the hook stays enabled, the hooked classes are patched whenever they
+        // are retransformed or redefined (by JNIHook in retransform mode, by anyone
+        // in persistent mode). Other classes are rejected by name, without JNI calls.
+        if ((g_init_flags & (JNIHOOK_INIT_RETRANSFORM | JNIHOOK_INIT_PERSISTENT)) && !t_caching) {
+                // The bytes of our own redefinitions are already patched
+                if (!t_redefining)
+                        TransformClass(jvmti_env, name, class_being_redefined, class_data_len, class_data, new_class_data_len, new_class_data);
+                return;
+        }
+
+        // Classes are only cached on the thread that asked for it (see `CacheClass`),
+        // the redefinitions of other threads (and other agents) are left alone
+        if (!t_caching)
+                return;
 
-        // Don't do anything for unhooked classes
-        // (unless g_force_class_caching is true)
-        if (class_name == "" || (g_hooks.find(class_name) == g_hooks.end() || g_hooks[class_name].size() == 0) && !g_force_class_caching)
+        // Only the classes tagged by JNIHook can be hooked
+        jlong clazz_id;
+        if (jvmti_env->GetTag(class_being_redefined, &clazz_id) != JVMTI_ERROR_NONE || clazz_id == 0)
                 return;
 
         // Cache parsed ClassFile if it's not cached yet
-        if (g_class_file_cache.find(class_name) == g_class_file_cache.end()) {
-                auto cf = ClassFile::parse((u1 *)class_data, class_data_len);
+        if (!g_class_file_cache.contains(clazz_id)) {
+                // Batched caching only captures the bytes here,
+                // they are parsed in parallel after the retransformation
+                if (t_captured_classes) {
+                        t_captured_classes->emplace(clazz_id, std::vector<u1>(class_data, &class_data[class_data_len]));
+                        return;
+                }
+
+                // Classes with the same bytes (e.g. loaded by other class loaders) share their cached class file
+                auto hash = ContentHash(class_data, class_data_len);
+                if (g_class_file_cache.share(clazz_id, hash, class_data, class_data_len)) {
+                        SetInstalledHash(clazz_id, hash);
+                        StatsAdd(g_stats.classes_cached, 1);
+                        return;
+                }
+
+                std::vector<u1> class_bytes(class_data, &class_data[class_data_len]);
+
+                // With a class archive, the class file is only parsed if it has to be patched
+                if (g_class_archive.is_open()) {
+                        g_class_file_cache.insert(clazz_id, hash, nullptr, std::move(class_bytes));
+                        SetInstalledHash(clazz_id, hash);
+                        StatsAdd(g_stats.classes_cached, 1);
+                        return;
+                }
+
+                std::unique_ptr<ClassFile> cf;
+                {
+                        StatsTimer timer(JNIHOOK_PHASE_PARSE);
+                        cf = ClassFile::parse(class_bytes.data(), class_bytes.size());
+                }
                 if (!cf)
                         return;
 
@@ -188,113 +569,344 @@ void JNICALL JNIHook_ClassFileLoadHook(jvmtiEnv *jvmti_env,
                 LOG("Class file parse check: %s\n", check ? "OK" : "BAD");
                 // cf->dump("/tmp/ORIG.class");
 #endif
-                g_class_file_cache[class_name] = std::move(cf);
+                g_class_file_cache.insert(clazz_id, hash, std::move(cf), std::move(class_bytes));
+                SetInstalledHash(clazz_id, hash);
+                StatsAdd(g_stats.classes_cached, 1);
         }
 
         return;
 }
 
-// Patches up a class with the current hooks (if any)
-// and redefines it using JVMTI
+// Generates the bytes of a copy of a cached class file patched with the given hooks.
+// It only reads the cached class file, so it can run on any thread.
+static jnihook_result_t
+GenerateClassBytes(ClassFile *cached_cf, const std::vector<method_info_t> &hooked_methods, std::vector<u1> &class_bytes)
+{
+        std::unique_ptr<ClassFile> cf;
+        {
+                StatsTimer timer(JNIHOOK_PHASE_CLONE);
+                cf = cached_cf->clone();
+        }
+
+        PatchClassFile(cf.get(), hooked_methods, g_copy_suffix);
+
+        {
+                StatsTimer timer(JNIHOOK_PHASE_SERIALIZE);
+                class_bytes = cf->toBytes();
+        }
+        StatsAdd(g_stats.bytes_serialized, class_bytes.size());
+
+#ifdef JNIHOOK_DEBUG
+        std::stringstream ss;
+        LOG("===== CLASS PREPARED =====\n");
+        ss << *cf;
+        LOG("%s\n", ss.str().c_str());
+        LOG("==========================\n");
+#endif
+
+        return JNIHOOK_OK;
+}
+
+// Patches up many cached classes with their current hooks (if any)
+// and generates the bytes of the resulting class files.
+// The classes are looked up in the cache and in the hooks serially, and then
+// cloned, patched and serialized in parallel on the thread pool.
+// Classes that share their cached class file (see `ClassCache`) and their hooks
+// are only patched once, and the last patched result of each class file is reused.
+// The bytes and results are stored at the same index as the class identifier.
+// NOTE: With JNIHOOK_INIT_RETRANSFORM, no bytes are generated, since
+//       the classes are patched while they are retransformed
+// NOTE: The shards of the classes must be locked
+void
+PrepareClasses(const std::vector<class_id_t> &class_ids, std::vector<std::vector<u1>> &class_bytes, std::vector<jnihook_result_t> &results)
+{
+        std::vector<ClassFile *> cached_cfs(class_ids.size(), nullptr);
+        std::vector<std::vector<method_info_t>> class_hooks(class_ids.size());
+        std::vector<uint64_t> hooksets(class_ids.size());
+        std::vector<size_t> sources(class_ids.size()); // Class whose bytes are copied
+        std::map<std::pair<ClassFile *, uint64_t>, size_t> patched;
+        std::vector<size_t> generated;
+
+        class_bytes.assign(class_ids.size(), {});
+        results.assign(class_ids.size(), JNIHOOK_OK);
+
+        if (g_init_flags & JNIHOOK_INIT_RETRANSFORM)
+                return;
+
+        // NOTE: Every cached class file is pinned as it is looked up, since inflating
+        //       an entry (here or on another thread) may demote the others under a budget
+        for (size_t i = 0; i < class_ids.size(); ++i) {
+                auto clazz_id = class_ids[i];
+
+                class_hooks[i] = GetClassHooks(clazz_id);
+                hooksets[i] = HookSetHash(class_hooks[i]);
+                sources[i] = i;
+
+                if (g_class_file_cache.get_patched(clazz_id, hooksets[i], class_bytes[i]))
+                        continue;
+
+                // Class files found in the archive don't need to be parsed at all
+                if (g_class_archive.is_open() &&
+                    g_class_archive.find(g_class_file_cache.content_hash(clazz_id), hooksets[i], class_bytes[i]))
+                        continue;
+
+                // NOTE: Class files demoted by the cache budget are parsed again here
+                cached_cfs[i] = g_class_file_cache.acquire(clazz_id);
+                if (!cached_cfs[i]) {
+                        LOG("ERR: Failed to retrieve cached classfile\n");
+                        results[i] = JNIHOOK_ERR_CLASS_FILE_CACHE;
+                        continue;
+                }
+
+                auto [it, inserted] = patched.insert({ { cached_cfs[i], hooksets[i] }, i });
+                if (inserted)
+                        generated.push_back(i);
+                else
+                        sources[i] = it->second;
+        }
+
+        g_thread_pool.parallel_for(generated.size(), [&](size_t j) {
+                auto i = generated[j];
+
+                try {
+                        results[i] = GenerateClassBytes(cached_cfs[i], class_hooks[i], class_bytes[i]);
+                } catch (const Exception &ex) {
+                        LOG("ERR: Failed to patch class file: %s\n", ex.message.c_str());
+                        results[i] = JNIHOOK_ERR_CLASS_FILE_FORMAT;
+                } catch (...) {
+                        LOG("ERR: Failed to patch class file\n");
+                        results[i] = JNIHOOK_ERR_CLASS_FILE_FORMAT;
+                }
+        });
+
+        for (auto i : generated) {
+                if (results[i] != JNIHOOK_OK)
+                        continue;
+
+                g_class_file_cache.set_patched(class_ids[i], hooksets[i], class_bytes[i]);
+                g_class_archive.store(g_class_file_cache.content_hash(class_ids[i]), hooksets[i], class_bytes[i].data(), class_bytes[i].size());
+        }
+
+        for (size_t i = 0; i < class_ids.size(); ++i) {
+                if (sources[i] != i) {
+                        results[i] = results[sources[i]];
+                        class_bytes[i] = class_bytes[sources[i]];
+                        StatsAdd(g_stats.bytes_serialized, class_bytes[i].size());
+                }
+
+                if (cached_cfs[i])
+                        g_class_file_cache.unpin(class_ids[i]);
+        }
+}
+
+// Patches up a cached class with the current hooks (if any)
+// and generates the bytes of the resulting class file
 jnihook_result_t
-ReapplyClass(jclass clazz, std::string clazz_name)
+PrepareClass(class_id_t clazz_id, std::vector<u1> &class_bytes)
+{
+        std::vector<std::vector<u1>> prepared;
+        std::vector<jnihook_result_t> results;
+
+        PrepareClasses({ clazz_id }, prepared, results);
+        class_bytes = std::move(prepared[0]);
+
+        return results[0];
+}
+
+// Redefines classes with the bytes generated by `PrepareClass`
+// (or retransforms them, with JNIHOOK_INIT_RETRANSFORM)
+// NOTE: `g_redefine_mutex` must be held
+jnihook_result_t
+RedefinePreparedClasses(const std::vector<jvmtiClassDefinition> &class_definitions, const std::vector<class_id_t> &class_ids)
 {
-        jvmtiClassDefinition class_definition;
         jvmtiError err;
-        auto cf = g_class_file_cache[clazz_name]->clone();
-
-        // Patch class file
-        // NOTE: The `methods` attribute only has the methods defined by the main class of this ClassFile
-        //       Method references are not included here
-        //       If the source file has more than one class, they are compiled as separate ClassFiles
-        for (auto &method : cf->methods) {
-                auto name = method.getName();
-                auto descriptor = method.getDesc();
-
-                // Check if the current method is a method that should be hooked
-                // TODO: Use hashmap for faster lookup
-                bool should_hook = false;
-                for (auto &hk_info : g_hooks[clazz_name]) {
-                        auto &minfo = hk_info.method_info;
-                        if (minfo.name == name && minfo.signature == descriptor) {
-                                should_hook = true;
-                                break;
+
+        // Publish the hooks being applied before the ClassFileLoadHook runs for these classes
+        std::vector<std::vector<method_info_t>> previous_patches;
+        for (auto clazz_id : class_ids)
+                previous_patches.push_back(SetClassPatches(clazz_id, GetClassHooks(clazz_id)));
+
+        // Leave out the classes whose new bytes are already installed
+        // (e.g. detaching a method that was not hooked), since every
+        // redefinition costs a safepoint and deoptimizes the dependents
+        bool track_hashes = !(g_init_flags & (JNIHOOK_INIT_RETRANSFORM | JNIHOOK_INIT_PERSISTENT));
+        std::vector<jvmtiClassDefinition> changed_definitions;
+        std::vector<std::pair<class_id_t, uint64_t>> changed_hashes;
+        if (track_hashes) {
+                changed_definitions.reserve(class_definitions.size());
+                changed_hashes.reserve(class_definitions.size());
+                std::lock_guard<std::mutex> lock(g_registry_mutex);
+                for (size_t i = 0; i < class_definitions.size(); ++i) {
+                        auto &class_definition = class_definitions[i];
+                        auto hash = ContentHash(class_definition.class_bytes, class_definition.class_byte_count);
+
+                        if (auto it = g_installed_hashes.find(class_ids[i]); it != g_installed_hashes.end() && it->second == hash) {
+                                StatsAdd(g_stats.content_hash_hits, 1);
+                                continue;
                         }
+
+                        changed_definitions.push_back(class_definition);
+                        changed_hashes.push_back({ class_ids[i], hash });
                 }
-                if (!should_hook)
-                        continue;
 
-                // New method
-                auto copyName = get_copy_method_name(name);
-                u2 copyflags = Method::PRIVATE | Method::FINAL;
-                if (method.accessFlags & Method::STATIC){
-                        copyflags |= Method::STATIC;
-                }
-                auto &copyMethod = cf->addMethod(copyName.c_str(), descriptor, copyflags);
-
-                // Set method to native
-                *(u2 *)&method.accessFlags |= Method::NATIVE;
-
-                // Remove "Code" attribute
-                for (size_t i = 0; i < method.attrs.size(); ++i) {
-                        auto &attr = method.attrs[i];
-                        copyMethod.attrs.add((Attr *)&attr); // Copy method should inherit all the attributes
-                                                             // from the original method
-                        if (attr.kind == ATTR_CODE) {
-                                method.attrs.remove(i);
-                                break;
-                        }
+                if (changed_definitions.empty()) {
+                        StatsAdd(g_stats.redefinitions_skipped, 1);
+                        return JNIHOOK_OK;
                 }
         }
 
-        // Redefine class with modified ClassFile
-        auto cf_bytes = cf->toBytes();
+        if (g_init_flags & JNIHOOK_INIT_RETRANSFORM) {
+                std::vector<jclass> classes;
+
+                for (auto &class_definition : class_definitions)
+                        classes.push_back(class_definition.klass);
+
+                StatsTimer timer(JNIHOOK_PHASE_REDEFINE);
+                err = g_jnihook->jvmti->RetransformClasses(classes.size(), classes.data());
+        } else {
+                auto &definitions = track_hashes ? changed_definitions : class_definitions;
+
+                StatsTimer timer(JNIHOOK_PHASE_REDEFINE);
+                t_redefining = true;
+                err = g_jnihook->jvmti->RedefineClasses(definitions.size(), definitions.data());
+                t_redefining = false;
+        }
 
-        class_definition.klass = clazz;
-        class_definition.class_byte_count = cf_bytes.size();
-        class_definition.class_bytes = cf_bytes.data();
-        err = g_jnihook->jvmti->RedefineClasses(1, &class_definition);
-        std::stringstream ss;
-        LOG("===== CLASS REAPPLIED =====\n");
-        ss << *cf;
-        LOG("%s\n", ss.str().c_str());
-        LOG("===========================\n");
         if (err != JVMTI_ERROR_NONE) {
-                LOG("ERR: JVMTI error in ReapplyClass: %d\n", err);
+                LOG("ERR: JVMTI error in RedefineClasses: %d\n", err);
                 // cf->dump("/tmp/DUMP.class");
+                for (size_t i = 0; i < class_ids.size(); ++i)
+                        SetClassPatches(class_ids[i], std::move(previous_patches[i]));
                 return JNIHOOK_ERR_JVMTI_OPERATION;
         }
 
+        for (auto &[clazz_id, hash] : changed_hashes)
+                SetInstalledHash(clazz_id, hash);
+
+        StatsAdd(g_stats.classes_redefined, track_hashes ? changed_definitions.size() : class_definitions.size());
+
         return JNIHOOK_OK;
 }
 
+// Patches up a class with the current hooks (if any)
+// and redefines it using JVMTI
+jnihook_result_t
+ReapplyClass(jclass clazz, class_id_t clazz_id)
+{
+        std::vector<u1> class_bytes;
+        jnihook_result_t result;
+
+        if (result = PrepareClass(clazz_id, class_bytes); result != JNIHOOK_OK)
+                return result;
+
+        jvmtiClassDefinition class_definition;
+        class_definition.klass = clazz;
+        class_definition.class_byte_count = class_bytes.size();
+        class_definition.class_bytes = class_bytes.data();
+
+        std::lock_guard<std::recursive_mutex> lock(g_redefine_mutex);
+        return RedefinePreparedClasses({ class_definition }, { clazz_id });
+}
+
+// Whether a class has been hooked at some point
+// (its methods may need to be restored)
+// NOTE: The shard of the class must be locked
+bool
+WasClassHooked(class_id_t clazz_id)
+{
+        if (g_init_flags & JNIHOOK_INIT_RETRANSFORM)
+                return ClassShard(clazz_id).hooks.count(clazz_id) > 0;
+
+        return g_class_file_cache.contains(clazz_id);
+}
+
+// Amount of methods declared by a class, used to predict its redefinition pause
+size_t
+CountClassMethods(jclass clazz, class_id_t clazz_id)
+{
+        // NOTE: With a class archive, the cached class file may not be parsed yet
+        if (!(g_init_flags & JNIHOOK_INIT_RETRANSFORM) && !g_class_archive.is_open()) {
+                if (auto cf = g_class_file_cache.acquire(clazz_id)) {
+                        size_t method_count = cf->methods.size();
+                        g_class_file_cache.unpin(clazz_id);
+                        return method_count;
+                }
+        }
+
+        jint method_count;
+        jmethodID *methods;
+        if (g_jnihook->jvmti->GetClassMethods(clazz, &method_count, &methods) != JVMTI_ERROR_NONE)
+                return 0;
+
+        g_jnihook->jvmti->Deallocate(reinterpret_cast<unsigned char *>(methods));
+
+        return static_cast<size_t>(method_count);
+}
+
+// Enables the ClassFileLoadHook for a caller that caches classes. It stays
+// enabled until the last caller releases it, since they may run concurrently.
+static bool
+AcquireClassFileLoadHook()
+{
+        std::lock_guard<std::mutex> lock(g_load_hook_mutex);
+
+        if (g_load_hook_users == 0 &&
+            g_jnihook->jvmti->SetEventNotificationMode(JVMTI_ENABLE, JVMTI_EVENT_CLASS_FILE_LOAD_HOOK, NULL) != JVMTI_ERROR_NONE)
+                return false;
+
+        ++g_load_hook_users;
+        return true;
+}
+
+// NOTE: We disable the ClassFileLoadHook here because it breaks
+//       any `env->DefineClass()` calls. Also, it's not necessary
+//       to keep it active at all times, we just have to use it for caching
+//       classes that havent been cached yet.
+// TODO: Investigate why it breaks it (possibly NullPointerException in
+//       JNIHook_ClassFileLoadHook)
+// NOTE: In persistent mode, the hook stays enabled to keep the classes patched
+static bool
+ReleaseClassFileLoadHook()
+{
+        std::lock_guard<std::mutex> lock(g_load_hook_mutex);
+
+        if (--g_load_hook_users > 0 || (g_init_flags & JNIHOOK_INIT_PERSISTENT))
+                return true;
+
+        return g_jnihook->jvmti->SetEventNotificationMode(JVMTI_DISABLE, JVMTI_EVENT_CLASS_FILE_LOAD_HOOK, NULL) == JVMTI_ERROR_NONE;
+}
+
 // Stores a loaded class in the class cache
+// NOTE: The shard of the class must be locked
 jnihook_result_t
 CacheClass(JNIEnv *env, jclass clazz)
 {
-        std::string clazz_name = get_class_name(env, clazz);
+        // The JVM keeps the original bytes of retransformable classes by itself
+        if (g_init_flags & JNIHOOK_INIT_RETRANSFORM)
+                return JNIHOOK_OK;
 
-        if (g_class_file_cache.find(clazz_name) == g_class_file_cache.end()) {
-                if (g_jnihook->jvmti->SetEventNotificationMode(JVMTI_ENABLE, JVMTI_EVENT_CLASS_FILE_LOAD_HOOK, NULL) != JVMTI_ERROR_NONE) {
+        class_id_t clazz_id = GetClassId(env, clazz);
+        if (!clazz_id) {
+                LOG("ERR: Failed to tag class\n");
+                return JNIHOOK_ERR_JVMTI_OPERATION;
+        }
+
+        if (!g_class_file_cache.contains(clazz_id)) {
+                if (!AcquireClassFileLoadHook()) {
                         LOG("ERR: Failed to enable class file load hook\n");
                         return JNIHOOK_ERR_SETUP_CLASS_FILE_LOAD_HOOK;
                 }
 
-                // Enable forceful caching of classfiles
-                // WARN: If something goes wrong, every class
-                // that goes through the ClassFileLoadHook
-                // would get cached! May waste a ton of memory.
-                g_force_class_caching = true;
-                auto result = g_jnihook->jvmti->RetransformClasses(1, &clazz);
-                g_force_class_caching = false;
-
-                // NOTE: We disable the ClassFileLoadHook here because it breaks
-                //       any `env->DefineClass()` calls. Also, it's not necessary
-                //       to keep it active at all times, we just have to use it for caching
-                //       classes that havent been cached yet.
-                // TODO: Investigate why it breaks it (possibly NullPointerException in
-                //       JNIHook_ClassFileLoadHook)
-                if (g_jnihook->jvmti->SetEventNotificationMode(JVMTI_DISABLE, JVMTI_EVENT_CLASS_FILE_LOAD_HOOK, NULL) != JVMTI_ERROR_NONE) {
+                // The ClassFileLoadHook only caches the classes retransformed by this thread
+                t_caching = true;
+                jvmtiError result;
+                {
+                        StatsTimer timer(JNIHOOK_PHASE_CACHE);
+                        result = g_jnihook->jvmti->RetransformClasses(1, &clazz);
+                }
+                t_caching = false;
+
+                if (!ReleaseClassFileLoadHook()) {
                         LOG("ERR: Failed to disable class file load hook\n");
                         return JNIHOOK_ERR_SETUP_CLASS_FILE_LOAD_HOOK;
                 }
@@ -304,7 +916,7 @@ CacheClass(JNIEnv *env, jclass clazz)
                         return JNIHOOK_ERR_CLASS_FILE_CACHE;
                 }
 
-                if (g_class_file_cache.find(clazz_name) == g_class_file_cache.end()) {
+                if (!g_class_file_cache.contains(clazz_id)) {
                         LOG("ERR: Failed to cache classfile\n");
                         return JNIHOOK_ERR_CLASS_FILE_CACHE;
                 }
@@ -313,47 +925,190 @@ CacheClass(JNIEnv *env, jclass clazz)
         return JNIHOOK_OK;
 }
 
-// Copy a class and its inner classes
-// (no longer used)
-/*
+// Stores many loaded classes in the class cache with a single retransformation.
+// The captured class files are parsed in parallel afterwards.
+// The classes are locked while they are cached, since their hooks may be placed concurrently.
 jnihook_result_t
-CopyClass(JNIEnv *env, jclass clazz, const std::string &new_class_name, std::string nest_host="", std::string old_nest_host="")
+CacheClasses(JNIEnv *env, const std::vector<jclass> &classes)
 {
-        jnihook_result_t result;
-        auto clazz_name = get_class_name(env, clazz);
-        std::map<jclass, std::string> additional_classes_to_copy = {};
-        jobject class_loader;
+        jnihook_result_t result = JNIHOOK_OK;
+        std::vector<jclass> modifiable_classes;
+        std::vector<class_id_t> class_ids;
+        std::vector<jclass> uncached;
+        std::unordered_set<class_id_t> seen;
+
+        // The JVM keeps the original bytes of retransformable classes by itself
+        if (g_init_flags & JNIHOOK_INIT_RETRANSFORM)
+                return JNIHOOK_OK;
 
-        LOG("Copying class '%s' to: %s\n", clazz_name.c_str(), new_class_name.c_str());
+        for (auto clazz : classes) {
+                jboolean modifiable = JNI_FALSE;
 
-        // Cache class being copied
-        result = CacheClass(env, clazz);
-        if (result != JNIHOOK_OK)
-                return result;
+                // A single unmodifiable class would make the whole retransformation fail
+                if (g_jnihook->jvmti->IsModifiableClass(clazz, &modifiable) != JVMTI_ERROR_NONE || !modifiable) {
+                        result = JNIHOOK_ERR_CLASS_FILE_CACHE;
+                        continue;
+                }
 
-        // Find inner classes
-        auto &cf = g_class_file_cache[clazz_name];
-        for (auto &attr : cf->attrs) {
-                if (attr->kind == jnif::model::ATTR_NESTMEMBERS) {
-                        auto nested_members_attr = (NestMembersAttr *)attr;
+                class_id_t clazz_id = GetClassId(env, clazz);
+                if (!clazz_id) {
+                        result = JNIHOOK_ERR_JVMTI_OPERATION;
+                        continue;
+                }
 
-                        for (auto &class_index : nested_members_attr->classes) {
-                                auto inner_name = std::string(nested_members_attr->constPool->getClassName(class_index));
-                                auto inner_clazz = env->FindClass(inner_name.c_str());
+                modifiable_classes.push_back(clazz);
+                class_ids.push_back(clazz_id);
+        }
 
-                                result = CacheClass(env, inner_clazz);
-                                if (result != JNIHOOK_OK)
-                                        return result;
+        auto shard_locks = LockClassShards(class_ids);
 
-                                // Add inner class for copy
-                                // WARN: Assumes that the inner class name
-                                //       starts with the original class name
-                                inner_name.replace(0, clazz_name.length(), new_class_name);
-                                additional_classes_to_copy.insert({ inner_clazz, inner_name });
-                        }
+        for (size_t i = 0; i < class_ids.size(); ++i) {
+                if (!g_class_file_cache.contains(class_ids[i]) && seen.insert(class_ids[i]).second)
+                        uncached.push_back(modifiable_classes[i]);
+        }
 
-                        // NestMembers can only happen once per class
-                        break;
+        if (uncached.empty())
+                return result;
+
+        if (!AcquireClassFileLoadHook()) {
+                LOG("ERR: Failed to enable class file load hook\n");
+                return JNIHOOK_ERR_SETUP_CLASS_FILE_LOAD_HOOK;
+        }
+
+        std::unordered_map<class_id_t, std::vector<u1>> captured;
+        t_caching = true;
+        t_captured_classes = &captured;
+        jvmtiError err;
+        {
+                StatsTimer timer(JNIHOOK_PHASE_CACHE);
+                err = g_jnihook->jvmti->RetransformClasses(uncached.size(), uncached.data());
+        }
+        t_captured_classes = nullptr;
+        t_caching = false;
+
+        if (!ReleaseClassFileLoadHook()) {
+                LOG("ERR: Failed to disable class file load hook\n");
+                return JNIHOOK_ERR_SETUP_CLASS_FILE_LOAD_HOOK;
+        }
+
+        if (err != JVMTI_ERROR_NONE) {
+                LOG("ERR: Failed to cache classfiles (JVMTI error: %d)\n", err);
+                return JNIHOOK_ERR_CLASS_FILE_CACHE;
+        }
+
+        if (captured.size() != uncached.size()) {
+                LOG("ERR: Failed to capture %zu classfiles\n", uncached.size() - captured.size());
+                result = JNIHOOK_ERR_CLASS_FILE_CACHE;
+        }
+
+        // Only parse one copy of each distinct class file. The classes whose bytes are
+        // already cached (or captured earlier in this batch) share that class file.
+        std::vector<std::pair<const class_id_t, std::vector<u1>> *> items;
+        std::vector<uint64_t> hashes;
+        std::vector<std::pair<class_id_t, uint64_t>> duplicates;
+        std::unordered_map<uint64_t, std::vector<u1> *> batch_contents;
+        for (auto &item : captured) {
+                auto &bytes = item.second;
+                auto hash = ContentHash(bytes.data(), bytes.size());
+
+                if (g_class_file_cache.share(item.first, hash, bytes.data(), bytes.size())) {
+                        SetInstalledHash(item.first, hash);
+                        StatsAdd(g_stats.classes_cached, 1);
+                        continue;
+                }
+
+                if (auto it = batch_contents.find(hash); it != batch_contents.end() && *it->second == bytes) {
+                        duplicates.push_back({ item.first, hash });
+                        continue;
+                }
+
+                batch_contents.insert({ hash, &bytes });
+                items.push_back(&item);
+                hashes.push_back(hash);
+        }
+
+        // With a class archive, the class files are only parsed if they have to be patched
+        bool deferred = g_class_archive.is_open();
+        std::vector<std::unique_ptr<ClassFile>> parsed(items.size());
+        g_thread_pool.parallel_for(deferred ? 0 : items.size(), [&items, &parsed](size_t i) {
+                auto &bytes = items[i]->second;
+
+                try {
+                        StatsTimer timer(JNIHOOK_PHASE_PARSE);
+                        parsed[i] = ClassFile::parse(bytes.data(), bytes.size());
+                } catch (...) {
+                        parsed[i] = nullptr;
+                }
+        });
+
+        for (size_t i = 0; i < items.size(); ++i) {
+                if (!parsed[i] && !deferred) {
+                        result = JNIHOOK_ERR_CLASS_FILE_FORMAT;
+                        continue;
+                }
+
+                g_class_file_cache.insert(items[i]->first, hashes[i], std::move(parsed[i]), std::move(items[i]->second));
+                SetInstalledHash(items[i]->first, hashes[i]);
+                StatsAdd(g_stats.classes_cached, 1);
+        }
+
+        for (auto &[clazz_id, hash] : duplicates) {
+                auto &bytes = captured[clazz_id];
+
+                // NOTE: This fails if the first copy of the class file could not be parsed
+                if (!g_class_file_cache.share(clazz_id, hash, bytes.data(), bytes.size())) {
+                        result = JNIHOOK_ERR_CLASS_FILE_FORMAT;
+                        continue;
+                }
+
+                SetInstalledHash(clazz_id, hash);
+                StatsAdd(g_stats.classes_cached, 1);
+        }
+
+        return result;
+}
+
+// Copy a class and its inner classes
+// (no longer used)
+/*
+jnihook_result_t
+CopyClass(JNIEnv *env, jclass clazz, const std::string &new_class_name, std::string nest_host="", std::string old_nest_host="")
+{
+        jnihook_result_t result;
+        auto clazz_name = get_class_name(env, clazz);
+        std::map<jclass, std::string> additional_classes_to_copy = {};
+        jobject class_loader;
+
+        LOG("Copying class '%s' to: %s\n", clazz_name.c_str(), new_class_name.c_str());
+
+        // Cache class being copied
+        result = CacheClass(env, clazz);
+        if (result != JNIHOOK_OK)
+                return result;
+
+        // Find inner classes
+        auto &cf = g_class_file_cache[clazz_name];
+        for (auto &attr : cf->attrs) {
+                if (attr->kind == jnif::model::ATTR_NESTMEMBERS) {
+                        auto nested_members_attr = (NestMembersAttr *)attr;
+
+                        for (auto &class_index : nested_members_attr->classes) {
+                                auto inner_name = std::string(nested_members_attr->constPool->getClassName(class_index));
+                                auto inner_clazz = env->FindClass(inner_name.c_str());
+
+                                result = CacheClass(env, inner_clazz);
+                                if (result != JNIHOOK_OK)
+                                        return result;
+
+                                // Add inner class for copy
+                                // WARN: Assumes that the inner class name
+                                //       starts with the original class name
+                                inner_name.replace(0, clazz_name.length(), new_class_name);
+                                additional_classes_to_copy.insert({ inner_clazz, inner_name });
+                        }
+
+                        // NestMembers can only happen once per class
+                        break;
                 }
         }
 
@@ -442,9 +1197,18 @@ CopyClass(JNIEnv *env, jclass clazz, const std::string &new_class_name, std::str
 }
 */
 
+void JNICALL JNIHook_ObjectFree(jvmtiEnv *jvmti_env, jlong tag);
+
 JNIHOOK_API jnihook_result_t JNIHOOK_CALL
 JNIHook_Init(JavaVM *jvm)
 {
+        return JNIHook_InitEx(jvm, 0);
+}
+
+JNIHOOK_API jnihook_result_t JNIHOOK_CALL
+JNIHook_InitEx(JavaVM *jvm, jint flags)
+{
+        std::unique_lock<std::shared_mutex> lock(g_init_mutex);
         jvmtiEnv *jvmti;
         jvmtiCapabilities capabilities = {};
         jvmtiEventCallbacks callbacks = {};
@@ -454,6 +1218,8 @@ JNIHook_Init(JavaVM *jvm)
                 return JNIHOOK_ERR_GET_JVMTI;
         }
 
+        capabilities.can_tag_objects = 1;
+        capabilities.can_generate_object_free_events = 1;
         capabilities.can_redefine_classes = 1;
         capabilities.can_redefine_any_class = 1;
         capabilities.can_retransform_classes = 1;
@@ -466,11 +1232,28 @@ JNIHook_Init(JavaVM *jvm)
         }
 
         callbacks.ClassFileLoadHook = JNIHook_ClassFileLoadHook;
+        callbacks.ObjectFree = JNIHook_ObjectFree;
         if (jvmti->SetEventCallbacks(&callbacks, sizeof(callbacks)) != JVMTI_ERROR_NONE) {
                 LOG("ERR: Failed to setup class file load hook");
                 return JNIHOOK_ERR_SETUP_CLASS_FILE_LOAD_HOOK;
         }
 
+        // Tagged classes that get unloaded are reported with ObjectFree
+        if (jvmti->SetEventNotificationMode(JVMTI_ENABLE, JVMTI_EVENT_OBJECT_FREE, NULL) != JVMTI_ERROR_NONE) {
+                LOG("ERR: Failed to enable object free events");
+                return JNIHOOK_ERR_JVMTI_OPERATION;
+        }
+
+        // In retransform and persistent modes, the hooks are applied by the
+        // ClassFileLoadHook, so it must be enabled for as long as JNIHook is running
+        if (flags & (JNIHOOK_INIT_RETRANSFORM | JNIHOOK_INIT_PERSISTENT)) {
+                if (jvmti->SetEventNotificationMode(JVMTI_ENABLE, JVMTI_EVENT_CLASS_FILE_LOAD_HOOK, NULL) != JVMTI_ERROR_NONE) {
+                        LOG("ERR: Failed to enable class file load hook");
+                        return JNIHOOK_ERR_SETUP_CLASS_FILE_LOAD_HOOK;
+                }
+        }
+
+        g_init_flags = flags;
         g_jnihook = std::make_unique<jnihook_t>(jnihook_t { jvm, jvmti });
 
         // Generate VM type hashmaps
@@ -523,30 +1306,44 @@ JNIHook_Init(JavaVM *jvm)
         return JNIHOOK_OK;
 }
 
-JNIHOOK_API jnihook_result_t JNIHOOK_CALL
-_JNIHook_Attach(jmethodID method, void *native_hook_method, jmethodID *original_method)
+// Wraps a native hook in a thunk that records its calls and durations
+static void *
+InstrumentHook(jmethodID method, void *native_hook_method, const std::string &label)
 {
+        std::lock_guard<std::mutex> lock(g_hook_metrics_mutex);
+
+        auto &metrics = g_hook_metrics[method];
+        if (!metrics) {
+                metrics = std::make_unique<hook_metrics_t>();
+                metrics->label = label;
+        }
+
+        return GenerateTimingThunk(native_hook_method, metrics.get());
+}
+
+typedef struct hook_target_t {
         jclass clazz;
+        class_id_t clazz_id;
         std::string clazz_name;
         hook_info_t hook_info;
-        JNIEnv *env;
-        jnihook_result_t result;
-
-        if (g_jnihook->jvm->GetEnv(reinterpret_cast<void **>(&env), JNI_VERSION_1_8)) {
-                LOG("ERR: Failed to get JNI\n");
-                return JNIHOOK_ERR_GET_JNI;
-        }
+        std::string copy_suffix; // Only set if the method was patched ahead of time
+} hook_target_t;
 
-        if (g_jnihook->jvmti->GetMethodDeclaringClass(method, &clazz) != JVMTI_ERROR_NONE) {
+// Looks up everything needed to place a hook on `method`
+static jnihook_result_t
+ResolveHook(JNIEnv *env, jmethodID method, void *native_hook_method, jint flags, hook_target_t &target)
+{
+        if (g_jnihook->jvmti->GetMethodDeclaringClass(method, &target.clazz) != JVMTI_ERROR_NONE) {
                 LOG("ERR: Failed to get declaring class of method\n");
                 return JNIHOOK_ERR_JVMTI_OPERATION;
         }
 
-        clazz_name = get_class_name(env, clazz);
-        if (clazz_name.length() == 0) {
-                LOG("ERR: Failed to get class name\n");
-                return JNIHOOK_ERR_JNI_OPERATION;
+        target.clazz_id = GetClassId(env, target.clazz);
+        if (!target.clazz_id) {
+                LOG("ERR: Failed to tag class\n");
+                return JNIHOOK_ERR_JVMTI_OPERATION;
         }
+        target.clazz_name = GetClassName(target.clazz_id);
 
         auto method_info = get_method_info(g_jnihook->jvmti, method);
         if (!method_info) {
@@ -554,209 +1351,1528 @@ _JNIHook_Attach(jmethodID method, void *native_hook_method, jmethodID *original_
                 return JNIHOOK_ERR_JVMTI_OPERATION;
         }
 
-        hook_info.method_info = *method_info;
-        hook_info.native_hook_method = native_hook_method;
+        if (flags & JNIHOOK_ATTACH_INSTRUMENTED) {
+                auto label = target.clazz_name + "." + method_info->name + method_info->signature;
 
-        // Force caching of the class being hooked
-        result = CacheClass(env, clazz);
-        if (result != JNIHOOK_OK)
-                return result;
+                native_hook_method = InstrumentHook(method, native_hook_method, label);
+                if (!native_hook_method) {
+                        LOG("ERR: Failed to generate instrumentation thunk\n");
+                        return JNIHOOK_ERR_UNSUPPORTED;
+                }
+        }
 
-        // Suspend other threads while the hook is being set up
-        jthread curthread;
-        jthread *threads;
-        jint thread_count;
+        target.hook_info.method_info = *method_info;
+        target.hook_info.native_hook_method = native_hook_method;
+
+        // The manifest only applies if the class was loaded from the patched jars
+        std::string copy_suffix;
+        {
+                std::lock_guard<std::mutex> lock(g_registry_mutex);
+
+                auto prepatched = g_prepatched_methods.find(target.clazz_name + "." + method_info->name + method_info->signature);
+                if (prepatched != g_prepatched_methods.end())
+                        copy_suffix = prepatched->second;
+        }
+
+        if (!copy_suffix.empty()) {
+                jboolean is_native = JNI_FALSE;
+
+                if (g_jnihook->jvmti->IsMethodNative(method, &is_native) == JVMTI_ERROR_NONE && is_native)
+                        target.copy_suffix = copy_suffix;
+        }
+
+        return JNIHOOK_OK;
+}
 
+typedef struct suspended_threads_t {
+        jthread current;
+        jthread *threads;
+        jint count;
+        uint64_t start;
+        std::unique_lock<std::recursive_mutex> lock; // `g_redefine_mutex`
+} suspended_threads_t;
+
+// Suspends every thread but the current one while classes are being redefined.
+// Only one thread suspends the others at a time, or they could suspend each other.
+static jnihook_result_t
+SuspendOtherThreads(JNIEnv *env, suspended_threads_t &suspended)
+{
+        suspended.lock = std::unique_lock<std::recursive_mutex>(g_redefine_mutex);
         env->PushLocalFrame(16);
 
-        if (g_jnihook->jvmti->GetCurrentThread(&curthread) != JVMTI_ERROR_NONE) {
+        if (g_jnihook->jvmti->GetCurrentThread(&suspended.current) != JVMTI_ERROR_NONE) {
                 LOG("ERR: Failed to get current thread\n");
+                env->PopLocalFrame(NULL);
+                suspended.lock.unlock();
                 return JNIHOOK_ERR_JVMTI_OPERATION;
         }
 
-        if (g_jnihook->jvmti->GetAllThreads(&thread_count, &threads) != JVMTI_ERROR_NONE) {
+        if (g_jnihook->jvmti->GetAllThreads(&suspended.count, &suspended.threads) != JVMTI_ERROR_NONE) {
                 LOG("ERR: Failed to get all threads\n");
+                env->PopLocalFrame(NULL);
+                suspended.lock.unlock();
                 return JNIHOOK_ERR_JVMTI_OPERATION;
         }
 
         // TODO: Only suspend/resume threads that are actually active
-        for (jint i = 0; i < thread_count; ++i) {
-                if (env->IsSameObject(threads[i], curthread))
+        suspended.start = StatsNow();
+        StatsTimer timer(JNIHOOK_PHASE_SUSPEND);
+        for (jint i = 0; i < suspended.count; ++i) {
+                if (env->IsSameObject(suspended.threads[i], suspended.current))
                         continue;
 
-                g_jnihook->jvmti->SuspendThread(threads[i]);
+                if (g_jnihook->jvmti->SuspendThread(suspended.threads[i]) == JVMTI_ERROR_NONE)
+                        StatsAdd(g_stats.threads_suspended, 1);
         }
 
-        // Apply current hooks
-        jnihook_result_t ret = JNIHOOK_ERR_JNI_OPERATION;
-        g_hooks[clazz_name].push_back(hook_info);
-        if (ret = ReapplyClass(clazz, clazz_name); ret != JNIHOOK_OK) {
-                LOG("ERR: Failed to reapply class\n");
-                g_hooks[clazz_name].pop_back();
-                goto RESUME_THREADS;
+        return JNIHOOK_OK;
+}
+
+// Resumes the threads suspended by `SuspendOtherThreads`
+// and returns for how long they were suspended
+static uint64_t
+ResumeOtherThreads(JNIEnv *env, suspended_threads_t &suspended)
+{
+        StatsTimer timer(JNIHOOK_PHASE_RESUME);
+        for (jint i = 0; i < suspended.count; ++i) {
+                if (env->IsSameObject(suspended.threads[i], suspended.current))
+                        continue;
+
+                g_jnihook->jvmti->ResumeThread(suspended.threads[i]);
         }
+        timer.stop();
+
+        uint64_t pause = StatsNow() - suspended.start;
+        StatsMax(g_stats.max_pause_ns, pause);
+
+        g_jnihook->jvmti->Deallocate(reinterpret_cast<unsigned char *>(suspended.threads));
+        env->PopLocalFrame(NULL);
+        suspended.lock.unlock();
+
+        return pause;
+}
 
-        // Register native method for JVM lookup
+// Publishes a hook before it is registered, so that it can look up its original method
+// as soon as it runs. Returns the entry that it replaces (an empty one if there was none).
+// NOTE: While the other threads are suspended, the caller must reclaim the table later
+static hook_entry_t
+PublishHookEntry(const hook_entry_t &entry, bool threads_suspended)
+{
+        hook_entry_t previous = {};
+
+        g_hook_table.find(entry.method, &previous);
+        g_hook_table.publish({ entry }, threads_suspended);
+
+        return previous;
+}
+
+// Withdraws the entry of a hook that could not be registered
+static void
+WithdrawHookEntry(jmethodID method, const hook_entry_t &previous, bool threads_suspended)
+{
+        if (previous.method)
+                g_hook_table.publish({ previous }, threads_suspended);
+        else
+                g_hook_table.retract({ method }, threads_suspended);
+}
+
+// Register native method for JVM lookup
+static jnihook_result_t
+RegisterHook(JNIEnv *env, jclass clazz, const hook_info_t &hook_info)
+{
         JNINativeMethod native_method;
-        native_method.name = const_cast<char *>(method_info->name.c_str());
-        native_method.signature = const_cast<char *>(method_info->signature.c_str());
-        native_method.fnPtr = native_hook_method;
+        native_method.name = const_cast<char *>(hook_info.method_info.name.c_str());
+        native_method.signature = const_cast<char *>(hook_info.method_info.signature.c_str());
+        native_method.fnPtr = hook_info.native_hook_method;
 
         if (env->RegisterNatives(clazz, &native_method, 1) < 0) {
                 LOG("ERR: Failed to register natives\n");
-                g_hooks[clazz_name].pop_back();
-                ReapplyClass(clazz, clazz_name); // Attempt to restore class to previous state
-                goto RESUME_THREADS;
+                return JNIHOOK_ERR_JNI_OPERATION;
         }
 
-RESUME_THREADS:
-        // Resume other threads, hook already placed succesfully
-        for (jint i = 0; i < thread_count; ++i) {
-                if (env->IsSameObject(threads[i], curthread))
-                        continue;
+        return JNIHOOK_OK;
+}
 
-                g_jnihook->jvmti->ResumeThread(threads[i]);
+// Looks up the copy of the original method added by `PrepareClass`
+// (or by jnihook-patch, with the copy suffix from its manifest)
+static jnihook_result_t
+GetOriginalMethod(JNIEnv *env, jclass clazz, const method_info_t &method_info, jmethodID *original_method,
+                  const std::string &copy_suffix = g_copy_suffix)
+{
+        jmethodID orig;
+        std::string name = method_info.name + copy_suffix;
+
+        if ((method_info.access_flags & Method::STATIC) == Method::STATIC) {
+                orig = env->GetStaticMethodID(clazz, name.c_str(),
+                                              method_info.signature.c_str());
+        } else {
+                orig = env->GetMethodID(clazz, name.c_str(),
+                                        method_info.signature.c_str());
         }
 
-        g_jnihook->jvmti->Deallocate(reinterpret_cast<unsigned char *>(threads));
-        env->PopLocalFrame(NULL);
+        *original_method = orig;
 
-        if (ret != JNIHOOK_OK)
-                return ret;
+        if (!orig || env->ExceptionOccurred()) {
+                LOG("ERR: Exception while getting original method '%s -> %s'\n", name.c_str(), method_info.signature.c_str());
+                env->ExceptionDescribe();
+                env->ExceptionClear();
+                return JNIHOOK_ERR_JAVA_EXCEPTION;
+        }
 
-        // Get original method
-        ret = JNIHOOK_OK;
-        if (original_method) {
-                jclass orig_class = clazz;
-                jmethodID orig;
-                std::string name = get_copy_method_name(method_info->name);
+        return JNIHOOK_OK;
+}
 
-                if ((method_info->access_flags & Method::STATIC) == Method::STATIC) {
-                        orig = env->GetStaticMethodID(orig_class, name.c_str(),
-                                                      method_info->signature.c_str());
-                } else {
-                        orig = env->GetMethodID(orig_class, name.c_str(),
-                                                method_info->signature.c_str());
-                }
+// Places a hook on a method that was patched ahead of time,
+// which is already native and has its copy, so no redefinition is needed
+static jnihook_result_t
+AttachPrepatched(JNIEnv *env, jmethodID method, const hook_target_t &target, jmethodID *original_method)
+{
+        jmethodID orig;
+        jnihook_result_t result;
 
-                if (!orig || env->ExceptionOccurred()) {
-                        LOG("ERR: Exception while getting original method '%s -> %s'\n", name.c_str(), method_info->signature.c_str());
-                        env->ExceptionDescribe();
-                        env->ExceptionClear();
-                        ret = JNIHOOK_ERR_JAVA_EXCEPTION;
-                }
+        // Look the copy up first, so that a stale manifest leaves the method untouched
+        result = GetOriginalMethod(env, target.clazz, target.hook_info.method_info, &orig, target.copy_suffix);
+        if (result != JNIHOOK_OK)
+                return result;
 
+        // The hook may run as soon as it is registered
+        if (original_method)
                 *original_method = orig;
+
+        auto previous = PublishHookEntry({ method, orig, target.hook_info.native_hook_method, target.clazz_id }, false);
+        if (result = RegisterHook(env, target.clazz, target.hook_info); result != JNIHOOK_OK) {
+                WithdrawHookEntry(method, previous, false);
+                if (original_method)
+                        *original_method = NULL;
+
+                return result;
         }
 
-        if (ret != JNIHOOK_OK) {
-                JNIHook_Detach(method);
-                return ret;
+        {
+                std::lock_guard<std::mutex> lock(g_registry_mutex);
+                g_prepatched_hooks.insert(method);
         }
+        StatsAdd(g_stats.prepatched_attaches, 1);
 
         return JNIHOOK_OK;
 }
 
-JNIHOOK_API jnihook_result_t JNIHOOK_CALL
-JNIHook_Attach(jmethodID method, void *native_hook_method, jmethodID *original_method)
+// Removes the hook of a method and restores it
+// NOTE: The shard of the class must be locked
+static jnihook_result_t
+DetachHook(jclass clazz, class_id_t clazz_id, const method_info_t &method_info)
 {
-        try {
-                return _JNIHook_Attach(method, native_hook_method, original_method);
-        } catch (jnif::Exception ex) {
-                LOG("ERR: JNIF exception thrown -> %s\n", ex.message.c_str());
-                return JNIHOOK_ERR_CLASS_FILE_FORMAT;
-        } catch (...) {
-                LOG("ERR: Unhandled exception thrown\n");
-        }
-        return JNIHOOK_ERR_UNKNOWN;
-}
+        auto &class_hooks = ClassHooks(clazz_id);
 
+        std::erase_if(class_hooks, [&method_info](auto &hk_info) {
+                return hk_info.method_info.name == method_info.name &&
+                       hk_info.method_info.signature == method_info.signature;
+        });
+
+        return ReapplyClass(clazz, clazz_id);
+}
 
 JNIHOOK_API jnihook_result_t JNIHOOK_CALL
-JNIHook_Detach(jmethodID method)
+_JNIHook_Attach(jmethodID method, void *native_hook_method, jmethodID *original_method, jint flags)
 {
+        hook_target_t target;
         JNIEnv *env;
-        jclass clazz;
-        std::string clazz_name;
-        hook_info_t hook_info;
-        jvmtiClassDefinition class_definition;
+        jnihook_result_t result;
 
         if (g_jnihook->jvm->GetEnv(reinterpret_cast<void **>(&env), JNI_VERSION_1_8)) {
+                LOG("ERR: Failed to get JNI\n");
                 return JNIHOOK_ERR_GET_JNI;
         }
 
-        if (g_jnihook->jvmti->GetMethodDeclaringClass(method, &clazz) != JVMTI_ERROR_NONE) {
-                return JNIHOOK_ERR_JVMTI_OPERATION;
-        }
+        result = ResolveHook(env, method, native_hook_method, flags, target);
+        if (result != JNIHOOK_OK)
+                return result;
 
-        clazz_name = get_class_name(env, clazz);
-        if (clazz_name.length() == 0) {
-                return JNIHOOK_ERR_JNI_OPERATION;
-        }
+        if (!target.copy_suffix.empty())
+                return AttachPrepatched(env, method, target, original_method);
 
-        if (g_hooks.find(clazz_name) == g_hooks.end() || g_hooks[clazz_name].size() == 0) {
-                return JNIHOOK_OK;
+        auto &clazz = target.clazz;
+        auto clazz_id = target.clazz_id;
+        std::lock_guard<std::mutex> shard_lock(ClassShard(clazz_id).mutex);
+        auto &class_hooks = ClassHooks(clazz_id);
+
+        // Force caching of the class being hooked
+        result = CacheClass(env, clazz);
+        if (result != JNIHOOK_OK)
+                return result;
+
+        // Patch the class before suspending the other threads,
+        // so that they are only kept waiting during the redefinition
+        std::vector<u1> class_bytes;
+        class_hooks.push_back(target.hook_info);
+        if (result = PrepareClass(clazz_id, class_bytes); result != JNIHOOK_OK) {
+                LOG("ERR: Failed to prepare class\n");
+                class_hooks.pop_back();
+                return result;
         }
 
-        auto method_info = get_method_info(g_jnihook->jvmti, method);
-        if (!method_info) {
-                return JNIHOOK_ERR_JVMTI_OPERATION;
+        // Suspend other threads while the hook is being set up
+        suspended_threads_t suspended;
+        if (result = SuspendOtherThreads(env, suspended); result != JNIHOOK_OK) {
+                class_hooks.pop_back();
+                return result;
         }
 
-        for (size_t i = 0; i < g_hooks[clazz_name].size(); ++i) {
-                auto &hook_info = g_hooks[clazz_name][i];
-                if (hook_info.method_info.name != method_info->name ||
-                    hook_info.method_info.signature != method_info->signature)
-                        continue;
+        // Apply current hooks
+        jvmtiClassDefinition class_definition;
+        class_definition.klass = clazz;
+        class_definition.class_byte_count = class_bytes.size();
+        class_definition.class_bytes = class_bytes.data();
+
+        // Get original method (also kept in the hook table when it is not requested)
+        // before registering the hook, so that the hook never runs without it
+        jmethodID orig = NULL;
+        if (result = RedefinePreparedClasses({ class_definition }, { clazz_id }); result != JNIHOOK_OK) {
+                LOG("ERR: Failed to reapply class\n");
+                class_hooks.pop_back();
+        } else {
+                result = GetOriginalMethod(env, clazz, target.hook_info.method_info, &orig);
+                if (result == JNIHOOK_OK) {
+                        if (original_method)
+                                *original_method = orig;
+
+                        auto previous = PublishHookEntry({ method, orig, target.hook_info.native_hook_method, clazz_id }, true);
+                        if (result = RegisterHook(env, clazz, target.hook_info); result != JNIHOOK_OK)
+                                WithdrawHookEntry(method, previous, true);
+                }
+
+                if (result != JNIHOOK_OK) {
+                        if (original_method)
+                                *original_method = NULL;
 
-                g_hooks[clazz_name].erase(g_hooks[clazz_name].begin() + i);
+                        class_hooks.pop_back();
+                        ReapplyClass(clazz, clazz_id); // Attempt to restore class to previous state
+                }
         }
 
-        return ReapplyClass(clazz, clazz_name);
+        // Resume other threads, hook already placed succesfully
+        ResumeOtherThreads(env, suspended);
+        g_hook_table.reclaim();
+
+        return result;
 }
 
+JNIHOOK_API jnihook_result_t JNIHOOK_CALL
+JNIHook_Attach(jmethodID method, void *native_hook_method, jmethodID *original_method)
+{
+        return JNIHook_AttachEx(method, native_hook_method, original_method, 0);
+}
 
 JNIHOOK_API jnihook_result_t JNIHOOK_CALL
-JNIHook_Shutdown()
+JNIHook_AttachEx(jmethodID method, void *native_hook_method, jmethodID *original_method, jint flags)
 {
-        JNIEnv *env;
-        jvmtiEventCallbacks callbacks = {};
+        std::shared_lock<std::shared_mutex> lock(g_init_mutex);
+        jnihook_result_t result = JNIHOOK_ERR_UNKNOWN;
 
-        if (g_jnihook->jvm->GetEnv(reinterpret_cast<void **>(&env), JNI_VERSION_1_8)) {
-                return JNIHOOK_ERR_GET_JNI;
+        try {
+                result = _JNIHook_Attach(method, native_hook_method, original_method, flags);
+        } catch (jnif::Exception ex) {
+                LOG("ERR: JNIF exception thrown -> %s\n", ex.message.c_str());
+                result = JNIHOOK_ERR_CLASS_FILE_FORMAT;
+        } catch (...) {
+                LOG("ERR: Unhandled exception thrown\n");
         }
 
-        for (auto &[key, _value] : g_class_file_cache) {
-                jclass clazz = env->FindClass(key.c_str());
+        StatsAdd(result == JNIHOOK_OK ? g_stats.attaches : g_stats.failures, 1);
 
-                g_hooks[key].clear();
+        return result;
+}
 
-                if (!clazz)
-                        continue;
+JNIHOOK_API jnihook_result_t JNIHOOK_CALL
+JNIHook_Intercept(jmethodID method, jnihook_interceptor_t interceptor, void *arg, jmethodID *original_method, jint flags)
+{
+        JNIEnv *env;
+        jclass clazz;
+        interceptor_t *context;
 
-                // Reapplying the class with empty hooks will just restore the original one.
-                ReapplyClass(clazz, key);
-        }
+        if (!interceptor)
+                return JNIHOOK_ERR_INVALID_ARGUMENT;
 
-        g_class_file_cache.clear();
+        {
+                std::shared_lock<std::shared_mutex> lock(g_init_mutex);
 
-        // TODO: Fully cleanup defined classes in `g_original_classes` by deleting them from the JVM memory
-        //       (if possible without doing crazy hacks)
-        // NOTE: The above is no longer needed due to changing the hooking method.
-        // g_original_classes.clear();
+                if (!g_jnihook || g_jnihook->jvm->GetEnv(reinterpret_cast<void **>(&env), JNI_VERSION_1_8))
+                        return JNIHOOK_ERR_GET_JNI;
 
-        g_jnihook->jvmti->SetEventNotificationMode(JVMTI_DISABLE, JVMTI_EVENT_CLASS_FILE_LOAD_HOOK, NULL);
-        g_jnihook->jvmti->SetEventCallbacks(&callbacks, sizeof(callbacks));
+                auto method_info = get_method_info(g_jnihook->jvmti, method);
+                if (!method_info || g_jnihook->jvmti->GetMethodDeclaringClass(method, &clazz) != JVMTI_ERROR_NONE)
+                        return JNIHOOK_ERR_JVMTI_OPERATION;
 
-        jvmtiCapabilities caps{};
-		caps.can_redefine_classes = 1;
-		caps.can_redefine_any_class = 1;
+                std::lock_guard<std::mutex> interceptors_lock(g_interceptors_mutex);
+                auto &entry = g_interceptors[method];
+
+                if (!entry) {
+                        auto created = std::make_unique<interceptor_t>();
+
+                        created->method = method;
+                        created->signature = method_info->signature;
+                        created->is_static = (method_info->access_flags & Method::STATIC) == Method::STATIC;
+                        created->stub = GenerateInterceptorStub(created.get());
+                        if (!created->stub) {
+                                LOG("ERR: Failed to generate interceptor stub\n");
+                                g_interceptors.erase(method);
+                                return JNIHOOK_ERR_UNSUPPORTED;
+                        }
+
+                        created->clazz = env->NewWeakGlobalRef(clazz);
+                        entry = std::move(created);
+                }
+
+                context = entry.get();
+                SetInterceptorCallback(context, interceptor, arg);
+        }
+
+        // NOTE: The original method is stored before the stub is registered.
+        //       If this fails, the context is kept for the next interception of the
+        //       method, since the stub may have been registered for a moment.
+        auto result = JNIHook_AttachEx(method, context->stub, &context->original_method, flags);
+        if (result != JNIHOOK_OK)
+                return result;
+
+        if (original_method)
+                *original_method = context->original_method;
+
+        return JNIHOOK_OK;
+}
+
+JNIHOOK_API jnihook_result_t JNIHOOK_CALL
+JNIHook_CallOriginal(jnihook_call_t *call)
+{
+        if (!call)
+                return JNIHOOK_ERR_INVALID_ARGUMENT;
+
+        return InterceptorCallOriginal(call);
+}
+
+typedef struct batch_class_t {
+        jclass clazz;
+        class_id_t clazz_id;
+        std::vector<size_t> hooks; // Indices in the `hooks` array
+        std::vector<u1> class_bytes;
+        class_cost_t cost;
+} batch_class_t;
+
+JNIHOOK_API jnihook_result_t JNIHOOK_CALL
+_JNIHook_AttachBatch(jnihook_hook_t *hooks, jint count, const jnihook_schedule_t *schedule, jnihook_schedule_report_t *report)
+{
+        JNIEnv *env;
+        std::vector<hook_info_t> hook_infos(count);
+        std::vector<batch_class_t> classes;
+        std::unordered_map<class_id_t, size_t> class_indices;
+
+        if (g_jnihook->jvm->GetEnv(reinterpret_cast<void **>(&env), JNI_VERSION_1_8)) {
+                LOG("ERR: Failed to get JNI\n");
+                return JNIHOOK_ERR_GET_JNI;
+        }
+
+        // Group the hooks by class
+        for (jint i = 0; i < count; ++i) {
+                hook_target_t target;
+
+                hooks[i].original_method = NULL;
+                hooks[i].result = ResolveHook(env, hooks[i].method, hooks[i].native_hook_method, hooks[i].flags, target);
+                if (hooks[i].result != JNIHOOK_OK)
+                        continue;
+
+                // Prepatched methods need no redefinition, so they are hooked right away
+                if (!target.copy_suffix.empty()) {
+                        hooks[i].result = AttachPrepatched(env, hooks[i].method, target, &hooks[i].original_method);
+                        continue;
+                }
+
+                hook_infos[i] = target.hook_info;
+
+                auto it = class_indices.find(target.clazz_id);
+                if (it == class_indices.end()) {
+                        it = class_indices.insert({ target.clazz_id, classes.size() }).first;
+                        classes.push_back(batch_class_t { target.clazz, target.clazz_id, {}, {}, { 0, 0 } });
+                }
+
+                classes[it->second].hooks.push_back(i);
+        }
+
+        // Cache and patch every class before any thread is suspended, to plan the batches.
+        // The classes are only locked while they are being planned and while their batch
+        // is applied, so that other threads can work on them between batches.
+        std::vector<size_t> ready_classes;
+        std::vector<class_cost_t> costs;
+        {
+                std::vector<class_id_t> class_ids;
+                for (auto &cls : classes)
+                        class_ids.push_back(cls.clazz_id);
+                auto shard_locks = LockClassShards(class_ids);
+
+                std::vector<size_t> cached_classes;
+                std::vector<class_id_t> cached_ids;
+                for (size_t i = 0; i < classes.size(); ++i) {
+                        auto &cls = classes[i];
+                        auto result = CacheClass(env, cls.clazz);
+
+                        if (result != JNIHOOK_OK) {
+                                for (auto hook : cls.hooks)
+                                        hooks[hook].result = result;
+                                continue;
+                        }
+
+                        for (auto hook : cls.hooks)
+                                ClassHooks(cls.clazz_id).push_back(hook_infos[hook]);
+
+                        cached_classes.push_back(i);
+                        cached_ids.push_back(cls.clazz_id);
+                }
+
+                // NOTE: The patched bytes are kept by the class file cache,
+                //       so preparing the classes again for their batch is cheap
+                std::vector<std::vector<u1>> prepared_bytes;
+                std::vector<jnihook_result_t> prepare_results;
+                PrepareClasses(cached_ids, prepared_bytes, prepare_results);
+
+                for (size_t j = 0; j < cached_classes.size(); ++j) {
+                        auto i = cached_classes[j];
+                        auto &cls = classes[i];
+
+                        ClassHooks(cls.clazz_id).resize(ClassHooks(cls.clazz_id).size() - cls.hooks.size());
+
+                        if (prepare_results[j] != JNIHOOK_OK) {
+                                for (auto hook : cls.hooks)
+                                        hooks[hook].result = prepare_results[j];
+                                continue;
+                        }
+
+                        cls.cost = { prepared_bytes[j].size(), CountClassMethods(cls.clazz, cls.clazz_id) };
+                        ready_classes.push_back(i);
+                        costs.push_back(cls.cost);
+                }
+        }
+
+        // The batches are planned with the model as it is now,
+        // while other threads may be refining it with their pauses
+        PauseModel pause_model;
+        {
+                std::lock_guard<std::mutex> lock(g_pause_model_mutex);
+                pause_model = g_pause_model;
+        }
+
+        jnihook_schedule_report_t summary = {};
+        auto batches = ScheduleBatches(costs, schedule->pause_budget_ns, pause_model);
+        uint64_t last_pause = 0;
+
+        for (size_t b = 0; b < batches.size(); ++b) {
+                jnihook_batch_report_t batch_report = {};
+                std::vector<jvmtiClassDefinition> class_definitions;
+                std::vector<class_id_t> class_ids;
+                std::vector<batch_class_t *> batch_classes;
+                std::vector<batch_class_t *> failed_classes;
+                class_cost_t batch_cost = { 0, 0 };
+                suspended_threads_t suspended;
+                std::vector<batch_class_t *> planned_classes;
+                std::vector<class_id_t> planned_ids;
+
+                // Let the application threads make progress between pauses
+                if (b > 0) {
+                        uint64_t gap = schedule->min_gap_ns ? schedule->min_gap_ns : last_pause;
+                        std::this_thread::sleep_for(std::chrono::nanoseconds(gap));
+                }
+
+                for (auto index : batches[b]) {
+                        planned_classes.push_back(&classes[ready_classes[index]]);
+                        planned_ids.push_back(classes[ready_classes[index]].clazz_id);
+                }
+
+                // Patch the classes with their current hooks, which other threads
+                // may have changed since the batches were planned
+                auto shard_locks = LockClassShards(planned_ids);
+                for (auto cls : planned_classes) {
+                        for (auto hook : cls->hooks)
+                                ClassHooks(cls->clazz_id).push_back(hook_infos[hook]);
+                }
+
+                std::vector<std::vector<u1>> prepared_bytes;
+                std::vector<jnihook_result_t> prepare_results;
+                PrepareClasses(planned_ids, prepared_bytes, prepare_results);
+
+                for (size_t j = 0; j < planned_classes.size(); ++j) {
+                        auto cls = planned_classes[j];
+                        jvmtiClassDefinition class_definition;
+
+                        if (prepare_results[j] != JNIHOOK_OK) {
+                                ClassHooks(cls->clazz_id).resize(ClassHooks(cls->clazz_id).size() - cls->hooks.size());
+                                for (auto hook : cls->hooks)
+                                        hooks[hook].result = prepare_results[j];
+                                continue;
+                        }
+
+                        cls->class_bytes = std::move(prepared_bytes[j]);
+                        class_definition.klass = cls->clazz;
+                        class_definition.class_byte_count = cls->class_bytes.size();
+                        class_definition.class_bytes = cls->class_bytes.data();
+                        class_definitions.push_back(class_definition);
+                        class_ids.push_back(cls->clazz_id);
+                        batch_classes.push_back(cls);
+
+                        batch_cost.bytes += cls->cost.bytes;
+                        batch_cost.methods += cls->cost.methods;
+                }
+
+                if (batch_classes.empty())
+                        continue;
+
+                batch_report.index = static_cast<jint>(b);
+                batch_report.class_count = static_cast<jint>(batch_classes.size());
+                batch_report.class_bytes = batch_cost.bytes;
+                batch_report.predicted_pause_ns = pause_model.predict(batch_cost);
+
+                batch_report.result = SuspendOtherThreads(env, suspended);
+                if (batch_report.result == JNIHOOK_OK) {
+                        batch_report.result = RedefinePreparedClasses(class_definitions, class_ids);
+                        if (batch_report.result == JNIHOOK_OK) {
+                                // The original methods are looked up before the hooks can run
+                                for (auto cls : batch_classes) {
+                                        for (auto hook : cls->hooks) {
+                                                auto &minfo = hook_infos[hook].method_info;
+
+                                                hooks[hook].result = GetOriginalMethod(env, cls->clazz, minfo, &hooks[hook].original_method);
+                                                if (hooks[hook].result == JNIHOOK_OK) {
+                                                        hook_entry_t entry = { hooks[hook].method, hooks[hook].original_method,
+                                                                               hook_infos[hook].native_hook_method, cls->clazz_id };
+                                                        auto previous = PublishHookEntry(entry, true);
+
+                                                        hooks[hook].result = RegisterHook(env, cls->clazz, hook_infos[hook]);
+                                                        if (hooks[hook].result != JNIHOOK_OK)
+                                                                WithdrawHookEntry(entry.method, previous, true);
+                                                }
+
+                                                if (hooks[hook].result != JNIHOOK_OK)
+                                                        hooks[hook].original_method = NULL;
+
+                                                if (hooks[hook].result != JNIHOOK_OK &&
+                                                    (failed_classes.empty() || failed_classes.back() != cls))
+                                                        failed_classes.push_back(cls);
+                                        }
+                                }
+                        }
+
+                        batch_report.actual_pause_ns = ResumeOtherThreads(env, suspended);
+                        g_hook_table.reclaim();
+
+                        std::lock_guard<std::mutex> lock(g_pause_model_mutex);
+                        g_pause_model.observe(batch_cost, batch_report.actual_pause_ns);
+                        last_pause = batch_report.actual_pause_ns;
+                }
+
+                if (batch_report.result != JNIHOOK_OK) {
+                        // None of the classes in the batch were redefined
+                        for (auto cls : batch_classes) {
+                                ClassHooks(cls->clazz_id).resize(ClassHooks(cls->clazz_id).size() - cls->hooks.size());
+                                for (auto hook : cls->hooks)
+                                        hooks[hook].result = batch_report.result;
+                        }
+                }
+
+                // Drop the hooks that could not be registered
+                // and restore their methods (outside of the budgeted pause)
+                for (auto cls : failed_classes) {
+                        auto &class_hooks = ClassHooks(cls->clazz_id);
+
+                        for (auto hook : cls->hooks) {
+                                if (hooks[hook].result == JNIHOOK_OK)
+                                        continue;
+
+                                auto &minfo = hook_infos[hook].method_info;
+                                std::erase_if(class_hooks, [&minfo](auto &hk_info) {
+                                        return hk_info.method_info.name == minfo.name &&
+                                               hk_info.method_info.signature == minfo.signature;
+                                });
+                        }
+
+                        ReapplyClass(cls->clazz, cls->clazz_id);
+                }
+
+                for (auto cls : batch_classes)
+                        cls->class_bytes = {};
+                shard_locks.clear();
+
+                summary.batches += 1;
+                summary.predicted_pause_ns += batch_report.predicted_pause_ns;
+                summary.actual_pause_ns += batch_report.actual_pause_ns;
+                summary.max_predicted_pause_ns = std::max(summary.max_predicted_pause_ns, batch_report.predicted_pause_ns);
+                summary.max_actual_pause_ns = std::max(summary.max_actual_pause_ns, batch_report.actual_pause_ns);
+                if (batch_report.actual_pause_ns > schedule->pause_budget_ns)
+                        summary.over_budget += 1;
+
+                LOG("Batch %d: %d classes, predicted pause: %llu ns, actual pause: %llu ns\n",
+                    batch_report.index, batch_report.class_count,
+                    static_cast<unsigned long long>(batch_report.predicted_pause_ns),
+                    static_cast<unsigned long long>(batch_report.actual_pause_ns));
+
+                if (schedule->on_batch)
+                        schedule->on_batch(&batch_report, schedule->arg);
+        }
+
+        if (report)
+                *report = summary;
+
+        jnihook_result_t ret = JNIHOOK_OK;
+        for (jint i = 0; i < count; ++i) {
+                if (hooks[i].result != JNIHOOK_OK) {
+                        ret = hooks[i].result;
+                        break;
+                }
+        }
+
+        return ret;
+}
+
+JNIHOOK_API jnihook_result_t JNIHOOK_CALL
+JNIHook_AttachBatch(jnihook_hook_t *hooks, jint count, const jnihook_schedule_t *schedule, jnihook_schedule_report_t *report)
+{
+        jnihook_result_t result = JNIHOOK_ERR_UNKNOWN;
+
+        if ((!hooks && count > 0) || count < 0 || !schedule)
+                return JNIHOOK_ERR_INVALID_ARGUMENT;
+
+        std::shared_lock<std::shared_mutex> lock(g_init_mutex);
+
+        for (jint i = 0; i < count; ++i)
+                hooks[i].result = JNIHOOK_ERR_UNKNOWN;
+
+        try {
+                result = _JNIHook_AttachBatch(hooks, count, schedule, report);
+        } catch (jnif::Exception ex) {
+                LOG("ERR: JNIF exception thrown -> %s\n", ex.message.c_str());
+                result = JNIHOOK_ERR_CLASS_FILE_FORMAT;
+        } catch (...) {
+                LOG("ERR: Unhandled exception thrown\n");
+        }
+
+        for (jint i = 0; i < count; ++i)
+                StatsAdd(hooks[i].result == JNIHOOK_OK ? g_stats.attaches : g_stats.failures, 1);
+
+        return result;
+}
+
+JNIHOOK_API jnihook_result_t JNIHOOK_CALL
+JNIHook_Detach(jmethodID method)
+{
+        std::shared_lock<std::shared_mutex> lock(g_init_mutex);
+        JNIEnv *env;
+        jclass clazz;
+        class_id_t clazz_id;
+
+        if (g_jnihook->jvm->GetEnv(reinterpret_cast<void **>(&env), JNI_VERSION_1_8)) {
+                return JNIHOOK_ERR_GET_JNI;
+        }
+
+        {
+                std::lock_guard<std::mutex> registry_lock(g_registry_mutex);
+                if (g_prepatched_hooks.count(method)) {
+                        LOG("ERR: Hooks on prepatched methods cannot be detached\n");
+                        return JNIHOOK_ERR_UNSUPPORTED;
+                }
+        }
+
+        if (g_jnihook->jvmti->GetMethodDeclaringClass(method, &clazz) != JVMTI_ERROR_NONE) {
+                return JNIHOOK_ERR_JVMTI_OPERATION;
+        }
+
+        // Classes without a tag were never hooked
+        if (g_jnihook->jvmti->GetTag(clazz, &clazz_id) != JVMTI_ERROR_NONE) {
+                return JNIHOOK_ERR_JVMTI_OPERATION;
+        }
+
+        if (clazz_id == 0)
+                return JNIHOOK_OK;
+
+        auto method_info = get_method_info(g_jnihook->jvmti, method);
+        if (!method_info) {
+                return JNIHOOK_ERR_JVMTI_OPERATION;
+        }
+
+        auto &shard = ClassShard(clazz_id);
+        std::lock_guard<std::mutex> shard_lock(shard.mutex);
+
+        if (auto it = shard.hooks.find(clazz_id); it == shard.hooks.end() || it->second.empty())
+                return JNIHOOK_OK;
+
+        auto result = DetachHook(clazz, clazz_id, *method_info);
+        if (result == JNIHOOK_OK)
+                g_hook_table.retract({ method });
+        StatsAdd(result == JNIHOOK_OK ? g_stats.detaches : g_stats.failures, 1);
+
+        return result;
+}
+
+// NOTE: Neither of these takes `g_init_mutex`, they only read the published hook table
+JNIHOOK_API jnihook_result_t JNIHOOK_CALL
+JNIHook_GetOriginal(jmethodID method, jmethodID *original_method)
+{
+        hook_entry_t entry;
+
+        if (!original_method)
+                return JNIHOOK_ERR_INVALID_ARGUMENT;
+
+        if (!g_hook_table.find(method, &entry))
+                return JNIHOOK_ERR_INVALID_ARGUMENT;
+
+        *original_method = entry.original_method;
+
+        return JNIHOOK_OK;
+}
+
+JNIHOOK_API jboolean JNIHOOK_CALL
+JNIHook_IsHooked(jmethodID method)
+{
+        return g_hook_table.find(method, nullptr) ? JNI_TRUE : JNI_FALSE;
+}
+
+
+typedef enum {
+        ASYNC_ATTACH,
+        ASYNC_DETACH,
+        ASYNC_EVICT   // Release the state of an unloaded class (queued by JNIHook_ObjectFree)
+} async_kind_t;
+
+typedef struct async_op_t {
+        async_kind_t kind;
+        class_id_t clazz_id; // ASYNC_EVICT only
+        jmethodID method;
+        void *native_hook_method;
+        jint flags;
+        jnihook_callback_t callback;
+        void *arg;
+
+        // Filled in by the worker
+        hook_info_t hook_info;
+        jnihook_result_t result;
+        jmethodID original_method;
+} async_op_t;
+
+static Worker<async_op_t> g_worker;
+
+static bool
+same_method(const method_info_t &a, const method_info_t &b)
+{
+        return a.name == b.name && a.signature == b.signature;
+}
+
+// Applies every queued operation on a class with a single redefinition
+// NOTE: The shard of the class must be locked
+static void
+ApplyClassOperations(JNIEnv *env, jclass clazz, class_id_t clazz_id, std::vector<async_op_t *> &ops)
+{
+        jnihook_result_t result;
+        bool has_attach = std::any_of(ops.begin(), ops.end(), [](auto op) { return op->kind == ASYNC_ATTACH; });
+
+        // Classes that were never hooked have nothing to detach
+        if (!has_attach && !WasClassHooked(clazz_id)) {
+                for (auto op : ops)
+                        op->result = JNIHOOK_OK;
+                return;
+        }
+
+        if (result = CacheClass(env, clazz); result != JNIHOOK_OK) {
+                for (auto op : ops)
+                        op->result = result;
+                return;
+        }
+
+        // Replay the operations in the order they were queued.
+        // An attach replaces the previous hook of the same method.
+        auto &class_hooks = ClassHooks(clazz_id);
+        auto previous_hooks = class_hooks;
+        for (auto op : ops) {
+                std::erase_if(class_hooks, [op](auto &hk_info) {
+                        return same_method(hk_info.method_info, op->hook_info.method_info);
+                });
+
+                if (op->kind == ASYNC_ATTACH)
+                        class_hooks.push_back(op->hook_info);
+
+                op->result = JNIHOOK_OK;
+        }
+
+        // Only the last attach of each method is still placed after the replay
+        std::vector<async_op_t *> placed;
+        for (size_t i = 0; i < ops.size(); ++i) {
+                bool superseded = std::any_of(ops.begin() + i + 1, ops.end(), [&](auto later) {
+                        return same_method(later->hook_info.method_info, ops[i]->hook_info.method_info);
+                });
+
+                if (ops[i]->kind == ASYNC_ATTACH && !superseded)
+                        placed.push_back(ops[i]);
+        }
+
+        std::vector<u1> class_bytes;
+        if (result = PrepareClass(clazz_id, class_bytes); result != JNIHOOK_OK) {
+                class_hooks = previous_hooks;
+                for (auto op : ops)
+                        op->result = result;
+                return;
+        }
+
+        suspended_threads_t suspended;
+        if (result = SuspendOtherThreads(env, suspended); result != JNIHOOK_OK) {
+                class_hooks = previous_hooks;
+                for (auto op : ops)
+                        op->result = result;
+                return;
+        }
+
+        jvmtiClassDefinition class_definition;
+        class_definition.klass = clazz;
+        class_definition.class_byte_count = class_bytes.size();
+        class_definition.class_bytes = class_bytes.data();
+
+        bool needs_restore = false;
+        if (result = RedefinePreparedClasses({ class_definition }, { clazz_id }); result != JNIHOOK_OK) {
+                class_hooks = previous_hooks;
+                for (auto op : ops)
+                        op->result = result;
+        } else {
+                // A detach followed by an attach of the same method is published by the attach
+                std::vector<jmethodID> detached;
+                for (auto op : ops) {
+                        if (op->kind == ASYNC_DETACH)
+                                detached.push_back(op->method);
+                }
+                g_hook_table.retract(detached, true);
+
+                // The original methods are looked up and published before the hooks can run
+                for (auto op : placed) {
+                        op->result = GetOriginalMethod(env, clazz, op->hook_info.method_info, &op->original_method);
+                        if (op->result == JNIHOOK_OK) {
+                                hook_entry_t entry = { op->method, op->original_method, op->hook_info.native_hook_method, clazz_id };
+                                auto previous = PublishHookEntry(entry, true);
+
+                                op->result = RegisterHook(env, clazz, op->hook_info);
+                                if (op->result != JNIHOOK_OK)
+                                        WithdrawHookEntry(op->method, previous, true);
+                        }
+
+                        if (op->result != JNIHOOK_OK) {
+                                op->original_method = NULL;
+                                std::erase_if(class_hooks, [op](auto &hk_info) {
+                                        return same_method(hk_info.method_info, op->hook_info.method_info);
+                                });
+                                needs_restore = true;
+                        }
+                }
+        }
+
+        ResumeOtherThreads(env, suspended);
+        g_hook_table.reclaim();
+
+        // Remove the hooks that could not be completed
+        if (needs_restore)
+                ReapplyClass(clazz, clazz_id);
+}
+
+// Frees the contexts of the intercepted methods whose class has been unloaded,
+// which can't have a call running anymore (unlike the ones that were detached)
+static void
+ReleaseUnloadedInterceptors(JNIEnv *env)
+{
+        std::vector<std::unique_ptr<interceptor_t>> released;
+
+        {
+                std::lock_guard<std::mutex> lock(g_interceptors_mutex);
+
+                for (auto it = g_interceptors.begin(); it != g_interceptors.end();) {
+                        if (env->IsSameObject(it->second->clazz, NULL)) {
+                                released.push_back(std::move(it->second));
+                                it = g_interceptors.erase(it);
+                        } else {
+                                ++it;
+                        }
+                }
+        }
+
+        for (auto &context : released)
+                env->DeleteWeakGlobalRef(context->clazz);
+}
+
+// Releases everything kept for a class that has been unloaded
+// NOTE: The generated thunks and the hook metrics are kept, see `g_hook_metrics`
+static void
+EvictClass(JNIEnv *env, class_id_t clazz_id)
+{
+        size_t reclaimed = g_class_file_cache.erase(clazz_id);
+        jweak clazz_ref = NULL;
+
+        {
+                auto &shard = ClassShard(clazz_id);
+                std::lock_guard<std::mutex> lock(shard.mutex);
+
+                if (auto it = shard.hooks.find(clazz_id); it != shard.hooks.end()) {
+                        reclaimed += it->second.capacity() * sizeof(hook_info_t);
+                        for (auto &hk_info : it->second)
+                                reclaimed += hk_info.method_info.name.capacity() + hk_info.method_info.signature.capacity();
+                        shard.hooks.erase(it);
+                }
+        }
+
+        SetClassPatches(clazz_id, {});
+        g_hook_table.retract_class(clazz_id);
+
+        {
+                std::lock_guard<std::mutex> lock(g_registry_mutex);
+
+                g_installed_hashes.erase(clazz_id);
+
+                if (auto it = g_class_names.find(clazz_id); it != g_class_names.end()) {
+                        reclaimed += it->second.capacity();
+                        g_class_names.erase(it);
+                }
+
+                if (auto it = g_class_refs.find(clazz_id); it != g_class_refs.end()) {
+                        clazz_ref = it->second;
+                        g_class_refs.erase(it);
+                }
+        }
+
+        // NOTE: The reference was cleared by the collector, but it is still allocated
+        if (clazz_ref)
+                env->DeleteWeakGlobalRef(clazz_ref);
+
+        ReleaseUnloadedInterceptors(env);
+
+        LOG("Evicted unloaded class with tag %lld (%zu bytes)\n", static_cast<long long>(clazz_id), reclaimed);
+
+        StatsAdd(g_stats.classes_unloaded, 1);
+        StatsAdd(g_stats.bytes_reclaimed, reclaimed);
+}
+
+// Runs on the worker thread with every operation queued since the last run
+static void
+RunAsyncOperations(JNIEnv *env, std::vector<async_op_t> &ops)
+{
+        {
+                std::shared_lock<std::shared_mutex> lock(g_init_mutex);
+                std::vector<std::pair<jclass, class_id_t>> classes;
+                std::unordered_map<class_id_t, std::vector<async_op_t *>> class_ops;
+
+                for (auto &op : ops) {
+                        hook_target_t target;
+
+                        op.original_method = NULL;
+                        if (op.kind == ASYNC_EVICT) {
+                                EvictClass(env, op.clazz_id);
+                                op.result = JNIHOOK_OK;
+                                continue;
+                        }
+
+                        if (!env || !g_jnihook) {
+                                op.result = JNIHOOK_ERR_GET_JNI;
+                                continue;
+                        }
+
+                        // NOTE: Detaching does not need a hook, so it is never instrumented
+                        op.result = ResolveHook(env, op.method, op.native_hook_method,
+                                                op.kind == ASYNC_ATTACH ? op.flags : 0, target);
+                        if (op.result != JNIHOOK_OK)
+                                continue;
+
+                        if (!target.copy_suffix.empty()) {
+                                if (op.kind == ASYNC_ATTACH) {
+                                        op.result = AttachPrepatched(env, op.method, target, &op.original_method);
+                                } else {
+                                        std::lock_guard<std::mutex> registry_lock(g_registry_mutex);
+                                        if (g_prepatched_hooks.count(op.method))
+                                                op.result = JNIHOOK_ERR_UNSUPPORTED;
+                                }
+                                continue;
+                        }
+
+                        op.hook_info = target.hook_info;
+                        if (class_ops.find(target.clazz_id) == class_ops.end())
+                                classes.push_back({ target.clazz, target.clazz_id });
+                        class_ops[target.clazz_id].push_back(&op);
+                }
+
+                for (auto &[clazz, clazz_id] : classes) {
+                        auto &pending = class_ops[clazz_id];
+                        std::lock_guard<std::mutex> shard_lock(ClassShard(clazz_id).mutex);
+
+                        try {
+                                ApplyClassOperations(env, clazz, clazz_id, pending);
+                        } catch (jnif::Exception ex) {
+                                LOG("ERR: JNIF exception thrown -> %s\n", ex.message.c_str());
+                                for (auto op : pending)
+                                        op->result = JNIHOOK_ERR_CLASS_FILE_FORMAT;
+                        } catch (...) {
+                                LOG("ERR: Unhandled exception thrown\n");
+                                for (auto op : pending)
+                                        op->result = JNIHOOK_ERR_UNKNOWN;
+                        }
+                }
+        }
+
+        // Notify without holding the lock, the callbacks may want to place hooks too
+        for (auto &op : ops) {
+                if (op.kind == ASYNC_EVICT)
+                        continue;
+
+                if (op.result != JNIHOOK_OK)
+                        StatsAdd(g_stats.failures, 1);
+                else
+                        StatsAdd(op.kind == ASYNC_ATTACH ? g_stats.attaches : g_stats.detaches, 1);
+
+                if (op.callback)
+                        op.callback(op.method, op.result, op.original_method, op.arg);
+        }
+}
+
+static jnihook_result_t
+QueueAsyncOperation(async_op_t op)
+{
+        if (!g_jnihook)
+                return JNIHOOK_ERR_GET_JNI;
+
+        try {
+                g_worker.enqueue(g_jnihook->jvm, "JNIHook Worker", RunAsyncOperations, std::move(op));
+        } catch (...) {
+                LOG("ERR: Failed to queue async operation\n");
+                return JNIHOOK_ERR_UNKNOWN;
+        }
+
+        return JNIHOOK_OK;
+}
+
+// Called when a tagged class has been unloaded
+// NOTE: Only a few JVMTI functions can be called from here (and no JNI functions),
+//       so the state of the class is released later, on the worker thread
+void JNICALL JNIHook_ObjectFree(jvmtiEnv *jvmti_env, jlong tag)
+{
+        async_op_t op = {};
+
+        if (!g_jnihook)
+                return;
+
+        op.kind = ASYNC_EVICT;
+        op.clazz_id = tag;
+
+        QueueAsyncOperation(std::move(op));
+}
+
+JNIHOOK_API jnihook_result_t JNIHOOK_CALL
+JNIHook_AttachAsync(jmethodID method, void *native_hook_method, jint flags, jnihook_callback_t callback, void *arg)
+{
+        async_op_t op = {};
+
+        op.kind = ASYNC_ATTACH;
+        op.method = method;
+        op.native_hook_method = native_hook_method;
+        op.flags = flags;
+        op.callback = callback;
+        op.arg = arg;
+
+        return QueueAsyncOperation(std::move(op));
+}
+
+JNIHOOK_API jnihook_result_t JNIHOOK_CALL
+JNIHook_DetachAsync(jmethodID method, jnihook_callback_t callback, void *arg)
+{
+        async_op_t op = {};
+
+        op.kind = ASYNC_DETACH;
+        op.method = method;
+        op.callback = callback;
+        op.arg = arg;
+
+        return QueueAsyncOperation(std::move(op));
+}
+
+JNIHOOK_API jnihook_result_t JNIHOOK_CALL
+JNIHook_Shutdown()
+{
+        return JNIHook_ShutdownEx(NULL);
+}
+
+JNIHOOK_API jnihook_result_t JNIHOOK_CALL
+JNIHook_ShutdownEx(jnihook_shutdown_report_t *report)
+{
+        JNIEnv *env;
+        jvmtiEventCallbacks callbacks = {};
+        jnihook_shutdown_report_t summary = {};
+        uint64_t start = StatsNow();
+        uint64_t phase_start = start;
+
+        // Stop reporting unloaded classes, so that the worker is not started again
+        g_jnihook->jvmti->SetEventNotificationMode(JVMTI_DISABLE, JVMTI_EVENT_OBJECT_FREE, NULL);
+
+        // Run the pending async operations before restoring the classes
+        // NOTE: The worker needs `g_init_mutex` for that, so it can't be held here yet
+        g_worker.stop();
+
+        // Wait for the operations in progress on other threads, and keep new ones out
+        std::unique_lock<std::shared_mutex> lock(g_init_mutex);
+
+        if (g_jnihook->jvm->GetEnv(reinterpret_cast<void **>(&env), JNI_VERSION_1_8)) {
+                return JNIHOOK_ERR_GET_JNI;
+        }
+
+        // Resolve the tagged classes from their weak references, including the ones
+        // from other class loaders (FindClass would only see the system class loader).
+        // The classes that have been unloaded are gone and don't need to be restored.
+        std::vector<jclass> classes;
+        std::vector<jclass> hooked_classes;
+        std::vector<class_id_t> hooked_ids;
+        for (auto &[clazz_id, clazz_ref] : g_class_refs) {
+                auto clazz = reinterpret_cast<jclass>(env->NewLocalRef(clazz_ref));
+
+                env->DeleteWeakGlobalRef(clazz_ref);
+                if (!clazz)
+                        continue;
+
+                classes.push_back(clazz);
+
+                // Preparing the classes with empty hooks will just restore the original ones.
+                if (WasClassHooked(clazz_id)) {
+                        ClassHooks(clazz_id).clear();
+                        hooked_classes.push_back(clazz);
+                        hooked_ids.push_back(clazz_id);
+                }
+        }
+        g_class_refs.clear();
+        summary.class_count = static_cast<jint>(hooked_ids.size());
+        summary.lookup_ns = StatsNow() - phase_start;
+
+        phase_start = StatsNow();
+        std::vector<std::vector<u1>> original_bytes;
+        std::vector<jnihook_result_t> prepare_results;
+        PrepareClasses(hooked_ids, original_bytes, prepare_results);
+
+        std::vector<jvmtiClassDefinition> class_definitions;
+        std::vector<class_id_t> class_ids;
+        class_definitions.reserve(hooked_ids.size());
+        class_ids.reserve(hooked_ids.size());
+        for (size_t i = 0; i < hooked_ids.size(); ++i) {
+                if (prepare_results[i] != JNIHOOK_OK)
+                        continue;
+
+                jvmtiClassDefinition class_definition;
+                class_definition.klass = hooked_classes[i];
+                class_definition.class_byte_count = original_bytes[i].size();
+                class_definition.class_bytes = original_bytes[i].data();
+                class_definitions.push_back(class_definition);
+                class_ids.push_back(hooked_ids[i]);
+        }
+        summary.prepare_ns = StatsNow() - phase_start;
+
+        // Restore everything with a single redefinition (and a single safepoint).
+        // If the JVM rejects it, restore the classes one by one, so that
+        // a single bad class does not leave all the others hooked.
+        phase_start = StatsNow();
+        std::unique_lock<std::recursive_mutex> redefine_lock(g_redefine_mutex);
+        if (!class_definitions.empty()) {
+                summary.redefinitions += 1;
+                if (RedefinePreparedClasses(class_definitions, class_ids) == JNIHOOK_OK) {
+                        summary.restored = static_cast<jint>(class_definitions.size());
+                } else {
+                        for (size_t i = 0; i < class_definitions.size(); ++i) {
+                                summary.redefinitions += 1;
+                                if (RedefinePreparedClasses({ class_definitions[i] }, { class_ids[i] }) == JNIHOOK_OK)
+                                        summary.restored += 1;
+                        }
+                }
+        }
+        redefine_lock.unlock();
+        summary.redefine_ns = StatsNow() - phase_start;
+
+        phase_start = StatsNow();
+        for (auto clazz : classes) {
+                g_jnihook->jvmti->SetTag(clazz, 0);
+                env->DeleteLocalRef(clazz);
+        }
+
+        for (auto &shard : g_class_shards)
+                shard.hooks.clear();
+        g_hook_table.clear();
+        g_class_names.clear();
+        g_class_file_cache.clear();
+        g_installed_hashes.clear();
+        g_class_archive.close();
+        // NOTE: The hooks on prepatched methods stay registered, there is no original code to restore
+        g_prepatched_methods.clear();
+        g_prepatched_hooks.clear();
+        // NOTE: The other interceptors are kept for the methods that are intercepted again,
+        //       since their stubs may still be running
+        ReleaseUnloadedInterceptors(env);
+
+        // TODO: Fully cleanup defined classes in `g_original_classes` by deleting them from the JVM memory
+        //       (if possible without doing crazy hacks)
+        // NOTE: The above is no longer needed due to changing the hooking method.
+        // g_original_classes.clear();
+
+        g_jnihook->jvmti->SetEventNotificationMode(JVMTI_DISABLE, JVMTI_EVENT_CLASS_FILE_LOAD_HOOK, NULL);
+        g_jnihook->jvmti->SetEventCallbacks(&callbacks, sizeof(callbacks));
+
+        jvmtiCapabilities caps{};
+		caps.can_tag_objects = 1;
+		caps.can_generate_object_free_events = 1;
+		caps.can_redefine_classes = 1;
+		caps.can_redefine_any_class = 1;
 		caps.can_retransform_classes = 1;
         caps.can_retransform_any_class = 1;
 		caps.can_suspend = 1;
 		jvmtiError err = g_jnihook->jvmti->RelinquishCapabilities(&caps);
 
+        {
+                std::lock_guard<std::mutex> patches_lock(g_class_patches_mutex);
+                g_class_patches.clear();
+                g_class_patches_filter.clear();
+        }
+
         g_jnihook = nullptr;
+        g_init_flags = 0;
+
+        summary.cleanup_ns = StatsNow() - phase_start;
+        summary.total_ns = StatsNow() - start;
+
+        LOG("Shutdown: restored %d/%d classes with %d redefinitions in %llu ns "
+            "(lookup: %llu ns, prepare: %llu ns, redefine: %llu ns, cleanup: %llu ns)\n",
+            summary.restored, summary.class_count, summary.redefinitions,
+            static_cast<unsigned long long>(summary.total_ns),
+            static_cast<unsigned long long>(summary.lookup_ns),
+            static_cast<unsigned long long>(summary.prepare_ns),
+            static_cast<unsigned long long>(summary.redefine_ns),
+            static_cast<unsigned long long>(summary.cleanup_ns));
+
+        if (report)
+                *report = summary;
+
+        return JNIHOOK_OK;
+}
+
+JNIHOOK_API jnihook_result_t JNIHOOK_CALL
+JNIHook_GetStats(jnihook_stats_t *stats)
+{
+        if (!stats)
+                return JNIHOOK_ERR_INVALID_ARGUMENT;
+
+        StatsSnapshot(stats);
+
+        return JNIHOOK_OK;
+}
+
+JNIHOOK_API void JNIHOOK_CALL
+JNIHook_ResetStats()
+{
+        StatsReset();
+}
+
+JNIHOOK_API jnihook_result_t JNIHOOK_CALL
+JNIHook_GetHookMetrics(jmethodID method, jnihook_hook_metrics_t *metrics)
+{
+        std::lock_guard<std::mutex> lock(g_hook_metrics_mutex);
+
+        if (!metrics)
+                return JNIHOOK_ERR_INVALID_ARGUMENT;
+
+        auto it = g_hook_metrics.find(method);
+        if (it == g_hook_metrics.end())
+                return JNIHOOK_ERR_INVALID_ARGUMENT;
+
+        MetricsSnapshot(it->second.get(), metrics);
+
+        return JNIHOOK_OK;
+}
+
+JNIHOOK_API jnihook_result_t JNIHOOK_CALL
+JNIHook_GetHistogramBucketBound(jint bucket, uint64_t *lower_ns, uint64_t *upper_ns)
+{
+        if (bucket < 0 || bucket >= JNIHOOK_HISTOGRAM_BUCKETS)
+                return JNIHOOK_ERR_INVALID_ARGUMENT;
+
+        if (lower_ns)
+                *lower_ns = bucket > 0 ? MetricsHistogramUpperBound(bucket - 1) : 0;
+
+        if (upper_ns)
+                *upper_ns = MetricsHistogramUpperBound(bucket);
+
+        return JNIHOOK_OK;
+}
+
+JNIHOOK_API jnihook_result_t JNIHOOK_CALL
+JNIHook_ExportMetrics(const char *path)
+{
+        std::vector<hook_metrics_t *> metrics;
+
+        if (!path)
+                return JNIHOOK_ERR_INVALID_ARGUMENT;
+
+        {
+                std::lock_guard<std::mutex> lock(g_hook_metrics_mutex);
+                for (auto &[_method, m] : g_hook_metrics)
+                        metrics.push_back(m.get());
+        }
+
+        // Sort by label so that consecutive exports are easy to diff
+        std::sort(metrics.begin(), metrics.end(), [](auto a, auto b) { return a->label < b->label; });
+
+        if (!MetricsExportPrometheus(metrics, path)) {
+                LOG("ERR: Failed to export metrics to: %s\n", path);
+                return JNIHOOK_ERR_UNKNOWN;
+        }
+
+        return JNIHOOK_OK;
+}
+
+JNIHOOK_API void JNIHOOK_CALL
+JNIHook_SetCacheBudget(uint64_t budget_bytes, jboolean compress)
+{
+        g_class_file_cache.set_budget(budget_bytes, compress == JNI_TRUE);
+}
+
+JNIHOOK_API jnihook_result_t JNIHOOK_CALL
+JNIHook_GetCacheStats(jnihook_cache_stats_t *stats)
+{
+        if (!stats)
+                return JNIHOOK_ERR_INVALID_ARGUMENT;
+
+        g_class_file_cache.snapshot(stats);
+
+        return JNIHOOK_OK;
+}
+
+JNIHOOK_API jnihook_result_t JNIHOOK_CALL
+JNIHook_PrewarmCache(jclass *classes, jint count)
+{
+        JNIEnv *env;
+        jnihook_result_t result = JNIHOOK_ERR_UNKNOWN;
+
+        if ((!classes && count > 0) || count < 0)
+                return JNIHOOK_ERR_INVALID_ARGUMENT;
+
+        std::shared_lock<std::shared_mutex> lock(g_init_mutex);
+
+        if (g_jnihook->jvm->GetEnv(reinterpret_cast<void **>(&env), JNI_VERSION_1_8)) {
+                return JNIHOOK_ERR_GET_JNI;
+        }
+
+        try {
+                result = CacheClasses(env, std::vector<jclass>(classes, &classes[count]));
+        } catch (...) {
+                LOG("ERR: Unhandled exception thrown\n");
+        }
+
+        return result;
+}
+
+JNIHOOK_API jnihook_result_t JNIHOOK_CALL
+JNIHook_PrewarmCacheByPrefix(const char *prefix)
+{
+        JNIEnv *env;
+        jint class_count;
+        jclass *loaded_classes;
+        std::vector<jclass> classes;
+        jnihook_result_t result = JNIHOOK_ERR_UNKNOWN;
+
+        if (!prefix)
+                return JNIHOOK_ERR_INVALID_ARGUMENT;
+
+        std::shared_lock<std::shared_mutex> lock(g_init_mutex);
+
+        if (g_jnihook->jvm->GetEnv(reinterpret_cast<void **>(&env), JNI_VERSION_1_8)) {
+                return JNIHOOK_ERR_GET_JNI;
+        }
+
+        if (g_jnihook->jvmti->GetLoadedClasses(&class_count, &loaded_classes) != JVMTI_ERROR_NONE) {
+                LOG("ERR: Failed to get loaded classes\n");
+                return JNIHOOK_ERR_JVMTI_OPERATION;
+        }
+
+        // Match the prefix against the internal names (e.g. "Lcom/acme/Foo;").
+        // Arrays, primitives and other unmodifiable classes are skipped.
+        size_t prefix_length = strlen(prefix);
+        for (jint i = 0; i < class_count; ++i) {
+                auto clazz = loaded_classes[i];
+                jboolean modifiable = JNI_FALSE;
+                auto signature = get_class_signature(g_jnihook->jvmti, clazz);
+
+                if (signature.length() > prefix_length + 1 && signature[0] == 'L' &&
+                    signature.compare(1, prefix_length, prefix) == 0 &&
+                    g_jnihook->jvmti->IsModifiableClass(clazz, &modifiable) == JVMTI_ERROR_NONE && modifiable)
+                        classes.push_back(clazz);
+                else
+                        env->DeleteLocalRef(clazz);
+        }
+
+        g_jnihook->jvmti->Deallocate(reinterpret_cast<unsigned char *>(loaded_classes));
+
+        LOG("Prewarming %zu classes with prefix: %s\n", classes.size(), prefix);
+
+        try {
+                result = CacheClasses(env, classes);
+        } catch (...) {
+                LOG("ERR: Unhandled exception thrown\n");
+        }
+
+        for (auto clazz : classes)
+                env->DeleteLocalRef(clazz);
+
+        return result;
+}
+
+JNIHOOK_API jnihook_result_t JNIHOOK_CALL
+JNIHook_SetClassArchive(const char *directory)
+{
+        // Exclusive, since it may change how the classes are patched
+        std::unique_lock<std::shared_mutex> lock(g_init_mutex);
+
+        if (!directory) {
+                g_class_archive.close();
+                return JNIHOOK_OK;
+        }
+
+        // The copy suffix of the archive can only be adopted while no class is patched
+        bool adopt_suffix = std::all_of(std::begin(g_class_shards), std::end(g_class_shards), [](auto &shard) {
+                return std::all_of(shard.hooks.begin(), shard.hooks.end(), [](auto &class_hooks) {
+                        return class_hooks.second.empty();
+                });
+        });
+
+        auto copy_suffix = g_copy_suffix;
+        if (!g_class_archive.open(directory, copy_suffix, adopt_suffix)) {
+                LOG("ERR: Failed to open class archive in: %s\n", directory);
+                return JNIHOOK_ERR_UNKNOWN;
+        }
+
+        // The class files patched so far refer to the copies by the previous suffix
+        if (copy_suffix != g_copy_suffix) {
+                g_copy_suffix = copy_suffix;
+                g_class_file_cache.clear_patched();
+        }
+
+        return JNIHOOK_OK;
+}
+
+JNIHOOK_API jnihook_result_t JNIHOOK_CALL
+JNIHook_LoadManifest(const char *path)
+{
+        manifest_t manifest;
+
+        if (!path)
+                return JNIHOOK_ERR_INVALID_ARGUMENT;
+
+        if (!ReadManifest(path, manifest)) {
+                LOG("ERR: Failed to read manifest: %s\n", path);
+                return JNIHOOK_ERR_UNKNOWN;
+        }
+
+        std::lock_guard<std::mutex> lock(g_registry_mutex);
+
+        for (auto &method : manifest.methods) {
+                auto key = method.class_name + "." + method.name + method.signature;
+                g_prepatched_methods[key] = manifest.copy_suffix;
+        }
+
+        LOG("Loaded %zu prepatched methods from manifest: %s\n", manifest.methods.size(), path);
 
         return JNIHOOK_OK;
 }
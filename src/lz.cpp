@@ -0,0 +1,183 @@
+/*
+ *  -----------------------------------
+ * |         JNIHook - by rdbo         |
+ * |      Java VM Hooking Library      |
+ *  -----------------------------------
+ */
+
+/*
+ * Copyright (C) 2026    Rdbo
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License version 3
+ * as published by the Free Software Foundation.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "lz.hpp"
+#include <algorithm>
+#include <cstring>
+
+#define LZ_MIN_MATCH 4
+#define LZ_MAX_OFFSET 65535
+#define LZ_HASH_BITS 12
+#define LZ_LAST_LITERALS 5 // The end of the input is always emitted as literals
+
+static inline uint32_t
+read32(const uint8_t *p)
+{
+        uint32_t value;
+        memcpy(&value, p, sizeof(value));
+        return value;
+}
+
+static inline uint32_t
+hash4(uint32_t value)
+{
+        return (value * 2654435761U) >> (32 - LZ_HASH_BITS);
+}
+
+static void
+emit_length(std::vector<uint8_t> &out, size_t length)
+{
+        while (length >= 255) {
+                out.push_back(255);
+                length -= 255;
+        }
+        out.push_back(static_cast<uint8_t>(length));
+}
+
+static void
+emit_sequence(std::vector<uint8_t> &out, const uint8_t *literals, size_t literal_length, size_t offset, size_t match_length)
+{
+        size_t match_code = match_length ? match_length - LZ_MIN_MATCH : 0;
+        uint8_t token = static_cast<uint8_t>((std::min<size_t>(literal_length, 15) << 4) | std::min<size_t>(match_code, 15));
+
+        out.push_back(token);
+        if (literal_length >= 15)
+                emit_length(out, literal_length - 15);
+        out.insert(out.end(), literals, &literals[literal_length]);
+
+        if (!match_length)
+                return;
+
+        out.push_back(static_cast<uint8_t>(offset & 0xff));
+        out.push_back(static_cast<uint8_t>(offset >> 8));
+        if (match_code >= 15)
+                emit_length(out, match_code - 15);
+}
+
+std::vector<uint8_t>
+LzCompress(const uint8_t *data, size_t size)
+{
+        std::vector<uint8_t> out;
+        std::vector<uint32_t> table(1 << LZ_HASH_BITS, 0);
+        size_t anchor = 0;
+        size_t pos = 0;
+
+        out.reserve(size / 2 + 16);
+
+        if (size > LZ_MIN_MATCH + LZ_LAST_LITERALS) {
+                size_t match_limit = size - LZ_LAST_LITERALS;
+
+                // NOTE: Positions are stored off by one, so that 0 means "empty"
+                while (pos + LZ_MIN_MATCH <= match_limit) {
+                        uint32_t sequence = read32(&data[pos]);
+                        auto &slot = table[hash4(sequence)];
+                        size_t candidate = slot;
+                        slot = static_cast<uint32_t>(pos + 1);
+
+                        if (candidate == 0 || pos - (candidate - 1) > LZ_MAX_OFFSET ||
+                            read32(&data[candidate - 1]) != sequence) {
+                                ++pos;
+                                continue;
+                        }
+
+                        candidate -= 1;
+                        size_t length = LZ_MIN_MATCH;
+                        while (pos + length < match_limit && data[candidate + length] == data[pos + length])
+                                ++length;
+
+                        emit_sequence(out, &data[anchor], pos - anchor, pos - candidate, length);
+                        pos += length;
+                        anchor = pos;
+                }
+        }
+
+        emit_sequence(out, &data[anchor], size - anchor, 0, 0);
+
+        return out;
+}
+
+// Reads an extended length, returns false on truncated input
+static bool
+read_length(const uint8_t *data, size_t size, size_t &pos, size_t &length)
+{
+        uint8_t byte;
+
+        do {
+                if (pos >= size)
+                        return false;
+                byte = data[pos++];
+                length += byte;
+        } while (byte == 255);
+
+        return true;
+}
+
+std::optional<std::vector<uint8_t>>
+LzDecompress(const uint8_t *data, size_t compressed_size, size_t size)
+{
+        std::vector<uint8_t> out;
+        size_t pos = 0;
+
+        out.reserve(size);
+
+        while (pos < compressed_size) {
+                uint8_t token = data[pos++];
+                size_t literal_length = token >> 4;
+
+                if (literal_length == 15 && !read_length(data, compressed_size, pos, literal_length))
+                        return std::nullopt;
+
+                if (literal_length > compressed_size - pos || out.size() + literal_length > size)
+                        return std::nullopt;
+
+                out.insert(out.end(), &data[pos], &data[pos + literal_length]);
+                pos += literal_length;
+
+                // The last sequence has no match
+                if (pos == compressed_size)
+                        break;
+
+                if (compressed_size - pos < 2)
+                        return std::nullopt;
+
+                size_t offset = data[pos] | (data[pos + 1] << 8);
+                pos += 2;
+
+                size_t match_length = token & 0x0f;
+                if (match_length == 15 && !read_length(data, compressed_size, pos, match_length))
+                        return std::nullopt;
+                match_length += LZ_MIN_MATCH;
+
+                if (offset == 0 || offset > out.size() || out.size() + match_length > size)
+                        return std::nullopt;
+
+                // Matches may overlap with the bytes being written, copy byte by byte
+                size_t from = out.size() - offset;
+                for (size_t i = 0; i < match_length; ++i)
+                        out.push_back(out[from + i]);
+        }
+
+        if (out.size() != size)
+                return std::nullopt;
+
+        return out;
+}
@@ -0,0 +1,47 @@
+/*
+ *  -----------------------------------
+ * |         JNIHook - by rdbo         |
+ * |      Java VM Hooking Library      |
+ *  -----------------------------------
+ */
+
+/*
+ * Copyright (C) 2026    Rdbo
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License version 3
+ * as published by the Free Software Foundation.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef _LZ_HPP_
+#define _LZ_HPP_
+
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <vector>
+
+// Small LZ77 codec (similar to the LZ4 block format), fast enough
+// to be used on class files whenever they are demoted/inflated.
+//
+// Sequence format:
+//     token:            high nibble = literal length, low nibble = match length - 4
+//     [literal length]: extra bytes (each adds up to 255) if the nibble is 15
+//     literals
+//     offset:           2 bytes, little endian (omitted in the last sequence)
+//     [match length]:   extra bytes (each adds up to 255) if the nibble is 15
+std::vector<uint8_t>
+LzCompress(const uint8_t *data, size_t size);
+
+// Returns std::nullopt if the data is malformed or does not decompress to `size` bytes
+std::optional<std::vector<uint8_t>>
+LzDecompress(const uint8_t *data, size_t compressed_size, size_t size);
+
+#endif
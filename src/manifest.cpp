@@ -0,0 +1,80 @@
+/*
+ *  -----------------------------------
+ * |         JNIHook - by rdbo         |
+ * |      Java VM Hooking Library      |
+ *  -----------------------------------
+ */
+
+/*
+ * Copyright (C) 2026    Rdbo
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License version 3
+ * as published by the Free Software Foundation.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "manifest.hpp"
+#include <fstream>
+#include <sstream>
+
+bool
+ReadManifest(const std::string &path, manifest_t &manifest)
+{
+        std::ifstream file(path);
+        std::string line;
+        int version = 0;
+
+        if (!file)
+                return false;
+
+        manifest = {};
+
+        while (std::getline(file, line)) {
+                std::istringstream fields(line);
+                std::string kind;
+
+                if (!(fields >> kind) || kind[0] == '#')
+                        continue;
+
+                if (kind == "version") {
+                        fields >> version;
+                } else if (kind == "suffix") {
+                        fields >> manifest.copy_suffix;
+                } else if (kind == "method") {
+                        manifest_method_t method;
+
+                        if (!(fields >> method.class_name >> method.name >> method.signature))
+                                return false;
+
+                        manifest.methods.push_back(std::move(method));
+                }
+        }
+
+        return version == MANIFEST_VERSION && !manifest.copy_suffix.empty();
+}
+
+bool
+WriteManifest(const std::string &path, const manifest_t &manifest)
+{
+        std::ofstream file(path, std::ios::trunc);
+
+        if (!file)
+                return false;
+
+        file << "# Generated by jnihook-patch, see JNIHook_LoadManifest\n";
+        file << "version " << MANIFEST_VERSION << "\n";
+        file << "suffix " << manifest.copy_suffix << "\n";
+        for (auto &method : manifest.methods)
+                file << "method " << method.class_name << " " << method.name << " " << method.signature << "\n";
+
+        file.flush();
+
+        return static_cast<bool>(file);
+}
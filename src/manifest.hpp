@@ -0,0 +1,54 @@
+/*
+ *  -----------------------------------
+ * |         JNIHook - by rdbo         |
+ * |      Java VM Hooking Library      |
+ *  -----------------------------------
+ */
+
+/*
+ * Copyright (C) 2026    Rdbo
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License version 3
+ * as published by the Free Software Foundation.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef _MANIFEST_HPP_
+#define _MANIFEST_HPP_
+
+#include <string>
+#include <vector>
+
+#define MANIFEST_VERSION 1
+
+// Method of a class file that was patched ahead of time by jnihook-patch
+typedef struct manifest_method_t {
+        std::string class_name; // Internal name, e.g. "com/acme/Foo"
+        std::string name;
+        std::string signature;
+} manifest_method_t;
+
+// Text file written by jnihook-patch, and read by JNIHook_LoadManifest:
+//     # comment
+//     version <MANIFEST_VERSION>
+//     suffix <copy suffix of the patched methods>
+//     method <class name> <method name> <signature>
+typedef struct manifest_t {
+        std::string copy_suffix;
+        std::vector<manifest_method_t> methods;
+} manifest_t;
+
+bool
+ReadManifest(const std::string &path, manifest_t &manifest);
+
+bool
+WriteManifest(const std::string &path, const manifest_t &manifest);
+
+#endif
@@ -0,0 +1,162 @@
+/*
+ *  -----------------------------------
+ * |         JNIHook - by rdbo         |
+ * |      Java VM Hooking Library      |
+ *  -----------------------------------
+ */
+
+/*
+ * Copyright (C) 2026    Rdbo
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License version 3
+ * as published by the Free Software Foundation.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "metrics.hpp"
+#include <bit>
+#include <cstdio>
+#include <filesystem>
+
+#define HISTOGRAM_SUB_BITS 2 // log2(JNIHOOK_HISTOGRAM_SUB_BUCKETS)
+
+static_assert((1 << HISTOGRAM_SUB_BITS) == JNIHOOK_HISTOGRAM_SUB_BUCKETS);
+
+size_t
+MetricsHistogramIndex(uint64_t ns)
+{
+        if (ns < JNIHOOK_HISTOGRAM_SUB_BUCKETS)
+                return ns;
+
+        size_t exponent = 63 - std::countl_zero(ns);
+        size_t index = (exponent - HISTOGRAM_SUB_BITS + 1) * JNIHOOK_HISTOGRAM_SUB_BUCKETS +
+                       ((ns >> (exponent - HISTOGRAM_SUB_BITS)) & (JNIHOOK_HISTOGRAM_SUB_BUCKETS - 1));
+
+        // Everything above the last bucket is clamped into it
+        return std::min(index, static_cast<size_t>(JNIHOOK_HISTOGRAM_BUCKETS - 1));
+}
+
+uint64_t
+MetricsHistogramUpperBound(size_t index)
+{
+        if (index < JNIHOOK_HISTOGRAM_SUB_BUCKETS)
+                return index + 1;
+
+        size_t exponent = index / JNIHOOK_HISTOGRAM_SUB_BUCKETS + HISTOGRAM_SUB_BITS - 1;
+        uint64_t sub_bucket = index % JNIHOOK_HISTOGRAM_SUB_BUCKETS;
+
+        return (JNIHOOK_HISTOGRAM_SUB_BUCKETS + sub_bucket + 1) << (exponent - HISTOGRAM_SUB_BITS);
+}
+
+metrics_shard_t &
+MetricsCurrentShard(hook_metrics_t *metrics)
+{
+        static std::atomic<size_t> next_shard = 0;
+        thread_local size_t shard = next_shard.fetch_add(1, std::memory_order_relaxed) % METRICS_SHARDS;
+
+        return metrics->shards[shard];
+}
+
+void
+MetricsSnapshot(hook_metrics_t *metrics, jnihook_hook_metrics_t *snapshot)
+{
+        *snapshot = {};
+
+        for (auto &shard : metrics->shards) {
+                snapshot->calls += shard.calls.load(std::memory_order_relaxed);
+                snapshot->total_ns += shard.total_ns.load(std::memory_order_relaxed);
+                for (size_t i = 0; i < JNIHOOK_HISTOGRAM_BUCKETS; ++i)
+                        snapshot->buckets[i] += shard.buckets[i].load(std::memory_order_relaxed);
+        }
+}
+
+// Escapes a label value as required by the exposition format
+static std::string
+escape_label(const std::string &value)
+{
+        std::string escaped;
+
+        for (auto c : value) {
+                if (c == '\\' || c == '"')
+                        escaped += '\\';
+                else if (c == '\n') {
+                        escaped += "\\n";
+                        continue;
+                }
+
+                escaped += c;
+        }
+
+        return escaped;
+}
+
+bool
+MetricsExportPrometheus(const std::vector<hook_metrics_t *> &metrics, const char *path)
+{
+        // Write to a temporary file first, so that scrapers
+        // never observe a partially written file
+        auto tmp_path = std::string(path) + ".tmp";
+        FILE *file = fopen(tmp_path.c_str(), "w");
+        if (!file)
+                return false;
+
+        fprintf(file, "# HELP jnihook_hook_calls_total Amount of calls to the hook.\n");
+        fprintf(file, "# TYPE jnihook_hook_calls_total counter\n");
+        for (auto m : metrics) {
+                jnihook_hook_metrics_t snapshot;
+
+                MetricsSnapshot(m, &snapshot);
+                fprintf(file, "jnihook_hook_calls_total{method=\"%s\"} %llu\n",
+                        escape_label(m->label).c_str(), static_cast<unsigned long long>(snapshot.calls));
+        }
+
+        fprintf(file, "# HELP jnihook_hook_duration_seconds Time spent inside the hook.\n");
+        fprintf(file, "# TYPE jnihook_hook_duration_seconds histogram\n");
+        for (auto m : metrics) {
+                jnihook_hook_metrics_t snapshot;
+                uint64_t cumulative = 0;
+                size_t last_bucket = 0;
+                auto label = escape_label(m->label);
+
+                MetricsSnapshot(m, &snapshot);
+                for (size_t i = 0; i < JNIHOOK_HISTOGRAM_BUCKETS; ++i) {
+                        if (snapshot.buckets[i] > 0)
+                                last_bucket = i;
+                }
+
+                // Only emit the buckets up until the slowest observed call
+                for (size_t i = 0; i <= last_bucket; ++i) {
+                        // Observations are integers, so everything below the
+                        // exclusive bound is also less or equal than (bound - 1)
+                        double le = static_cast<double>(MetricsHistogramUpperBound(i) - 1) / 1e9;
+
+                        cumulative += snapshot.buckets[i];
+                        fprintf(file, "jnihook_hook_duration_seconds_bucket{method=\"%s\",le=\"%.9g\"} %llu\n",
+                                label.c_str(), le, static_cast<unsigned long long>(cumulative));
+                }
+
+                fprintf(file, "jnihook_hook_duration_seconds_bucket{method=\"%s\",le=\"+Inf\"} %llu\n",
+                        label.c_str(), static_cast<unsigned long long>(cumulative));
+                fprintf(file, "jnihook_hook_duration_seconds_sum{method=\"%s\"} %.9f\n",
+                        label.c_str(), static_cast<double>(snapshot.total_ns) / 1e9);
+                fprintf(file, "jnihook_hook_duration_seconds_count{method=\"%s\"} %llu\n",
+                        label.c_str(), static_cast<unsigned long long>(cumulative));
+        }
+
+        bool ok = !ferror(file);
+        ok = (fclose(file) == 0) && ok;
+        if (!ok)
+                return false;
+
+        std::error_code ec;
+        std::filesystem::rename(tmp_path, path, ec);
+
+        return !ec;
+}
@@ -0,0 +1,81 @@
+/*
+ *  -----------------------------------
+ * |         JNIHook - by rdbo         |
+ * |      Java VM Hooking Library      |
+ *  -----------------------------------
+ */
+
+/*
+ * Copyright (C) 2026    Rdbo
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License version 3
+ * as published by the Free Software Foundation.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef _METRICS_HPP_
+#define _METRICS_HPP_
+
+#include <jnihook.h>
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#define METRICS_SHARDS 8
+
+// Counters of a single shard. Each thread always writes to the same shard,
+// so threads calling the same hook rarely contend on a cache line.
+typedef struct alignas(64) metrics_shard_t {
+        std::atomic<uint64_t> calls;
+        std::atomic<uint64_t> total_ns;
+        std::atomic<uint64_t> buckets[JNIHOOK_HISTOGRAM_BUCKETS];
+} metrics_shard_t;
+
+typedef struct hook_metrics_t {
+        std::string label; // Format: class.method(signature)
+        metrics_shard_t shards[METRICS_SHARDS];
+} hook_metrics_t;
+
+// Log-linear histogram: every power of two is split into
+// JNIHOOK_HISTOGRAM_SUB_BUCKETS linear buckets
+size_t
+MetricsHistogramIndex(uint64_t ns);
+
+// Exclusive upper bound (in nanoseconds) of a histogram bucket
+uint64_t
+MetricsHistogramUpperBound(size_t index);
+
+metrics_shard_t &
+MetricsCurrentShard(hook_metrics_t *metrics);
+
+inline void
+MetricsRecordCall(hook_metrics_t *metrics)
+{
+        MetricsCurrentShard(metrics).calls.fetch_add(1, std::memory_order_relaxed);
+}
+
+inline void
+MetricsRecordDuration(hook_metrics_t *metrics, uint64_t ns)
+{
+        auto &shard = MetricsCurrentShard(metrics);
+
+        shard.total_ns.fetch_add(ns, std::memory_order_relaxed);
+        shard.buckets[MetricsHistogramIndex(ns)].fetch_add(1, std::memory_order_relaxed);
+}
+
+void
+MetricsSnapshot(hook_metrics_t *metrics, jnihook_hook_metrics_t *snapshot);
+
+// Writes the metrics in the Prometheus text exposition format
+bool
+MetricsExportPrometheus(const std::vector<hook_metrics_t *> &metrics, const char *path);
+
+#endif
@@ -0,0 +1,87 @@
+/*
+ *  -----------------------------------
+ * |         JNIHook - by rdbo         |
+ * |      Java VM Hooking Library      |
+ *  -----------------------------------
+ */
+
+/*
+ * Copyright (C) 2026    Rdbo
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License version 3
+ * as published by the Free Software Foundation.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "patcher.hpp"
+#include "stats.hpp"
+#include <unordered_set>
+
+using namespace jnif;
+
+size_t
+PatchClassFile(ClassFile *cf, const std::vector<method_info_t> &hooked_methods, const std::string &copy_suffix)
+{
+        StatsTimer timer(JNIHOOK_PHASE_PATCH);
+        std::unordered_set<std::string> existing_methods;
+        size_t patched = 0;
+
+        for (auto &method : cf->methods)
+                existing_methods.insert(std::string(method.getName()) + method.getDesc());
+
+        // NOTE: The `methods` attribute only has the methods defined by the main class of this ClassFile
+        //       Method references are not included here
+        //       If the source file has more than one class, they are compiled as separate ClassFiles
+        for (auto &method : cf->methods) {
+                auto name = method.getName();
+                auto descriptor = method.getDesc();
+
+                // Check if the current method is a method that should be hooked
+                // TODO: Use hashmap for faster lookup
+                bool should_hook = false;
+                for (auto &minfo : hooked_methods) {
+                        if (minfo.name == name && minfo.signature == descriptor) {
+                                should_hook = true;
+                                break;
+                        }
+                }
+                if (!should_hook)
+                        continue;
+
+                // New method
+                auto copyName = name + copy_suffix;
+                if (existing_methods.count(copyName + descriptor))
+                        continue;
+
+                u2 copyflags = Method::PRIVATE | Method::FINAL;
+                if (method.accessFlags & Method::STATIC){
+                        copyflags |= Method::STATIC;
+                }
+                auto &copyMethod = cf->addMethod(copyName.c_str(), descriptor, copyflags);
+
+                // Set method to native
+                *(u2 *)&method.accessFlags |= Method::NATIVE;
+
+                // Remove "Code" attribute
+                for (size_t i = 0; i < method.attrs.size(); ++i) {
+                        auto &attr = method.attrs[i];
+                        copyMethod.attrs.add((Attr *)&attr); // Copy method should inherit all the attributes
+                                                             // from the original method
+                        if (attr.kind == ATTR_CODE) {
+                                method.attrs.remove(i);
+                                break;
+                        }
+                }
+
+                ++patched;
+        }
+
+        return patched;
+}
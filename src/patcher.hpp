@@ -0,0 +1,48 @@
+/*
+ *  -----------------------------------
+ * |         JNIHook - by rdbo         |
+ * |      Java VM Hooking Library      |
+ *  -----------------------------------
+ */
+
+/*
+ * Copyright (C) 2026    Rdbo
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License version 3
+ * as published by the Free Software Foundation.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef _PATCHER_HPP_
+#define _PATCHER_HPP_
+
+#include <jni.h>
+#include <jnif.hpp>
+#include <cstddef>
+#include <string>
+#include <vector>
+
+typedef struct method_info_t {
+        std::string name;
+        std::string signature;
+        jint access_flags;
+} method_info_t;
+
+// Applies hooks to a class file, returns the amount of methods patched.
+// Every hooked method is turned into a native method (so that the hook can be
+// registered with RegisterNatives), and its code is moved to a private copy
+// named `<method name><copy_suffix>`, which is called as the original method.
+// Methods that are already patched (their copy exists) are skipped,
+// so patching a class file twice has no effect.
+// NOTE: Shared by the runtime and the offline patcher (jnihook-patch)
+size_t
+PatchClassFile(jnif::ClassFile *cf, const std::vector<method_info_t> &hooked_methods, const std::string &copy_suffix);
+
+#endif
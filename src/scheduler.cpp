@@ -0,0 +1,111 @@
+/*
+ *  -----------------------------------
+ * |         JNIHook - by rdbo         |
+ * |      Java VM Hooking Library      |
+ *  -----------------------------------
+ */
+
+/*
+ * Copyright (C) 2026    Rdbo
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License version 3
+ * as published by the Free Software Foundation.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "scheduler.hpp"
+#include <algorithm>
+
+// A method costs about as much as this many class file bytes
+// (linking, jmethodID and constant pool cache updates)
+#define PAUSE_MODEL_METHOD_WEIGHT 64
+
+// Starting point used before any pause is observed
+#define PAUSE_MODEL_DEFAULT_OVERHEAD_NS 200000.0
+#define PAUSE_MODEL_DEFAULT_RATE_NS 10.0
+
+#define PAUSE_MODEL_DECAY 0.9
+
+static double
+cost_units(const class_cost_t &cost)
+{
+        return static_cast<double>(cost.bytes + PAUSE_MODEL_METHOD_WEIGHT * cost.methods);
+}
+
+PauseModel::PauseModel()
+        : overhead_ns(PAUSE_MODEL_DEFAULT_OVERHEAD_NS), rate_ns(PAUSE_MODEL_DEFAULT_RATE_NS)
+{}
+
+uint64_t
+PauseModel::predict(const class_cost_t &cost) const
+{
+        return static_cast<uint64_t>(overhead_ns + rate_ns * cost_units(cost));
+}
+
+void
+PauseModel::observe(const class_cost_t &cost, uint64_t pause_ns)
+{
+        double x = cost_units(cost);
+        double y = static_cast<double>(pause_ns);
+
+        weight = weight * PAUSE_MODEL_DECAY + 1.0;
+        sum_x = sum_x * PAUSE_MODEL_DECAY + x;
+        sum_y = sum_y * PAUSE_MODEL_DECAY + y;
+        sum_xx = sum_xx * PAUSE_MODEL_DECAY + x * x;
+        sum_xy = sum_xy * PAUSE_MODEL_DECAY + x * y;
+
+        double denominator = weight * sum_xx - sum_x * sum_x;
+        if (weight > 1.0 && denominator > 1e-9 * weight * sum_xx) {
+                rate_ns = (weight * sum_xy - sum_x * sum_y) / denominator;
+                overhead_ns = (sum_y - rate_ns * sum_x) / weight;
+        } else if (x > 0.0) {
+                // Not enough variety in the observations to fit both
+                // coefficients, only adjust the rate
+                rate_ns = std::max(y - overhead_ns, 0.0) / x;
+        }
+
+        // Negative coefficients make no sense and would underestimate big batches
+        if (rate_ns < 0.0) {
+                rate_ns = sum_x > 0.0 ? sum_y / sum_x : PAUSE_MODEL_DEFAULT_RATE_NS;
+                overhead_ns = 0.0;
+        } else if (overhead_ns < 0.0) {
+                overhead_ns = 0.0;
+                rate_ns = sum_x > 0.0 ? sum_y / sum_x : rate_ns;
+        }
+}
+
+std::vector<std::vector<size_t>>
+ScheduleBatches(const std::vector<class_cost_t> &classes, uint64_t budget_ns, const PauseModel &model)
+{
+        std::vector<std::vector<size_t>> batches;
+        std::vector<size_t> batch;
+        class_cost_t batch_cost = { 0, 0 };
+
+        for (size_t i = 0; i < classes.size(); ++i) {
+                class_cost_t cost = {
+                        batch_cost.bytes + classes[i].bytes,
+                        batch_cost.methods + classes[i].methods
+                };
+
+                if (!batch.empty() && model.predict(cost) > budget_ns) {
+                        batches.push_back(std::move(batch));
+                        batch.clear();
+                        cost = classes[i];
+                }
+
+                batch.push_back(i);
+                batch_cost = cost;
+        }
+
+        if (!batch.empty())
+                batches.push_back(std::move(batch));
+
+        return batches;
+}
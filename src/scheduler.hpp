@@ -0,0 +1,66 @@
+/*
+ *  -----------------------------------
+ * |         JNIHook - by rdbo         |
+ * |      Java VM Hooking Library      |
+ *  -----------------------------------
+ */
+
+/*
+ * Copyright (C) 2026    Rdbo
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License version 3
+ * as published by the Free Software Foundation.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef _SCHEDULER_HPP_
+#define _SCHEDULER_HPP_
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+typedef struct class_cost_t {
+        uint64_t bytes;   // Size of the class file passed to RedefineClasses
+        uint64_t methods; // Amount of methods in the class file
+} class_cost_t;
+
+// Linear model of the pause caused by redefining a batch of classes:
+//     pause = overhead + rate * (bytes + PAUSE_MODEL_METHOD_WEIGHT * methods)
+// The coefficients are fitted with least squares on the observed pauses.
+// Older observations decay, so the model follows changes in the JVM
+// (heap size, amount of threads, JIT state).
+class PauseModel {
+private:
+        double weight = 0.0;
+        double sum_x = 0.0;
+        double sum_y = 0.0;
+        double sum_xx = 0.0;
+        double sum_xy = 0.0;
+
+        double overhead_ns;
+        double rate_ns;
+public:
+        PauseModel();
+
+        uint64_t
+        predict(const class_cost_t &cost) const;
+
+        void
+        observe(const class_cost_t &cost, uint64_t pause_ns);
+};
+
+// Groups the classes (by index) in batches whose predicted pause fits in
+// `budget_ns`, keeping their order. A class that does not fit the budget
+// by itself gets a batch of its own.
+std::vector<std::vector<size_t>>
+ScheduleBatches(const std::vector<class_cost_t> &classes, uint64_t budget_ns, const PauseModel &model);
+
+#endif
@@ -0,0 +1,86 @@
+/*
+ *  -----------------------------------
+ * |         JNIHook - by rdbo         |
+ * |      Java VM Hooking Library      |
+ *  -----------------------------------
+ */
+
+/*
+ * Copyright (C) 2026    Rdbo
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License version 3
+ * as published by the Free Software Foundation.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "stats.hpp"
+
+stats_t g_stats = {};
+
+void
+StatsSnapshot(jnihook_stats_t *stats)
+{
+        // NOTE: Every counter is read individually, so a snapshot taken while
+        //       a hook operation is running may be slightly inconsistent
+        //       (e.g. a phase count already bumped but its total not yet).
+        for (int i = 0; i < JNIHOOK_PHASE_COUNT; ++i) {
+                stats->phases[i].count = g_stats.phase_count[i].load(std::memory_order_relaxed);
+                stats->phases[i].total_ns = g_stats.phase_total_ns[i].load(std::memory_order_relaxed);
+                stats->phases[i].max_ns = g_stats.phase_max_ns[i].load(std::memory_order_relaxed);
+        }
+
+        stats->attaches = g_stats.attaches.load(std::memory_order_relaxed);
+        stats->detaches = g_stats.detaches.load(std::memory_order_relaxed);
+        stats->failures = g_stats.failures.load(std::memory_order_relaxed);
+        stats->classes_cached = g_stats.classes_cached.load(std::memory_order_relaxed);
+        stats->classes_redefined = g_stats.classes_redefined.load(std::memory_order_relaxed);
+        stats->bytes_serialized = g_stats.bytes_serialized.load(std::memory_order_relaxed);
+        stats->threads_suspended = g_stats.threads_suspended.load(std::memory_order_relaxed);
+        stats->max_pause_ns = g_stats.max_pause_ns.load(std::memory_order_relaxed);
+        stats->classes_transformed = g_stats.classes_transformed.load(std::memory_order_relaxed);
+        stats->classes_unloaded = g_stats.classes_unloaded.load(std::memory_order_relaxed);
+        stats->bytes_reclaimed = g_stats.bytes_reclaimed.load(std::memory_order_relaxed);
+        stats->content_hash_hits = g_stats.content_hash_hits.load(std::memory_order_relaxed);
+        stats->redefinitions_skipped = g_stats.redefinitions_skipped.load(std::memory_order_relaxed);
+        stats->archive_hits = g_stats.archive_hits.load(std::memory_order_relaxed);
+        stats->archive_misses = g_stats.archive_misses.load(std::memory_order_relaxed);
+        stats->archive_stores = g_stats.archive_stores.load(std::memory_order_relaxed);
+        stats->archive_corrupt = g_stats.archive_corrupt.load(std::memory_order_relaxed);
+        stats->prepatched_attaches = g_stats.prepatched_attaches.load(std::memory_order_relaxed);
+}
+
+void
+StatsReset()
+{
+        for (int i = 0; i < JNIHOOK_PHASE_COUNT; ++i) {
+                g_stats.phase_count[i].store(0, std::memory_order_relaxed);
+                g_stats.phase_total_ns[i].store(0, std::memory_order_relaxed);
+                g_stats.phase_max_ns[i].store(0, std::memory_order_relaxed);
+        }
+
+        g_stats.attaches.store(0, std::memory_order_relaxed);
+        g_stats.detaches.store(0, std::memory_order_relaxed);
+        g_stats.failures.store(0, std::memory_order_relaxed);
+        g_stats.classes_cached.store(0, std::memory_order_relaxed);
+        g_stats.classes_redefined.store(0, std::memory_order_relaxed);
+        g_stats.bytes_serialized.store(0, std::memory_order_relaxed);
+        g_stats.threads_suspended.store(0, std::memory_order_relaxed);
+        g_stats.max_pause_ns.store(0, std::memory_order_relaxed);
+        g_stats.classes_transformed.store(0, std::memory_order_relaxed);
+        g_stats.classes_unloaded.store(0, std::memory_order_relaxed);
+        g_stats.bytes_reclaimed.store(0, std::memory_order_relaxed);
+        g_stats.content_hash_hits.store(0, std::memory_order_relaxed);
+        g_stats.redefinitions_skipped.store(0, std::memory_order_relaxed);
+        g_stats.archive_hits.store(0, std::memory_order_relaxed);
+        g_stats.archive_misses.store(0, std::memory_order_relaxed);
+        g_stats.archive_stores.store(0, std::memory_order_relaxed);
+        g_stats.archive_corrupt.store(0, std::memory_order_relaxed);
+        g_stats.prepatched_attaches.store(0, std::memory_order_relaxed);
+}
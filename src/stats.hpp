@@ -0,0 +1,125 @@
+/*
+ *  -----------------------------------
+ * |         JNIHook - by rdbo         |
+ * |      Java VM Hooking Library      |
+ *  -----------------------------------
+ */
+
+/*
+ * Copyright (C) 2026    Rdbo
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License version 3
+ * as published by the Free Software Foundation.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef _STATS_HPP_
+#define _STATS_HPP_
+
+#include <jnihook.h>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+typedef struct stats_t {
+        std::atomic<uint64_t> phase_count[JNIHOOK_PHASE_COUNT];
+        std::atomic<uint64_t> phase_total_ns[JNIHOOK_PHASE_COUNT];
+        std::atomic<uint64_t> phase_max_ns[JNIHOOK_PHASE_COUNT];
+
+        std::atomic<uint64_t> attaches;
+        std::atomic<uint64_t> detaches;
+        std::atomic<uint64_t> failures;
+        std::atomic<uint64_t> classes_cached;
+        std::atomic<uint64_t> classes_redefined;
+        std::atomic<uint64_t> bytes_serialized;
+        std::atomic<uint64_t> threads_suspended;
+        std::atomic<uint64_t> max_pause_ns;
+        std::atomic<uint64_t> classes_transformed;
+        std::atomic<uint64_t> classes_unloaded;
+        std::atomic<uint64_t> bytes_reclaimed;
+        std::atomic<uint64_t> content_hash_hits;
+        std::atomic<uint64_t> redefinitions_skipped;
+        std::atomic<uint64_t> archive_hits;
+        std::atomic<uint64_t> archive_misses;
+        std::atomic<uint64_t> archive_stores;
+        std::atomic<uint64_t> archive_corrupt;
+        std::atomic<uint64_t> prepatched_attaches;
+} stats_t;
+
+extern stats_t g_stats;
+
+// Monotonic timestamp in nanoseconds
+inline uint64_t
+StatsNow()
+{
+        auto since_epoch = std::chrono::steady_clock::now().time_since_epoch();
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(since_epoch).count();
+}
+
+inline void
+StatsAdd(std::atomic<uint64_t> &counter, uint64_t value)
+{
+        counter.fetch_add(value, std::memory_order_relaxed);
+}
+
+inline void
+StatsMax(std::atomic<uint64_t> &counter, uint64_t value)
+{
+        uint64_t current = counter.load(std::memory_order_relaxed);
+        while (current < value && !counter.compare_exchange_weak(current, value, std::memory_order_relaxed));
+}
+
+inline void
+StatsRecordPhase(jnihook_phase_t phase, uint64_t elapsed_ns)
+{
+        StatsAdd(g_stats.phase_count[phase], 1);
+        StatsAdd(g_stats.phase_total_ns[phase], elapsed_ns);
+        StatsMax(g_stats.phase_max_ns[phase], elapsed_ns);
+}
+
+// Records the time spent in a phase from construction until
+// destruction (or until `stop` is called, whichever comes first)
+class StatsTimer {
+private:
+        jnihook_phase_t phase;
+        uint64_t start;
+        bool stopped;
+public:
+        inline StatsTimer(jnihook_phase_t phase)
+                : phase(phase), start(StatsNow()), stopped(false)
+        {}
+
+        inline ~StatsTimer()
+        {
+                stop();
+        }
+
+        inline uint64_t stop()
+        {
+                if (stopped)
+                        return 0;
+
+                uint64_t elapsed = StatsNow() - start;
+                StatsRecordPhase(phase, elapsed);
+                stopped = true;
+                return elapsed;
+        }
+
+        StatsTimer(const StatsTimer &) = delete;
+        StatsTimer &operator=(const StatsTimer &) = delete;
+};
+
+void
+StatsSnapshot(jnihook_stats_t *stats);
+
+void
+StatsReset();
+
+#endif
@@ -0,0 +1,180 @@
+/*
+ *  -----------------------------------
+ * |         JNIHook - by rdbo         |
+ * |      Java VM Hooking Library      |
+ *  -----------------------------------
+ */
+
+/*
+ * Copyright (C) 2026    Rdbo
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License version 3
+ * as published by the Free Software Foundation.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "threadpool.hpp"
+#include <algorithm>
+
+ThreadPool::ThreadPool(size_t threads)
+{
+        if (threads == 0) {
+                size_t hardware_threads = std::thread::hardware_concurrency();
+                threads = hardware_threads > 1 ? hardware_threads - 1 : 0;
+        }
+
+        thread_count = threads;
+}
+
+ThreadPool::~ThreadPool()
+{
+        {
+                std::lock_guard<std::mutex> lock(mutex);
+                stopping = true;
+        }
+
+        cond.notify_all();
+
+        for (auto &thread : threads)
+                thread.join();
+}
+
+// Takes a range from the front of the participant's queue, or steals one from the back of another queue
+bool
+ThreadPool::take(size_t slot, std::pair<size_t, size_t> &range)
+{
+        for (size_t i = 0; i < queues.size(); ++i) {
+                auto &queue = *queues[(slot + i) % queues.size()];
+                std::lock_guard<std::mutex> lock(queue.mutex);
+
+                if (queue.ranges.empty())
+                        continue;
+
+                if (i == 0) {
+                        range = queue.ranges.front();
+                        queue.ranges.pop_front();
+                } else {
+                        range = queue.ranges.back();
+                        queue.ranges.pop_back();
+                }
+
+                return true;
+        }
+
+        return false;
+}
+
+void
+ThreadPool::work(size_t slot, const std::function<void(size_t)> &fn)
+{
+        std::pair<size_t, size_t> range;
+        size_t finished = 0;
+
+        // NOTE: No ranges are added once a job starts, so empty queues mean that
+        //       every item has been taken (the ones in progress finish on their own)
+        while (take(slot, range)) {
+                for (size_t i = range.first; i < range.second; ++i)
+                        fn(i);
+                finished += range.second - range.first;
+        }
+
+        std::lock_guard<std::mutex> lock(mutex);
+        pending -= finished;
+}
+
+void
+ThreadPool::run(size_t slot)
+{
+        unsigned seen_generation = 0;
+
+        for (;;) {
+                const std::function<void(size_t)> *fn;
+
+                {
+                        std::unique_lock<std::mutex> lock(mutex);
+                        cond.wait(lock, [&]() { return stopping || (job && job_generation != seen_generation); });
+                        if (stopping)
+                                return;
+
+                        seen_generation = job_generation;
+                        fn = job;
+                        ++active;
+                }
+
+                work(slot, *fn);
+
+                {
+                        std::lock_guard<std::mutex> lock(mutex);
+                        --active;
+                }
+
+                done_cond.notify_all();
+        }
+}
+
+void
+ThreadPool::parallel_for(size_t count, const std::function<void(size_t)> &fn)
+{
+        if (count == 0)
+                return;
+
+        // Small jobs are not worth waking up the pool. Jobs submitted while the pool
+        // is busy run on their caller instead of waiting, so that callers preparing
+        // different classes never wait for each other.
+        std::unique_lock<std::mutex> run_lock(run_mutex, std::defer_lock);
+        if (count == 1 || thread_count == 0 || !run_lock.try_lock()) {
+                for (size_t i = 0; i < count; ++i)
+                        fn(i);
+                return;
+        }
+
+        {
+                std::lock_guard<std::mutex> lock(mutex);
+
+                while (queues.size() < thread_count + 1)
+                        queues.push_back(std::make_unique<work_queue_t>());
+
+                while (threads.size() < thread_count)
+                        threads.emplace_back(&ThreadPool::run, this, threads.size() + 1);
+
+                // Deal the indices in ranges of ~1/4 of each participant's share,
+                // contiguous per participant to keep neighbouring items together
+                size_t chunk = std::max<size_t>(1, count / (queues.size() * 4));
+                size_t per_queue = (count + queues.size() - 1) / queues.size();
+                for (size_t q = 0; q < queues.size(); ++q) {
+                        size_t begin = std::min(count, q * per_queue);
+                        size_t end = std::min(count, begin + per_queue);
+
+                        std::lock_guard<std::mutex> queue_lock(queues[q]->mutex);
+                        for (size_t i = begin; i < end; i += chunk)
+                                queues[q]->ranges.push_back({ i, std::min(end, i + chunk) });
+                }
+
+                job = &fn;
+                job_generation += 1;
+                pending = count;
+        }
+
+        cond.notify_all();
+
+        work(0, fn);
+
+        // NOTE: The threads that joined the job must be done with it,
+        //       since `fn` does not outlive this call
+        std::unique_lock<std::mutex> lock(mutex);
+        done_cond.wait(lock, [&]() { return pending == 0 && active == 0; });
+        job = nullptr;
+}
+
+size_t
+ThreadPool::size() const
+{
+        return thread_count + 1;
+}
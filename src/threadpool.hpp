@@ -0,0 +1,94 @@
+/*
+ *  -----------------------------------
+ * |         JNIHook - by rdbo         |
+ * |      Java VM Hooking Library      |
+ *  -----------------------------------
+ */
+
+/*
+ * Copyright (C) 2026    Rdbo
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License version 3
+ * as published by the Free Software Foundation.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef _THREADPOOL_HPP_
+#define _THREADPOOL_HPP_
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Work-stealing pool of native threads (not attached to the JVM) for
+// CPU-bound work, such as parsing and patching class files.
+// Every participant of a job (the pool threads and the caller) gets its share
+// of the indices as small ranges in its own queue. It takes ranges from the
+// front of its queue, and when it runs out, steals from the back of the others,
+// so that a few expensive items (e.g. huge classes) don't leave threads idle.
+// The threads are started on the first job and kept until destruction.
+class ThreadPool {
+private:
+        typedef struct alignas(64) work_queue_t {
+                std::mutex mutex;
+                std::deque<std::pair<size_t, size_t>> ranges; // [begin, end)
+        } work_queue_t;
+
+        std::vector<std::unique_ptr<work_queue_t>> queues; // Index 0 belongs to the caller
+
+        std::mutex mutex;
+        std::condition_variable cond;      // Signals the threads that a job is available
+        std::condition_variable done_cond; // Signals the caller that the job is done
+        std::mutex run_mutex;              // Only one job runs on the pool at a time
+        std::vector<std::thread> threads;
+        size_t thread_count;
+        bool stopping = false;
+
+        // Current job
+        const std::function<void(size_t)> *job = nullptr;
+        unsigned job_generation = 0;
+        size_t active = 0;  // Threads working on the current job
+        size_t pending = 0; // Items of the current job that have not finished
+
+        void
+        run(size_t slot);
+
+        bool
+        take(size_t slot, std::pair<size_t, size_t> &range);
+
+        void
+        work(size_t slot, const std::function<void(size_t)> &fn);
+public:
+        // 0 threads means one less than the amount of hardware threads
+        // (the thread that submits a job works on it too)
+        explicit ThreadPool(size_t threads = 0);
+
+        ~ThreadPool();
+
+        // Calls `fn` for every index in [0, count) across the pool and waits for all of them.
+        // If another job is using the pool, `fn` is called on the current thread only.
+        // NOTE: `fn` must not throw
+        void
+        parallel_for(size_t count, const std::function<void(size_t)> &fn);
+
+        size_t
+        size() const;
+
+        ThreadPool(const ThreadPool &) = delete;
+        ThreadPool &operator=(const ThreadPool &) = delete;
+};
+
+#endif
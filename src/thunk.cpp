@@ -0,0 +1,291 @@
+/*
+ *  -----------------------------------
+ * |         JNIHook - by rdbo         |
+ * |      Java VM Hooking Library      |
+ *  -----------------------------------
+ */
+
+/*
+ * Copyright (C) 2026    Rdbo
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License version 3
+ * as published by the Free Software Foundation.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "thunk.hpp"
+#include "codearena.hpp"
+#include "stats.hpp"
+#include <cstddef>
+#include <mutex>
+
+// How many nested instrumented calls are timed per thread.
+// Deeper calls are still counted, but not timed.
+#define THUNK_MAX_DEPTH 256
+
+typedef struct thunk_frame_t {
+        void *return_address;
+        hook_metrics_t *metrics;
+        uint64_t start;
+} thunk_frame_t;
+
+thread_local thunk_frame_t t_thunk_frames[THUNK_MAX_DEPTH];
+thread_local size_t t_thunk_depth = 0;
+
+static void *g_thunk_enter_stub = nullptr;
+static void *g_thunk_exit_stub = nullptr;
+
+// Called by the enter stub before jumping into the hook.
+// Returns the address the hook should return to.
+static void *
+ThunkEnter(timing_thunk_t *thunk, void *return_address)
+{
+        MetricsRecordCall(thunk->metrics);
+
+        if (t_thunk_depth >= THUNK_MAX_DEPTH)
+                return return_address;
+
+        auto &frame = t_thunk_frames[t_thunk_depth++];
+        frame.return_address = return_address;
+        frame.metrics = thunk->metrics;
+        frame.start = StatsNow();
+
+        return g_thunk_exit_stub;
+}
+
+// Called by the exit stub after the hook returned.
+// Returns the original return address of the call.
+static void *
+ThunkExit()
+{
+        auto &frame = t_thunk_frames[--t_thunk_depth];
+
+        MetricsRecordDuration(frame.metrics, StatsNow() - frame.start);
+
+        return frame.return_address;
+}
+
+#if defined(__x86_64__) || defined(_M_X64)
+// NOTE: The stubs load the arguments of the C++ helpers in both the
+//       System V (rdi, rsi) and Microsoft x64 (rcx, rdx) registers,
+//       so the same code works on every x86_64 calling convention.
+//       Every argument register of both conventions is preserved.
+
+// Stack layout of the enter stub (offsets from rsp after the prologue):
+//     [0, 32)    shadow space for the helper call (Microsoft x64)
+//     [32, 160)  xmm0-xmm7
+//     [160, 168) thunk context (r10)
+//     [168, 216) r9, r8, rcx, rdx, rsi, rdi
+//     [216, 224) return address
+#define ENTER_FRAME_SIZE 168
+#define ENTER_XMM_OFFSET 32
+#define ENTER_CONTEXT_OFFSET 160
+#define ENTER_RETURN_OFFSET 216
+
+static void
+emit_xmm_transfer(CodeBuffer &code, bool store)
+{
+        for (uint8_t i = 0; i < 8; ++i) {
+                // movdqu [rsp + disp32], xmm<i> / movdqu xmm<i>, [rsp + disp32]
+                code.emit({ 0xF3, 0x0F, static_cast<uint8_t>(store ? 0x7F : 0x6F), static_cast<uint8_t>(0x84 | (i << 3)), 0x24 });
+                code.emit_imm<int32_t>(ENTER_XMM_OFFSET + 16 * i);
+        }
+}
+
+static void *
+generate_enter_stub()
+{
+        CodeBuffer code;
+
+        code.emit({ 0x57, 0x56, 0x52, 0x51, 0x41, 0x50, 0x41, 0x51 }); // push rdi, rsi, rdx, rcx, r8, r9
+        code.emit({ 0x48, 0x81, 0xEC });                               // sub rsp, ENTER_FRAME_SIZE
+        code.emit_imm<int32_t>(ENTER_FRAME_SIZE);
+        emit_xmm_transfer(code, true);
+        code.emit({ 0x4C, 0x89, 0x94, 0x24 });                         // mov [rsp + ENTER_CONTEXT_OFFSET], r10
+        code.emit_imm<int32_t>(ENTER_CONTEXT_OFFSET);
+
+        code.emit({ 0x4C, 0x89, 0xD7 });                               // mov rdi, r10
+        code.emit({ 0x4C, 0x89, 0xD1 });                               // mov rcx, r10
+        code.emit({ 0x48, 0x8B, 0xB4, 0x24 });                         // mov rsi, [rsp + ENTER_RETURN_OFFSET]
+        code.emit_imm<int32_t>(ENTER_RETURN_OFFSET);
+        code.emit({ 0x48, 0x89, 0xF2 });                               // mov rdx, rsi
+        code.emit({ 0x48, 0xB8 });                                     // mov rax, ThunkEnter
+        code.emit_imm(reinterpret_cast<uint64_t>(&ThunkEnter));
+        code.emit({ 0xFF, 0xD0 });                                     // call rax
+        code.emit({ 0x48, 0x89, 0x84, 0x24 });                         // mov [rsp + ENTER_RETURN_OFFSET], rax
+        code.emit_imm<int32_t>(ENTER_RETURN_OFFSET);
+
+        emit_xmm_transfer(code, false);
+        code.emit({ 0x4C, 0x8B, 0x94, 0x24 });                         // mov r10, [rsp + ENTER_CONTEXT_OFFSET]
+        code.emit_imm<int32_t>(ENTER_CONTEXT_OFFSET);
+        code.emit({ 0x4D, 0x8B, 0x5A });                               // mov r11, [r10 + target]
+        code.emit_imm<int8_t>(offsetof(timing_thunk_t, target));
+        code.emit({ 0x48, 0x81, 0xC4 });                               // add rsp, ENTER_FRAME_SIZE
+        code.emit_imm<int32_t>(ENTER_FRAME_SIZE);
+        code.emit({ 0x41, 0x59, 0x41, 0x58, 0x59, 0x5A, 0x5E, 0x5F }); // pop r9, r8, rcx, rdx, rsi, rdi
+        code.emit({ 0x41, 0xFF, 0xE3 });                               // jmp r11
+
+        return CodeArenaWrite(code.data(), code.size());
+}
+
+static void *
+generate_exit_stub()
+{
+        CodeBuffer code;
+
+        // The hook already returned, so the stack is back to what the caller had
+        // before the call. Reserve a slot for the real return address and keep
+        // the return value (rax or xmm0) intact around the helper call.
+        code.emit({ 0x50, 0x50 });                               // push rax (slot); push rax
+        code.emit({ 0x48, 0x83, 0xEC, 0x30 });                   // sub rsp, 48
+        code.emit({ 0xF3, 0x0F, 0x7F, 0x44, 0x24, 0x20 });       // movdqu [rsp + 32], xmm0
+        code.emit({ 0x48, 0xB8 });                               // mov rax, ThunkExit
+        code.emit_imm(reinterpret_cast<uint64_t>(&ThunkExit));
+        code.emit({ 0xFF, 0xD0 });                               // call rax
+        code.emit({ 0x48, 0x89, 0x44, 0x24, 0x38 });             // mov [rsp + 56], rax
+        code.emit({ 0xF3, 0x0F, 0x6F, 0x44, 0x24, 0x20 });       // movdqu xmm0, [rsp + 32]
+        code.emit({ 0x48, 0x83, 0xC4, 0x30 });                   // add rsp, 48
+        code.emit({ 0x58 });                                     // pop rax
+        code.emit({ 0xC3 });                                     // ret
+
+        return CodeArenaWrite(code.data(), code.size());
+}
+
+static void *
+generate_thunk(timing_thunk_t *thunk)
+{
+        CodeBuffer code;
+
+        code.emit({ 0x49, 0xBA });                               // mov r10, thunk
+        code.emit_imm(reinterpret_cast<uint64_t>(thunk));
+        code.emit({ 0x49, 0xBB });                               // mov r11, enter stub
+        code.emit_imm(reinterpret_cast<uint64_t>(g_thunk_enter_stub));
+        code.emit({ 0x41, 0xFF, 0xE3 });                         // jmp r11
+
+        return CodeArenaWrite(code.data(), code.size());
+}
+#elif defined(__aarch64__) || defined(_M_ARM64)
+// Stack layout of the enter stub (offsets from sp after the prologue):
+//     [0, 128)   q0-q7
+//     [128, 192) x0-x7
+//     [192, 208) x8, thunk context (x16)
+//     [208, 224) x29, x30 of the caller
+#define ENTER_FRAME_SIZE 224
+#define ENTER_GPR_OFFSET 128
+#define ENTER_FRAME_RECORD_OFFSET 208
+
+// stp/ldp <rt>, <rt2>, [sp, #offset] (q registers if `fp` is set)
+static uint32_t
+encode_pair(uint32_t rt, uint32_t rt2, uint32_t offset, bool fp, bool load)
+{
+        return (fp ? 0xAD000000 : 0xA9000000) | (load ? 0x00400000 : 0) |
+               ((offset / (fp ? 16 : 8)) << 15) | (rt2 << 10) | (31 << 5) | rt;
+}
+
+static void
+emit_register_transfer(CodeBuffer &code, bool load)
+{
+        for (uint32_t i = 0; i < 8; i += 2)
+                code.emit_imm<uint32_t>(encode_pair(i, i + 1, 16 * i, true, load));                    // stp/ldp q<i>, q<i+1>
+        for (uint32_t i = 0; i < 8; i += 2)
+                code.emit_imm<uint32_t>(encode_pair(i, i + 1, ENTER_GPR_OFFSET + 8 * i, false, load)); // stp/ldp x<i>, x<i+1>
+        code.emit_imm<uint32_t>(encode_pair(8, 16, ENTER_GPR_OFFSET + 64, false, load));               // stp/ldp x8, x16
+}
+
+static void *
+generate_enter_stub()
+{
+        CodeBuffer code;
+
+        code.emit_imm<uint32_t>(0xD10003FF | (ENTER_FRAME_SIZE << 10));     // sub sp, sp, #ENTER_FRAME_SIZE
+        emit_register_transfer(code, false);
+        code.emit_imm<uint32_t>(encode_pair(29, 30, ENTER_FRAME_RECORD_OFFSET, false, false)); // stp x29, x30, [sp, #ENTER_FRAME_RECORD_OFFSET]
+        code.emit_imm<uint32_t>(0x910003FD | (ENTER_FRAME_RECORD_OFFSET << 10)); // add x29, sp, #ENTER_FRAME_RECORD_OFFSET
+
+        code.emit_imm<uint32_t>(0xAA1003E0);                     // mov x0, x16
+        code.emit_imm<uint32_t>(0xAA1E03E1);                     // mov x1, x30
+        code.emit_imm<uint32_t>(0x58000000 | (16 << 5) | 17);    // ldr x17, ThunkEnter (64 bytes ahead)
+        code.emit_imm<uint32_t>(0xD63F0220);                     // blr x17
+        code.emit_imm<uint32_t>(0xAA0003FE);                     // mov x30, x0
+
+        emit_register_transfer(code, true);
+        code.emit_imm<uint32_t>(0xF94003FD | ((ENTER_FRAME_RECORD_OFFSET / 8) << 10)); // ldr x29, [sp, #ENTER_FRAME_RECORD_OFFSET]
+        code.emit_imm<uint32_t>(0x910003FF | (ENTER_FRAME_SIZE << 10));     // add sp, sp, #ENTER_FRAME_SIZE
+        code.emit_imm<uint32_t>(0xF9400211 | ((offsetof(timing_thunk_t, target) / 8) << 10)); // ldr x17, [x16, #target]
+        code.emit_imm<uint32_t>(0xD61F0220);                     // br x17
+        code.emit_imm(reinterpret_cast<uint64_t>(&ThunkEnter));
+
+        return CodeArenaWrite(code.data(), code.size());
+}
+
+static void *
+generate_exit_stub()
+{
+        CodeBuffer code;
+
+        // The hook already returned through x30, so the stack is back to what the
+        // caller had before the call. Keep the return value (x0 or q0) intact around
+        // the helper call, then return to the real return address.
+        code.emit_imm<uint32_t>(0xA9BD7BFD);                     // stp x29, x30, [sp, #-48]!
+        code.emit_imm<uint32_t>(0x910003FD);                     // mov x29, sp
+        code.emit_imm<uint32_t>(0x3D8007E0);                     // str q0, [sp, #16]
+        code.emit_imm<uint32_t>(0xF90013E0);                     // str x0, [sp, #32]
+        code.emit_imm<uint32_t>(0x58000000 | (8 << 5) | 17);     // ldr x17, ThunkExit (32 bytes ahead)
+        code.emit_imm<uint32_t>(0xD63F0220);                     // blr x17
+        code.emit_imm<uint32_t>(0xAA0003FE);                     // mov x30, x0
+        code.emit_imm<uint32_t>(0x3DC007E0);                     // ldr q0, [sp, #16]
+        code.emit_imm<uint32_t>(0xF94013E0);                     // ldr x0, [sp, #32]
+        code.emit_imm<uint32_t>(0xF94003FD);                     // ldr x29, [sp]
+        code.emit_imm<uint32_t>(0x9100C3FF);                     // add sp, sp, #48
+        code.emit_imm<uint32_t>(0xD65F03C0);                     // ret
+        code.emit_imm(reinterpret_cast<uint64_t>(&ThunkExit));
+
+        return CodeArenaWrite(code.data(), code.size());
+}
+
+static void *
+generate_thunk(timing_thunk_t *thunk)
+{
+        CodeBuffer code;
+
+        code.emit_imm<uint32_t>(0x58000000 | (4 << 5) | 16);     // ldr x16, thunk
+        code.emit_imm<uint32_t>(0x58000000 | (5 << 5) | 17);     // ldr x17, enter stub
+        code.emit_imm<uint32_t>(0xD61F0220);                     // br x17
+        code.emit_imm<uint32_t>(0xD503201F);                     // nop (aligns the literals)
+        code.emit_imm(reinterpret_cast<uint64_t>(thunk));
+        code.emit_imm(reinterpret_cast<uint64_t>(g_thunk_enter_stub));
+
+        return CodeArenaWrite(code.data(), code.size());
+}
+#endif
+
+void *
+GenerateTimingThunk(void *target, hook_metrics_t *metrics)
+{
+#if defined(__x86_64__) || defined(_M_X64) || defined(__aarch64__) || defined(_M_ARM64)
+        static std::once_flag stubs_flag;
+
+        std::call_once(stubs_flag, []() {
+                g_thunk_enter_stub = generate_enter_stub();
+                g_thunk_exit_stub = generate_exit_stub();
+        });
+
+        if (!g_thunk_enter_stub || !g_thunk_exit_stub)
+                return nullptr;
+
+        // NOTE: The context is never freed, the thunk may still be running
+        //       on another thread after the hook is detached
+        auto thunk = new timing_thunk_t { target, metrics };
+
+        return generate_thunk(thunk);
+#else
+        return nullptr;
+#endif
+}
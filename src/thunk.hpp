@@ -0,0 +1,39 @@
+/*
+ *  -----------------------------------
+ * |         JNIHook - by rdbo         |
+ * |      Java VM Hooking Library      |
+ *  -----------------------------------
+ */
+
+/*
+ * Copyright (C) 2026    Rdbo
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License version 3
+ * as published by the Free Software Foundation.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef _THUNK_HPP_
+#define _THUNK_HPP_
+
+#include "metrics.hpp"
+
+typedef struct timing_thunk_t {
+        void *target; // NOTE: Read by the generated code, keep it as the first field
+        hook_metrics_t *metrics;
+} timing_thunk_t;
+
+// Generates a function that forwards every call to `target` (with the
+// arguments untouched) and records the call and its duration in `metrics`.
+// Returns NULL if the current architecture is not supported.
+void *
+GenerateTimingThunk(void *target, hook_metrics_t *metrics);
+
+#endif
@@ -0,0 +1,165 @@
+/*
+ *  -----------------------------------
+ * |         JNIHook - by rdbo         |
+ * |      Java VM Hooking Library      |
+ *  -----------------------------------
+ */
+
+/*
+ * Copyright (C) 2026    Rdbo
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License version 3
+ * as published by the Free Software Foundation.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef _WORKER_HPP_
+#define _WORKER_HPP_
+
+#include <jni.h>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Thread attached to the JVM (as a daemon) that runs queued work items.
+// Every item that is queued while the worker is busy is handed to the
+// processing function in the same call, so that it can coalesce them.
+// Only one thread processes items at a time: a worker that was stopped from
+// its own thread leaves the queue to the next one, which waits for it to finish.
+template <typename T>
+class Worker {
+public:
+        typedef std::function<void(JNIEnv *env, std::vector<T> &items)> process_t;
+private:
+        std::mutex mutex;
+        std::condition_variable cond;
+        std::vector<T> queue;
+        std::thread thread;
+        bool running = false;
+        bool processing = false; // Items were taken from the queue and are being processed
+        std::thread::id processor; // Thread that is processing them, possibly a stopped worker
+        unsigned generation = 0; // Bumped when stopping, so a detached worker can't outlive its stop
+
+        void run(JavaVM *jvm, const char *name, process_t process, unsigned run_generation)
+        {
+                JNIEnv *env;
+                JavaVMAttachArgs attach_args = { JNI_VERSION_1_8, const_cast<char *>(name), NULL };
+
+                if (jvm->AttachCurrentThreadAsDaemon(reinterpret_cast<void **>(&env), &attach_args) != JNI_OK)
+                        env = nullptr;
+
+                for (;;) {
+                        std::vector<T> items;
+
+                        {
+                                std::unique_lock<std::mutex> lock(mutex);
+                                cond.wait(lock, [&]() {
+                                        return generation != run_generation || (!queue.empty() && !processing);
+                                });
+                                if (generation != run_generation)
+                                        break;
+
+                                items.swap(queue);
+                                processing = true;
+                                processor = std::this_thread::get_id();
+                        }
+
+                        // NOTE: This thread never returns to Java, so the local references
+                        //       created while processing must be released explicitly
+                        if (env)
+                                env->PushLocalFrame(64);
+
+                        process(env, items);
+
+                        if (env)
+                                env->PopLocalFrame(NULL);
+
+                        {
+                                std::lock_guard<std::mutex> lock(mutex);
+                                processing = false;
+                                processor = std::thread::id();
+                        }
+                        cond.notify_all();
+                }
+
+                if (env)
+                        jvm->DetachCurrentThread();
+        }
+public:
+        ~Worker()
+        {
+                // NOTE: Joining here could wait on a JVM that is being torn down,
+                //       call `stop` explicitly instead
+                if (thread.joinable())
+                        thread.detach();
+        }
+
+        // Queues an item, starting the worker thread if needed.
+        // Throws if the thread can't be started, in which case the item is not queued.
+        void enqueue(JavaVM *jvm, const char *name, process_t process, T item)
+        {
+                std::lock_guard<std::mutex> lock(mutex);
+
+                // The thread is started first, so that a failure leaves
+                // no item in the queue that nothing would ever process
+                if (!running) {
+                        thread = std::thread(&Worker::run, this, jvm, name, process, generation);
+                        running = true;
+                }
+
+                queue.push_back(std::move(item));
+                cond.notify_all(); // `stop` may be waiting as well
+        }
+
+        // Processes every queued item and stops the worker thread.
+        // From the worker thread itself (e.g. from a completion callback), it can't
+        // wait for the items, which are left to the next worker that is started.
+        void stop()
+        {
+                std::thread worker;
+
+                {
+                        std::unique_lock<std::mutex> lock(mutex);
+                        if (!running)
+                                return;
+
+                        // NOTE: The thread that is processing items would wait for itself
+                        if (!processing || processor != std::this_thread::get_id())
+                                cond.wait(lock, [&]() { return queue.empty() && !processing; });
+
+                        // The worker may have stopped itself while this thread was waiting
+                        if (!running)
+                                return;
+
+                        generation += 1;
+                        running = false;
+
+                        // Taken under the lock, as `enqueue` may start the next worker right after
+                        worker = std::move(thread);
+                }
+
+                cond.notify_all();
+
+                if (worker.get_id() == std::this_thread::get_id())
+                        worker.detach();
+                else
+                        worker.join();
+        }
+
+        bool is_current_thread()
+        {
+                std::lock_guard<std::mutex> lock(mutex);
+                return thread.get_id() == std::this_thread::get_id();
+        }
+};
+
+#endif
@@ -0,0 +1,220 @@
+/*
+ *  -----------------------------------
+ * |         JNIHook - by rdbo         |
+ * |      Java VM Hooking Library      |
+ *  -----------------------------------
+ */
+
+/*
+ * Copyright (C) 2026    Rdbo
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License version 3
+ * as published by the Free Software Foundation.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+// Damaged class archive test (no JVM needed):
+//     jnihook-archive-test <directory>
+// Builds an archive in `directory`, damages it in the ways a crash or a
+// bad disk would (a flipped data byte, a truncated record) and bumps its
+// patch version, then checks that every damaged entry is dropped, counted
+// in `archive_corrupt`, and written again by the next store.
+
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <vector>
+#include "archive.hpp"
+#include "hash.hpp"
+#include "stats.hpp"
+
+#define ARCHIVE_FILE "classes.jnihook"
+#define COPY_SUFFIX "_jnihook_test"
+
+// Layout of the archive header (see `archive_header_t`)
+#define HEADER_VERSION_OFFSET 12
+#define HEADER_CHECKSUM_OFFSET 80
+
+#define CHECK(condition) \
+        do { \
+                if (!(condition)) { \
+                        fprintf(stderr, "[!] Check failed at %s:%d: %s\n", __FILE__, __LINE__, #condition); \
+                        return false; \
+                } \
+        } while (0)
+
+static std::vector<uint8_t>
+pattern(size_t size, uint8_t seed)
+{
+        std::vector<uint8_t> bytes(size);
+
+        for (size_t i = 0; i < size; ++i)
+                bytes[i] = static_cast<uint8_t>(seed + i * 7);
+
+        return bytes;
+}
+
+static uint64_t
+corrupt_count()
+{
+        jnihook_stats_t stats;
+
+        StatsSnapshot(&stats);
+
+        return stats.archive_corrupt;
+}
+
+static uint64_t
+store_count()
+{
+        jnihook_stats_t stats;
+
+        StatsSnapshot(&stats);
+
+        return stats.archive_stores;
+}
+
+static bool
+reopen(ClassArchive &archive, const std::string &directory)
+{
+        std::string copy_suffix = COPY_SUFFIX;
+
+        archive.close();
+
+        return archive.open(directory, copy_suffix, false) && copy_suffix == COPY_SUFFIX;
+}
+
+static bool
+has(ClassArchive &archive, uint64_t content_hash, const std::vector<uint8_t> &expected)
+{
+        std::vector<uint8_t> bytes;
+
+        return archive.find(content_hash, 1, bytes) && bytes == expected;
+}
+
+static bool
+patch_file(const std::string &path, uint64_t offset, const void *data, size_t size)
+{
+        std::fstream file(path, std::ios::in | std::ios::out | std::ios::binary);
+
+        file.seekp(static_cast<std::streamoff>(offset));
+        file.write(reinterpret_cast<const char *>(data), static_cast<std::streamsize>(size));
+
+        return file.good();
+}
+
+static bool
+run(const std::string &directory)
+{
+        ClassArchive archive;
+        auto path = (std::filesystem::path(directory) / ARCHIVE_FILE).string();
+        auto first = pattern(64, 1);
+        auto second = pattern(128, 2);
+
+        std::filesystem::remove_all(directory);
+        CHECK(reopen(archive, directory));
+        uint64_t header_size = std::filesystem::file_size(path);
+
+        archive.store(1, 1, first.data(), first.size());
+        uint64_t first_end = std::filesystem::file_size(path);
+        archive.store(2, 1, second.data(), second.size());
+        uint64_t second_end = std::filesystem::file_size(path);
+        CHECK(has(archive, 1, first) && has(archive, 2, second));
+
+        // The sizes are multiples of the alignment, so the records have no padding
+        uint64_t record_header_size = first_end - header_size - first.size();
+
+        CHECK(reopen(archive, directory));
+        CHECK(has(archive, 1, first) && has(archive, 2, second));
+
+        // A flipped data byte is only noticed when the record is read
+        uint64_t corrupt = corrupt_count();
+        uint8_t flipped = first[10] ^ 0xff;
+        archive.close();
+        CHECK(patch_file(path, header_size + record_header_size + 10, &flipped, 1));
+        CHECK(reopen(archive, directory));
+        CHECK(!has(archive, 1, first));
+        CHECK(corrupt_count() == corrupt + 1);
+        CHECK(has(archive, 2, second));
+
+        uint64_t stores = store_count();
+        archive.store(1, 1, first.data(), first.size());
+        CHECK(store_count() == stores + 1);
+        CHECK(has(archive, 1, first));
+
+        // The rewritten record replaces the damaged one
+        CHECK(reopen(archive, directory));
+        CHECK(has(archive, 1, first) && has(archive, 2, second));
+        CHECK(corrupt_count() == corrupt + 1);
+
+        // A truncated record (e.g. a crash while storing it) cuts the archive there
+        uint64_t rewritten_end = std::filesystem::file_size(path);
+        archive.close();
+        std::filesystem::resize_file(path, rewritten_end - 5);
+        corrupt = corrupt_count();
+        CHECK(reopen(archive, directory));
+        CHECK(corrupt_count() == corrupt + 1);
+        CHECK(std::filesystem::file_size(path) == second_end);
+        CHECK(has(archive, 2, second));
+        CHECK(!has(archive, 1, first)); // Only the damaged record is left for it
+
+        stores = store_count();
+        archive.store(1, 1, first.data(), first.size());
+        CHECK(store_count() == stores + 1);
+        CHECK(reopen(archive, directory));
+        CHECK(has(archive, 1, first) && has(archive, 2, second));
+
+        // An archive of another patch version is stale, and it is rebuilt (it is not damaged)
+        uint8_t header[HEADER_CHECKSUM_OFFSET];
+        uint32_t version = CLASS_ARCHIVE_VERSION + 1;
+        archive.close();
+        {
+                std::ifstream file(path, std::ios::binary);
+                file.read(reinterpret_cast<char *>(header), sizeof(header));
+                CHECK(file.good());
+        }
+        memcpy(&header[HEADER_VERSION_OFFSET], &version, sizeof(version));
+        uint64_t checksum = ContentHash(header, sizeof(header));
+        CHECK(patch_file(path, 0, header, sizeof(header)));
+        CHECK(patch_file(path, HEADER_CHECKSUM_OFFSET, &checksum, sizeof(checksum)));
+
+        corrupt = corrupt_count();
+        CHECK(reopen(archive, directory));
+        CHECK(std::filesystem::file_size(path) == header_size);
+        CHECK(!has(archive, 1, first) && !has(archive, 2, second));
+        CHECK(corrupt_count() == corrupt);
+
+        archive.store(1, 1, first.data(), first.size());
+        CHECK(reopen(archive, directory));
+        CHECK(has(archive, 1, first));
+
+        archive.close();
+        std::filesystem::remove_all(directory);
+
+        return true;
+}
+
+int
+main(int argc, char **argv)
+{
+        if (argc != 2) {
+                fprintf(stderr, "usage: %s <directory>\n", argv[0]);
+                return 1;
+        }
+
+        if (!run(argv[1]))
+                return 1;
+
+        printf("ok - archive\n");
+
+        return 0;
+}
@@ -0,0 +1,165 @@
+/*
+ *  -----------------------------------
+ * |         JNIHook - by rdbo         |
+ * |      Java VM Hooking Library      |
+ *  -----------------------------------
+ */
+
+/*
+ * Copyright (C) 2026    Rdbo
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License version 3
+ * as published by the Free Software Foundation.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "harness.hpp"
+#include <cstdio>
+
+#ifndef JNIHOOK_TEST_CLASSPATH
+#define JNIHOOK_TEST_CLASSPATH "harness-classes"
+#endif
+
+void
+Harness::add(const char *name, scenario_fn_t fn)
+{
+        this->scenarios.push_back({ name, fn });
+}
+
+std::vector<std::string>
+Harness::names() const
+{
+        std::vector<std::string> names;
+
+        for (auto &[name, fn] : this->scenarios)
+                names.push_back(name);
+
+        return names;
+}
+
+void
+Harness::set_step_hook(step_hook_t hook, void *arg)
+{
+        this->step_hook = hook;
+        this->step_arg = arg;
+}
+
+bool
+Harness::start(const std::vector<std::string> &jvm_options)
+{
+        const std::string class_path_option = "-Djava.class.path=";
+        std::vector<std::string> options;
+
+        // The class path can be replaced, e.g. by classes patched ahead of time
+        this->classes_dir = JNIHOOK_TEST_CLASSPATH;
+        for (auto &option : jvm_options) {
+                if (option.compare(0, class_path_option.size(), class_path_option) == 0)
+                        this->classes_dir = option.substr(class_path_option.size());
+        }
+
+        options.push_back(class_path_option + this->classes_dir);
+        for (auto &option : jvm_options) {
+                if (option.compare(0, class_path_option.size(), class_path_option) != 0)
+                        options.push_back(option);
+        }
+
+        return CreateJavaVM(options, &this->jvm, &this->env);
+}
+
+size_t
+Harness::run(const std::vector<std::string> &names)
+{
+        size_t failures = 0;
+        size_t count = 0;
+
+        for (auto &[name, fn] : this->scenarios) {
+                bool selected = names.empty();
+                for (auto &selected_name : names)
+                        selected = selected || selected_name == name;
+                if (!selected)
+                        continue;
+
+                this->current = name;
+                ++count;
+
+                // Every scenario gets its own local frame, so that it cannot leak references
+                this->env->PushLocalFrame(64);
+                bool ok = fn(*this);
+                ok = !this->exception() && ok;
+                this->env->PopLocalFrame(NULL);
+
+                printf("%s - %s\n", ok ? "ok" : "FAILED", name.c_str());
+                fflush(stdout);
+                failures += !ok;
+        }
+
+        // Unknown names fail, so that a typo in the CTest list cannot pass
+        if (count < names.size()) {
+                fprintf(stderr, "[!] Unknown scenarios were requested\n");
+                failures += names.size() - count;
+        }
+
+        this->current.clear();
+
+        return failures;
+}
+
+void
+Harness::finish_step(const char *name, uint64_t elapsed_ns)
+{
+        if (this->step_hook)
+                this->step_hook(this->current.c_str(), name, elapsed_ns, this->step_arg);
+}
+
+bool
+Harness::check(bool ok, const char *expression, const char *file, int line)
+{
+        if (!ok) {
+                fprintf(stderr, "[!] %s: check failed at %s:%d: %s\n", this->current.c_str(), file, line, expression);
+                this->exception();
+        }
+
+        return ok;
+}
+
+const char *
+Harness::class_path() const
+{
+        return this->classes_dir.c_str();
+}
+
+jclass
+Harness::find_class(const char *name)
+{
+        jclass clazz = this->env->FindClass(name);
+
+        if (!clazz) {
+                this->exception();
+                fprintf(stderr, "[!] Class not found: %s (class path: %s)\n", name, this->classes_dir.c_str());
+                return NULL;
+        }
+
+        auto global = reinterpret_cast<jclass>(this->env->NewGlobalRef(clazz));
+        this->env->DeleteLocalRef(clazz);
+
+        return global;
+}
+
+bool
+Harness::exception()
+{
+        if (!this->env->ExceptionCheck())
+                return false;
+
+        this->env->ExceptionDescribe();
+        this->env->ExceptionClear();
+
+        return true;
+}
@@ -0,0 +1,118 @@
+/*
+ *  -----------------------------------
+ * |         JNIHook - by rdbo         |
+ * |      Java VM Hooking Library      |
+ *  -----------------------------------
+ */
+
+/*
+ * Copyright (C) 2026    Rdbo
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License version 3
+ * as published by the Free Software Foundation.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef _HARNESS_HPP_
+#define _HARNESS_HPP_
+
+#include <jni.h>
+#include <cstdint>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#include "bench.hpp"
+
+// Headless test harness: runs hook scenarios inside a JVM created by this
+// process (see `CreateJavaVM`), with the test classes from the build directory.
+// Scenarios report failures with HARNESS_CHECK and time their steps with
+// `Harness::step`, whose timings are passed to the step hook.
+
+class Harness;
+
+typedef bool (*scenario_fn_t)(Harness &harness);
+
+// Called after every step of a scenario
+typedef void (*step_hook_t)(const char *scenario, const char *step, uint64_t elapsed_ns, void *arg);
+
+class Harness {
+private:
+        std::vector<std::pair<std::string, scenario_fn_t>> scenarios;
+        std::string current;
+        std::string classes_dir;
+        step_hook_t step_hook = nullptr;
+        void *step_arg = nullptr;
+public:
+        JavaVM *jvm = nullptr;
+        JNIEnv *env = nullptr;
+
+        void
+        add(const char *name, scenario_fn_t fn);
+
+        std::vector<std::string>
+        names() const;
+
+        void
+        set_step_hook(step_hook_t hook, void *arg);
+
+        // Creates the JVM, with the test classes in the class path
+        // (unless the options have their own -Djava.class.path)
+        bool
+        start(const std::vector<std::string> &jvm_options);
+
+        // Runs the given scenarios (every scenario if empty), returns the amount that failed
+        size_t
+        run(const std::vector<std::string> &names);
+
+        // Runs `fn` as a step of the current scenario, and returns its result
+        template <typename F>
+        auto
+        step(const char *name, F &&fn)
+        {
+                uint64_t start = BenchNow();
+
+                if constexpr (std::is_void_v<std::invoke_result_t<F>>) {
+                        fn();
+                        finish_step(name, BenchNow() - start);
+                } else {
+                        auto result = fn();
+                        finish_step(name, BenchNow() - start);
+                        return result;
+                }
+        }
+
+        void
+        finish_step(const char *name, uint64_t elapsed_ns);
+
+        // Reports a failed check, returns `ok`
+        bool
+        check(bool ok, const char *expression, const char *file, int line);
+
+        // Directory with the test classes
+        const char *
+        class_path() const;
+
+        // Global reference to a class of the class path, NULL if it is not found
+        jclass
+        find_class(const char *name);
+
+        // Describes and clears a pending Java exception, returns true if there was one
+        bool
+        exception();
+};
+
+#define HARNESS_CHECK(harness, condition) \
+        do { \
+                if (!(harness).check((condition), #condition, __FILE__, __LINE__)) \
+                        return false; \
+        } while (0)
+
+#endif
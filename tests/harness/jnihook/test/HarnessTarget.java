@@ -0,0 +1,77 @@
+package jnihook.test;
+
+import java.util.concurrent.CountDownLatch;
+
+// Methods hooked by the scenarios of jnihook-harness. They return values
+// instead of printing, so that the scenarios can check them.
+public class HarnessTarget {
+    private final int factor;
+
+    public HarnessTarget(int factor) {
+        this.factor = factor;
+    }
+
+    public static int add(int a, int b) {
+        return a + b;
+    }
+
+    public static String greet(String name) {
+        return "Hello, " + name;
+    }
+
+    public int scale(int value) {
+        return value * factor;
+    }
+
+    // Has enough arguments of both kinds to pass some of them on the stack
+    public static double mix(int a, long b, float c, double d, String e, int f, int g, int h,
+                             float i, double j, double k, double l, double m, double n, double o, boolean p) {
+        return a + b + c + d + e.length() + f + g + h + i + j + k + l + m + n + o + (p ? 1 : 0);
+    }
+
+    // Reaches `add` through a regular Java invocation, instead of JNI
+    public static int callAdd(int a, int b) {
+        return add(a, b);
+    }
+
+    // Calls `add(2, 3)` in a loop on its own thread, until stopped
+    public static class Spinner implements Runnable {
+        private final CountDownLatch started = new CountDownLatch(1);
+        private final Thread thread = new Thread(this, "jnihook-harness-spinner");
+        private volatile boolean running = true;
+        private volatile int last;
+
+        public static Spinner start() throws InterruptedException {
+            Spinner spinner = new Spinner();
+            spinner.thread.setDaemon(true);
+            spinner.thread.start();
+            spinner.started.await();
+            return spinner;
+        }
+
+        public void run() {
+            last = add(2, 3);
+            started.countDown();
+            while (running)
+                last = add(2, 3);
+        }
+
+        // Waits until `add` returns `expected` on the spinner thread
+        public boolean awaitResult(int expected, long timeoutMs) {
+            long deadline = System.nanoTime() + timeoutMs * 1000000L;
+
+            while (System.nanoTime() < deadline) {
+                if (last == expected)
+                    return true;
+                Thread.yield();
+            }
+
+            return last == expected;
+        }
+
+        public void stop() throws InterruptedException {
+            running = false;
+            thread.join();
+        }
+    }
+}
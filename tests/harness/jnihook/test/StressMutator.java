@@ -0,0 +1,99 @@
+package jnihook.test;
+
+import java.util.concurrent.CountDownLatch;
+
+// Application thread of jnihook-stress: calls the methods of StressTarget in
+// a tight loop, checks every result, and records how long each iteration took
+// in a log2 histogram, so that the pauses caused by hooking show up as stalls.
+public class StressMutator implements Runnable {
+    // Bucket `b` counts the iterations that took [2^(b-1), 2^b) ns
+    public static final int BUCKETS = 65;
+
+    private final CountDownLatch started = new CountDownLatch(1);
+    private final Thread thread;
+    private volatile boolean running = true;
+
+    // Read after `stop`, which joins the thread
+    private final long[] histogram = new long[BUCKETS];
+    private long iterations;
+    private long mismatches;
+    private long maxNs;
+    private String firstMismatch;
+
+    private StressMutator(int index) {
+        thread = new Thread(this, "jnihook-stress-mutator-" + index);
+        thread.setDaemon(true);
+    }
+
+    public static StressMutator start(int index) throws InterruptedException {
+        StressMutator mutator = new StressMutator(index);
+        mutator.thread.start();
+        mutator.started.await();
+        return mutator;
+    }
+
+    private void check(String method, int x, int result, int expected, boolean hookable) {
+        if (result == expected || (hookable && result == expected + 1))
+            return;
+
+        if (mismatches++ == 0)
+            firstMismatch = method + "(" + x + ") returned " + result + ", expected " + expected;
+    }
+
+    public void run() {
+        started.countDown();
+
+        long last = System.nanoTime();
+        int x = 0;
+
+        while (running) {
+            x = (x + 1) & 0xffff;
+
+            try {
+                check("Left.first", x, StressTarget.Left.first(x), x * 3 + 1, true);
+                check("Left.second", x, StressTarget.Left.second(x), x * 7 + 3, true);
+                check("Left.plain", x, StressTarget.Left.plain(x), x * 5 + 7, false);
+                check("Right.first", x, StressTarget.Right.first(x), x * 11 + 5, true);
+                check("Right.second", x, StressTarget.Right.second(x), x * 13 + 9, true);
+                check("Right.plain", x, StressTarget.Right.plain(x), x * 17 + 2, false);
+            } catch (Throwable t) {
+                if (mismatches++ == 0)
+                    firstMismatch = "exception: " + t;
+            }
+
+            long now = System.nanoTime();
+            long elapsed = now - last;
+            last = now;
+
+            ++iterations;
+            ++histogram[64 - Long.numberOfLeadingZeros(elapsed)];
+            if (elapsed > maxNs)
+                maxNs = elapsed;
+        }
+    }
+
+    public void stop() throws InterruptedException {
+        running = false;
+        thread.join();
+    }
+
+    public long[] histogram() {
+        return histogram;
+    }
+
+    public long iterations() {
+        return iterations;
+    }
+
+    public long mismatches() {
+        return mismatches;
+    }
+
+    public long maxNs() {
+        return maxNs;
+    }
+
+    public String firstMismatch() {
+        return firstMismatch;
+    }
+}
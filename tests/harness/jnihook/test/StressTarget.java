@@ -0,0 +1,35 @@
+package jnihook.test;
+
+// Methods hooked and unhooked by jnihook-stress. Two classes with two hooked
+// methods each, so that hooks on the same class and on different classes race.
+// The hooks return the original value plus one, anything else is a mismatch.
+public class StressTarget {
+    public static class Left {
+        public static int first(int x) {
+            return x * 3 + 1;
+        }
+
+        public static int second(int x) {
+            return x * 7 + 3;
+        }
+
+        // Never hooked, but redefined along with the hooked methods
+        public static int plain(int x) {
+            return x * 5 + 7;
+        }
+    }
+
+    public static class Right {
+        public static int first(int x) {
+            return x * 11 + 5;
+        }
+
+        public static int second(int x) {
+            return x * 13 + 9;
+        }
+
+        public static int plain(int x) {
+            return x * 17 + 2;
+        }
+    }
+}
@@ -0,0 +1,1194 @@
+/*
+ *  -----------------------------------
+ * |         JNIHook - by rdbo         |
+ * |      Java VM Hooking Library      |
+ *  -----------------------------------
+ */
+
+/*
+ * Copyright (C) 2026    Rdbo
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License version 3
+ * as published by the Free Software Foundation.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+// Hook scenarios run by CTest, one process (and JVM) per scenario:
+//     jnihook-harness [--list] [--timings] [-J<jvm option>]... [<scenario>...]
+
+#include <jnihook.hpp>
+#include <jvmti.h>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "harness.hpp"
+
+#define ASYNC_TIMEOUT std::chrono::seconds(30)
+#define SPINNER_TIMEOUT_MS 30000
+#define EVICT_ATTEMPTS 50
+#define BATCH_GAP_NS 20000000
+
+static jclass g_target;        // jnihook.test.HarnessTarget
+static jclass g_spinner;       // jnihook.test.HarnessTarget$Spinner
+static jmethodID g_add;        // static int add(int, int)
+static jmethodID g_call_add;   // static int callAdd(int, int)
+static jmethodID g_greet;      // static String greet(String)
+static jmethodID g_scale;      // int scale(int)
+static jmethodID g_mix;         // static double mix(int, long, float, double, String, int, int, int, float, double x6, boolean)
+static jmethodID g_constructor;
+static jclass g_left;          // jnihook.test.StressTarget$Left
+static jmethodID g_left_first; // static int first(int)
+static jmethodID g_orig_add;
+static jmethodID g_orig_scale;
+
+static jint JNICALL
+hk_add(JNIEnv *env, jclass clazz, jint a, jint b)
+{
+        return a * b;
+}
+
+static jint JNICALL
+hk_add_passthrough(JNIEnv *env, jclass clazz, jint a, jint b)
+{
+        return env->CallStaticIntMethod(clazz, g_orig_add, a, b) + 100;
+}
+
+// Finds its original method on every call, instead of keeping it around
+static jint JNICALL
+hk_add_lookup(JNIEnv *env, jclass clazz, jint a, jint b)
+{
+        jmethodID orig;
+
+        if (JNIHook_GetOriginal(g_add, &orig) != JNIHOOK_OK)
+                return -1;
+
+        return env->CallStaticIntMethod(clazz, orig, a, b) + 100;
+}
+
+static jint JNICALL
+hk_left_first(JNIEnv *env, jclass clazz, jint x)
+{
+        return -x;
+}
+
+static jstring JNICALL
+hk_greet(JNIEnv *env, jclass clazz, jstring name)
+{
+        return env->NewStringUTF("Hooked");
+}
+
+static jint JNICALL
+hk_scale(JNIEnv *env, jobject obj, jint value)
+{
+        return env->CallNonvirtualIntMethod(obj, g_target, g_orig_scale, value) + 1;
+}
+
+typedef jnihook::static_hook<"jnihook/test/HarnessTarget", "add", jint(jint, jint)> typed_add_t;
+typedef jnihook::static_hook<"jnihook/test/HarnessTarget", "greet", jstring(jstring)> typed_greet_t;
+typedef jnihook::hook<"jnihook/test/HarnessTarget", "scale", jint(jint)> typed_scale_t;
+
+static jint
+hk_typed_add(JNIEnv *env, jclass clazz, jint a, jint b)
+{
+        return typed_add_t::call_original(env, clazz, a, b) + 100;
+}
+
+static void
+ic_multiply(jnihook_call_t *call)
+{
+        call->result.i = call->args[0].i * call->args[1].i;
+}
+
+// Adds the value pointed to by `arg` to the result of the original method
+static void
+ic_offset(jnihook_call_t *call)
+{
+        if (JNIHook_CallOriginal(call) == JNIHOOK_OK)
+                call->result.i += *static_cast<jint *>(call->arg);
+}
+
+static void
+ic_rename(jnihook_call_t *call)
+{
+        call->args[0].l = call->env->NewStringUTF("intercepted");
+        JNIHook_CallOriginal(call);
+}
+
+static void
+ic_increment(jnihook_call_t *call)
+{
+        if (JNIHook_CallOriginal(call) == JNIHOOK_OK)
+                call->result.i += 1;
+}
+
+// Adds the arguments up like `mix` does, and checks the sum against the original method
+static void
+ic_mix(jnihook_call_t *call)
+{
+        double sum = 0;
+
+        for (jint i = 0; i < call->arg_count; ++i) {
+                auto &arg = call->args[i];
+
+                switch (call->arg_types[i]) {
+                case 'Z': sum += arg.z ? 1 : 0; break;
+                case 'I': sum += arg.i; break;
+                case 'J': sum += arg.j; break;
+                case 'F': sum += arg.f; break;
+                case 'D': sum += arg.d; break;
+                case 'L': sum += call->env->GetStringUTFLength(static_cast<jstring>(arg.l)); break;
+                }
+        }
+
+        if (JNIHook_CallOriginal(call) == JNIHOOK_OK && call->result.d != sum)
+                call->result.d = -1;
+}
+
+static jint
+add(Harness &harness, jint a, jint b)
+{
+        return harness.env->CallStaticIntMethod(g_target, g_add, a, b);
+}
+
+static jint
+call_add(Harness &harness, jint a, jint b)
+{
+        return harness.env->CallStaticIntMethod(g_target, g_call_add, a, b);
+}
+
+static jint
+left_first(Harness &harness, jint x)
+{
+        return harness.env->CallStaticIntMethod(g_left, g_left_first, x);
+}
+
+static std::string
+greet(Harness &harness, const char *name)
+{
+        jstring arg = harness.env->NewStringUTF(name);
+        auto result = reinterpret_cast<jstring>(harness.env->CallStaticObjectMethod(g_target, g_greet, arg));
+        std::string value;
+
+        if (result) {
+                const char *chars = harness.env->GetStringUTFChars(result, NULL);
+                value = chars;
+                harness.env->ReleaseStringUTFChars(result, chars);
+        }
+
+        return value;
+}
+
+// Completion of an async operation, waited on by the scenario
+typedef struct async_state_t {
+        std::mutex mutex;
+        std::condition_variable cond;
+        bool done = false;
+        jnihook_result_t result = JNIHOOK_ERR_UNKNOWN;
+        jmethodID original_method = NULL;
+} async_state_t;
+
+static void
+async_callback(jmethodID method, jnihook_result_t result, jmethodID original_method, void *arg)
+{
+        auto state = reinterpret_cast<async_state_t *>(arg);
+
+        std::lock_guard<std::mutex> lock(state->mutex);
+        state->done = true;
+        state->result = result;
+        state->original_method = original_method;
+        state->cond.notify_all();
+}
+
+static bool
+async_wait(async_state_t &state)
+{
+        std::unique_lock<std::mutex> lock(state.mutex);
+
+        return state.cond.wait_for(lock, ASYNC_TIMEOUT, [&]() { return state.done; });
+}
+
+static bool
+init_shutdown(Harness &harness)
+{
+        HARNESS_CHECK(harness, harness.step("init", [&]() { return JNIHook_Init(harness.jvm); }) == JNIHOOK_OK);
+        HARNESS_CHECK(harness, harness.step("shutdown", []() { return JNIHook_Shutdown(); }) == JNIHOOK_OK);
+        HARNESS_CHECK(harness, harness.step("init_again", [&]() { return JNIHook_Init(harness.jvm); }) == JNIHOOK_OK);
+        HARNESS_CHECK(harness, JNIHook_Shutdown() == JNIHOOK_OK);
+
+        return true;
+}
+
+static bool
+attach_static(Harness &harness)
+{
+        HARNESS_CHECK(harness, JNIHook_Init(harness.jvm) == JNIHOOK_OK);
+        HARNESS_CHECK(harness, add(harness, 2, 3) == 5);
+
+        auto result = harness.step("attach", []() {
+                return JNIHook_Attach(g_add, reinterpret_cast<void *>(hk_add), &g_orig_add);
+        });
+        HARNESS_CHECK(harness, result == JNIHOOK_OK);
+        HARNESS_CHECK(harness, g_orig_add != NULL);
+        HARNESS_CHECK(harness, add(harness, 2, 3) == 6);
+        HARNESS_CHECK(harness, call_add(harness, 2, 3) == 6);
+        HARNESS_CHECK(harness, harness.env->CallStaticIntMethod(g_target, g_orig_add, 2, 3) == 5);
+
+        HARNESS_CHECK(harness, harness.step("detach", []() { return JNIHook_Detach(g_add); }) == JNIHOOK_OK);
+        HARNESS_CHECK(harness, add(harness, 2, 3) == 5);
+        HARNESS_CHECK(harness, call_add(harness, 2, 3) == 5);
+
+        HARNESS_CHECK(harness, harness.step("shutdown", []() { return JNIHook_Shutdown(); }) == JNIHOOK_OK);
+
+        return true;
+}
+
+static bool
+attach_passthrough(Harness &harness)
+{
+        HARNESS_CHECK(harness, JNIHook_Init(harness.jvm) == JNIHOOK_OK);
+
+        auto result = harness.step("attach", []() {
+                return JNIHook_Attach(g_add, reinterpret_cast<void *>(hk_add_passthrough), &g_orig_add);
+        });
+        HARNESS_CHECK(harness, result == JNIHOOK_OK);
+        HARNESS_CHECK(harness, add(harness, 2, 3) == 105);
+        HARNESS_CHECK(harness, call_add(harness, 2, 3) == 105);
+
+        HARNESS_CHECK(harness, JNIHook_Shutdown() == JNIHOOK_OK);
+        HARNESS_CHECK(harness, add(harness, 2, 3) == 5);
+
+        return true;
+}
+
+static bool
+attach_instance(Harness &harness)
+{
+        jobject target = harness.env->NewObject(g_target, g_constructor, 3);
+        HARNESS_CHECK(harness, target != NULL);
+        HARNESS_CHECK(harness, JNIHook_Init(harness.jvm) == JNIHOOK_OK);
+
+        auto result = harness.step("attach", []() {
+                return JNIHook_Attach(g_scale, reinterpret_cast<void *>(hk_scale), &g_orig_scale);
+        });
+        HARNESS_CHECK(harness, result == JNIHOOK_OK);
+        HARNESS_CHECK(harness, harness.env->CallIntMethod(target, g_scale, 2) == 7);
+
+        HARNESS_CHECK(harness, harness.step("detach", []() { return JNIHook_Detach(g_scale); }) == JNIHOOK_OK);
+        HARNESS_CHECK(harness, harness.env->CallIntMethod(target, g_scale, 2) == 6);
+
+        HARNESS_CHECK(harness, JNIHook_Shutdown() == JNIHOOK_OK);
+
+        return true;
+}
+
+static bool
+attach_object(Harness &harness)
+{
+        HARNESS_CHECK(harness, JNIHook_Init(harness.jvm) == JNIHOOK_OK);
+        HARNESS_CHECK(harness, greet(harness, "harness") == "Hello, harness");
+
+        auto result = harness.step("attach", []() {
+                return JNIHook_Attach(g_greet, reinterpret_cast<void *>(hk_greet), NULL);
+        });
+        HARNESS_CHECK(harness, result == JNIHOOK_OK);
+        HARNESS_CHECK(harness, greet(harness, "harness") == "Hooked");
+
+        HARNESS_CHECK(harness, JNIHook_Detach(g_greet) == JNIHOOK_OK);
+        HARNESS_CHECK(harness, greet(harness, "harness") == "Hello, harness");
+
+        HARNESS_CHECK(harness, JNIHook_Shutdown() == JNIHOOK_OK);
+
+        return true;
+}
+
+static bool
+reattach(Harness &harness)
+{
+        HARNESS_CHECK(harness, JNIHook_Init(harness.jvm) == JNIHOOK_OK);
+
+        HARNESS_CHECK(harness, JNIHook_Attach(g_add, reinterpret_cast<void *>(hk_add), &g_orig_add) == JNIHOOK_OK);
+        HARNESS_CHECK(harness, JNIHook_Detach(g_add) == JNIHOOK_OK);
+
+        // The class is cached by now
+        auto result = harness.step("attach_cached", []() {
+                return JNIHook_Attach(g_add, reinterpret_cast<void *>(hk_add_passthrough), &g_orig_add);
+        });
+        HARNESS_CHECK(harness, result == JNIHOOK_OK);
+        HARNESS_CHECK(harness, add(harness, 2, 3) == 105);
+
+        // Attaching again replaces the hook
+        HARNESS_CHECK(harness, JNIHook_Attach(g_add, reinterpret_cast<void *>(hk_add), &g_orig_add) == JNIHOOK_OK);
+        HARNESS_CHECK(harness, add(harness, 2, 3) == 6);
+
+        HARNESS_CHECK(harness, JNIHook_Shutdown() == JNIHOOK_OK);
+        HARNESS_CHECK(harness, add(harness, 2, 3) == 5);
+
+        return true;
+}
+
+static bool
+hook_lookup(Harness &harness)
+{
+        jmethodID orig;
+
+        HARNESS_CHECK(harness, JNIHook_Init(harness.jvm) == JNIHOOK_OK);
+        HARNESS_CHECK(harness, !JNIHook_IsHooked(g_add));
+        HARNESS_CHECK(harness, JNIHook_GetOriginal(g_add, &orig) == JNIHOOK_ERR_INVALID_ARGUMENT);
+
+        HARNESS_CHECK(harness, JNIHook_Attach(g_add, reinterpret_cast<void *>(hk_add_lookup), NULL) == JNIHOOK_OK);
+        HARNESS_CHECK(harness, JNIHook_IsHooked(g_add));
+        HARNESS_CHECK(harness, !JNIHook_IsHooked(g_scale));
+        HARNESS_CHECK(harness, add(harness, 2, 3) == 105);
+        HARNESS_CHECK(harness, call_add(harness, 2, 3) == 105);
+
+        HARNESS_CHECK(harness, JNIHook_Detach(g_add) == JNIHOOK_OK);
+        HARNESS_CHECK(harness, !JNIHook_IsHooked(g_add));
+
+        // Shutdown forgets the hooks that are still placed
+        HARNESS_CHECK(harness, JNIHook_Attach(g_scale, reinterpret_cast<void *>(hk_scale), &g_orig_scale) == JNIHOOK_OK);
+        HARNESS_CHECK(harness, JNIHook_GetOriginal(g_scale, &orig) == JNIHOOK_OK && orig == g_orig_scale);
+        HARNESS_CHECK(harness, JNIHook_Shutdown() == JNIHOOK_OK);
+        HARNESS_CHECK(harness, !JNIHook_IsHooked(g_scale));
+
+        return true;
+}
+
+static bool
+typed_hooks(Harness &harness)
+{
+        jobject target = harness.env->NewObject(g_target, g_constructor, 3);
+        HARNESS_CHECK(harness, target != NULL);
+        HARNESS_CHECK(harness, JNIHook_Init(harness.jvm) == JNIHOOK_OK);
+
+        HARNESS_CHECK(harness, typed_add_t::attach<hk_typed_add>(harness.env).has_value());
+        HARNESS_CHECK(harness, typed_add_t::target() == g_add);
+        HARNESS_CHECK(harness, add(harness, 2, 3) == 105);
+        HARNESS_CHECK(harness, call_add(harness, 2, 3) == 105);
+
+        auto greet_result = typed_greet_t::attach<[](JNIEnv *env, jclass clazz, jstring name) {
+                return typed_greet_t::call_original(env, clazz, env->NewStringUTF("typed"));
+        }>(harness.env);
+        HARNESS_CHECK(harness, greet_result.has_value());
+        HARNESS_CHECK(harness, greet(harness, "harness") == "Hello, typed");
+
+        auto scale_result = typed_scale_t::attach<[](JNIEnv *env, jobject self, jint value) {
+                return typed_scale_t::call_original(env, self, value) + 1;
+        }>(harness.env);
+        HARNESS_CHECK(harness, scale_result.has_value());
+        HARNESS_CHECK(harness, harness.env->CallIntMethod(target, g_scale, 2) == 7);
+
+        // The descriptor must match the method
+        typedef jnihook::hook<"jnihook/test/HarnessTarget", "scale", jlong(jint)> wrong_scale_t;
+        auto wrong_result = wrong_scale_t::attach<[](JNIEnv *, jobject, jint) { return jlong(0); }>(harness.env);
+        HARNESS_CHECK(harness, !wrong_result && wrong_result.error() == JNIHOOK_ERR_JAVA_EXCEPTION);
+
+        HARNESS_CHECK(harness, typed_add_t::detach() == JNIHOOK_OK);
+        HARNESS_CHECK(harness, add(harness, 2, 3) == 5);
+
+        HARNESS_CHECK(harness, JNIHook_Shutdown() == JNIHOOK_OK);
+        HARNESS_CHECK(harness, greet(harness, "harness") == "Hello, harness");
+        HARNESS_CHECK(harness, harness.env->CallIntMethod(target, g_scale, 2) == 6);
+
+        return true;
+}
+
+static bool
+intercept(Harness &harness)
+{
+        auto env = harness.env;
+        jobject target = env->NewObject(g_target, g_constructor, 3);
+        HARNESS_CHECK(harness, target != NULL);
+        HARNESS_CHECK(harness, JNIHook_Init(harness.jvm) == JNIHOOK_OK);
+
+        auto result = harness.step("intercept", []() {
+                return JNIHook_Intercept(g_add, ic_multiply, NULL, NULL, 0);
+        });
+        HARNESS_CHECK(harness, result == JNIHOOK_OK);
+        HARNESS_CHECK(harness, add(harness, 2, 3) == 6);
+        HARNESS_CHECK(harness, call_add(harness, 2, 3) == 6);
+
+        HARNESS_CHECK(harness, JNIHook_Intercept(g_greet, ic_rename, NULL, NULL, 0) == JNIHOOK_OK);
+        HARNESS_CHECK(harness, greet(harness, "harness") == "Hello, intercepted");
+
+        HARNESS_CHECK(harness, JNIHook_Intercept(g_scale, ic_increment, NULL, NULL, 0) == JNIHOOK_OK);
+        HARNESS_CHECK(harness, env->CallIntMethod(target, g_scale, 2) == 7);
+
+        jstring name = env->NewStringUTF("four");
+        jdouble expected = env->CallStaticDoubleMethod(g_target, g_mix, 1, (jlong)2, 3.5, 4.25, name, 5, 6, 7,
+                                                       8.5, 9.0, 10.0, 11.0, 12.0, 13.0, 14.5, (jboolean)JNI_TRUE);
+        HARNESS_CHECK(harness, JNIHook_Intercept(g_mix, ic_mix, NULL, NULL, 0) == JNIHOOK_OK);
+        jdouble intercepted = env->CallStaticDoubleMethod(g_target, g_mix, 1, (jlong)2, 3.5, 4.25, name, 5, 6, 7,
+                                                          8.5, 9.0, 10.0, 11.0, 12.0, 13.0, 14.5, (jboolean)JNI_TRUE);
+        HARNESS_CHECK(harness, intercepted == expected);
+
+        // Intercepting a method again reuses its stub with the new interceptor and argument
+        jint offset = 10;
+        jmethodID orig;
+        HARNESS_CHECK(harness, JNIHook_Intercept(g_add, ic_offset, &offset, &orig, 0) == JNIHOOK_OK);
+        HARNESS_CHECK(harness, orig != NULL);
+        HARNESS_CHECK(harness, add(harness, 2, 3) == 15);
+        offset = 20;
+        HARNESS_CHECK(harness, add(harness, 2, 3) == 25);
+
+        HARNESS_CHECK(harness, JNIHook_Detach(g_add) == JNIHOOK_OK);
+        HARNESS_CHECK(harness, add(harness, 2, 3) == 5);
+
+        HARNESS_CHECK(harness, JNIHook_Intercept(g_add, ic_multiply, NULL, NULL, 0) == JNIHOOK_OK);
+        HARNESS_CHECK(harness, add(harness, 2, 3) == 6);
+
+        HARNESS_CHECK(harness, JNIHook_Shutdown() == JNIHOOK_OK);
+        HARNESS_CHECK(harness, greet(harness, "harness") == "Hello, harness");
+        HARNESS_CHECK(harness, add(harness, 2, 3) == 5);
+
+        // The interceptors are kept across a shutdown, for the next interception
+        HARNESS_CHECK(harness, JNIHook_Init(harness.jvm) == JNIHOOK_OK);
+        HARNESS_CHECK(harness, JNIHook_Intercept(g_add, ic_offset, &offset, NULL, 0) == JNIHOOK_OK);
+        HARNESS_CHECK(harness, add(harness, 2, 3) == 25);
+        HARNESS_CHECK(harness, JNIHook_Shutdown() == JNIHOOK_OK);
+
+        return true;
+}
+
+static bool
+attach_batch(Harness &harness)
+{
+        jnihook_hook_t hooks[] = {
+                { g_add, reinterpret_cast<void *>(hk_add), 0, NULL, JNIHOOK_OK },
+                { g_greet, reinterpret_cast<void *>(hk_greet), 0, NULL, JNIHOOK_OK },
+        };
+        jnihook_schedule_t schedule = { UINT64_MAX, 0, NULL, NULL }; // Single batch
+
+        HARNESS_CHECK(harness, JNIHook_Init(harness.jvm) == JNIHOOK_OK);
+
+        auto result = harness.step("attach_batch", [&]() {
+                return JNIHook_AttachBatch(hooks, 2, &schedule, NULL);
+        });
+        HARNESS_CHECK(harness, result == JNIHOOK_OK);
+        HARNESS_CHECK(harness, hooks[0].result == JNIHOOK_OK && hooks[0].original_method != NULL);
+        HARNESS_CHECK(harness, hooks[1].result == JNIHOOK_OK && hooks[1].original_method != NULL);
+        HARNESS_CHECK(harness, add(harness, 2, 3) == 6);
+        HARNESS_CHECK(harness, greet(harness, "harness") == "Hooked");
+
+        HARNESS_CHECK(harness, harness.step("shutdown", []() { return JNIHook_Shutdown(); }) == JNIHOOK_OK);
+        HARNESS_CHECK(harness, add(harness, 2, 3) == 5);
+        HARNESS_CHECK(harness, greet(harness, "harness") == "Hello, harness");
+
+        return true;
+}
+
+// Reports of the batches of a split attach, with the time each one was reported at
+typedef struct batch_log_t {
+        std::vector<jnihook_batch_report_t> reports;
+        std::vector<std::chrono::steady_clock::time_point> times;
+} batch_log_t;
+
+static void
+log_batch(const jnihook_batch_report_t *report, void *arg)
+{
+        auto log = reinterpret_cast<batch_log_t *>(arg);
+
+        log->reports.push_back(*report);
+        log->times.push_back(std::chrono::steady_clock::now());
+}
+
+// A budget below the pause of any class puts every class in a batch of its own
+static bool
+attach_batch_split(Harness &harness)
+{
+        jnihook_hook_t hooks[] = {
+                { g_add, reinterpret_cast<void *>(hk_add), 0, NULL, JNIHOOK_OK },
+                { g_left_first, reinterpret_cast<void *>(hk_left_first), 0, NULL, JNIHOOK_OK },
+        };
+        batch_log_t log;
+        jnihook_schedule_t schedule = { 1, BATCH_GAP_NS, log_batch, &log };
+        jnihook_schedule_report_t report = {};
+
+        HARNESS_CHECK(harness, JNIHook_Init(harness.jvm) == JNIHOOK_OK);
+
+        auto result = harness.step("attach_batch", [&]() {
+                return JNIHook_AttachBatch(hooks, 2, &schedule, &report);
+        });
+        HARNESS_CHECK(harness, result == JNIHOOK_OK);
+        HARNESS_CHECK(harness, hooks[0].result == JNIHOOK_OK && hooks[0].original_method != NULL);
+        HARNESS_CHECK(harness, hooks[1].result == JNIHOOK_OK && hooks[1].original_method != NULL);
+        HARNESS_CHECK(harness, add(harness, 2, 3) == 6);
+        HARNESS_CHECK(harness, left_first(harness, 2) == -2);
+
+        HARNESS_CHECK(harness, report.batches == 2);
+        HARNESS_CHECK(harness, report.over_budget == 2);
+        HARNESS_CHECK(harness, report.predicted_pause_ns > 0 && report.actual_pause_ns > 0);
+        HARNESS_CHECK(harness, report.max_predicted_pause_ns > 0 && report.max_actual_pause_ns > 0);
+        HARNESS_CHECK(harness, report.max_actual_pause_ns <= report.actual_pause_ns);
+
+        // One report per batch, and the batches are spaced by the gap
+        HARNESS_CHECK(harness, log.reports.size() == 2);
+        uint64_t predicted = 0;
+        uint64_t actual = 0;
+        for (size_t i = 0; i < log.reports.size(); ++i) {
+                auto &batch = log.reports[i];
+
+                HARNESS_CHECK(harness, batch.index == static_cast<jint>(i));
+                HARNESS_CHECK(harness, batch.class_count == 1 && batch.class_bytes > 0);
+                HARNESS_CHECK(harness, batch.result == JNIHOOK_OK);
+                HARNESS_CHECK(harness, batch.predicted_pause_ns > 0 && batch.actual_pause_ns > 0);
+                predicted += batch.predicted_pause_ns;
+                actual += batch.actual_pause_ns;
+        }
+        HARNESS_CHECK(harness, predicted == report.predicted_pause_ns && actual == report.actual_pause_ns);
+        HARNESS_CHECK(harness, log.times[1] - log.times[0] >= std::chrono::nanoseconds(BATCH_GAP_NS));
+
+        HARNESS_CHECK(harness, JNIHook_Shutdown() == JNIHOOK_OK);
+        HARNESS_CHECK(harness, add(harness, 2, 3) == 5);
+        HARNESS_CHECK(harness, left_first(harness, 2) == 7);
+
+        return true;
+}
+
+static bool
+attach_async(Harness &harness)
+{
+        async_state_t attached, detached;
+
+        HARNESS_CHECK(harness, JNIHook_Init(harness.jvm) == JNIHOOK_OK);
+
+        auto result = harness.step("attach_async", [&]() {
+                return JNIHook_AttachAsync(g_add, reinterpret_cast<void *>(hk_add), 0, async_callback, &attached);
+        });
+        HARNESS_CHECK(harness, result == JNIHOOK_OK);
+        HARNESS_CHECK(harness, harness.step("attach_wait", [&]() { return async_wait(attached); }));
+        HARNESS_CHECK(harness, attached.result == JNIHOOK_OK && attached.original_method != NULL);
+        HARNESS_CHECK(harness, add(harness, 2, 3) == 6);
+
+        result = harness.step("detach_async", [&]() { return JNIHook_DetachAsync(g_add, async_callback, &detached); });
+        HARNESS_CHECK(harness, result == JNIHOOK_OK);
+        HARNESS_CHECK(harness, harness.step("detach_wait", [&]() { return async_wait(detached); }));
+        HARNESS_CHECK(harness, detached.result == JNIHOOK_OK);
+        HARNESS_CHECK(harness, add(harness, 2, 3) == 5);
+
+        HARNESS_CHECK(harness, JNIHook_Shutdown() == JNIHOOK_OK);
+
+        return true;
+}
+
+// Hooks a method while another thread keeps calling it
+static bool
+concurrent_caller(Harness &harness)
+{
+        auto env = harness.env;
+        jmethodID start = env->GetStaticMethodID(g_spinner, "start", "()Ljnihook/test/HarnessTarget$Spinner;");
+        jmethodID await_result = env->GetMethodID(g_spinner, "awaitResult", "(IJ)Z");
+        jmethodID stop = env->GetMethodID(g_spinner, "stop", "()V");
+
+        HARNESS_CHECK(harness, JNIHook_Init(harness.jvm) == JNIHOOK_OK);
+
+        // Returns once the spinner is running
+        jobject spinner = env->CallStaticObjectMethod(g_spinner, start);
+        HARNESS_CHECK(harness, spinner != NULL);
+
+        auto result = harness.step("attach", []() {
+                return JNIHook_Attach(g_add, reinterpret_cast<void *>(hk_add), &g_orig_add);
+        });
+        HARNESS_CHECK(harness, result == JNIHOOK_OK);
+        HARNESS_CHECK(harness, env->CallBooleanMethod(spinner, await_result, 6, (jlong)SPINNER_TIMEOUT_MS));
+
+        HARNESS_CHECK(harness, harness.step("detach", []() { return JNIHook_Detach(g_add); }) == JNIHOOK_OK);
+        HARNESS_CHECK(harness, env->CallBooleanMethod(spinner, await_result, 5, (jlong)SPINNER_TIMEOUT_MS));
+
+        env->CallVoidMethod(spinner, stop);
+        HARNESS_CHECK(harness, JNIHook_Shutdown() == JNIHOOK_OK);
+
+        return true;
+}
+
+static bool
+shutdown_restores(Harness &harness)
+{
+        jobject target = harness.env->NewObject(g_target, g_constructor, 3);
+        jnihook_shutdown_report_t report;
+
+        HARNESS_CHECK(harness, JNIHook_Init(harness.jvm) == JNIHOOK_OK);
+        HARNESS_CHECK(harness, JNIHook_Attach(g_add, reinterpret_cast<void *>(hk_add), &g_orig_add) == JNIHOOK_OK);
+        HARNESS_CHECK(harness, JNIHook_Attach(g_scale, reinterpret_cast<void *>(hk_scale), &g_orig_scale) == JNIHOOK_OK);
+
+        HARNESS_CHECK(harness, harness.step("shutdown", [&]() { return JNIHook_ShutdownEx(&report); }) == JNIHOOK_OK);
+        HARNESS_CHECK(harness, report.class_count == 1 && report.restored == 1);
+        HARNESS_CHECK(harness, add(harness, 2, 3) == 5);
+        HARNESS_CHECK(harness, harness.env->CallIntMethod(target, g_scale, 2) == 6);
+
+        return true;
+}
+
+static bool
+hook_stats(Harness &harness)
+{
+        jnihook_stats_t stats;
+
+        HARNESS_CHECK(harness, JNIHook_Init(harness.jvm) == JNIHOOK_OK);
+        JNIHook_ResetStats();
+        JNIHook_GetStats(&stats);
+        HARNESS_CHECK(harness, stats.attaches == 0 && stats.detaches == 0);
+        HARNESS_CHECK(harness, stats.phases[JNIHOOK_PHASE_REDEFINE].count == 0);
+        HARNESS_CHECK(harness, stats.max_pause_ns == 0);
+
+        HARNESS_CHECK(harness, JNIHook_Attach(g_add, reinterpret_cast<void *>(hk_add), &g_orig_add) == JNIHOOK_OK);
+        JNIHook_GetStats(&stats);
+        HARNESS_CHECK(harness, stats.attaches == 1 && stats.failures == 0);
+        HARNESS_CHECK(harness, stats.classes_cached == 1 && stats.classes_redefined >= 1);
+        HARNESS_CHECK(harness, stats.phases[JNIHOOK_PHASE_CACHE].count == 1);
+        HARNESS_CHECK(harness, stats.phases[JNIHOOK_PHASE_REDEFINE].count >= 1);
+        HARNESS_CHECK(harness, stats.phases[JNIHOOK_PHASE_REDEFINE].total_ns > 0);
+        HARNESS_CHECK(harness, stats.phases[JNIHOOK_PHASE_REDEFINE].max_ns <= stats.phases[JNIHOOK_PHASE_REDEFINE].total_ns);
+        HARNESS_CHECK(harness, stats.max_pause_ns > 0);
+        // The pause covers the redefinition
+        HARNESS_CHECK(harness, stats.max_pause_ns >= stats.phases[JNIHOOK_PHASE_REDEFINE].max_ns);
+
+        HARNESS_CHECK(harness, JNIHook_Detach(g_add) == JNIHOOK_OK);
+        JNIHook_GetStats(&stats);
+        HARNESS_CHECK(harness, stats.attaches == 1 && stats.detaches == 1);
+
+        JNIHook_ResetStats();
+        JNIHook_GetStats(&stats);
+        HARNESS_CHECK(harness, stats.attaches == 0 && stats.detaches == 0 && stats.classes_redefined == 0);
+        HARNESS_CHECK(harness, stats.phases[JNIHOOK_PHASE_REDEFINE].count == 0);
+        HARNESS_CHECK(harness, stats.phases[JNIHOOK_PHASE_REDEFINE].total_ns == 0);
+        HARNESS_CHECK(harness, stats.max_pause_ns == 0);
+
+        HARNESS_CHECK(harness, JNIHook_Shutdown() == JNIHOOK_OK);
+
+        return true;
+}
+
+// Operations that would install the bytes a class already has must not redefine it
+static bool
+skip_redefinitions(Harness &harness)
+{
+        jnihook_stats_t before, after;
+
+        HARNESS_CHECK(harness, JNIHook_Init(harness.jvm) == JNIHOOK_OK);
+        HARNESS_CHECK(harness, JNIHook_Attach(g_add, reinterpret_cast<void *>(hk_add), &g_orig_add) == JNIHOOK_OK);
+        JNIHook_GetStats(&before);
+
+        // The same hook again generates the bytes that are already installed
+        auto result = harness.step("attach_duplicate", []() {
+                return JNIHook_Attach(g_add, reinterpret_cast<void *>(hk_add), &g_orig_add);
+        });
+        HARNESS_CHECK(harness, result == JNIHOOK_OK);
+        HARNESS_CHECK(harness, add(harness, 2, 3) == 6);
+
+        // So does detaching a method of the class that is not hooked
+        HARNESS_CHECK(harness, harness.step("detach_unhooked", []() { return JNIHook_Detach(g_greet); }) == JNIHOOK_OK);
+        HARNESS_CHECK(harness, greet(harness, "harness") == "Hello, harness");
+        HARNESS_CHECK(harness, add(harness, 2, 3) == 6);
+
+        JNIHook_GetStats(&after);
+        HARNESS_CHECK(harness, after.classes_redefined == before.classes_redefined);
+        HARNESS_CHECK(harness, after.phases[JNIHOOK_PHASE_REDEFINE].count == before.phases[JNIHOOK_PHASE_REDEFINE].count);
+        HARNESS_CHECK(harness, after.content_hash_hits == before.content_hash_hits + 2);
+        HARNESS_CHECK(harness, after.redefinitions_skipped == before.redefinitions_skipped + 2);
+
+        // An actual change is still applied
+        HARNESS_CHECK(harness, JNIHook_Detach(g_add) == JNIHOOK_OK);
+        HARNESS_CHECK(harness, add(harness, 2, 3) == 5);
+        JNIHook_GetStats(&after);
+        HARNESS_CHECK(harness, after.classes_redefined == before.classes_redefined + 1);
+        HARNESS_CHECK(harness, after.redefinitions_skipped == before.redefinitions_skipped + 2);
+
+        HARNESS_CHECK(harness, JNIHook_Shutdown() == JNIHOOK_OK);
+
+        return true;
+}
+
+// Loads a copy of the target class through its own class loader
+static jclass
+load_isolated_target(Harness &harness)
+{
+        auto env = harness.env;
+        jclass file_class = env->FindClass("java/io/File");
+        jclass uri_class = env->FindClass("java/net/URI");
+        jclass url_class = env->FindClass("java/net/URL");
+        jclass loader_class = env->FindClass("java/net/URLClassLoader");
+        if (!file_class || !uri_class || !url_class || !loader_class)
+                return NULL;
+
+        jmethodID file_constructor = env->GetMethodID(file_class, "<init>", "(Ljava/lang/String;)V");
+        jmethodID to_uri = env->GetMethodID(file_class, "toURI", "()Ljava/net/URI;");
+        jmethodID to_url = env->GetMethodID(uri_class, "toURL", "()Ljava/net/URL;");
+        jmethodID loader_constructor = env->GetMethodID(loader_class, "<init>", "([Ljava/net/URL;Ljava/lang/ClassLoader;)V");
+        jmethodID load_class = env->GetMethodID(loader_class, "loadClass", "(Ljava/lang/String;)Ljava/lang/Class;");
+        if (!file_constructor || !to_uri || !to_url || !loader_constructor || !load_class)
+                return NULL;
+
+        jobject file = env->NewObject(file_class, file_constructor, env->NewStringUTF(harness.class_path()));
+        jobject url = file ? env->CallObjectMethod(env->CallObjectMethod(file, to_uri), to_url) : NULL;
+        jobjectArray urls = url ? env->NewObjectArray(1, url_class, url) : NULL;
+        // No parent, so that the system class loader can't load the class first
+        jobject loader = urls ? env->NewObject(loader_class, loader_constructor, urls, NULL) : NULL;
+        if (!loader)
+                return NULL;
+
+        return static_cast<jclass>(env->CallObjectMethod(loader, load_class, env->NewStringUTF("jnihook.test.HarnessTarget")));
+}
+
+// Hooks a class whose class loader is then collected, which must release
+// everything that JNIHook kept for the class. The copy of the class in the
+// system class loader is hooked as well, so the two share their class file.
+static bool
+evict_unloaded(Harness &harness)
+{
+        auto env = harness.env;
+        jmethodID isolated_add = NULL;
+        jnihook_stats_t stats;
+        jnihook_cache_stats_t cache_stats;
+
+        HARNESS_CHECK(harness, JNIHook_Init(harness.jvm) == JNIHOOK_OK);
+        HARNESS_CHECK(harness, JNIHook_Attach(g_add, reinterpret_cast<void *>(hk_add), &g_orig_add) == JNIHOOK_OK);
+        HARNESS_CHECK(harness, JNIHook_GetCacheStats(&cache_stats) == JNIHOOK_OK);
+        uint64_t dedup_hits = cache_stats.dedup_hits;
+        uint64_t patch_reuses = cache_stats.patch_reuses;
+
+        // Only the jmethodID outlives the local frame
+        HARNESS_CHECK(harness, env->PushLocalFrame(32) == JNI_OK);
+        bool hooked = [&]() {
+                jclass isolated = load_isolated_target(harness);
+                HARNESS_CHECK(harness, isolated != NULL && !env->IsSameObject(isolated, g_target));
+
+                isolated_add = env->GetStaticMethodID(isolated, "add", "(II)I");
+                HARNESS_CHECK(harness, isolated_add != NULL);
+                HARNESS_CHECK(harness, JNIHook_Attach(isolated_add, reinterpret_cast<void *>(hk_add), NULL) == JNIHOOK_OK);
+                HARNESS_CHECK(harness, env->CallStaticIntMethod(isolated, isolated_add, 2, 3) == 6);
+                HARNESS_CHECK(harness, add(harness, 2, 3) == 6);
+
+                return true;
+        }();
+        env->PopLocalFrame(NULL);
+
+        HARNESS_CHECK(harness, hooked);
+        HARNESS_CHECK(harness, JNIHook_IsHooked(isolated_add));
+
+        // Same bytes and same hooks: one cached class file, patched once
+        HARNESS_CHECK(harness, JNIHook_GetCacheStats(&cache_stats) == JNIHOOK_OK);
+        HARNESS_CHECK(harness, cache_stats.classes == 2);
+        HARNESS_CHECK(harness, cache_stats.parsed_entries + cache_stats.raw_entries + cache_stats.compressed_entries == 1);
+        HARNESS_CHECK(harness, cache_stats.dedup_hits >= dedup_hits + 1);
+        HARNESS_CHECK(harness, cache_stats.patch_reuses >= patch_reuses + 1);
+        JNIHook_ResetStats();
+
+        // The class is freed by a collection, and evicted later by the worker thread
+        jclass system_class = env->FindClass("java/lang/System");
+        jmethodID gc = env->GetStaticMethodID(system_class, "gc", "()V");
+        harness.step("unload", [&]() {
+                for (int i = 0; i < EVICT_ATTEMPTS; ++i) {
+                        env->CallStaticVoidMethod(system_class, gc);
+                        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+
+                        JNIHook_GetStats(&stats);
+                        if (stats.classes_unloaded > 0 && !JNIHook_IsHooked(isolated_add))
+                                break;
+                }
+        });
+
+        HARNESS_CHECK(harness, stats.classes_unloaded >= 1);
+        HARNESS_CHECK(harness, stats.bytes_reclaimed > 0);
+        HARNESS_CHECK(harness, !JNIHook_IsHooked(isolated_add));
+
+        // The shared class file is kept for the class of the system class loader
+        HARNESS_CHECK(harness, JNIHook_GetCacheStats(&cache_stats) == JNIHOOK_OK);
+        HARNESS_CHECK(harness, cache_stats.classes == 1);
+        HARNESS_CHECK(harness, cache_stats.parsed_entries + cache_stats.raw_entries + cache_stats.compressed_entries == 1);
+        HARNESS_CHECK(harness, JNIHook_IsHooked(g_add));
+        HARNESS_CHECK(harness, add(harness, 2, 3) == 6);
+
+        HARNESS_CHECK(harness, JNIHook_Detach(g_add) == JNIHOOK_OK);
+        HARNESS_CHECK(harness, add(harness, 2, 3) == 5);
+        HARNESS_CHECK(harness, JNIHook_Attach(g_add, reinterpret_cast<void *>(hk_add), &g_orig_add) == JNIHOOK_OK);
+        HARNESS_CHECK(harness, add(harness, 2, 3) == 6);
+
+        HARNESS_CHECK(harness, JNIHook_Shutdown() == JNIHOOK_OK);
+        HARNESS_CHECK(harness, add(harness, 2, 3) == 5);
+
+        return true;
+}
+
+// Keeps the class file cache over a tiny budget, so that every class file is
+// demoted (and compressed) once it is not in use, and parsed again when it is
+static bool
+cache_budget(Harness &harness)
+{
+        jnihook_cache_stats_t cache_stats;
+
+        HARNESS_CHECK(harness, JNIHook_Init(harness.jvm) == JNIHOOK_OK);
+        JNIHook_SetCacheBudget(1, JNI_TRUE);
+
+        for (int round = 0; round < 2; ++round) {
+                HARNESS_CHECK(harness, JNIHook_Attach(g_add, reinterpret_cast<void *>(hk_add), NULL) == JNIHOOK_OK);
+                HARNESS_CHECK(harness, JNIHook_Attach(g_left_first, reinterpret_cast<void *>(hk_left_first), NULL) == JNIHOOK_OK);
+                HARNESS_CHECK(harness, add(harness, 2, 3) == 6);
+                HARNESS_CHECK(harness, left_first(harness, 2) == -2);
+
+                HARNESS_CHECK(harness, harness.step("detach", []() { return JNIHook_Detach(g_add); }) == JNIHOOK_OK);
+                HARNESS_CHECK(harness, JNIHook_Detach(g_left_first) == JNIHOOK_OK);
+                HARNESS_CHECK(harness, add(harness, 2, 3) == 5);
+                HARNESS_CHECK(harness, left_first(harness, 2) == 7);
+        }
+
+        HARNESS_CHECK(harness, JNIHook_GetCacheStats(&cache_stats) == JNIHOOK_OK);
+        HARNESS_CHECK(harness, cache_stats.budget_bytes == 1);
+        HARNESS_CHECK(harness, cache_stats.classes == 2);
+        HARNESS_CHECK(harness, cache_stats.parsed_entries == 0);
+        HARNESS_CHECK(harness, cache_stats.raw_entries + cache_stats.compressed_entries == 2);
+        HARNESS_CHECK(harness, cache_stats.compressed_entries >= 1);
+        HARNESS_CHECK(harness, cache_stats.demotions > 0);
+        HARNESS_CHECK(harness, cache_stats.inflations > 0);
+        HARNESS_CHECK(harness, cache_stats.inflation_failures == 0);
+
+        // Lifting the budget keeps the class files parsed again
+        JNIHook_SetCacheBudget(0, JNI_FALSE);
+        HARNESS_CHECK(harness, JNIHook_Attach(g_add, reinterpret_cast<void *>(hk_add), NULL) == JNIHOOK_OK);
+        HARNESS_CHECK(harness, add(harness, 2, 3) == 6);
+        HARNESS_CHECK(harness, JNIHook_GetCacheStats(&cache_stats) == JNIHOOK_OK);
+        HARNESS_CHECK(harness, cache_stats.parsed_entries == 1);
+
+        HARNESS_CHECK(harness, JNIHook_Shutdown() == JNIHOOK_OK);
+        HARNESS_CHECK(harness, add(harness, 2, 3) == 5);
+
+        return true;
+}
+
+// Caches the test classes with a single retransformation, so that
+// hooking them later does not need one
+static bool
+prewarm_cache(Harness &harness)
+{
+        jclass classes[] = { g_target, g_spinner };
+        jnihook_stats_t stats;
+
+        HARNESS_CHECK(harness, JNIHook_Init(harness.jvm) == JNIHOOK_OK);
+        JNIHook_ResetStats();
+
+        HARNESS_CHECK(harness, harness.step("prewarm", [&]() { return JNIHook_PrewarmCache(classes, 2); }) == JNIHOOK_OK);
+        JNIHook_GetStats(&stats);
+        HARNESS_CHECK(harness, stats.classes_cached == 2);
+        HARNESS_CHECK(harness, stats.phases[JNIHOOK_PHASE_CACHE].count == 1);
+
+        // Cached classes are not retransformed again
+        HARNESS_CHECK(harness, JNIHook_PrewarmCache(classes, 2) == JNIHOOK_OK);
+        HARNESS_CHECK(harness, JNIHook_Attach(g_add, reinterpret_cast<void *>(hk_add), &g_orig_add) == JNIHOOK_OK);
+        HARNESS_CHECK(harness, add(harness, 2, 3) == 6);
+        JNIHook_GetStats(&stats);
+        HARNESS_CHECK(harness, stats.classes_cached == 2);
+        HARNESS_CHECK(harness, stats.phases[JNIHOOK_PHASE_CACHE].count == 1);
+
+        // The cache is dropped on shutdown
+        HARNESS_CHECK(harness, JNIHook_Shutdown() == JNIHOOK_OK);
+        HARNESS_CHECK(harness, JNIHook_Init(harness.jvm) == JNIHOOK_OK);
+        JNIHook_ResetStats();
+
+        HARNESS_CHECK(harness, JNIHook_PrewarmCacheByPrefix("jnihook/nonexistent/") == JNIHOOK_OK);
+        JNIHook_GetStats(&stats);
+        HARNESS_CHECK(harness, stats.classes_cached == 0);
+        HARNESS_CHECK(harness, stats.phases[JNIHOOK_PHASE_CACHE].count == 0);
+
+        auto result = harness.step("prewarm_by_prefix", []() { return JNIHook_PrewarmCacheByPrefix("jnihook/test/"); });
+        HARNESS_CHECK(harness, result == JNIHOOK_OK);
+        JNIHook_GetStats(&stats);
+        HARNESS_CHECK(harness, stats.classes_cached >= 2);
+        HARNESS_CHECK(harness, stats.phases[JNIHOOK_PHASE_CACHE].count == 1);
+
+        HARNESS_CHECK(harness, JNIHook_Attach(g_add, reinterpret_cast<void *>(hk_add), &g_orig_add) == JNIHOOK_OK);
+        HARNESS_CHECK(harness, add(harness, 2, 3) == 6);
+        JNIHook_GetStats(&stats);
+        HARNESS_CHECK(harness, stats.phases[JNIHOOK_PHASE_CACHE].count == 1);
+
+        HARNESS_CHECK(harness, JNIHook_Shutdown() == JNIHOOK_OK);
+        HARNESS_CHECK(harness, add(harness, 2, 3) == 5);
+
+        return true;
+}
+
+// Hooks a method patched ahead of time by jnihook-patch, which needs no redefinition.
+// Only run by CTest after jnihook-patch, with the patched classes in the class path
+// and the manifest in the jnihook.test.manifest property.
+static bool
+prepatched(Harness &harness)
+{
+        auto env = harness.env;
+        jnihook_stats_t stats;
+
+        jclass system_class = env->FindClass("java/lang/System");
+        jmethodID get_property = env->GetStaticMethodID(system_class, "getProperty", "(Ljava/lang/String;)Ljava/lang/String;");
+        auto manifest = static_cast<jstring>(env->CallStaticObjectMethod(system_class, get_property,
+                                                                         env->NewStringUTF("jnihook.test.manifest")));
+        if (!manifest) {
+                printf("# skipped: no manifest, the classes were not patched by jnihook-patch\n");
+                return true;
+        }
+
+        const char *chars = env->GetStringUTFChars(manifest, NULL);
+        std::string manifest_path = chars;
+        env->ReleaseStringUTFChars(manifest, chars);
+
+        HARNESS_CHECK(harness, JNIHook_Init(harness.jvm) == JNIHOOK_OK);
+        HARNESS_CHECK(harness, JNIHook_LoadManifest(NULL) == JNIHOOK_ERR_INVALID_ARGUMENT);
+        HARNESS_CHECK(harness, JNIHook_LoadManifest(manifest_path.c_str()) == JNIHOOK_OK);
+        JNIHook_ResetStats();
+
+        auto result = harness.step("attach", []() {
+                return JNIHook_Attach(g_add, reinterpret_cast<void *>(hk_add), &g_orig_add);
+        });
+        HARNESS_CHECK(harness, result == JNIHOOK_OK);
+        HARNESS_CHECK(harness, add(harness, 2, 3) == 6);
+        HARNESS_CHECK(harness, call_add(harness, 2, 3) == 6);
+        HARNESS_CHECK(harness, env->CallStaticIntMethod(g_target, g_orig_add, 2, 3) == 5);
+
+        JNIHook_GetStats(&stats);
+        HARNESS_CHECK(harness, stats.prepatched_attaches == 1);
+        HARNESS_CHECK(harness, stats.classes_redefined == 0);
+        HARNESS_CHECK(harness, stats.phases[JNIHOOK_PHASE_REDEFINE].count == 0);
+        HARNESS_CHECK(harness, stats.phases[JNIHOOK_PHASE_SUSPEND].count == 0);
+
+        // The original code is never restored
+        HARNESS_CHECK(harness, JNIHook_Detach(g_add) == JNIHOOK_ERR_UNSUPPORTED);
+        HARNESS_CHECK(harness, add(harness, 2, 3) == 6);
+
+        HARNESS_CHECK(harness, JNIHook_Shutdown() == JNIHOOK_OK);
+
+        return true;
+}
+
+// Counts the calls to an instrumented hook and exports them
+static bool
+instrumented_hooks(Harness &harness)
+{
+        jnihook_hook_metrics_t metrics;
+        auto path = (std::filesystem::temp_directory_path() / "jnihook-harness-metrics.prom").string();
+
+        HARNESS_CHECK(harness, JNIHook_Init(harness.jvm) == JNIHOOK_OK);
+
+        HARNESS_CHECK(harness, harness.step("attach", []() {
+                return JNIHook_AttachEx(g_add, reinterpret_cast<void *>(hk_add), &g_orig_add, JNIHOOK_ATTACH_INSTRUMENTED);
+        }) == JNIHOOK_OK);
+
+        for (jint i = 0; i < 3; ++i)
+                HARNESS_CHECK(harness, add(harness, 2, 3) == 6);
+
+        HARNESS_CHECK(harness, JNIHook_GetHookMetrics(g_add, &metrics) == JNIHOOK_OK);
+        HARNESS_CHECK(harness, metrics.calls == 3);
+
+        uint64_t bucket_calls = 0;
+        for (auto calls : metrics.buckets)
+                bucket_calls += calls;
+        HARNESS_CHECK(harness, bucket_calls == 3);
+
+        // Not instrumented
+        HARNESS_CHECK(harness, JNIHook_GetHookMetrics(g_greet, &metrics) != JNIHOOK_OK);
+
+        // The metrics are kept after the hook is detached
+        HARNESS_CHECK(harness, JNIHook_Detach(g_add) == JNIHOOK_OK);
+        HARNESS_CHECK(harness, add(harness, 2, 3) == 5);
+        HARNESS_CHECK(harness, JNIHook_GetHookMetrics(g_add, &metrics) == JNIHOOK_OK && metrics.calls == 3);
+
+        HARNESS_CHECK(harness, harness.step("export", [&]() { return JNIHook_ExportMetrics(path.c_str()); }) == JNIHOOK_OK);
+
+        std::ifstream file(path);
+        std::string line;
+        bool exported = false;
+        while (std::getline(file, line)) {
+                if (line.starts_with("jnihook_hook_calls_total{") && line.find("add(II)I") != std::string::npos)
+                        exported = line.ends_with(" 3");
+        }
+        file.close();
+        std::filesystem::remove(path);
+        HARNESS_CHECK(harness, exported);
+
+        HARNESS_CHECK(harness, JNIHook_Shutdown() == JNIHOOK_OK);
+
+        return true;
+}
+
+// Same operations as the scenarios above, with the class files taken
+// from a retransformation every time instead of the class file cache
+static bool
+retransform_mode(Harness &harness)
+{
+        jobject target = harness.env->NewObject(g_target, g_constructor, 3);
+        jnihook_shutdown_report_t report;
+        jnihook_stats_t stats;
+
+        HARNESS_CHECK(harness, target != NULL);
+        HARNESS_CHECK(harness, JNIHook_InitEx(harness.jvm, JNIHOOK_INIT_RETRANSFORM) == JNIHOOK_OK);
+        JNIHook_ResetStats();
+
+        auto result = harness.step("attach", []() {
+                return JNIHook_Attach(g_add, reinterpret_cast<void *>(hk_add), &g_orig_add);
+        });
+        HARNESS_CHECK(harness, result == JNIHOOK_OK);
+        HARNESS_CHECK(harness, add(harness, 2, 3) == 6);
+        HARNESS_CHECK(harness, harness.env->CallStaticIntMethod(g_target, g_orig_add, 2, 3) == 5);
+
+        result = harness.step("attach_second", []() {
+                return JNIHook_Attach(g_scale, reinterpret_cast<void *>(hk_scale), &g_orig_scale);
+        });
+        HARNESS_CHECK(harness, result == JNIHOOK_OK);
+        HARNESS_CHECK(harness, add(harness, 2, 3) == 6);
+        HARNESS_CHECK(harness, harness.env->CallIntMethod(target, g_scale, 2) == 7);
+
+        HARNESS_CHECK(harness, harness.step("detach", []() { return JNIHook_Detach(g_add); }) == JNIHOOK_OK);
+        HARNESS_CHECK(harness, add(harness, 2, 3) == 5);
+        HARNESS_CHECK(harness, harness.env->CallIntMethod(target, g_scale, 2) == 7);
+
+        // Nothing is cached, every class file was patched while it was retransformed
+        JNIHook_GetStats(&stats);
+        HARNESS_CHECK(harness, stats.classes_cached == 0);
+        HARNESS_CHECK(harness, stats.classes_transformed >= 3);
+
+        HARNESS_CHECK(harness, harness.step("shutdown", [&]() { return JNIHook_ShutdownEx(&report); }) == JNIHOOK_OK);
+        HARNESS_CHECK(harness, report.class_count == 1 && report.restored == 1);
+        HARNESS_CHECK(harness, add(harness, 2, 3) == 5);
+        HARNESS_CHECK(harness, harness.env->CallIntMethod(target, g_scale, 2) == 6);
+
+        return true;
+}
+
+// Another agent (with its own jvmtiEnv) retransforms a hooked class,
+// which must not remove the hook in persistent mode
+static bool
+persistent_retransform(Harness &harness)
+{
+        jvmtiEnv *jvmti;
+        jvmtiCapabilities capabilities = {};
+
+        HARNESS_CHECK(harness, harness.jvm->GetEnv(reinterpret_cast<void **>(&jvmti), JVMTI_VERSION_1_2) == JNI_OK);
+        capabilities.can_retransform_classes = 1;
+        HARNESS_CHECK(harness, jvmti->AddCapabilities(&capabilities) == JVMTI_ERROR_NONE);
+
+        HARNESS_CHECK(harness, JNIHook_InitEx(harness.jvm, JNIHOOK_INIT_PERSISTENT) == JNIHOOK_OK);
+        HARNESS_CHECK(harness, JNIHook_Attach(g_add, reinterpret_cast<void *>(hk_add), &g_orig_add) == JNIHOOK_OK);
+        HARNESS_CHECK(harness, add(harness, 2, 3) == 6);
+
+        auto error = harness.step("retransform", [&]() { return jvmti->RetransformClasses(1, &g_target); });
+        HARNESS_CHECK(harness, error == JVMTI_ERROR_NONE);
+        HARNESS_CHECK(harness, add(harness, 2, 3) == 6);
+        HARNESS_CHECK(harness, call_add(harness, 2, 3) == 6);
+        HARNESS_CHECK(harness, harness.env->CallStaticIntMethod(g_target, g_orig_add, 2, 3) == 5);
+
+        HARNESS_CHECK(harness, JNIHook_Detach(g_add) == JNIHOOK_OK);
+        HARNESS_CHECK(harness, add(harness, 2, 3) == 5);
+        HARNESS_CHECK(harness, JNIHook_Shutdown() == JNIHOOK_OK);
+
+        // Once the hooks are gone, a retransformation keeps the original method
+        HARNESS_CHECK(harness, jvmti->RetransformClasses(1, &g_target) == JVMTI_ERROR_NONE);
+        HARNESS_CHECK(harness, add(harness, 2, 3) == 5);
+        jvmti->DisposeEnvironment();
+
+        return true;
+}
+
+static void
+print_step(const char *scenario, const char *step, uint64_t elapsed_ns, void *arg)
+{
+        printf("# %s/%s: %llu ns\n", scenario, step, static_cast<unsigned long long>(elapsed_ns));
+}
+
+static bool
+setup(Harness &harness)
+{
+        auto env = harness.env;
+
+        g_target = harness.find_class("jnihook/test/HarnessTarget");
+        g_spinner = harness.find_class("jnihook/test/HarnessTarget$Spinner");
+        if (!g_target || !g_spinner)
+                return false;
+
+        g_add = env->GetStaticMethodID(g_target, "add", "(II)I");
+        g_call_add = env->GetStaticMethodID(g_target, "callAdd", "(II)I");
+        g_greet = env->GetStaticMethodID(g_target, "greet", "(Ljava/lang/String;)Ljava/lang/String;");
+        g_scale = env->GetMethodID(g_target, "scale", "(I)I");
+        g_mix = env->GetStaticMethodID(g_target, "mix", "(IJFDLjava/lang/String;IIIFDDDDDDZ)D");
+        g_constructor = env->GetMethodID(g_target, "<init>", "(I)V");
+
+        g_left = harness.find_class("jnihook/test/StressTarget$Left");
+        if (!g_left)
+                return false;
+
+        g_left_first = env->GetStaticMethodID(g_left, "first", "(I)I");
+
+        return !harness.exception() && g_add && g_call_add && g_greet && g_scale && g_mix && g_constructor && g_left_first;
+}
+
+int
+main(int argc, char **argv)
+{
+        Harness harness;
+        std::vector<std::string> jvm_options;
+        std::vector<std::string> names;
+        bool list = false;
+
+        harness.add("init_shutdown", init_shutdown);
+        harness.add("attach_static", attach_static);
+        harness.add("attach_passthrough", attach_passthrough);
+        harness.add("attach_instance", attach_instance);
+        harness.add("attach_object", attach_object);
+        harness.add("reattach", reattach);
+        harness.add("hook_lookup", hook_lookup);
+        harness.add("typed_hooks", typed_hooks);
+        harness.add("intercept", intercept);
+        harness.add("attach_batch", attach_batch);
+        harness.add("attach_batch_split", attach_batch_split);
+        harness.add("attach_async", attach_async);
+        harness.add("concurrent_caller", concurrent_caller);
+        harness.add("shutdown_restores", shutdown_restores);
+        harness.add("hook_stats", hook_stats);
+        harness.add("skip_redefinitions", skip_redefinitions);
+        harness.add("prewarm_cache", prewarm_cache);
+        harness.add("cache_budget", cache_budget);
+        harness.add("evict_unloaded", evict_unloaded);
+        harness.add("instrumented_hooks", instrumented_hooks);
+        harness.add("retransform_mode", retransform_mode);
+        harness.add("persistent_retransform", persistent_retransform);
+        harness.add("prepatched", prepatched);
+
+        for (int i = 1; i < argc; ++i) {
+                std::string arg = argv[i];
+
+                if (arg == "--list")
+                        list = true;
+                else if (arg == "--timings")
+                        harness.set_step_hook(print_step, NULL);
+                else if (arg.compare(0, 2, "-J") == 0)
+                        jvm_options.push_back(arg.substr(2));
+                else
+                        names.push_back(arg);
+        }
+
+        if (list) {
+                for (auto &name : harness.names())
+                        printf("%s\n", name.c_str());
+                return 0;
+        }
+
+        if (!harness.start(jvm_options)) {
+                fprintf(stderr, "[!] Failed to create JVM\n");
+                return 1;
+        }
+
+        if (!setup(harness)) {
+                fprintf(stderr, "[!] Failed to find the test classes\n");
+                return 1;
+        }
+
+        return harness.run(names) ? 1 : 0;
+}
@@ -0,0 +1,550 @@
+/*
+ *  -----------------------------------
+ * |         JNIHook - by rdbo         |
+ * |      Java VM Hooking Library      |
+ *  -----------------------------------
+ */
+
+/*
+ * Copyright (C) 2026    Rdbo
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License version 3
+ * as published by the Free Software Foundation.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+// Concurrent attach/detach stress test:
+//     jnihook-stress [-m <mutators>] [-k <controllers>] [-d <seconds>] [-s <seed>] [-o <file.json>] [-J<jvm option>]...
+// Mutator threads (jnihook.test.StressMutator) call hooked and unhooked methods
+// in a tight loop, while control threads attach, detach and replace hooks on
+// them. The mutators check every result and record how long each iteration
+// took; a baseline phase without control threads runs first, so that the
+// stalls caused by hooking can be told apart from the JVM's own.
+// Mismatches and failed operations make it exit with 1, a crash kills it.
+
+#include <jnihook.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <map>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+#include "harness.hpp"
+
+#define TARGET_COUNT 4
+#define HISTOGRAM_BUCKETS 65 // StressMutator.BUCKETS
+
+typedef struct config_t {
+        size_t mutators = 4;
+        size_t controllers = 2;
+        uint64_t duration_ms = 5000;
+        uint64_t seed = 1;
+        std::string output;
+} config_t;
+
+// Hooked method of StressTarget, which returns `x * mul + add`
+typedef struct target_t {
+        const char *clazz_name;
+        const char *name;
+        uint32_t mul;
+        uint32_t add;
+
+        jclass clazz;
+        jmethodID method;
+
+        // Held during every operation on the target, so that `hooked` matches the library
+        std::mutex mutex;
+        bool hooked;
+        // Bumped before and after every detach (odd while one is in progress)
+        std::atomic<uint64_t> detaches;
+} target_t;
+
+static target_t g_targets[TARGET_COUNT] = {
+        { "jnihook/test/StressTarget$Left", "first", 3, 1 },
+        { "jnihook/test/StressTarget$Left", "second", 7, 3 },
+        { "jnihook/test/StressTarget$Right", "first", 11, 5 },
+        { "jnihook/test/StressTarget$Right", "second", 13, 9 }
+};
+
+static config_t g_config;
+// Calls of the passthrough hook that could not find their original method
+static std::atomic<uint64_t> g_lookup_misses = 0;
+static jclass g_mutator;
+static jmethodID g_mutator_start;
+static jmethodID g_mutator_stop;
+static jmethodID g_mutator_histogram;
+static jmethodID g_mutator_iterations;
+static jmethodID g_mutator_mismatches;
+static jmethodID g_mutator_max;
+static jmethodID g_mutator_first_mismatch;
+
+static jint
+expected(size_t index, jint x)
+{
+        // Wraps around like the Java arithmetic
+        return static_cast<jint>(static_cast<uint32_t>(x) * g_targets[index].mul + g_targets[index].add);
+}
+
+template <size_t I>
+static jint JNICALL
+hk_replace(JNIEnv *env, jclass clazz, jint x)
+{
+        return expected(I, x) + 1;
+}
+
+template <size_t I>
+static jint JNICALL
+hk_passthrough(JNIEnv *env, jclass clazz, jint x)
+{
+        auto &target = g_targets[I];
+        uint64_t detaches = target.detaches.load();
+        jmethodID original;
+
+        // A hook is published before it can run, so the original method can
+        // only be missing if the hook was detached while this call was running
+        if (JNIHook_GetOriginal(target.method, &original) != JNIHOOK_OK) {
+                if (detaches % 2 == 1 || target.detaches.load() != detaches)
+                        return expected(I, x) + 1;
+
+                g_lookup_misses.fetch_add(1);
+                return 0;
+        }
+
+        return env->CallStaticIntMethod(clazz, original, x) + 1;
+}
+
+#define HOOKS(i) { reinterpret_cast<void *>(hk_replace<i>), reinterpret_cast<void *>(hk_passthrough<i>) }
+
+// Hooks that can be placed on each target
+static void *const g_hooks[TARGET_COUNT][2] = { HOOKS(0), HOOKS(1), HOOKS(2), HOOKS(3) };
+
+// Stall distribution of the mutators during a phase
+typedef struct phase_t {
+        uint64_t histogram[HISTOGRAM_BUCKETS] = {};
+        uint64_t iterations = 0;
+        uint64_t mismatches = 0;
+        uint64_t max_ns = 0;
+        std::string first_mismatch;
+        uint64_t elapsed_ns = 0;
+} phase_t;
+
+typedef struct op_stats_t {
+        std::vector<uint64_t> samples;
+        uint64_t failures = 0;
+        jnihook_result_t first_failure = JNIHOOK_OK;
+} op_stats_t;
+
+typedef std::map<std::string, op_stats_t> ops_t;
+
+static uint64_t
+bucket_bound(size_t bucket)
+{
+        return bucket >= 64 ? UINT64_MAX : (1ull << bucket);
+}
+
+// Upper bound of the bucket holding the `q` quantile of the iteration times
+static uint64_t
+stall_quantile(const phase_t &phase, double q)
+{
+        uint64_t rank = static_cast<uint64_t>(q * phase.iterations);
+        uint64_t seen = 0;
+
+        for (size_t i = 0; i < HISTOGRAM_BUCKETS; ++i) {
+                seen += phase.histogram[i];
+                if (seen > rank)
+                        return bucket_bound(i);
+        }
+
+        return 0;
+}
+
+// Iterations that took at least `ns` (rounded down to a bucket bound)
+static uint64_t
+stalls_over(const phase_t &phase, uint64_t ns)
+{
+        uint64_t count = 0;
+
+        for (size_t i = 1; i < HISTOGRAM_BUCKETS; ++i) {
+                if (bucket_bound(i - 1) >= ns)
+                        count += phase.histogram[i];
+        }
+
+        return count;
+}
+
+static jnihook_result_t
+timed(op_stats_t &stats, jnihook_result_t (*fn)(target_t &, size_t, size_t), target_t &target, size_t index, size_t hook)
+{
+        uint64_t start = BenchNow();
+        jnihook_result_t result = fn(target, index, hook);
+
+        stats.samples.push_back(BenchNow() - start);
+        if (result != JNIHOOK_OK && stats.failures++ == 0)
+                stats.first_failure = result;
+
+        return result;
+}
+
+static jnihook_result_t
+attach(target_t &target, size_t index, size_t hook)
+{
+        jnihook_result_t result = JNIHook_Attach(target.method, g_hooks[index][hook], NULL);
+
+        if (result == JNIHOOK_OK)
+                target.hooked = true;
+
+        return result;
+}
+
+static jnihook_result_t
+detach(target_t &target, size_t index, size_t hook)
+{
+        target.detaches.fetch_add(1);
+        jnihook_result_t result = JNIHook_Detach(target.method);
+        target.detaches.fetch_add(1);
+
+        if (result == JNIHOOK_OK)
+                target.hooked = false;
+
+        return result;
+}
+
+// Attaches, detaches and replaces hooks on random targets until `deadline`
+static void
+control(JavaVM *jvm, size_t index, uint64_t deadline, ops_t &ops)
+{
+        JNIEnv *env;
+        std::mt19937_64 rng(g_config.seed + index);
+
+        if (jvm->AttachCurrentThreadAsDaemon(reinterpret_cast<void **>(&env), NULL) != JNI_OK) {
+                ops["attach_thread"].failures++;
+                return;
+        }
+
+        while (BenchNow() < deadline) {
+                size_t i = rng() % TARGET_COUNT;
+                size_t hook = rng() % 2;
+                auto &target = g_targets[i];
+                std::lock_guard<std::mutex> lock(target.mutex);
+
+                if (!target.hooked) {
+                        timed(ops["attach"], attach, target, i, hook);
+                } else if (rng() % 2) {
+                        timed(ops["detach"], detach, target, i, hook);
+                } else {
+                        // There is no replacement in place, so it is a detach followed by an attach
+                        uint64_t start = BenchNow();
+                        auto &stats = ops["replace"];
+                        jnihook_result_t result = detach(target, i, hook);
+
+                        if (result == JNIHOOK_OK)
+                                result = attach(target, i, hook);
+
+                        stats.samples.push_back(BenchNow() - start);
+                        if (result != JNIHOOK_OK && stats.failures++ == 0)
+                                stats.first_failure = result;
+                }
+        }
+
+        jvm->DetachCurrentThread();
+}
+
+static bool
+collect(Harness &harness, jobject mutator, phase_t &phase)
+{
+        auto env = harness.env;
+        jlong histogram[HISTOGRAM_BUCKETS];
+
+        env->CallVoidMethod(mutator, g_mutator_stop);
+        auto array = reinterpret_cast<jlongArray>(env->CallObjectMethod(mutator, g_mutator_histogram));
+        if (harness.exception() || !array || env->GetArrayLength(array) != HISTOGRAM_BUCKETS)
+                return false;
+
+        env->GetLongArrayRegion(array, 0, HISTOGRAM_BUCKETS, histogram);
+        for (size_t i = 0; i < HISTOGRAM_BUCKETS; ++i)
+                phase.histogram[i] += histogram[i];
+
+        phase.iterations += env->CallLongMethod(mutator, g_mutator_iterations);
+        jlong mismatches = env->CallLongMethod(mutator, g_mutator_mismatches);
+        phase.max_ns = std::max<uint64_t>(phase.max_ns, env->CallLongMethod(mutator, g_mutator_max));
+
+        if (mismatches > 0 && phase.mismatches == 0) {
+                auto description = reinterpret_cast<jstring>(env->CallObjectMethod(mutator, g_mutator_first_mismatch));
+                if (description) {
+                        const char *chars = env->GetStringUTFChars(description, NULL);
+                        phase.first_mismatch = chars;
+                        env->ReleaseStringUTFChars(description, chars);
+                }
+        }
+        phase.mismatches += mismatches;
+
+        return !harness.exception();
+}
+
+// Runs the mutators for the configured duration, with `controllers` control threads
+static bool
+run_phase(Harness &harness, size_t controllers, phase_t &phase, ops_t &ops)
+{
+        auto env = harness.env;
+        std::vector<jobject> mutators;
+        std::vector<std::thread> threads;
+        std::vector<ops_t> thread_ops(controllers);
+        bool ok = true;
+
+        if (env->PushLocalFrame(static_cast<jint>(g_config.mutators) + 16) < 0)
+                return false;
+
+        for (size_t i = 0; i < g_config.mutators; ++i) {
+                jobject mutator = env->CallStaticObjectMethod(g_mutator, g_mutator_start, static_cast<jint>(i));
+                if (harness.exception() || !mutator) {
+                        ok = false;
+                        break;
+                }
+                mutators.push_back(mutator);
+        }
+
+        uint64_t start = BenchNow();
+        uint64_t deadline = start + g_config.duration_ms * 1000000;
+
+        if (ok) {
+                for (size_t i = 0; i < controllers; ++i)
+                        threads.emplace_back(control, harness.jvm, i, deadline, std::ref(thread_ops[i]));
+                for (auto &thread : threads)
+                        thread.join();
+
+                // Without control threads, the mutators run on their own
+                while (BenchNow() < deadline)
+                        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+
+        for (auto mutator : mutators)
+                ok = collect(harness, mutator, phase) && ok;
+        phase.elapsed_ns = BenchNow() - start;
+
+        for (auto &ops_of_thread : thread_ops) {
+                for (auto &[name, stats] : ops_of_thread) {
+                        auto &merged = ops[name];
+                        merged.samples.insert(merged.samples.end(), stats.samples.begin(), stats.samples.end());
+                        if (stats.failures > 0 && merged.failures == 0)
+                                merged.first_failure = stats.first_failure;
+                        merged.failures += stats.failures;
+                }
+        }
+
+        env->PopLocalFrame(NULL);
+
+        return ok;
+}
+
+static JsonObject
+phase_json(const char *name, const phase_t &phase)
+{
+        JsonObject object;
+        std::vector<JsonObject> histogram;
+
+        for (size_t i = 0; i < HISTOGRAM_BUCKETS; ++i) {
+                if (phase.histogram[i] == 0)
+                        continue;
+
+                JsonObject bucket;
+                bucket.set("upper_ns", bucket_bound(i));
+                bucket.set("count", phase.histogram[i]);
+                histogram.push_back(bucket);
+        }
+
+        object.set("phase", name);
+        object.set("elapsed_ns", phase.elapsed_ns);
+        object.set("iterations", phase.iterations);
+        object.set("mismatches", phase.mismatches);
+        if (!phase.first_mismatch.empty())
+                object.set("first_mismatch", phase.first_mismatch);
+        object.set("stall_p50_ns", stall_quantile(phase, 0.5));
+        object.set("stall_p99_ns", stall_quantile(phase, 0.99));
+        object.set("stall_p999_ns", stall_quantile(phase, 0.999));
+        object.set("stall_max_ns", phase.max_ns);
+        object.set("stalls_over_1ms", stalls_over(phase, 1000000));
+        object.set("stalls_over_10ms", stalls_over(phase, 10000000));
+        object.set("stalls_over_100ms", stalls_over(phase, 100000000));
+        object.set("histogram", histogram);
+
+        return object;
+}
+
+static void
+print_phase(const char *name, const phase_t &phase)
+{
+        printf("[*] %-8s iterations: %llu, mismatches: %llu, stall p99: %llu ns, max: %llu ns, over 1ms: %llu\n",
+               name,
+               static_cast<unsigned long long>(phase.iterations),
+               static_cast<unsigned long long>(phase.mismatches),
+               static_cast<unsigned long long>(stall_quantile(phase, 0.99)),
+               static_cast<unsigned long long>(phase.max_ns),
+               static_cast<unsigned long long>(stalls_over(phase, 1000000)));
+        if (!phase.first_mismatch.empty())
+                fprintf(stderr, "[!] %s: first mismatch: %s\n", name, phase.first_mismatch.c_str());
+}
+
+static bool
+stress(Harness &harness)
+{
+        auto env = harness.env;
+        phase_t baseline;
+        phase_t stressed;
+        ops_t ops;
+        bool ok = true;
+
+        HARNESS_CHECK(harness, JNIHook_Init(harness.jvm) == JNIHOOK_OK);
+
+        HARNESS_CHECK(harness, harness.step("baseline", [&]() { return run_phase(harness, 0, baseline, ops); }));
+        HARNESS_CHECK(harness, harness.step("stress", [&]() {
+                return run_phase(harness, g_config.controllers, stressed, ops);
+        }));
+
+        // Leave every method unhooked, and check that the originals are back
+        for (size_t i = 0; i < TARGET_COUNT; ++i) {
+                auto &target = g_targets[i];
+
+                if (target.hooked)
+                        ok = harness.check(detach(target, i, 0) == JNIHOOK_OK, "detach", __FILE__, __LINE__) && ok;
+                ok = harness.check(env->CallStaticIntMethod(target.clazz, target.method, 42) == expected(i, 42),
+                                   "original restored", __FILE__, __LINE__) && ok;
+        }
+        HARNESS_CHECK(harness, JNIHook_Shutdown() == JNIHOOK_OK);
+
+        print_phase("baseline", baseline);
+        print_phase("stress", stressed);
+
+        JsonObject root;
+        std::vector<JsonObject> phases = { phase_json("baseline", baseline), phase_json("stress", stressed) };
+        std::vector<JsonObject> operations;
+
+        root.set("java_version", JavaVersion(env));
+        root.set("mutators", g_config.mutators);
+        root.set("controllers", g_config.controllers);
+        root.set("duration_ms", g_config.duration_ms);
+        root.set("seed", g_config.seed);
+        root.set("phases", phases);
+        root.set("lookup_misses", g_lookup_misses.load());
+
+        for (auto &[name, stats] : ops) {
+                JsonObject op;
+
+                op.set("operation", name);
+                op.set(Summarize(stats.samples));
+                op.set("failures", stats.failures);
+                if (stats.failures > 0) {
+                        op.set("first_failure", static_cast<int>(stats.first_failure));
+                        fprintf(stderr, "[!] %s: %llu failures, first: %d\n", name.c_str(),
+                                static_cast<unsigned long long>(stats.failures), static_cast<int>(stats.first_failure));
+                }
+                operations.push_back(op);
+                ok = stats.failures == 0 && ok;
+        }
+        root.set("operations", operations);
+
+        if (!g_config.output.empty())
+                WriteJson(g_config.output, root);
+
+        HARNESS_CHECK(harness, ok);
+        HARNESS_CHECK(harness, baseline.mismatches == 0 && stressed.mismatches == 0);
+        HARNESS_CHECK(harness, g_lookup_misses.load() == 0);
+
+        return true;
+}
+
+static bool
+setup(Harness &harness)
+{
+        auto env = harness.env;
+
+        for (auto &target : g_targets) {
+                target.clazz = harness.find_class(target.clazz_name);
+                if (!target.clazz)
+                        return false;
+
+                target.method = env->GetStaticMethodID(target.clazz, target.name, "(I)I");
+                if (!target.method)
+                        return false;
+        }
+
+        g_mutator = harness.find_class("jnihook/test/StressMutator");
+        if (!g_mutator)
+                return false;
+
+        g_mutator_start = env->GetStaticMethodID(g_mutator, "start", "(I)Ljnihook/test/StressMutator;");
+        g_mutator_stop = env->GetMethodID(g_mutator, "stop", "()V");
+        g_mutator_histogram = env->GetMethodID(g_mutator, "histogram", "()[J");
+        g_mutator_iterations = env->GetMethodID(g_mutator, "iterations", "()J");
+        g_mutator_mismatches = env->GetMethodID(g_mutator, "mismatches", "()J");
+        g_mutator_max = env->GetMethodID(g_mutator, "maxNs", "()J");
+        g_mutator_first_mismatch = env->GetMethodID(g_mutator, "firstMismatch", "()Ljava/lang/String;");
+
+        return !harness.exception() && g_mutator_start && g_mutator_stop && g_mutator_histogram &&
+               g_mutator_iterations && g_mutator_mismatches && g_mutator_max && g_mutator_first_mismatch;
+}
+
+static void
+usage(const char *program)
+{
+        fprintf(stderr, "usage: %s [-m <mutators>] [-k <controllers>] [-d <seconds>] [-s <seed>] [-o <file.json>] [-J<jvm option>]...\n", program);
+}
+
+int
+main(int argc, char **argv)
+{
+        Harness harness;
+        std::vector<std::string> jvm_options;
+
+        for (int i = 1; i < argc; ++i) {
+                std::string arg = argv[i];
+                bool has_value = i + 1 < argc;
+
+                if (arg == "-m" && has_value) {
+                        g_config.mutators = strtoull(argv[++i], NULL, 10);
+                } else if (arg == "-k" && has_value) {
+                        g_config.controllers = strtoull(argv[++i], NULL, 10);
+                } else if (arg == "-d" && has_value) {
+                        g_config.duration_ms = static_cast<uint64_t>(strtod(argv[++i], NULL) * 1000);
+                } else if (arg == "-s" && has_value) {
+                        g_config.seed = strtoull(argv[++i], NULL, 10);
+                } else if (arg == "-o" && has_value) {
+                        g_config.output = argv[++i];
+                } else if (arg.compare(0, 2, "-J") == 0) {
+                        jvm_options.push_back(arg.substr(2));
+                } else {
+                        usage(argv[0]);
+                        return 1;
+                }
+        }
+
+        if (g_config.mutators == 0) {
+                usage(argv[0]);
+                return 1;
+        }
+
+        harness.add("stress", stress);
+
+        if (!harness.start(jvm_options)) {
+                fprintf(stderr, "[!] Failed to create JVM\n");
+                return 1;
+        }
+
+        if (!setup(harness)) {
+                fprintf(stderr, "[!] Failed to find the test classes\n");
+                return 1;
+        }
+
+        return harness.run({}) ? 1 : 0;
+}
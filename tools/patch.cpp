@@ -0,0 +1,546 @@
+/*
+ *  -----------------------------------
+ * |         JNIHook - by rdbo         |
+ * |      Java VM Hooking Library      |
+ *  -----------------------------------
+ */
+
+/*
+ * Copyright (C) 2026    Rdbo
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License version 3
+ * as published by the Free Software Foundation.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+// jnihook-patch: patches the hooked methods of the classes inside jars and
+// class directories ahead of time, so that the JVM loads them already patched.
+// A hook on a prepatched method only has to register the native hook, which
+// needs neither a class redefinition nor suspending threads (see JNIHook_LoadManifest).
+//
+// Every method is patched the same way as at runtime (see `PatchClassFile`).
+// The jars are processed in chunks of entries: a chunk is read, its matching
+// classes are patched in parallel and then the chunk is written in order, so
+// that memory use does not depend on the size of the jars. Only the classes
+// with hooked methods are parsed, the other entries are copied as they are.
+
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <set>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include "manifest.hpp"
+#include "patcher.hpp"
+#include "threadpool.hpp"
+#include "zip.hpp"
+
+#define DEFAULT_COPY_SUFFIX "_____jnihook_static"
+#define DEFAULT_OUTPUT "jnihook-patched"
+#define MANIFEST_NAME "jnihook.manifest"
+#define CHUNK_ENTRIES 256
+
+namespace fs = std::filesystem;
+using namespace jnif;
+
+typedef struct patch_item_t {
+        std::string class_name;
+        std::vector<u1> data; // Class file bytes, replaced by the patched bytes
+        bool patched = false;
+        std::vector<method_info_t> methods; // Hooked methods found in the class
+        std::string error;
+} patch_item_t;
+
+// Hooked methods by internal class name
+static std::unordered_map<std::string, std::vector<method_info_t>> g_targets;
+static std::string g_copy_suffix = DEFAULT_COPY_SUFFIX;
+static std::unique_ptr<ThreadPool> g_thread_pool;
+// Methods patched so far, by "<class name>.<method name><signature>"
+static std::map<std::string, manifest_method_t> g_patched_methods;
+static size_t g_patched_classes = 0;
+static size_t g_errors = 0;
+
+static void
+usage(const char *program)
+{
+        fprintf(stderr,
+                "usage: %s [options] <jar or class directory>...\n"
+                "  -m <class>.<method><signature>  Method to patch, e.g. com/acme/Foo.bar(I)V\n"
+                "  -f <file>                        File with one method to patch per line\n"
+                "  -o <directory>                   Output directory (default: " DEFAULT_OUTPUT ")\n"
+                "  -s <suffix>                      Suffix of the copies of the original methods\n"
+                "                                   (default: " DEFAULT_COPY_SUFFIX ")\n"
+                "  -j <threads>                     Amount of threads (default: all hardware threads)\n"
+                "The output directory receives the patched jars and directories, and the\n"
+                "manifest to pass to JNIHook_LoadManifest (" MANIFEST_NAME ").\n",
+                program);
+}
+
+// Parses "<class>.<method><signature>", where the class name may use dots or slashes
+static bool
+add_target(const std::string &spec)
+{
+        auto paren = spec.find('(');
+        if (paren == std::string::npos || paren == 0)
+                return false;
+
+        auto dot = spec.rfind('.', paren);
+        if (dot == std::string::npos || dot == 0 || dot + 1 == paren)
+                return false;
+
+        std::string class_name = spec.substr(0, dot);
+        method_info_t method;
+        method.name = spec.substr(dot + 1, paren - dot - 1);
+        method.signature = spec.substr(paren);
+        method.access_flags = 0;
+
+        // Constructors cannot be hooked
+        if (method.name[0] == '<')
+                return false;
+
+        for (auto &c : class_name) {
+                if (c == '.')
+                        c = '/';
+        }
+
+        g_targets[class_name].push_back(std::move(method));
+
+        return true;
+}
+
+static bool
+add_targets_file(const std::string &path)
+{
+        std::ifstream file(path);
+        std::string line;
+
+        if (!file)
+                return false;
+
+        while (std::getline(file, line)) {
+                line.erase(0, line.find_first_not_of(" \t"));
+                line.erase(line.find_last_not_of(" \t\r") + 1);
+                if (line.empty() || line[0] == '#')
+                        continue;
+
+                if (!add_target(line)) {
+                        fprintf(stderr, "ERR: Invalid method '%s' in %s\n", line.c_str(), path.c_str());
+                        return false;
+                }
+        }
+
+        return true;
+}
+
+// Returns the internal name of the class stored in an entry ("" if it is not a class),
+// without the versioned directory of multi-release jars ("META-INF/versions/<N>/")
+static std::string
+entry_class_name(const std::string &entry_name)
+{
+        static const std::string class_ext = ".class";
+        static const std::string versions = "META-INF/versions/";
+
+        if (entry_name.size() <= class_ext.size() ||
+            entry_name.compare(entry_name.size() - class_ext.size(), class_ext.size(), class_ext) != 0)
+                return "";
+
+        std::string name = entry_name.substr(0, entry_name.size() - class_ext.size());
+        if (name.compare(0, versions.size(), versions) == 0) {
+                auto slash = name.find('/', versions.size());
+                if (slash == std::string::npos)
+                        return "";
+                name = name.substr(slash + 1);
+        }
+
+        return name;
+}
+
+static bool
+is_target(const std::string &class_name)
+{
+        return !class_name.empty() && g_targets.find(class_name) != g_targets.end();
+}
+
+// Runs on the pool threads
+static void
+PatchItem(patch_item_t &item)
+{
+        auto &hooked_methods = g_targets.at(item.class_name);
+
+        try {
+                auto cf = ClassFile::parse(item.data.data(), static_cast<int>(item.data.size()));
+
+                // The entry name only hints the class name
+                if (item.class_name != cf->getThisClassName())
+                        return;
+
+                for (auto &method : cf->methods) {
+                        for (auto &minfo : hooked_methods) {
+                                if (minfo.name == method.getName() && minfo.signature == method.getDesc())
+                                        item.methods.push_back(minfo);
+                        }
+                }
+
+                // Classes that were already patched with the same suffix are kept as they are
+                if (PatchClassFile(cf.get(), hooked_methods, g_copy_suffix) > 0) {
+                        item.data = cf->toBytes();
+                        item.patched = true;
+                }
+        } catch (const Exception &ex) {
+                item.error = ex.message;
+        } catch (...) {
+                item.error = "unknown error";
+        }
+}
+
+static void
+PatchItems(std::vector<patch_item_t *> &items)
+{
+        if (g_thread_pool) {
+                g_thread_pool->parallel_for(items.size(), [&](size_t i) {
+                        PatchItem(*items[i]);
+                });
+        } else {
+                for (auto item : items)
+                        PatchItem(*item);
+        }
+}
+
+// Records the result of a patched item, returns false on errors
+static bool
+FinishItem(const std::string &source, const patch_item_t &item)
+{
+        if (!item.error.empty()) {
+                fprintf(stderr, "ERR: Failed to patch %s in %s: %s\n", item.class_name.c_str(), source.c_str(), item.error.c_str());
+                ++g_errors;
+                return false;
+        }
+
+        for (auto &method : item.methods) {
+                g_patched_methods[item.class_name + "." + method.name + method.signature] =
+                        { item.class_name, method.name, method.signature };
+        }
+
+        if (item.patched)
+                ++g_patched_classes;
+
+        return true;
+}
+
+#ifdef JNIHOOK_PATCH_ZIP
+// Signature files of signed jars, which do not match the patched classes anymore
+static bool
+is_signature_file(const std::string &entry_name)
+{
+        static const char *extensions[] = { ".SF", ".RSA", ".DSA", ".EC" };
+
+        if (entry_name.compare(0, 9, "META-INF/") != 0 || entry_name.find('/', 9) != std::string::npos)
+                return false;
+
+        for (auto ext : extensions) {
+                size_t size = strlen(ext);
+                if (entry_name.size() > size && entry_name.compare(entry_name.size() - size, size, ext) == 0)
+                        return true;
+        }
+
+        return false;
+}
+
+static bool
+PatchJar(const fs::path &input, const fs::path &output)
+{
+        ZipReader reader;
+        ZipWriter writer;
+
+        if (!reader.open(input.string())) {
+                fprintf(stderr, "ERR: Failed to read jar (zip64 is not supported): %s\n", input.string().c_str());
+                return false;
+        }
+
+        auto &entries = reader.list();
+        bool has_targets = false;
+        for (auto &entry : entries)
+                has_targets = has_targets || is_target(entry_class_name(entry.name));
+
+        if (!writer.open(output.string())) {
+                fprintf(stderr, "ERR: Failed to create jar: %s\n", output.string().c_str());
+                return false;
+        }
+
+        for (size_t begin = 0; begin < entries.size(); begin += CHUNK_ENTRIES) {
+                size_t end = std::min(entries.size(), begin + CHUNK_ENTRIES);
+                std::vector<std::vector<u1>> raws(end - begin);
+                std::vector<patch_item_t> items(end - begin);
+                std::vector<patch_item_t *> targets;
+
+                // Read the chunk sequentially, the patching is done in parallel
+                for (size_t i = begin; i < end; ++i) {
+                        auto &entry = entries[i];
+                        auto &raw = raws[i - begin];
+
+                        if (!reader.read_raw(entry, raw)) {
+                                fprintf(stderr, "ERR: Failed to read entry %s of %s\n", entry.name.c_str(), input.string().c_str());
+                                return false;
+                        }
+
+                        auto class_name = entry_class_name(entry.name);
+                        if (!is_target(class_name))
+                                continue;
+
+                        auto &item = items[i - begin];
+                        item.class_name = class_name;
+                        if (!ZipReader::inflate(entry, raw, item.data)) {
+                                item.error = "failed to decompress entry";
+                                continue;
+                        }
+                        targets.push_back(&item);
+                }
+
+                PatchItems(targets);
+
+                for (size_t i = begin; i < end; ++i) {
+                        auto &entry = entries[i];
+                        auto &item = items[i - begin];
+                        bool written;
+
+                        if (has_targets && is_signature_file(entry.name))
+                                continue;
+
+                        if (!item.class_name.empty() && FinishItem(input.string(), item) && item.patched)
+                                written = writer.add(entry, item.data);
+                        else
+                                written = writer.add_raw(entry, raws[i - begin]);
+
+                        if (!written) {
+                                fprintf(stderr, "ERR: Failed to write entry %s of %s\n", entry.name.c_str(), output.string().c_str());
+                                return false;
+                        }
+                }
+        }
+
+        if (!writer.finish()) {
+                fprintf(stderr, "ERR: Failed to write jar (zip64 is not supported): %s\n", output.string().c_str());
+                return false;
+        }
+
+        if (has_targets)
+                fprintf(stderr, "NOTE: Signatures removed from %s, since its classes were modified\n", output.string().c_str());
+
+        return true;
+}
+#endif
+
+static bool
+read_file(const fs::path &path, std::vector<u1> &data)
+{
+        std::ifstream file(path, std::ios::binary);
+
+        if (!file)
+                return false;
+
+        data.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+
+        return !file.bad();
+}
+
+static bool
+write_file(const fs::path &path, const std::vector<u1> &data)
+{
+        std::ofstream file(path, std::ios::binary | std::ios::trunc);
+
+        if (!file)
+                return false;
+
+        file.write(reinterpret_cast<const char *>(data.data()), data.size());
+        file.flush();
+
+        return static_cast<bool>(file);
+}
+
+static bool
+PatchDirectory(const fs::path &input, const fs::path &output)
+{
+        std::vector<fs::path> files;
+        std::error_code ec;
+
+        for (auto it = fs::recursive_directory_iterator(input, ec); !ec && it != fs::recursive_directory_iterator(); it.increment(ec)) {
+                if (it->is_regular_file(ec))
+                        files.push_back(it->path());
+        }
+        if (ec) {
+                fprintf(stderr, "ERR: Failed to list directory %s: %s\n", input.string().c_str(), ec.message().c_str());
+                return false;
+        }
+
+        for (size_t begin = 0; begin < files.size(); begin += CHUNK_ENTRIES) {
+                size_t end = std::min(files.size(), begin + CHUNK_ENTRIES);
+                std::vector<patch_item_t> items(end - begin);
+                std::vector<patch_item_t *> targets;
+
+                for (size_t i = begin; i < end; ++i) {
+                        auto relative = fs::relative(files[i], input).generic_string();
+                        auto class_name = entry_class_name(relative);
+                        if (!is_target(class_name))
+                                continue;
+
+                        auto &item = items[i - begin];
+                        item.class_name = class_name;
+                        if (!read_file(files[i], item.data)) {
+                                item.error = "failed to read file";
+                                continue;
+                        }
+                        targets.push_back(&item);
+                }
+
+                PatchItems(targets);
+
+                for (size_t i = begin; i < end; ++i) {
+                        auto target = output / fs::relative(files[i], input);
+                        auto &item = items[i - begin];
+                        bool written;
+
+                        fs::create_directories(target.parent_path(), ec);
+                        if (!item.class_name.empty() && FinishItem(input.string(), item) && item.patched)
+                                written = write_file(target, item.data);
+                        else
+                                written = fs::copy_file(files[i], target, fs::copy_options::overwrite_existing, ec);
+
+                        if (!written) {
+                                fprintf(stderr, "ERR: Failed to write %s\n", target.string().c_str());
+                                return false;
+                        }
+                }
+        }
+
+        return true;
+}
+
+int
+main(int argc, char **argv)
+{
+        fs::path output = DEFAULT_OUTPUT;
+        std::vector<fs::path> inputs;
+        size_t threads = std::thread::hardware_concurrency();
+
+        for (int i = 1; i < argc; ++i) {
+                std::string arg = argv[i];
+
+                if (arg == "-h" || arg == "--help") {
+                        usage(argv[0]);
+                        return 0;
+                }
+
+                if (arg.size() == 2 && arg[0] == '-') {
+                        if (i + 1 >= argc) {
+                                usage(argv[0]);
+                                return 1;
+                        }
+
+                        std::string value = argv[++i];
+                        bool ok = true;
+                        switch (arg[1]) {
+                        case 'm':
+                                ok = add_target(value);
+                                break;
+                        case 'f':
+                                ok = add_targets_file(value);
+                                break;
+                        case 'o':
+                                output = value;
+                                break;
+                        case 's':
+                                g_copy_suffix = value;
+                                ok = !value.empty() && value.find_first_of(" \t\r\n") == std::string::npos;
+                                break;
+                        case 'j':
+                                threads = strtoul(value.c_str(), NULL, 10);
+                                break;
+                        default:
+                                ok = false;
+                        }
+
+                        if (!ok) {
+                                fprintf(stderr, "ERR: Invalid argument: %s %s\n", arg.c_str(), value.c_str());
+                                return 1;
+                        }
+                        continue;
+                }
+
+                inputs.push_back(arg);
+        }
+
+        if (inputs.empty() || g_targets.empty()) {
+                usage(argv[0]);
+                return 1;
+        }
+
+        // The main thread works on the patches too
+        if (threads > 1)
+                g_thread_pool = std::make_unique<ThreadPool>(threads - 1);
+
+        std::error_code ec;
+        fs::create_directories(output, ec);
+        if (ec) {
+                fprintf(stderr, "ERR: Failed to create output directory %s: %s\n", output.string().c_str(), ec.message().c_str());
+                return 1;
+        }
+
+        for (auto &input : inputs) {
+                auto target = output / input.filename();
+                bool ok;
+
+                if (fs::equivalent(input, output, ec) || fs::equivalent(input.parent_path(), output, ec)) {
+                        fprintf(stderr, "ERR: The output directory would overwrite the input: %s\n", input.string().c_str());
+                        return 1;
+                }
+
+                if (fs::is_directory(input)) {
+                        ok = PatchDirectory(input, target);
+                } else {
+#ifdef JNIHOOK_PATCH_ZIP
+                        ok = PatchJar(input, target);
+#else
+                        fprintf(stderr, "ERR: Built without zlib, only class directories are supported: %s\n", input.string().c_str());
+                        ok = false;
+#endif
+                }
+
+                if (!ok)
+                        return 1;
+        }
+
+        manifest_t manifest;
+        manifest.copy_suffix = g_copy_suffix;
+        for (auto &[key, method] : g_patched_methods)
+                manifest.methods.push_back(method);
+
+        for (auto &[class_name, methods] : g_targets) {
+                for (auto &method : methods) {
+                        if (g_patched_methods.find(class_name + "." + method.name + method.signature) == g_patched_methods.end())
+                                fprintf(stderr, "WARN: Method not found: %s.%s%s\n", class_name.c_str(), method.name.c_str(), method.signature.c_str());
+                }
+        }
+
+        auto manifest_path = output / MANIFEST_NAME;
+        if (!WriteManifest(manifest_path.string(), manifest)) {
+                fprintf(stderr, "ERR: Failed to write manifest: %s\n", manifest_path.string().c_str());
+                return 1;
+        }
+
+        printf("Patched %zu methods in %zu classes, manifest: %s\n",
+               manifest.methods.size(), g_patched_classes, manifest_path.string().c_str());
+
+        return g_errors ? 1 : 0;
+}
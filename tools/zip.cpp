@@ -0,0 +1,363 @@
+/*
+ *  -----------------------------------
+ * |         JNIHook - by rdbo         |
+ * |      Java VM Hooking Library      |
+ *  -----------------------------------
+ */
+
+/*
+ * Copyright (C) 2026    Rdbo
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License version 3
+ * as published by the Free Software Foundation.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "zip.hpp"
+
+#ifdef JNIHOOK_PATCH_ZIP
+#include <algorithm>
+#include <zlib.h>
+
+#ifdef _WIN32
+#define fseeko _fseeki64
+#define ftello _ftelli64
+typedef long long zip_off_t;
+#else
+typedef off_t zip_off_t;
+#endif
+
+#define ZIP_LOCAL_SIGNATURE 0x04034b50
+#define ZIP_CENTRAL_SIGNATURE 0x02014b50
+#define ZIP_END_SIGNATURE 0x06054b50
+#define ZIP_LOCAL_SIZE 30
+#define ZIP_CENTRAL_SIZE 46
+#define ZIP_END_SIZE 22
+#define ZIP_FLAG_DESCRIPTOR (1 << 3) // Sizes and CRC follow the data instead of the local header
+#define ZIP_FLAG_ENCRYPTED (1 << 0)
+
+static uint16_t
+get16(const uint8_t *p)
+{
+        return static_cast<uint16_t>(p[0] | (p[1] << 8));
+}
+
+static uint32_t
+get32(const uint8_t *p)
+{
+        return static_cast<uint32_t>(p[0]) | (static_cast<uint32_t>(p[1]) << 8) |
+               (static_cast<uint32_t>(p[2]) << 16) | (static_cast<uint32_t>(p[3]) << 24);
+}
+
+static void
+put16(std::vector<uint8_t> &out, uint16_t value)
+{
+        out.push_back(value & 0xff);
+        out.push_back(value >> 8);
+}
+
+static void
+put32(std::vector<uint8_t> &out, uint32_t value)
+{
+        put16(out, value & 0xffff);
+        put16(out, value >> 16);
+}
+
+static bool
+read_at(FILE *file, uint64_t offset, void *data, size_t size)
+{
+        if (fseeko(file, static_cast<zip_off_t>(offset), SEEK_SET) != 0)
+                return false;
+
+        return fread(data, 1, size, file) == size;
+}
+
+ZipReader::~ZipReader()
+{
+        if (this->file)
+                fclose(this->file);
+}
+
+bool
+ZipReader::open(const std::string &path)
+{
+        std::vector<uint8_t> tail;
+        std::vector<uint8_t> directory;
+        uint64_t file_size;
+
+        this->file = fopen(path.c_str(), "rb");
+        if (!this->file)
+                return false;
+
+        if (fseeko(this->file, 0, SEEK_END) != 0)
+                return false;
+        file_size = static_cast<uint64_t>(ftello(this->file));
+        if (file_size < ZIP_END_SIZE)
+                return false;
+
+        // The end record is followed by a comment of up to 64 KiB
+        tail.resize(std::min<uint64_t>(file_size, ZIP_END_SIZE + 0xffff));
+        if (!read_at(this->file, file_size - tail.size(), tail.data(), tail.size()))
+                return false;
+
+        const uint8_t *end = nullptr;
+        for (size_t i = tail.size() - ZIP_END_SIZE + 1; i-- > 0;) {
+                if (get32(&tail[i]) == ZIP_END_SIGNATURE) {
+                        end = &tail[i];
+                        break;
+                }
+        }
+        if (!end)
+                return false;
+
+        uint16_t count = get16(&end[10]);
+        uint32_t directory_size = get32(&end[12]);
+        uint32_t directory_offset = get32(&end[16]);
+        if (count == 0xffff || directory_size == 0xffffffff || directory_offset == 0xffffffff)
+                return false; // Zip64
+
+        // The offsets are relative to the start of the archive, which may be preceded
+        // by other data (e.g. the header of jmod files, or a self-extracting stub)
+        uint64_t end_offset = file_size - tail.size() + (end - tail.data());
+        if (static_cast<uint64_t>(directory_offset) + directory_size > end_offset)
+                return false;
+        uint64_t base = end_offset - directory_size - directory_offset;
+
+        directory.resize(directory_size);
+        if (!read_at(this->file, base + directory_offset, directory.data(), directory.size()))
+                return false;
+
+        size_t pos = 0;
+        this->entries.clear();
+        this->entries.reserve(count);
+        for (uint16_t i = 0; i < count; ++i) {
+                if (pos + ZIP_CENTRAL_SIZE > directory.size() || get32(&directory[pos]) != ZIP_CENTRAL_SIGNATURE)
+                        return false;
+
+                const uint8_t *p = &directory[pos];
+                zip_entry_t entry;
+                uint16_t name_size = get16(&p[28]);
+                uint16_t extra_size = get16(&p[30]);
+                uint16_t comment_size = get16(&p[32]);
+
+                if (pos + ZIP_CENTRAL_SIZE + name_size + extra_size + comment_size > directory.size())
+                        return false;
+
+                entry.version_needed = get16(&p[6]);
+                entry.flags = get16(&p[8]);
+                entry.method = get16(&p[10]);
+                entry.mod_time = get16(&p[12]);
+                entry.mod_date = get16(&p[14]);
+                entry.crc = get32(&p[16]);
+                entry.compressed_size = get32(&p[20]);
+                entry.size = get32(&p[24]);
+                entry.external_attrs = get32(&p[38]);
+                entry.offset = get32(&p[42]);
+                entry.name.assign(reinterpret_cast<const char *>(&p[ZIP_CENTRAL_SIZE]), name_size);
+                entry.extra.assign(&p[ZIP_CENTRAL_SIZE + name_size], &p[ZIP_CENTRAL_SIZE + name_size + extra_size]);
+
+                if (entry.compressed_size == 0xffffffff || entry.size == 0xffffffff || entry.offset == 0xffffffff)
+                        return false; // Zip64
+                entry.offset += base;
+
+                this->entries.push_back(std::move(entry));
+                pos += ZIP_CENTRAL_SIZE + name_size + extra_size + comment_size;
+        }
+
+        return true;
+}
+
+const std::vector<zip_entry_t> &
+ZipReader::list() const
+{
+        return this->entries;
+}
+
+bool
+ZipReader::read_raw(const zip_entry_t &entry, std::vector<uint8_t> &data)
+{
+        uint8_t header[ZIP_LOCAL_SIZE];
+
+        if (!read_at(this->file, entry.offset, header, sizeof(header)) || get32(header) != ZIP_LOCAL_SIGNATURE)
+                return false;
+
+        // The local extra field may differ from the one in the central directory
+        uint64_t data_offset = static_cast<uint64_t>(entry.offset) + ZIP_LOCAL_SIZE + get16(&header[26]) + get16(&header[28]);
+
+        data.resize(entry.compressed_size);
+        return read_at(this->file, data_offset, data.data(), data.size());
+}
+
+bool
+ZipReader::inflate(const zip_entry_t &entry, const std::vector<uint8_t> &raw, std::vector<uint8_t> &data)
+{
+        if (entry.flags & ZIP_FLAG_ENCRYPTED)
+                return false;
+
+        if (entry.method == ZIP_STORED) {
+                data = raw;
+        } else if (entry.method == ZIP_DEFLATED) {
+                z_stream stream = {};
+
+                if (inflateInit2(&stream, -MAX_WBITS) != Z_OK)
+                        return false;
+
+                data.resize(entry.size);
+                stream.next_in = const_cast<Bytef *>(raw.data());
+                stream.avail_in = static_cast<uInt>(raw.size());
+                stream.next_out = data.data();
+                stream.avail_out = static_cast<uInt>(data.size());
+
+                int ret = ::inflate(&stream, Z_FINISH);
+                inflateEnd(&stream);
+                if (ret != Z_STREAM_END || stream.total_out != entry.size)
+                        return false;
+        } else {
+                return false;
+        }
+
+        return crc32(0, data.data(), static_cast<uInt>(data.size())) == entry.crc;
+}
+
+ZipWriter::~ZipWriter()
+{
+        if (this->file)
+                fclose(this->file);
+}
+
+bool
+ZipWriter::open(const std::string &path)
+{
+        this->file = fopen(path.c_str(), "wb");
+        this->entries.clear();
+        this->offset = 0;
+
+        return this->file != nullptr;
+}
+
+bool
+ZipWriter::write_entry(zip_entry_t entry, const std::vector<uint8_t> &raw)
+{
+        std::vector<uint8_t> header;
+
+        // The sizes are known, so they are always written in the local header
+        entry.flags &= ~ZIP_FLAG_DESCRIPTOR;
+        entry.compressed_size = static_cast<uint32_t>(raw.size());
+        entry.offset = this->offset;
+
+        put32(header, ZIP_LOCAL_SIGNATURE);
+        put16(header, entry.version_needed);
+        put16(header, entry.flags);
+        put16(header, entry.method);
+        put16(header, entry.mod_time);
+        put16(header, entry.mod_date);
+        put32(header, entry.crc);
+        put32(header, entry.compressed_size);
+        put32(header, entry.size);
+        put16(header, static_cast<uint16_t>(entry.name.size()));
+        put16(header, static_cast<uint16_t>(entry.extra.size()));
+        header.insert(header.end(), entry.name.begin(), entry.name.end());
+        header.insert(header.end(), entry.extra.begin(), entry.extra.end());
+
+        if (fwrite(header.data(), 1, header.size(), this->file) != header.size() ||
+            fwrite(raw.data(), 1, raw.size(), this->file) != raw.size())
+                return false;
+
+        this->offset += header.size() + raw.size();
+        if (this->offset > 0xffffffff)
+                return false; // Zip64
+
+        this->entries.push_back(std::move(entry));
+
+        return true;
+}
+
+bool
+ZipWriter::add_raw(const zip_entry_t &entry, const std::vector<uint8_t> &raw)
+{
+        return write_entry(entry, raw);
+}
+
+bool
+ZipWriter::add(const zip_entry_t &entry, const std::vector<uint8_t> &data)
+{
+        zip_entry_t new_entry = entry;
+        std::vector<uint8_t> raw(compressBound(static_cast<uLong>(data.size())) + 16);
+        z_stream stream = {};
+
+        if (deflateInit2(&stream, Z_DEFAULT_COMPRESSION, Z_DEFLATED, -MAX_WBITS, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+                return false;
+
+        stream.next_in = const_cast<Bytef *>(data.data());
+        stream.avail_in = static_cast<uInt>(data.size());
+        stream.next_out = raw.data();
+        stream.avail_out = static_cast<uInt>(raw.size());
+
+        int ret = deflate(&stream, Z_FINISH);
+        raw.resize(stream.total_out);
+        deflateEnd(&stream);
+        if (ret != Z_STREAM_END)
+                return false;
+
+        new_entry.method = ZIP_DEFLATED;
+        new_entry.version_needed = std::max<uint16_t>(new_entry.version_needed, 20);
+        new_entry.crc = crc32(0, data.data(), static_cast<uInt>(data.size()));
+        new_entry.size = static_cast<uint32_t>(data.size());
+
+        return write_entry(std::move(new_entry), raw);
+}
+
+bool
+ZipWriter::finish()
+{
+        std::vector<uint8_t> directory;
+
+        for (auto &entry : this->entries) {
+                put32(directory, ZIP_CENTRAL_SIGNATURE);
+                put16(directory, 20); // Version made by
+                put16(directory, entry.version_needed);
+                put16(directory, entry.flags);
+                put16(directory, entry.method);
+                put16(directory, entry.mod_time);
+                put16(directory, entry.mod_date);
+                put32(directory, entry.crc);
+                put32(directory, entry.compressed_size);
+                put32(directory, entry.size);
+                put16(directory, static_cast<uint16_t>(entry.name.size()));
+                put16(directory, static_cast<uint16_t>(entry.extra.size()));
+                put16(directory, 0); // Comment
+                put16(directory, 0); // Disk
+                put16(directory, 0); // Internal attributes
+                put32(directory, entry.external_attrs);
+                put32(directory, static_cast<uint32_t>(entry.offset));
+                directory.insert(directory.end(), entry.name.begin(), entry.name.end());
+                directory.insert(directory.end(), entry.extra.begin(), entry.extra.end());
+        }
+
+        if (this->entries.size() >= 0xffff || this->offset + directory.size() > 0xffffffff)
+                return false; // Zip64
+
+        uint32_t directory_size = static_cast<uint32_t>(directory.size());
+        put32(directory, ZIP_END_SIGNATURE);
+        put16(directory, 0);
+        put16(directory, 0);
+        put16(directory, static_cast<uint16_t>(this->entries.size()));
+        put16(directory, static_cast<uint16_t>(this->entries.size()));
+        put32(directory, directory_size);
+        put32(directory, static_cast<uint32_t>(this->offset));
+        put16(directory, 0);
+
+        bool ok = fwrite(directory.data(), 1, directory.size(), this->file) == directory.size();
+        ok = fclose(this->file) == 0 && ok;
+        this->file = nullptr;
+
+        return ok;
+}
+#endif
@@ -0,0 +1,104 @@
+/*
+ *  -----------------------------------
+ * |         JNIHook - by rdbo         |
+ * |      Java VM Hooking Library      |
+ *  -----------------------------------
+ */
+
+/*
+ * Copyright (C) 2026    Rdbo
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License version 3
+ * as published by the Free Software Foundation.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef _ZIP_HPP_
+#define _ZIP_HPP_
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+// Minimal zip (jar) reader and writer for jnihook-patch.
+// Entries are read and written one at a time, so that a jar is never fully
+// loaded in memory. Unchanged entries are copied without being recompressed.
+// NOTE: Zip64 archives and encrypted entries are not supported.
+
+#define ZIP_STORED 0
+#define ZIP_DEFLATED 8
+
+typedef struct zip_entry_t {
+        std::string name;
+        uint16_t version_needed;
+        uint16_t flags;
+        uint16_t method;
+        uint16_t mod_time;
+        uint16_t mod_date;
+        uint32_t crc;
+        uint32_t compressed_size;
+        uint32_t size;
+        uint32_t external_attrs;
+        uint64_t offset; // Offset of the local header in the file
+        std::vector<uint8_t> extra;
+} zip_entry_t;
+
+class ZipReader {
+private:
+        FILE *file = nullptr;
+        std::vector<zip_entry_t> entries;
+public:
+        ~ZipReader();
+
+        // Reads the central directory
+        bool
+        open(const std::string &path);
+
+        const std::vector<zip_entry_t> &
+        list() const;
+
+        // Reads the data of an entry as it is stored (possibly compressed)
+        bool
+        read_raw(const zip_entry_t &entry, std::vector<uint8_t> &data);
+
+        // Decompresses the data returned by `read_raw`
+        static bool
+        inflate(const zip_entry_t &entry, const std::vector<uint8_t> &raw, std::vector<uint8_t> &data);
+};
+
+class ZipWriter {
+private:
+        FILE *file = nullptr;
+        std::vector<zip_entry_t> entries;
+        uint64_t offset = 0;
+
+        bool
+        write_entry(zip_entry_t entry, const std::vector<uint8_t> &raw);
+public:
+        ~ZipWriter();
+
+        bool
+        open(const std::string &path);
+
+        // Copies an entry returned by `ZipReader::read_raw` as is
+        bool
+        add_raw(const zip_entry_t &entry, const std::vector<uint8_t> &raw);
+
+        // Replaces the data of an entry, compressing it
+        bool
+        add(const zip_entry_t &entry, const std::vector<uint8_t> &data);
+
+        // Writes the central directory and closes the file
+        bool
+        finish();
+};
+
+#endif